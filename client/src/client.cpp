@@ -6,6 +6,7 @@
 #include "common/common.hpp"
 #include "common/logger.hpp"
 #include "common/time.hpp"
+#include "common/wire.hpp"
 #include "proto/pref.pb.h"
 
 #include <docopt.h>
@@ -34,11 +35,13 @@
 #include <cmath>
 #include <concepts>
 #include <cstring>
+#include <fstream>
 #include <functional>
 #include <gsl/gsl>
 #include <list>
 #include <mdspan>
 #include <numbers>
+#include <type_traits>
 #include <vector>
 
 namespace pref {
@@ -129,20 +132,38 @@ template<typename... Args>
     return resources("fonts", name);
 }
 
+// A face in the card atlas, packed at build time by client/tools/pack-cards.py with a row per suit and a column per
+// rank. Every face is drawn from the one texture, so nothing is decoded or resized in the browser
 struct Card {
-    Card(CardNameView n)
+    static_assert(PREF_CARD_WIDTH == static_cast<int>(CardWidth) and PREF_CARD_HEIGHT == static_cast<int>(CardHeight));
+    static constexpr auto Width = static_cast<float>(PREF_CARD_WIDTH);
+    static constexpr auto Height = static_cast<float>(PREF_CARD_HEIGHT);
+    static constexpr auto Gutter = static_cast<float>(PREF_CARD_ATLAS_GUTTER);
+    static constexpr auto Scale = static_cast<float>(PREF_CARD_ATLAS_SCALE); // of the atlas over the drawn size
+
+    Card(const CardNameView n)
         : name{n}
-        , image{r::Image{resources("cards", fmt::format("{}.png", name))}}
     {
-        image.Resize(static_cast<int>(CardWidth), static_cast<int>(CardHeight));
-        texture = image.LoadTexture();
+        const auto card = toCardId(name);
+        assert(card and "a card of the deck");
+        const auto column = static_cast<float>(std::to_underlying(rankOf(*card)));
+        const auto row = static_cast<float>(std::to_underlying(suitOf(*card)));
+        source = r::Rectangle{
+            (column * (Width + 2.f * Gutter) + Gutter) * Scale,
+            (row * (Height + 2.f * Gutter) + Gutter) * Scale,
+            Width * Scale,
+            Height * Scale};
     }
 
     CardNameView name;
-    r::Image image;
-    r::Texture texture{};
+    r::Rectangle source; // in the atlas
 };
 
+[[nodiscard]] auto cardRect(const r::Vector2 pos) -> r::Rectangle
+{
+    return r::Rectangle{pos.x, pos.y, Card::Width, Card::Height};
+}
+
 [[nodiscard]] auto suitValue(const std::string_view suit) -> int
 {
     static const auto map
@@ -244,10 +265,8 @@ struct HowToPlayMenu {
 
 [[nodiscard]] constexpr auto bidRank(const std::string_view bid) noexcept -> std::size_t
 {
-    for (auto i = 0uz; i < std::size(BidsRank); ++i) {
-        if (BidsRank[i] == bid) { return i; }
-    }
-    return AllRanks;
+    static_assert(Bid{}.rank() == AllRanks);
+    return Bid::parse(bid).rank();
 }
 
 [[nodiscard]] constexpr auto isRedSuit(const std::string_view suit) noexcept -> bool
@@ -422,7 +441,8 @@ struct OverallScoreboard {
     r::Vector2 grabOffset{};
     bool moving{};
     r::Vector2 windowBoxPos{};
-    UserGames userGames;
+    UserGames userGames; // the pages loaded so far, the newest ones
+    bool isLoading{}; // a page is asked for
     Table table;
 };
 
@@ -472,9 +492,22 @@ struct Ping {
     return allCards.at(name);
 }
 
-auto loadCards() -> void
+[[nodiscard]] auto getCard(const CardId card) -> const Card&
 {
-    auto&& _ = getCard(PREF_SEVEN_OF_SPADES);
+    return getCard(toCardName(card));
+}
+
+// the server fills either the names or the compact ids, depending on the negotiated WireFormat
+[[nodiscard]] auto getCardsNames(const auto& names, const auto& ids) -> std::vector<CardNameView>
+{
+    if (std::empty(ids)) {
+        return names | rv::transform([](const auto& name) { return getCard(name).name; }) | rng::to_vector;
+    }
+    auto result = std::vector<CardNameView>{};
+    for (const auto id : ids) {
+        if (const auto card = fromWireCard(id)) { result.push_back(getCard(*card).name); }
+    }
+    return result;
 }
 
 struct PassGameTalon {
@@ -567,6 +600,30 @@ struct Sound {
     std::optional<r::Sound> dealCards = makeSound("deal_cards.wav");
     std::optional<r::Sound> placeCard = makeSound("place_card.mp3");
 
+    // Opens only the sound just fetched, the others stay as they are, see fetchLazyResources
+    auto load(const std::string_view filename) -> void
+    {
+        using Slot = std::optional<r::Sound> Sound::*;
+        static constexpr auto Slots = std::array<std::pair<std::string_view, Slot>, 9>{{
+            {"game_about_to_start.mp3", &Sound::gameAboutToStarted},
+            {"game_started.mp3", &Sound::gameStarted},
+            {"ready_check_accepted.mp3", &Sound::readyCheckAccepted},
+            {"ready_check_declined.mp3", &Sound::readyCheckDeclined},
+            {"ready_check_received.mp3", &Sound::readyCheckReceived},
+            {"ready_check_requested.mp3", &Sound::readyCheckRequested},
+            {"ready_check_succeeded.mp3", &Sound::readyCheckSucceeded},
+            {"deal_cards.wav", &Sound::dealCards},
+            {"place_card.mp3", &Sound::placeCard},
+        }};
+        for (const auto& [name, slot] : Slots) {
+            if (name == filename) {
+                this->*slot = makeSound(filename);
+                return;
+            }
+        }
+        PREF_W("error: unknown sound, {}", PREF_V(filename));
+    }
+
     auto withoutSoundEffects() -> void
     {
         // TODO: add sounds to a container and replace with a loop
@@ -589,6 +646,8 @@ struct Context {
     r::Font initialFont;
     r::Font fontAwesome;
     r::Font fontAwesomeXL;
+    bool areIconFontsLoaded{}; // fetched after the login screen, see fetchLazyResources
+    bool areLazyResourcesFetched{};
     float scale = 1.f;
     float offsetX = 0.f;
     float offsetY = 0.f;
@@ -596,6 +655,7 @@ struct Context {
     int windowHeight = static_cast<int>(VirtualH);
     r::Window window{windowWidth, windowHeight, "Preferans"};
     r::RenderTexture target{static_cast<int>(VirtualW), static_cast<int>(VirtualH)};
+    r::Texture cardAtlas; // every card face, see Card
     r::AudioDevice audio;
     Sound sound;
     Mic microphone;
@@ -605,6 +665,7 @@ struct Context {
     std::string authToken;
     bool isLoggedIn{};
     bool isLoginInProgress{};
+    WireFormat wireFormat = WireFormat::WIRE_TEXT;
     mutable std::map<PlayerId, Player> players;
     EMSCRIPTEN_WEBSOCKET_T ws{};
     int leftCardCount = 10;
@@ -639,8 +700,9 @@ struct Context {
     std::map<CardNameView, r::Vector2> cardPositions;
     std::vector<MovingCard> movingCards;
     bool isGameFreezed{};
-    bool needsDraw = true;
-    double tick = 0.0;
+    bool needsDraw = true; // something changed since the last frame, or the last frame moves with time
+    bool isDrawing{}; // inside `updateDrawFrame`
+    bool isIdle{}; // the main loop polls every `IdleFrameInterval` instead of every animation frame
     bool isGameStarted{};
 
     auto clear() -> void
@@ -734,6 +796,43 @@ struct Context {
     return ctx;
 }
 
+// Long enough to leave the CPU alone, short enough for the input raylib sees without waking us, e.g. a gamepad
+inline constexpr auto IdleFrameInterval = 250ms;
+
+auto setIdle(const bool isIdle) -> void
+{
+    if (ctx().isIdle == isIdle) { return; }
+    ctx().isIdle = isIdle;
+    if (isIdle) {
+        emscripten_set_main_loop_timing(EM_TIMING_SETTIMEOUT, static_cast<int>(IdleFrameInterval.count()));
+        return;
+    }
+    emscripten_set_main_loop_timing(EM_TIMING_RAF, 1);
+    if (ctx().isDrawing) { return; } // the next frame is scheduled after this one with the new timing
+    // or the frame already scheduled waits out the idle interval, the resumed loop drops it and draws right away
+    emscripten_pause_main_loop();
+    emscripten_resume_main_loop();
+}
+
+// For whatever changes the screen: a message, a timer, an input event, or a frame that moves with time
+auto requestDraw() -> void
+{
+    ctx().needsDraw = true;
+    setIdle(false);
+}
+
+auto loadCards() -> void
+{
+    ctx().cardAtlas = r::Texture{resources("cards", "atlas.png")};
+    if (Card::Scale != 1.f) { SetTextureFilter(ctx().cardAtlas, TEXTURE_FILTER_BILINEAR); } // scaled down to draw
+    auto&& _ = getCard(PREF_SEVEN_OF_SPADES);
+}
+
+auto drawCard(const Card& card, const r::Vector2 pos, const r::Color tint = r::Color::White()) -> void
+{
+    ctx().cardAtlas.Draw(card.source, cardRect(pos), {}, 0.f, tint);
+}
+
 auto initAudioEngine() -> void;
 auto syncAudioPeers() -> void;
 auto teardownAudioEngine() -> void;
@@ -1002,7 +1101,7 @@ auto startCardMove(const PlayerId& playerId, const Card& card, std::optional<r::
     constexpr auto durationMs = 240.0;
     std::erase_if(ctx().movingCards, [&](const MovingCard& movingCard) { return movingCard.playerId == playerId; });
     ctx().movingCards.push_back(MovingCard{playerId, &card, from, *to, emscripten_get_now(), durationMs});
-    ctx().needsDraw = true;
+    requestDraw();
 }
 
 auto drawMovingCards() -> void
@@ -1012,10 +1111,10 @@ auto drawMovingCards() -> void
     std::erase_if(ctx().movingCards, [&](const MovingCard& movingCard) {
         const auto progress = std::clamp((now - movingCard.startedAt) / movingCard.durationMs, 0.0, 1.0);
         const auto pos = Vector2Lerp(movingCard.from, movingCard.to, static_cast<float>(progress));
-        movingCard.card->texture.Draw(pos);
+        drawCard(*movingCard.card, pos);
         return progress >= 1.0;
     });
-    ctx().needsDraw = true;
+    requestDraw();
 }
 
 auto sendMessage(const EMSCRIPTEN_WEBSOCKET_T ws, const Message& msg) -> bool
@@ -1024,11 +1123,11 @@ auto sendMessage(const EMSCRIPTEN_WEBSOCKET_T ws, const Message& msg) -> bool
         PREF_W("error: ws is not open");
         return false;
     }
-    ctx().needsDraw = true;
+    requestDraw();
     auto data = msg.SerializeAsString();
     if (const auto result = emscripten_websocket_send_binary(ws, data.data(), std::size(data));
         result != EMSCRIPTEN_RESULT_SUCCESS) {
-        PREF_W("error: {}, method: {}", emResult(result), msg.method());
+        PREF_W("error: {}, method: {}", emResult(result), methodName(msg.body_case()));
         return false;
     }
     return true;
@@ -1050,6 +1149,8 @@ auto sendMessage(const EMSCRIPTEN_WEBSOCKET_T ws, const Message& msg) -> bool
     auto result = LoginRequest{};
     result.set_player_name(playerName);
     result.set_password(password);
+    result.set_wire_format(WireFormat::WIRE_COMPACT);
+    result.set_batches(true);
     return result;
 }
 
@@ -1058,6 +1159,8 @@ auto sendMessage(const EMSCRIPTEN_WEBSOCKET_T ws, const Message& msg) -> bool
     auto result = AuthRequest{};
     result.set_player_id(playerId);
     result.set_auth_token(authToken);
+    result.set_wire_format(WireFormat::WIRE_COMPACT);
+    result.set_batches(true);
     return result;
 }
 
@@ -1081,7 +1184,12 @@ auto sendMessage(const EMSCRIPTEN_WEBSOCKET_T ws, const Message& msg) -> bool
 {
     auto result = Bidding{};
     result.set_player_id(playerId);
-    result.set_bid(bid);
+    if (const auto code = toBidCode(bid);
+        (ctx().wireFormat == WireFormat::WIRE_COMPACT) and (code != BidCode::NO_BID)) {
+        result.set_bid_code(code);
+    } else {
+        result.set_bid(bid);
+    }
     return result;
 }
 
@@ -1091,6 +1199,19 @@ auto sendMessage(const EMSCRIPTEN_WEBSOCKET_T ws, const Message& msg) -> bool
 {
     auto result = DiscardTalon{};
     result.set_player_id(playerId);
+    if (ctx().wireFormat == WireFormat::WIRE_COMPACT) {
+        if (const auto code = toBidCode(bid); code != BidCode::NO_BID) {
+            result.set_bid_code(code);
+        } else {
+            result.set_bid(bid);
+        }
+        auto cards = CardMask{};
+        for (const auto name : discardedTalon) {
+            if (const auto card = toCardId(name)) { cards.insert(*card); }
+        }
+        result.set_cards_mask(toWireHand(cards));
+        return result;
+    }
     result.set_bid(bid);
     for (const auto card : discardedTalon) { result.add_cards(std::string{card}); }
     return result;
@@ -1124,7 +1245,11 @@ auto sendMessage(const EMSCRIPTEN_WEBSOCKET_T ws, const Message& msg) -> bool
 {
     auto result = PlayCard{};
     result.set_player_id(playerId);
-    result.set_card(std::string{cardName});
+    if (const auto card = toCardId(cardName); (ctx().wireFormat == WireFormat::WIRE_COMPACT) and card) {
+        result.set_card_id(toWireCard(*card));
+    } else {
+        result.set_card(std::string{cardName});
+    }
     return result;
 }
 
@@ -1164,6 +1289,13 @@ auto sendMessage(const EMSCRIPTEN_WEBSOCKET_T ws, const Message& msg) -> bool
     return result;
 }
 
+[[nodiscard]] auto makeUserGamesRequest(const std::int32_t beforeId) -> UserGamesRequest
+{
+    auto result = UserGamesRequest{};
+    result.set_before_id(beforeId);
+    return result;
+}
+
 auto sendLoginRequest() -> void
 {
     auto _ = gsl::finally([] { ctx().password.clear(); });
@@ -1242,11 +1374,24 @@ auto sendAudioSignal(const std::string& toPlayerId, const std::string& kind, con
     return sendMessage(ctx().ws, makeMessage(makePingPong(id)));
 }
 
+// the page of the games older than `beforeId`, or of the newest ones when it's 0
+auto sendUserGamesRequest(const std::int32_t beforeId) -> void
+{
+    PREF_DI(beforeId);
+    ctx().overallScoreboard.isLoading = sendMessage(ctx().ws, makeMessage(makeUserGamesRequest(beforeId)));
+}
+
 template<typename Rep, typename Period, typename Func>
-auto waitFor(const std::chrono::duration<Rep, Period> duration, Func func, void* ud) -> void
+auto waitFor(const std::chrono::duration<Rep, Period> duration, [[maybe_unused]] Func func, void* ud) -> void
 {
+    static_assert(std::is_empty_v<Func> and std::is_default_constructible_v<Func>, "a lambda without captures");
     emscripten_async_call(
-        func, ud, static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(duration).count()));
+        [](void* data) {
+            Func{}(data);
+            requestDraw(); // whatever the timer changed
+        },
+        ud,
+        static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(duration).count()));
 }
 
 template<typename Rep, typename Period, typename Func>
@@ -1262,6 +1407,35 @@ auto waitFor(const std::chrono::duration<Rep, Period> duration, Func func) -> vo
         new std::function<void()>{std::move(func)});
 }
 
+// A resource left out of index.data: the web server has it next to index.html at the path the client opens it at
+auto fetchResource(std::string path, std::function<void()> onLoad) -> void
+{
+    struct Fetch {
+        std::string path;
+        std::function<void()> onLoad;
+    };
+    PREF_DI(path);
+    auto* fetch = new Fetch{std::move(path), std::move(onLoad)};
+    emscripten_async_wget2(
+        fetch->path.c_str(),
+        fetch->path.c_str(),
+        "GET",
+        "",
+        fetch,
+        []([[maybe_unused]] const unsigned handle, void* ud, [[maybe_unused]] const char* file) {
+            auto* f = static_cast<Fetch*>(ud);
+            const auto _ = gsl::finally([&] { delete f; });
+            f->onLoad();
+            requestDraw();
+        },
+        []([[maybe_unused]] const unsigned handle, void* ud, const int status) {
+            auto* f = static_cast<Fetch*>(ud);
+            const auto _ = gsl::finally([&] { delete f; });
+            PREF_W("error: failed to fetch {}, status: {}", f->path, status);
+        },
+        nullptr);
+}
+
 auto repeatPingPong() -> void;
 
 auto shedulePingPong() -> void
@@ -1307,13 +1481,19 @@ auto handleLoginResponse(const Message& msg) -> void
         return;
     }
     ctx().stage = loginResponse->stage();
+    ctx().wireFormat = loginResponse->wire_format();
     if (ctx().stage != GameStage::UNKNOWN) { ctx().isGameStarted = true; }
-    PREF_I("playerId: {}, stage: {}", loginResponse->player_id(), GameStage_Name(ctx().stage));
+    PREF_I(
+        "playerId: {}, stage: {}, format: {}",
+        loginResponse->player_id(),
+        GameStage_Name(ctx().stage),
+        WireFormat_Name(ctx().wireFormat));
     ctx().myPlayerId = std::string{loginResponse->player_id()};
     ctx().authToken = std::string{loginResponse->auth_token()};
     saveToLocalStoragePlayerId();
     saveToLocalStorageAuthToken();
     finishLogin(*loginResponse);
+    sendUserGamesRequest(0);
 }
 
 [[nodiscard]] auto isReadyCheckSucceeded() -> bool
@@ -1425,11 +1605,17 @@ auto handleAuthResponse(const Message& msg) -> void
         return;
     }
     ctx().stage = authResponse->stage();
+    ctx().wireFormat = authResponse->wire_format();
     if (ctx().stage != GameStage::UNKNOWN) { ctx().isGameStarted = true; }
     ctx().myPlayerName = std::string{authResponse->player_name()};
-    PREF_I("playerName: {}, stage: {}", ctx().myPlayerName, GameStage_Name(ctx().stage));
+    PREF_I(
+        "playerName: {}, stage: {}, format: {}",
+        ctx().myPlayerName,
+        GameStage_Name(ctx().stage),
+        WireFormat_Name(ctx().wireFormat));
     saveToLocalStoragePlayerName();
     finishLogin(*authResponse);
+    sendUserGamesRequest(0);
 }
 
 auto handlePlayerJoined(const Message& msg) -> void
@@ -1456,7 +1642,7 @@ auto handlePlayerLeft(const Message& msg) -> void
 
 [[nodiscard]] auto isMiser() -> bool
 {
-    return rng::any_of(players(), [](const std::string_view bid) { return bid.contains(PREF_MIS); }, &Player::bid);
+    return rng::any_of(players(), [](const std::string_view bid) { return Bid::parse(bid).isMiser(); }, &Player::bid);
 }
 
 auto handleForehand(const Message& msg) -> void
@@ -1489,7 +1675,9 @@ auto handleDealCards(const Message& msg) -> void
         }
         return ctx().player(playerId);
     });
-    for (const auto& cardName : dealCards->cards()) { player.hand.emplace_back(&getCard(cardName)); }
+    for (const auto card : parseHand(dealCards->cards(), dealCards->hand())) {
+        player.hand.emplace_back(&getCard(card));
+    }
     PREF_I("{}, hand: {}", PREF_V(player.id), player.hand | rv::transform(&Card::name));
     player.sortCards();
 }
@@ -1501,7 +1689,7 @@ auto handlePlayerTurn(const Message& msg) -> void
     if (not playerTurn) { return; }
     ctx().turnPlayerId = playerTurn->player_id();
     ctx().stage = playerTurn->stage();
-    const auto minBid = playerTurn->min_bid();
+    const auto minBid = parseBid(playerTurn->min_bid(), playerTurn->min_bid_code());
     const auto passRound = playerTurn->pass_round();
     PREF_I(
         "turnPlayerId: {}, stage: {}, {}{}",
@@ -1509,11 +1697,11 @@ auto handlePlayerTurn(const Message& msg) -> void
         GameStage_Name(ctx().stage),
         PREF_V(minBid),
         PREF_B(passRound));
-    assert(not std::empty(minBid));
+    assert(not minBid.empty());
     const auto minRank = std::invoke([&] {
         if (minBid == PREF_SIX) { return AllRanks; }
-        if (minBid == PREF_SEVEN) { return bidRank(PREF_SIX); }
-        return bidRank(PREF_SEVEN);
+        if (minBid == PREF_SEVEN) { return Bid{PREF_SIX}.rank(); }
+        return Bid{PREF_SEVEN}.rank();
     });
     if (minRank != AllRanks) {
         auto& rank = ctx().bidding.rank;
@@ -1523,9 +1711,7 @@ auto handlePlayerTurn(const Message& msg) -> void
     const auto isMyTurn = pref::isMyTurn();
     // FIXME: On reconnection during talon picking, previously discarded cards are incorrectly restored to the hand
     if (ctx().stage == TALON_PICKING) {
-        const auto talonCards = playerTurn->talon()
-            | rv::transform([](const auto& cardName) { return getCard(cardName).name; })
-            | rng::to_vector;
+        auto talonCards = getCardsNames(playerTurn->talon(), playerTurn->talon_cards());
         if (not std::empty(talonCards)) {
             const auto allCardsAlreadyApplied = rng::all_of(talonCards, [&](const auto cardName) {
                 const auto& card = getCard(cardName);
@@ -1535,11 +1721,11 @@ auto handlePlayerTurn(const Message& msg) -> void
             if (not allCardsAlreadyApplied and not rng::equal(ctx().pendingTalonReveal, talonCards)) {
                 ctx().pendingTalonReveal = std::move(talonCards);
                 ctx().pendingTalonRevealUntil = ctx().window.GetTime() + 2.0;
-                ctx().needsDraw = true;
+                requestDraw();
             }
         }
         applyPendingTalonReveal();
-        for (const auto& cardName : playerTurn->talon()) {
+        for (const auto cardName : getCardsNames(playerTurn->talon(), playerTurn->talon_cards())) {
             const auto& card = getCard(cardName);
             // Note: On reconnection, the cards are already sent by DealCards, so they must not be inserted twice
             if (rng::contains(ctx().pendingTalonReveal, card.name)) { continue; }
@@ -1579,8 +1765,9 @@ auto handleBidding(const Message& msg) -> void
     auto bidding = makeMethod<Bidding>(msg);
     if (not bidding) { return; }
     const auto playerId = std::string{bidding->player_id()};
-    auto bid = std::string{bidding->bid()};
-    auto newRank = bidRank(bid);
+    const auto parsed = parseBid(bidding->bid(), bidding->bid_code());
+    auto bid = std::string{parsed.text()};
+    auto newRank = parsed.rank();
     auto& curRank = ctx().bidding.rank;
     if (ctx().myPlayerId == ctx().forehandId and newRank != 0) { --newRank; }
     if (newRank >= curRank or curRank == AllRanks) { ctx().bidding.bid = bid; }
@@ -1641,10 +1828,15 @@ auto handlePlayCard(const Message& msg) -> void
     if (not playCard) { return; }
     auto [leftOpponentId, rightOpponentId] = getOpponentIds();
     auto playerId = std::string{playCard->player_id()};
-    const auto cardName = playCard->card();
+    const auto cardId = parseCard(playCard->card(), playCard->card_id());
+    if (not cardId) {
+        PREF_W("error: unknown card: {}, id: {}", playCard->card(), Card_Name(playCard->card_id()));
+        return;
+    }
+    const auto& card = getCard(*cardId);
+    const auto cardName = card.name;
     PREF_DI(playerId, cardName);
 
-    const auto& card = getCard(cardName);
     if (playerId == leftOpponentId) {
         if (ctx().leftCardCount > 0) { --ctx().leftCardCount; }
     } else if (playerId == rightOpponentId) {
@@ -1663,10 +1855,9 @@ auto handleGameState(const Message& msg) -> void
     auto gameState = makeMethod<GameState>(msg);
     if (not gameState) { return; }
     ctx().lastTrickOrTalon.clear();
-    for (auto&& cardName : gameState->last_trick()) {
+    for (const auto cardName : getCardsNames(gameState->last_trick(), gameState->last_trick_cards())) {
         PREF_DI(cardName);
-        const auto& card = getCard(cardName);
-        ctx().lastTrickOrTalon.push_back(card.name);
+        ctx().lastTrickOrTalon.push_back(cardName);
     }
     for (auto&& tricks : gameState->taken_tricks()) {
         const auto playerId = std::string{tricks.player_id()};
@@ -1796,14 +1987,17 @@ auto handlePingPong(const Message& msg) -> void
 auto updateOverallScoreboardTable() -> void
 {
     const auto& games = ctx().overallScoreboard.userGames.games();
-    const auto totalGames = std::ssize(games);
-    const auto totalWins = rng::count_if(games, std::bind_front(std::less{}, 0), &UserGame::mmr);
-    const auto totalLosses = rng::count_if(games, std::bind_front(std::greater{}, 0), &UserGame::mmr);
+    const auto& totals = ctx().overallScoreboard.userGames.totals();
+    const auto totalWins = totals.wins();
+    const auto totalLosses = totals.losses();
     const auto winRate
         = static_cast<int>((static_cast<float>(totalWins) / static_cast<float>(totalWins + totalLosses)) * 100.f);
-    const auto total = [&](auto proj) { return rng::accumulate(games, 0, std::plus{}, proj); };
-    auto mmrDiff = games | rv::transform(&UserGame::mmr) | rv::partial_sum(std::plus{}) | rng::to_vector;
-    rng::actions::reverse(mmrDiff);
+    // the MMR after each of the loaded games, the newest first, counted back from the total
+    auto mmrDiff = std::vector<std::int32_t>{};
+    for (auto mmr = totals.mmr(); const auto& game : games | rv::reverse) {
+        mmrDiff.push_back(mmr);
+        mmr -= game.mmr();
+    }
     ctx().overallScoreboard.table = OverallScoreboard::Table{
         {ctx().localizeText(GameText::Date),
          ctx().localizeText(GameText::Time),
@@ -1814,11 +2008,11 @@ auto updateOverallScoreboardTable() -> void
          fmt::format("{} / {}", ctx().localizeText(GameText::Games), ctx().localizeText(GameText::Type))},
         {ctx().localizeText(GameText::Total),
          std::string{"-"},
-         formatDuration(total(&UserGame::duration)),
+         formatDuration(gsl::narrow_cast<std::int32_t>(totals.duration())),
          fmt::format("{}% {}", winRate, ctx().localizeText(GameText::WinRate)),
-         fmt::format("{}", rng::accumulate(games, 0, std::plus{}, &UserGame::mmr)),
-         fmt::format("{}/{}/{}", total(&UserGame::pool), total(&UserGame::dump), total(&UserGame::whists)),
-         std::format("{}", totalGames)}};
+         fmt::format("{}", totals.mmr()),
+         fmt::format("{}/{}/{}", totals.pool(), totals.dump(), totals.whists()),
+         std::format("{}", totals.games())}};
     const auto view
         = games | rv::reverse | rv::enumerate | rv::transform([&](auto&& index_game) {
               auto&& [index, game] = index_game;
@@ -1838,12 +2032,42 @@ auto updateOverallScoreboardTable() -> void
     std::ranges::copy(view, std::back_inserter(ctx().overallScoreboard.table));
 }
 
+auto updateUserGame(UserGames& loaded, const UserGame& game) -> void
+{
+    auto& games = *loaded.mutable_games();
+    auto& totals = *loaded.mutable_totals();
+    // the game being updated is almost always the last one
+    const auto gameIt = std::find_if(
+        std::rbegin(games), std::rend(games), [&](const UserGame& loadedGame) { return loadedGame.id() == game.id(); });
+    if (gameIt != std::rend(games)) {
+        addToTotals(totals, *gameIt, -1);
+        *gameIt = game;
+    } else {
+        *games.Add() = game;
+    }
+    addToTotals(totals, game);
+}
+
+// The page of the newest games replaces what's loaded, an older page goes before it, and an update adds or
+// replaces its game
 auto handleUserGames(const Message& msg) -> void
 {
-    auto userGames = makeMethod<UserGames>(msg);
+    const auto userGames = makeMethod<UserGames>(msg);
     if (not userGames) { return; }
     PREF_I();
-    ctx().overallScoreboard.userGames = std::move(*userGames);
+    auto& loaded = ctx().overallScoreboard.userGames;
+    if (userGames->is_update()) {
+        for (const auto& game : userGames->games()) { updateUserGame(loaded, game); }
+    } else if (userGames->has_totals()) {
+        loaded = *userGames;
+        ctx().overallScoreboard.isLoading = false;
+    } else {
+        auto older = *userGames;
+        older.mutable_games()->MergeFrom(loaded.games());
+        *older.mutable_totals() = loaded.totals();
+        loaded = std::move(older);
+        ctx().overallScoreboard.isLoading = false;
+    }
     updateOverallScoreboardTable();
 }
 
@@ -1851,18 +2075,25 @@ auto handleOpenTalon(const Message& msg) -> void
 {
     const auto openTalon = makeMethod<OpenTalon>(msg);
     if (not openTalon) { return; }
-    const auto cardName = openTalon->card();
+    const auto card = parseCard(openTalon->card(), openTalon->card_id());
+    if (not card) { return; }
+    const auto& cardName = getCard(*card).name;
     PREF_DI(cardName);
     ctx().leadSuit = cardSuit(cardName);
-    ctx().passGameTalon.push(getCard(cardName));
+    ctx().passGameTalon.push(getCard(*card));
 }
 
 auto handleMiserCards(const Message& msg) -> void
 {
     auto miserCards = makeMethod<MiserCards>(msg);
     if (not miserCards) { return; }
-    ctx().miserCardsPanel.played = miserCards->played_cards() | rng::to_vector;
-    ctx().miserCardsPanel.remaining = miserCards->remaining_cards() | rng::to_vector;
+    if (ctx().wireFormat == WireFormat::WIRE_COMPACT) {
+        ctx().miserCardsPanel.played = toCardsNames(fromWireHand(miserCards->played_mask()));
+        ctx().miserCardsPanel.remaining = toCardsNames(fromWireHand(miserCards->remaining_mask()));
+    } else {
+        ctx().miserCardsPanel.played = miserCards->played_cards() | rng::to_vector;
+        ctx().miserCardsPanel.remaining = miserCards->remaining_cards() | rng::to_vector;
+    }
     PREF_DI(ctx().miserCardsPanel.played, ctx().miserCardsPanel.remaining);
     ctx().miserCardsPanel.isVisible = true;
 }
@@ -1880,7 +2111,7 @@ auto applyPendingTalonReveal() -> void
     if (isMyTurn) { ctx().myPlayer().sortCards(); }
     ctx().pendingTalonReveal.clear();
     ctx().pendingTalonRevealUntil = 0.0;
-    ctx().needsDraw = true;
+    requestDraw();
 }
 
 auto updateWindowSize() -> void
@@ -1931,18 +2162,24 @@ auto updateWindowSize() -> void
     PREF_X(Whisting)
 // clang-format on
 
-auto dispatchMessage(const std::optional<Message>& msg) -> void
+auto dispatchMessage(const Message& msg) -> void
 {
-    if (not msg) { return; }
-    const auto& method = msg->method();
+    switch (msg.body_case()) {
 #define PREF_X(PREF_MSG_NAME)                                                                                          \
-    if (method == std::string_view{#PREF_MSG_NAME}) {                                                                  \
-        ctx().needsDraw = true;                                                                                        \
-        return handle##PREF_MSG_NAME(*msg);                                                                            \
-    }
-    PREF_METHODS;
+    case Message::k##PREF_MSG_NAME:                                                                                    \
+        requestDraw();                                                                                                 \
+        return handle##PREF_MSG_NAME(msg);
+        PREF_METHODS
 #undef PREF_X
-    PREF_W("error: unknown {}", PREF_V(method));
+    case Message::kBatch: // the messages the server had queued for us, in order
+        for (const auto& batched : msg.batch().messages()) { dispatchMessage(batched); }
+        return;
+    case Message::kGameSnapshot: // the table after we reconnect, or as a spectator sees it
+        for (const auto& snapshot : msg.game_snapshot().messages()) { dispatchMessage(snapshot); }
+        return;
+    default: break;
+    }
+    PREF_W("error: unexpected {}", methodName(msg.body_case()));
 }
 
 auto setupWebsocket() -> void;
@@ -1970,7 +2207,7 @@ auto onWsMessage(
     -> EM_BOOL
 {
     assert(event);
-    dispatchMessage(makeMessage(*event));
+    if (const auto msg = makeMessage(*event)) { dispatchMessage(*msg); }
     return EM_TRUE;
 }
 
@@ -2015,6 +2252,7 @@ auto setupWebsocket() -> void
         PREF_W("ws is not supported");
         return;
     }
+    // the browser offers permessage-deflate itself and hands us the inflated messages
     EmscriptenWebSocketCreateAttributes attr = {};
     attr.url = ctx().url.c_str();
     attr.protocols = nullptr;
@@ -2286,7 +2524,7 @@ auto drawTalonDiscardPopUp() -> void
         ctx().discardedTalon.clear();
     }
     ctx().talonDiscardPopUp.isVisible = false;
-    ctx().needsDraw = true;
+    requestDraw();
 }
 
 [[maybe_unused]] auto drawMessageBox(
@@ -2438,6 +2676,7 @@ auto drawCardShineEffect(const bool isHovered, const r::Vector2& cardPosition) -
     static constexpr auto fadeMargin = stripeWidth * 0.5f;
     static constexpr auto fadeEdge = CardWidth * 0.5f - fadeMargin;
     static constexpr auto marginY = CardHeight / 20.f;
+    requestDraw(); // the stripe runs while the card is hovered
     const auto time = static_cast<float>(ctx().window.GetTime());
     const auto x = std::fmod(time * speed, CardWidth - stripeWidth);
     const auto rect
@@ -2467,6 +2706,7 @@ auto drawHandTurnAura(const r::Rectangle& cardsRect) -> void
     static constexpr auto size = 12.f;
     static constexpr auto speed = 4.f;
     static constexpr auto thick = CardWidth / 35.f;
+    requestDraw(); // it pulses for as long as the turn lasts
     const auto time = static_cast<float>(ctx().window.GetTime());
     const auto pulse = (std::sin(time * speed) + 1.f) * 0.5f;
     const auto ringColor = getGuiColor(BORDER_COLOR_NORMAL);
@@ -2527,7 +2767,7 @@ auto drawCards(const r::Vector2 pos, Player& player, const Shift shift) -> void
         const auto canPlay = not ctx().cardsOnTable.contains(player.id) and isCardPlayable;
         const auto canPlayWithTalon
             = isTalonSelectionLocked ? (isSelectedForTalon ? true : false) : canPlay;
-        card->texture.Draw(cardPosition, tintForCard(canPlayWithTalon));
+        drawCard(*card, cardPosition, tintForCard(canPlayWithTalon));
         drawCardShineEffect(isHovered, cardPosition);
     }
 }
@@ -2693,7 +2933,9 @@ auto drawOfferButton() -> void
     }
     static constexpr auto shift = 110.0f; // TOOD: make reative or calculate properly
     const auto rect = r::Rectangle{textX + gap * 0.5f, textY - gap * 0.5f - shift, textSize.x + gap, textSize.y + gap};
-    if (isPlayerTurnOnBehalfOfSomeone) {
+    if (not ctx().areIconFontsLoaded) {
+        // the arrows wait for the icon font
+    } else if (isPlayerTurnOnBehalfOfSomeone) {
         static const auto arrowSize = ctx().fontSizeXL();
         const auto [leftOpponentId, _] = getOpponentIds();
         const auto isLeft = leftOpponentId == ctx().player(playerId).playsOnBehalfOf;
@@ -2839,17 +3081,17 @@ auto drawPlayedCards() -> void
 {
     const auto& slots = playSlots();
     const auto [leftOpponentId, rightOpponentId] = getOpponentIds();
-    if (ctx().passGameTalon.exists()) { ctx().passGameTalon.get().texture.Draw(slots.top); }
+    if (ctx().passGameTalon.exists()) { drawCard(ctx().passGameTalon.get(), slots.top); }
     drawMovingCards();
     if (std::empty(ctx().cardsOnTable)) { return; }
     if (ctx().cardsOnTable.contains(leftOpponentId) and not isCardMoving(leftOpponentId)) {
-        ctx().cardsOnTable.at(leftOpponentId)->texture.Draw(slots.left);
+        drawCard(*ctx().cardsOnTable.at(leftOpponentId), slots.left);
     }
     if (ctx().cardsOnTable.contains(rightOpponentId) and not isCardMoving(rightOpponentId)) {
-        ctx().cardsOnTable.at(rightOpponentId)->texture.Draw(slots.right);
+        drawCard(*ctx().cardsOnTable.at(rightOpponentId), slots.right);
     }
     if (ctx().cardsOnTable.contains(ctx().myPlayerId) and not isCardMoving(ctx().myPlayerId)) {
-        ctx().cardsOnTable.at(ctx().myPlayerId)->texture.Draw(slots.bottom);
+        drawCard(*ctx().cardsOnTable.at(ctx().myPlayerId), slots.bottom);
     }
 }
 
@@ -2863,7 +3105,7 @@ auto drawPendingTalonReveal() -> void
     const auto y = (VirtualH - CardHeight) * 0.5f;
     for (const auto [i, cardName] : ctx().pendingTalonReveal | rv::enumerate) {
         const auto pos = r::Vector2{x + static_cast<float>(i) * (CardWidth + gap), y};
-        getCard(cardName).texture.Draw(pos);
+        drawCard(getCard(cardName), pos);
     }
 }
 
@@ -3184,7 +3426,7 @@ auto handleTalonCardClick(std::list<const Card*>& hand) -> void
     if (not r::Mouse::IsButtonPressed(MOUSE_LEFT_BUTTON)) { return; }
     const auto mousePos = r::Mouse::GetPosition();
     const auto hit = [&](const Card* c) {
-        return r::Rectangle{ctx().cardPositions[c->name], c->texture.GetSize()}.CheckCollision(mousePos);
+        return cardRect(ctx().cardPositions[c->name]).CheckCollision(mousePos);
     };
     const auto reversed = hand | rv::reverse;
     if (const auto rit = rng::find_if(reversed, hit); rit != rng::cend(reversed)) {
@@ -3194,13 +3436,13 @@ auto handleTalonCardClick(std::list<const Card*>& hand) -> void
             selectedIt != rng::end(ctx().discardedTalon)) {
             ctx().discardedTalon.erase(selectedIt);
             if (std::size(ctx().discardedTalon) < 2) { ctx().talonDiscardPopUp.isVisible = false; }
-            ctx().needsDraw = true;
+            requestDraw();
             return;
         }
         if (std::size(ctx().discardedTalon) >= 2) { return; }
         ctx().discardedTalon.push_back(cardName);
         if (std::size(ctx().discardedTalon) == 2) { ctx().talonDiscardPopUp.isVisible = true; }
-        ctx().needsDraw = true;
+        requestDraw();
     }
 }
 
@@ -3212,7 +3454,7 @@ auto handleCardClick(
     if (not r::Mouse::IsButtonPressed(MOUSE_LEFT_BUTTON)) { return; }
     const auto mousePos = r::Mouse::GetPosition();
     const auto hit = [&](const Card* c) {
-        return r::Rectangle{ctx().cardPositions[c->name], c->texture.GetSize()}.CheckCollision(mousePos);
+        return cardRect(ctx().cardPositions[c->name]).CheckCollision(mousePos);
     };
     const auto reversed = hand | rv::reverse;
     if (const auto rit = rng::find_if(reversed, hit); rit != rng::cend(reversed)) {
@@ -3276,31 +3518,52 @@ auto handleCardClick(
     return std::array{LeftArrowIcon, RightArrowIcon, DownArrowIcon};
 }
 
+inline constexpr auto FontSizeS = static_cast<int>(VirtualH / 54.f);
+inline constexpr auto FontSizeM = static_cast<int>(VirtualH / 30.f);
+inline constexpr auto FontSizeL = static_cast<int>(VirtualH / 11.25f);
+inline constexpr auto FontSizeXL = static_cast<int>(VirtualH / 6.f);
+
 auto loadFonts() -> void
 {
-    static constexpr auto FontSizeS = static_cast<int>(VirtualH / 54.f);
-    static constexpr auto FontSizeM = static_cast<int>(VirtualH / 30.f);
-    static constexpr auto FontSizeL = static_cast<int>(VirtualH / 11.25f);
-    static constexpr auto FontSizeXL = static_cast<int>(VirtualH / 6.f);
     const auto fontPath = fonts("DejaVuSans.ttf");
-    const auto fontAwesomePath = fonts("Font-Awesome-7-Free-Solid-900.otf");
     auto codepoints = makeCodepoints();
     auto codepointsLarge = makeCodepointsLarge();
-    auto awesomeCodepoints = makeAwesomeCodepoints();
-    auto awesomeLargeCodepoints = makeAwesomeLargeCodepoints();
     ctx().fontS = LoadFontEx(fontPath.c_str(), FontSizeS, std::data(codepoints), std::ssize(codepoints));
     ctx().fontM = LoadFontEx(fontPath.c_str(), FontSizeM, std::data(codepoints), std::ssize(codepoints));
     ctx().fontL = LoadFontEx(fontPath.c_str(), FontSizeL, std::data(codepointsLarge), std::ssize(codepointsLarge));
+    SetTextureFilter(ctx().fontS.texture, TEXTURE_FILTER_BILINEAR);
+    SetTextureFilter(ctx().fontM.texture, TEXTURE_FILTER_BILINEAR);
+    SetTextureFilter(ctx().fontL.texture, TEXTURE_FILTER_BILINEAR);
+    setDefaultFont();
+}
+
+auto loadIconFonts() -> void
+{
+    const auto fontAwesomePath = fonts("Font-Awesome-7-Free-Solid-900.otf");
+    auto awesomeCodepoints = makeAwesomeCodepoints();
+    auto awesomeLargeCodepoints = makeAwesomeLargeCodepoints();
     ctx().fontAwesome = LoadFontEx(
         fontAwesomePath.c_str(), FontSizeM - 1, std::data(awesomeCodepoints), std::ssize(awesomeCodepoints));
     ctx().fontAwesomeXL = LoadFontEx(
         fontAwesomePath.c_str(), FontSizeXL, std::data(awesomeLargeCodepoints), std::ssize(awesomeLargeCodepoints));
-    SetTextureFilter(ctx().fontS.texture, TEXTURE_FILTER_BILINEAR);
-    SetTextureFilter(ctx().fontM.texture, TEXTURE_FILTER_BILINEAR);
-    SetTextureFilter(ctx().fontL.texture, TEXTURE_FILTER_BILINEAR);
     SetTextureFilter(ctx().fontAwesome.texture, TEXTURE_FILTER_BILINEAR);
     SetTextureFilter(ctx().fontAwesomeXL.texture, TEXTURE_FILTER_BILINEAR);
-    setDefaultFont();
+    ctx().areIconFontsLoaded = true;
+}
+
+// The sounds and the icon font listed in lazy.txt by the build, nothing on the login screen waits for them
+auto fetchLazyResources() -> void
+{
+    auto lazy = std::ifstream{resources("lazy.txt")};
+    for (auto path = std::string{}; std::getline(lazy, path);) {
+        if (path.starts_with("fonts/")) {
+            fetchResource(resources(path), [] { loadIconFonts(); });
+        } else if (path.starts_with("sounds/")) {
+            fetchResource(resources(path), [filename = fs::path{path}.filename().string()] {
+                ctx().sound.load(filename); // opens only the one fetched
+            });
+        }
+    }
 }
 
 auto loadColorScheme(const std::string_view style) -> void
@@ -3308,6 +3571,11 @@ auto loadColorScheme(const std::string_view style) -> void
     // TODO: highlighted a loaded scheme at startup
     const auto name = style | ToLower | ToString;
     const auto stylePath = resources("styles", fmt::format("style_{}.rgs", name));
+    if (not fs::exists(stylePath)) { // only the default one is preloaded
+        saveToLocalStorage("color_scheme", name); // kept even if the fetch fails
+        fetchResource(stylePath, [name] { loadColorScheme(name); });
+        return;
+    }
     GuiLoadStyle(stylePath.c_str());
     GuiSetStyle(LISTVIEW, SCROLLBAR_WIDTH, ScrollBarWidth);
     ctx().settingsMenu.loadedColorScheme = name;
@@ -3359,7 +3627,7 @@ auto toggleMic() -> void
     }, ctx().microphone.isMuted);
 #pragma GCC diagnostic pop
     // clang-format on
-    ctx().needsDraw = true;
+    requestDraw();
 }
 
 auto drawToolbarButton(
@@ -3377,7 +3645,7 @@ auto drawToolbarButton(
         buttonW,
         buttonH};
     withGuiFont(ctx().fontAwesome, [&] {
-        if (GuiButton(bounds, icon)) { onClick(); }
+        if (GuiButton(bounds, ctx().areIconFontsLoaded ? icon : "")) { onClick(); }
     });
 }
 
@@ -3791,6 +4059,11 @@ auto drawOverallScoreboard() -> void
         const auto title = ctx().localizeText(GameText::OverallScoreboard);
         ctx().overallScoreboard.isVisible = not GuiWindowBox(windowBox, title.c_str());
         GuiScrollPanel(scrollPanel, nullptr, content, &panelScroll, &panelView);
+        const auto& userGames = ctx().overallScoreboard.userGames;
+        const auto isScrolledToEnd = scrollPanel.height - panelScroll.y >= content.height - cellSize.y;
+        if (isScrolledToEnd and userGames.has_more() and not ctx().overallScoreboard.isLoading) {
+            sendUserGamesRequest(userGames.games(0).id());
+        }
 
         for (auto&& [j, row] : ctx().overallScoreboard.table | rv::enumerate) {
             for (auto&& [i, cell] : row | rv::enumerate) {
@@ -4216,14 +4489,11 @@ auto updateMenuPosition(Menu& menu) -> void
 auto needsDraw() -> bool
 {
     const auto deltaMouse = r::Mouse::GetDelta();
-    const auto now = emscripten_get_now();
-    const auto timeToDraw = now >= ctx().tick;
-    static constexpr auto fps = 36.0;
-    static constexpr auto deltaTime = 1.0 / fps * 1000.0;
-    if (timeToDraw) { ctx().tick = now + deltaTime; }
+    const auto isTalonRevealDue
+        = not std::empty(ctx().pendingTalonReveal) and ctx().window.GetTime() >= ctx().pendingTalonRevealUntil;
     if (not ctx().needsDraw
         && ((deltaMouse.x != 0.0f or deltaMouse.y != 0.0f)
-            or timeToDraw
+            or isTalonRevealDue
             or r::Mouse::IsButtonPressed(MOUSE_LEFT_BUTTON)
             or r::Mouse::IsButtonReleased(MOUSE_LEFT_BUTTON)
             or r::Mouse::IsButtonDown(MOUSE_LEFT_BUTTON)
@@ -4237,7 +4507,13 @@ auto needsDraw() -> bool
 
 auto updateDrawFrame([[maybe_unused]] void* ud) -> void
 {
+    ctx().isDrawing = true;
+    const auto _ = gsl::finally([] {
+        ctx().isDrawing = false;
+        setIdle(not ctx().needsDraw); // unless the frame asked for the next one
+    });
     if (not needsDraw()) { return; }
+    ctx().needsDraw = false;
     applyPendingTalonReveal();
     if (GuiIsLocked()
         and not ctx().settingsMenu.moving
@@ -4297,7 +4573,7 @@ auto updateDrawFrame([[maybe_unused]] void* ud) -> void
             -static_cast<float>(ctx().target.GetTexture().height)}, // flip vertically
         r::Rectangle{ctx().offsetX, ctx().offsetY, VirtualW * ctx().scale, VirtualH * ctx().scale});
     ctx().window.EndDrawing();
-    ctx().needsDraw = false;
+    if (not std::exchange(ctx().areLazyResourcesFetched, true)) { fetchLazyResources(); }
 }
 
 constexpr auto usage = R"(
@@ -4321,7 +4597,7 @@ auto setMicStatus(std::string status, const bool isError) -> void
     }
     ctx().microphone.status = std::move(status);
     ctx().microphone.isError = isError;
-    ctx().needsDraw = true;
+    requestDraw();
 }
 
 } // namespace pref
@@ -4357,22 +4633,42 @@ int main(const int argc, const char* const argv[])
     pref::loadLang(not std::empty(lang) ? lang : args.at("--language").asString());
     GuiLoadStyleDefault();
     const auto colorScheme = pref::loadFromLocalStorage("color_scheme");
-    pref::loadColorScheme(not std::empty(colorScheme) ? colorScheme : args.at("--color-scheme").asString());
+    const auto defaultColorScheme = args.at("--color-scheme").asString(); // preloaded, the saved one may be fetched
+    pref::loadColorScheme(defaultColorScheme);
+    if (not std::empty(colorScheme) and colorScheme != defaultColorScheme) { pref::loadColorScheme(colorScheme); }
     ctx.initialFont = GuiGetFont();
     pref::loadFonts();
     pref::loadCards();
     const auto resize
         = []([[maybe_unused]] const int eventType, [[maybe_unused]] const auto* e, [[maybe_unused]] void* ud) {
               pref::updateWindowSize();
+              pref::requestDraw();
               return EM_TRUE;
           };
     emscripten_set_resize_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, nullptr, true, resize);
     emscripten_set_fullscreenchange_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, nullptr, true, resize);
+    // raylib listens on the canvas and handles the input itself, we only wake the idle loop to see it
+    const auto wake
+        = []([[maybe_unused]] const int eventType, [[maybe_unused]] const auto* e, [[maybe_unused]] void* ud) {
+              pref::requestDraw();
+              return EM_FALSE;
+          };
+    emscripten_set_mousedown_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, nullptr, true, wake);
+    emscripten_set_mouseup_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, nullptr, true, wake);
+    emscripten_set_mousemove_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, nullptr, true, wake);
+    emscripten_set_wheel_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, nullptr, true, wake);
+    emscripten_set_keydown_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, nullptr, true, wake);
+    emscripten_set_keyup_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, nullptr, true, wake);
+    emscripten_set_touchstart_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, nullptr, true, wake);
+    emscripten_set_touchmove_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, nullptr, true, wake);
+    emscripten_set_touchend_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, nullptr, true, wake);
+    emscripten_set_focus_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, nullptr, true, wake);
     if (not std::empty(ctx.myPlayerId) and not std::empty(ctx.authToken)) {
         ctx.isLoginInProgress = true;
         pref::setupWebsocket();
     }
-    emscripten_set_main_loop_arg(pref::updateDrawFrame, nullptr, 60, true);
+    // on requestAnimationFrame until the first frame finds nothing to draw, see `setIdle`
+    emscripten_set_main_loop_arg(pref::updateDrawFrame, nullptr, 0, true);
     emscripten_websocket_deinitialize();
     return 0;
 }
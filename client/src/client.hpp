@@ -35,6 +35,7 @@ inline constexpr auto BorderMargin = VirtualW / 52.f;
 inline constexpr auto ScrollBarWidth = static_cast<int>(VirtualW / 106.f);
 inline constexpr auto MenuX = VirtualW - CardBorderMargin - CardWidth - CardInnerMargin;
 
+// The build keeps only these glyphs of the icon font, see PREF_ICON_FONT_UNICODES in client/CMakeLists.txt
 inline constexpr auto SettingsIcon = "";
 inline constexpr auto ScoreSheetIcon = "";
 inline constexpr auto EnterFullScreenIcon = "";
@@ -177,15 +178,7 @@ inline constexpr auto PREF_ACE_OF_HEARTS_CARD = 0x1F0B1;
 
 inline constexpr const auto LocalStoragePrefix = "preferans_";
 
-// ♠ - Spades | ♣ - Clubs | ♦ - Diamonds | ♥ - Hearts
 // clang-format off
-inline constexpr auto BidsRank = std::array{
-     PREF_SIX PREF_SPADE,   PREF_SIX PREF_CLUB,   PREF_SIX PREF_DIAMOND,   PREF_SIX PREF_HEART,            PREF_SIX,
-   PREF_SEVEN PREF_SPADE, PREF_SEVEN PREF_CLUB, PREF_SEVEN PREF_DIAMOND, PREF_SEVEN PREF_HEART,          PREF_SEVEN,
-   PREF_EIGHT PREF_SPADE, PREF_EIGHT PREF_CLUB, PREF_EIGHT PREF_DIAMOND, PREF_EIGHT PREF_HEART,          PREF_EIGHT, PREF_MISER,
-    PREF_NINE PREF_SPADE,  PREF_NINE PREF_CLUB,  PREF_NINE PREF_DIAMOND,  PREF_NINE PREF_HEART,           PREF_NINE, PREF_MISER_WT,
-            PREF_NINE_WT,  PREF_TEN PREF_SPADE,      PREF_TEN PREF_CLUB, PREF_TEN PREF_DIAMOND, PREF_TEN PREF_HEART, PREF_TEN, PREF_PASS};
-
 inline constexpr auto BidTable = std::array<std::array<std::string_view, 7>, 6>{
 {{           "",   PREF_SIX PREF_SPADE,   PREF_SIX PREF_CLUB,   PREF_SIX PREF_DIAMOND,   PREF_SIX PREF_HEART,   PREF_SIX, ""},
  {           "", PREF_SEVEN PREF_SPADE, PREF_SEVEN PREF_CLUB, PREF_SEVEN PREF_DIAMOND, PREF_SEVEN PREF_HEART, PREF_SEVEN, ""},
@@ -220,7 +213,7 @@ enum class GameLang : std::size_t {
     PREF_X(Amber, "Amber", "Бурштин", "Янтарь")                                                                        \
     PREF_X(Bluish, "Bluish", "Блакитний", "Голубоватый")                                                               \
     PREF_X(Catch, PREF_CATCH, "Ловлю", "Ловлю")                                                                        \
-    PREF_X(Closed, "Closed", "У темну", "Втёмную")                                                                     \
+    PREF_X(Closed, PREF_CLOSED, "У темну", "Втёмную")                                                                  \
     PREF_X(ColorScheme, "Color scheme", "Кольорова схема", "Цветовая схема")                                           \
     PREF_X(ConfirmTitle, "CONFIRM", "ПІДТВЕРДИТИ", "ПОДТВЕРДИТЬ")                                                       \
     PREF_X(CurrentPlayers, "Current players:", "Поточні гравці:", "Текущие игроки:")                                   \
@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+
+# SPDX-License-Identifier: AGPL-3.0-only
+# Copyright (c) 2025 Oleksandr Kozlov
+
+"""Packs the card faces into the one texture the client draws them from.
+
+Usage: pack-cards.py <faces> <atlas.png> --width=<px> --height=<px> [--gutter=<px>] [--scale=<n>]
+
+Every face is resized to width x height times the scale, and placed in a row
+per suit and a column per rank, in the order of Suit and Rank in
+common/common.hpp. A transparent gutter surrounds each face, so that the
+filtering of one doesn't bleed the edges of its neighbours.
+"""
+
+import os
+import sys
+
+from PIL import Image
+
+SUITS = ['spades', 'clubs', 'diamonds', 'hearts']
+RANKS = ['7', '8', '9', '10', 'jack', 'queen', 'king', 'ace']
+
+
+def parse_options(argv):
+    args = [arg for arg in argv if not arg.startswith('--')]
+    options = dict(arg[2:].split('=', 1) for arg in argv if arg.startswith('--') and '=' in arg)
+    return args, options
+
+
+def main(argv):
+    args, options = parse_options(argv)
+    if len(args) != 2 or 'width' not in options or 'height' not in options:
+        print(__doc__, file=sys.stderr)
+        return 2
+    faces, atlas = args
+    scale = int(options.get('scale', 1))
+    width, height = int(options['width']) * scale, int(options['height']) * scale
+    gutter = int(options.get('gutter', 0)) * scale
+    cell_width, cell_height = width + 2 * gutter, height + 2 * gutter
+    result = Image.new('RGBA', (cell_width * len(RANKS), cell_height * len(SUITS)), (0, 0, 0, 0))
+    for row, suit in enumerate(SUITS):
+        for column, rank in enumerate(RANKS):
+            with Image.open(os.path.join(faces, f'{rank}_of_{suit}.png')) as face:
+                face = face.convert('RGBA').resize((width, height), Image.Resampling.LANCZOS)
+                result.paste(face, (column * cell_width + gutter, row * cell_height + gutter))
+    os.makedirs(os.path.dirname(os.path.abspath(atlas)), exist_ok=True)
+    result.save(atlas, optimize=True)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
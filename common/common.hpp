@@ -11,17 +11,26 @@
 #include <fmt/format.h>
 #include <fmt/ranges.h>
 #include <fmt/std.h>
+#include <google/protobuf/io/coded_stream.h>
 #include <range/v3/all.hpp>
 
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cctype>
+#include <cstddef>
 #include <cstdint>
 #include <filesystem>
 #include <fstream>
+#include <initializer_list>
+#include <iterator>
 #include <map>
 #include <optional>
 #include <span>
+#include <stdexcept>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <utility>
 
 namespace pref {
@@ -68,6 +77,7 @@ inline constexpr std::string_view DiamondSign = PREF_DIAMOND;
 #define PREF_CATCH "Catch"
 #define PREF_TRUST "Trust"
 #define PREF_OPENLY "Openly"
+#define PREF_CLOSED "Closed"
 
 #define PREF_OF_ "_of_"
 
@@ -138,38 +148,423 @@ using ScoreSheet = std::map<PlayerId, Score>;
 using FinalScore = std::map<PlayerId, FinalScoreEntry>;
 using FinalResult = std::map<PlayerId, std::int32_t>;
 
-[[nodiscard]] inline auto cardSuit(const std::string_view card) -> std::string
+enum class Suit : std::uint8_t {
+    Spades,
+    Clubs,
+    Diamonds,
+    Hearts,
+};
+
+enum class Rank : std::uint8_t {
+    Seven,
+    Eight,
+    Nine,
+    Ten,
+    Jack,
+    Queen,
+    King,
+    Ace,
+};
+
+inline constexpr auto SuitsCount = 4uz;
+inline constexpr auto RanksCount = 8uz;
+inline constexpr auto DeckSize = SuitsCount * RanksCount;
+
+inline constexpr auto SuitNames = std::array<std::string_view, SuitsCount>{
+    PREF_SPADES,
+    PREF_CLUBS,
+    PREF_DIAMONDS,
+    PREF_HEARTS,
+};
+
+inline constexpr auto RankNames = std::array<std::string_view, RanksCount>{
+    PREF_SEVEN,
+    PREF_EIGHT,
+    PREF_NINE,
+    PREF_TEN,
+    PREF_JACK,
+    PREF_QUEEN,
+    PREF_KING,
+    PREF_ACE,
+};
+
+// A card is its index in the deck: suit * RanksCount + rank. String names are only used on the wire and in logs
+enum class CardId : std::uint8_t {};
+
+[[nodiscard]] constexpr auto makeCard(const Rank rank, const Suit suit) noexcept -> CardId
+{
+    return static_cast<CardId>((std::to_underlying(suit) * RanksCount) + std::to_underlying(rank));
+}
+
+[[nodiscard]] constexpr auto suitOf(const CardId card) noexcept -> Suit
+{
+    return static_cast<Suit>(std::to_underlying(card) / RanksCount);
+}
+
+[[nodiscard]] constexpr auto rankOf(const CardId card) noexcept -> Rank
+{
+    return static_cast<Rank>(std::to_underlying(card) % RanksCount);
+}
+
+[[nodiscard]] constexpr auto suitName(const Suit suit) noexcept -> std::string_view
+{
+    return SuitNames[std::to_underlying(suit)];
+}
+
+[[nodiscard]] constexpr auto rankName(const Rank rank) noexcept -> std::string_view
+{
+    return RankNames[std::to_underlying(rank)];
+}
+
+[[nodiscard]] constexpr auto toSuit(const std::string_view name) noexcept -> std::optional<Suit>
+{
+    const auto it = std::ranges::find(SuitNames, name);
+    if (it == std::ranges::end(SuitNames)) { return std::nullopt; }
+    return static_cast<Suit>(std::ranges::distance(std::ranges::begin(SuitNames), it));
+}
+
+[[nodiscard]] constexpr auto toRank(const std::string_view name) noexcept -> std::optional<Rank>
+{
+    const auto it = std::ranges::find(RankNames, name);
+    if (it == std::ranges::end(RankNames)) { return std::nullopt; }
+    return static_cast<Rank>(std::ranges::distance(std::ranges::begin(RankNames), it));
+}
+
+[[nodiscard]] inline auto toCardName(const CardId card) -> CardName
+{
+    return fmt::format("{}" PREF_OF_ "{}", rankName(rankOf(card)), suitName(suitOf(card)));
+}
+
+[[nodiscard]] constexpr auto toCardId(const CardNameView name) noexcept -> std::optional<CardId>
+{
+    const auto pos = name.find(PREF_OF_);
+    if (pos == CardNameView::npos) { return std::nullopt; }
+    const auto rank = toRank(name.substr(0, pos));
+    const auto suit = toSuit(name.substr(pos + std::size(std::string_view{PREF_OF_})));
+    if (not rank or not suit) { return std::nullopt; }
+    return makeCard(*rank, *suit);
+}
+
+// NOLINTNEXTLINE(readability-identifier-naming)
+[[maybe_unused]] inline auto format_as(const CardId card) -> CardName
+{
+    return toCardName(card);
+}
+
+// NOLINTNEXTLINE(readability-identifier-naming)
+[[maybe_unused]] constexpr auto format_as(const Suit suit) noexcept -> std::string_view
+{
+    return suitName(suit);
+}
+
+// A set of cards as a bitmask indexed by CardId, iterated in the CardId order
+class CardMask {
+public:
+    class Iterator {
+    public:
+        using value_type = CardId;
+        using difference_type = std::ptrdiff_t;
+        using iterator_concept = std::forward_iterator_tag;
+
+        constexpr Iterator() noexcept = default;
+        constexpr explicit Iterator(const std::uint32_t bits) noexcept
+            : m_bits{bits}
+        {
+        }
+
+        [[nodiscard]] constexpr auto operator*() const noexcept -> CardId
+        {
+            return static_cast<CardId>(std::countr_zero(m_bits));
+        }
+
+        constexpr auto operator++() noexcept -> Iterator&
+        {
+            m_bits &= m_bits - 1; // drop the lowest card
+            return *this;
+        }
+
+        constexpr auto operator++(int) noexcept -> Iterator
+        {
+            auto result = *this;
+            ++*this;
+            return result;
+        }
+
+        [[nodiscard]] constexpr auto operator==(const Iterator&) const noexcept -> bool = default;
+
+    private:
+        std::uint32_t m_bits{};
+    };
+
+    constexpr CardMask() noexcept = default;
+    constexpr explicit CardMask(const std::uint32_t bits) noexcept
+        : m_bits{bits}
+    {
+    }
+    constexpr CardMask(const std::initializer_list<CardId> cards) noexcept
+    {
+        for (const auto card : cards) { insert(card); }
+    }
+
+    [[nodiscard]] static constexpr auto of(const Suit suit) noexcept -> CardMask
+    {
+        return CardMask{0xFFu << (std::to_underlying(suit) * RanksCount)};
+    }
+
+    [[nodiscard]] constexpr auto bits() const noexcept -> std::uint32_t
+    {
+        return m_bits;
+    }
+
+    [[nodiscard]] constexpr auto empty() const noexcept -> bool
+    {
+        return m_bits == 0;
+    }
+
+    [[nodiscard]] constexpr auto size() const noexcept -> std::size_t
+    {
+        return static_cast<std::size_t>(std::popcount(m_bits));
+    }
+
+    [[nodiscard]] constexpr auto contains(const CardId card) const noexcept -> bool
+    {
+        return (m_bits & bit(card)) != 0;
+    }
+
+    constexpr auto insert(const CardId card) noexcept -> void
+    {
+        m_bits |= bit(card);
+    }
+
+    constexpr auto erase(const CardId card) noexcept -> void
+    {
+        m_bits &= ~bit(card);
+    }
+
+    constexpr auto clear() noexcept -> void
+    {
+        m_bits = 0;
+    }
+
+    [[nodiscard]] constexpr auto begin() const noexcept -> Iterator
+    {
+        return Iterator{m_bits};
+    }
+
+    [[nodiscard]] constexpr auto end() const noexcept -> Iterator
+    {
+        return Iterator{};
+    }
+
+    [[nodiscard]] constexpr auto operator|(const CardMask other) const noexcept -> CardMask
+    {
+        return CardMask{m_bits | other.m_bits};
+    }
+
+    [[nodiscard]] constexpr auto operator&(const CardMask other) const noexcept -> CardMask
+    {
+        return CardMask{m_bits & other.m_bits};
+    }
+
+    [[nodiscard]] constexpr auto operator-(const CardMask other) const noexcept -> CardMask
+    {
+        return CardMask{m_bits & ~other.m_bits};
+    }
+
+    [[nodiscard]] constexpr auto operator==(const CardMask&) const noexcept -> bool = default;
+
+private:
+    [[nodiscard]] static constexpr auto bit(const CardId card) noexcept -> std::uint32_t
+    {
+        return 1u << std::to_underlying(card);
+    }
+
+    std::uint32_t m_bits{};
+};
+
+static_assert(DeckSize <= 32, "CardMask fits the whole deck");
+
+template<typename Range>
+[[nodiscard]] constexpr auto toCardMask(Range&& cards) noexcept -> CardMask
+{
+    auto result = CardMask{};
+    for (const CardId card : std::forward<Range>(cards)) { result.insert(card); }
+    return result;
+}
+
+[[nodiscard]] inline auto toCardsNames(const auto& cards) -> CardsNames
+{
+    return cards | rv::transform(&toCardName) | rng::to_vector;
+}
+
+[[nodiscard]] constexpr auto cardSuit(const CardNameView card) noexcept -> std::string_view
+{
+    return card.substr(card.find(PREF_OF_) + std::size(std::string_view{PREF_OF_}));
+}
+
+[[nodiscard]] constexpr auto cardRank(const CardNameView card) noexcept -> std::string_view
 {
-    return std::string{card.substr(card.find(PREF_OF_) + 4)};
+    return card.substr(0, card.find(PREF_OF_));
 }
 
-[[nodiscard]] inline auto cardRank(const std::string_view card) -> std::string
+[[nodiscard]] constexpr auto rankValue(const std::string_view rank) noexcept -> int
 {
-    return std::string{card.substr(0, card.find(PREF_OF_))};
+    return toRank(rank).transform([](const Rank r) { return std::to_underlying(r) + 1; }).value_or(0);
 }
 
-[[nodiscard]] inline auto rankValue(const std::string_view rank) -> int
+// ♠ - Spades | ♣ - Clubs | ♦ - Diamonds | ♥ - Hearts
+// clang-format off
+inline constexpr auto BidsRank = std::array{
+     PREF_SIX PREF_SPADE,   PREF_SIX PREF_CLUB,   PREF_SIX PREF_DIAMOND,   PREF_SIX PREF_HEART,            PREF_SIX,
+   PREF_SEVEN PREF_SPADE, PREF_SEVEN PREF_CLUB, PREF_SEVEN PREF_DIAMOND, PREF_SEVEN PREF_HEART,          PREF_SEVEN,
+   PREF_EIGHT PREF_SPADE, PREF_EIGHT PREF_CLUB, PREF_EIGHT PREF_DIAMOND, PREF_EIGHT PREF_HEART,          PREF_EIGHT, PREF_MISER,
+    PREF_NINE PREF_SPADE,  PREF_NINE PREF_CLUB,  PREF_NINE PREF_DIAMOND,  PREF_NINE PREF_HEART,           PREF_NINE, PREF_MISER_WT,
+            PREF_NINE_WT,  PREF_TEN PREF_SPADE,      PREF_TEN PREF_CLUB, PREF_TEN PREF_DIAMOND, PREF_TEN PREF_HEART, PREF_TEN, PREF_PASS};
+// clang-format on
+
+namespace detail {
+
+struct BidTraits {
+    std::optional<Suit> trump{};
+    int level{}; // 6 to 10, none for a miser and a pass
+    bool isMiser{};
+    bool isWithoutTalon{};
+    bool isPass{};
+};
+
+// The only place a bid's text is taken apart, for the table of them below
+[[nodiscard]] constexpr auto makeBidTraits(const std::string_view bid) noexcept -> BidTraits
+{
+    auto result = BidTraits{
+        .isMiser = bid.starts_with(PREF_MIS), .isWithoutTalon = bid.contains(PREF_WT), .isPass = bid == PREF_PASS};
+    if (result.isMiser or result.isPass) { return result; }
+    result.level = bid.starts_with(PREF_TEN) ? 10 : bid.front() - '0';
+    if (bid.contains(PREF_SPADE)) { result.trump = Suit::Spades; }
+    if (bid.contains(PREF_CLUB)) { result.trump = Suit::Clubs; }
+    if (bid.contains(PREF_DIAMOND)) { result.trump = Suit::Diamonds; }
+    if (bid.contains(PREF_HEART)) { result.trump = Suit::Hearts; }
+    return result;
+}
+
+// By code, the first one is for no bid
+inline constexpr auto BidTable = [] {
+    auto result = std::array<BidTraits, std::size(BidsRank) + 1>{};
+    for (auto i = 0uz; i < std::size(BidsRank); ++i) { result[i + 1] = makeBidTraits(BidsRank[i]); }
+    return result;
+}();
+
+} // namespace detail
+
+// A bid as its code, the position in BidsRank plus one like the wire BidCode, and 0 before the first bid. Bids
+// compare as their codes, so a higher bid is a greater one, and what a bid is made of is a look-up of its code
+class Bid {
+public:
+    constexpr Bid() noexcept = default;
+
+    // From a bid literal, e.g. `bid == PREF_PASS`, which fails to compile for an unknown one
+    // NOLINTNEXTLINE(google-explicit-constructor, hicpp-explicit-conversions)
+    consteval Bid(const char* const text)
+        : m_code{codeOf(text)}
+    {
+        if (m_code == 0) { throw std::invalid_argument{"unknown bid"}; }
+    }
+
+    // No bid for an empty or an unknown text
+    [[nodiscard]] static constexpr auto parse(const std::string_view text) noexcept -> Bid
+    {
+        return fromCode(codeOf(text));
+    }
+
+    // No bid for NO_BID or an unknown code
+    [[nodiscard]] static constexpr auto fromCode(const int code) noexcept -> Bid
+    {
+        auto result = Bid{};
+        if (code > 0 and code <= static_cast<int>(std::size(BidsRank))) { result.m_code = static_cast<Code>(code); }
+        return result;
+    }
+
+    [[nodiscard]] constexpr auto code() const noexcept -> BidCode
+    {
+        return static_cast<BidCode>(m_code);
+    }
+
+    // The position in BidsRank, std::size(BidsRank) for no bid
+    [[nodiscard]] constexpr auto rank() const noexcept -> std::size_t
+    {
+        return empty() ? std::size(BidsRank) : std::size_t{m_code} - 1;
+    }
+
+    [[nodiscard]] constexpr auto text() const noexcept -> std::string_view
+    {
+        return empty() ? std::string_view{} : BidsRank[rank()];
+    }
+
+    [[nodiscard]] constexpr auto empty() const noexcept -> bool
+    {
+        return m_code == 0;
+    }
+
+    [[nodiscard]] constexpr auto isPass() const noexcept -> bool
+    {
+        return traits().isPass;
+    }
+
+    [[nodiscard]] constexpr auto isMiser() const noexcept -> bool
+    {
+        return traits().isMiser;
+    }
+
+    [[nodiscard]] constexpr auto isWithoutTalon() const noexcept -> bool
+    {
+        return traits().isWithoutTalon;
+    }
+
+    // 6 to 10 for a contract, 0 for a miser, a pass and no bid
+    [[nodiscard]] constexpr auto level() const noexcept -> int
+    {
+        return traits().level;
+    }
+
+    [[nodiscard]] constexpr auto trump() const noexcept -> std::optional<Suit>
+    {
+        return traits().trump;
+    }
+
+    friend constexpr auto operator==(Bid, Bid) noexcept -> bool = default;
+    friend constexpr auto operator<=>(Bid, Bid) noexcept = default;
+
+private:
+    using Code = std::uint8_t;
+
+    [[nodiscard]] static constexpr auto codeOf(const std::string_view text) noexcept -> Code
+    {
+        const auto it = std::ranges::find(BidsRank, text);
+        return (it == std::ranges::end(BidsRank)) ? Code{} : static_cast<Code>(it - std::ranges::begin(BidsRank) + 1);
+    }
+
+    [[nodiscard]] constexpr auto traits() const noexcept -> const detail::BidTraits&
+    {
+        return detail::BidTable[m_code];
+    }
+
+    Code m_code{};
+};
+
+// In the order of BidsRank
+inline constexpr auto AllBids = [] {
+    auto result = std::array<Bid, std::size(BidsRank)>{};
+    for (auto i = 0uz; i < std::size(result); ++i) { result[i] = Bid::fromCode(static_cast<int>(i) + 1); }
+    return result;
+}();
+
+[[maybe_unused]] constexpr auto format_as(const Bid bid) noexcept -> std::string_view
 {
-    static const auto rankMap = std::map<std::string_view, int>{
-        {PREF_ACE, 8},
-        {PREF_KING, 7},
-        {PREF_QUEEN, 6},
-        {PREF_JACK, 5},
-        {PREF_TEN, 4},
-        {PREF_NINE, 3},
-        {PREF_EIGHT, 2},
-        {PREF_SEVEN, 1}};
-    return rankMap.at(rank);
+    return bid.text();
 }
 
 [[nodiscard]] constexpr auto getTrump(const std::string_view bid) noexcept -> std::string_view
 {
-    if (bid.contains(PREF_WT) or bid.contains(PREF_MIS) or bid.contains(PREF_PASS)) { return {}; }
-    if (bid.contains(PREF_SPADE)) { return PREF_SPADES; }
-    if (bid.contains(PREF_CLUB)) { return PREF_CLUBS; }
-    if (bid.contains(PREF_HEART)) { return PREF_HEARTS; }
-    if (bid.contains(PREF_DIAMOND)) { return PREF_DIAMONDS; }
-    return {};
+    return Bid::parse(bid).trump().transform(&suitName).value_or(std::string_view{});
 }
 
 enum class Progression {
@@ -307,68 +702,145 @@ template<typename Range, typename Pred, typename ProjIn = rng::identity, typenam
     })) | rng::to<FinalScore>; // clang-format on
 }
 
-template<typename T>
+// clang-format off
+#define PREF_MESSAGE_METHODS \
+    PREF_X(AudioSignal, audio_signal) \
+    PREF_X(AuthRequest, auth_request) \
+    PREF_X(AuthResponse, auth_response) \
+    PREF_X(Batch, batch) \
+    PREF_X(Bidding, bidding) \
+    PREF_X(DealCards, deal_cards) \
+    PREF_X(DealFinished, deal_finished) \
+    PREF_X(DiscardTalon, discard_talon) \
+    PREF_X(Forehand, forehand) \
+    PREF_X(GameSnapshot, game_snapshot) \
+    PREF_X(GameState, game_state) \
+    PREF_X(HowToPlay, how_to_play) \
+    PREF_X(Log, log) \
+    PREF_X(LoginRequest, login_request) \
+    PREF_X(LoginResponse, login_response) \
+    PREF_X(Logout, logout) \
+    PREF_X(MakeOffer, make_offer) \
+    PREF_X(MiserCards, miser_cards) \
+    PREF_X(OpenTalon, open_talon) \
+    PREF_X(OpenWhistPlay, open_whist_play) \
+    PREF_X(PingPong, ping_pong) \
+    PREF_X(PlayCard, play_card) \
+    PREF_X(PlayerJoined, player_joined) \
+    PREF_X(PlayerLeft, player_left) \
+    PREF_X(PlayerTurn, player_turn) \
+    PREF_X(ReadyCheck, ready_check) \
+    PREF_X(SpectateRequest, spectate_request) \
+    PREF_X(SpeechBubble, speech_bubble) \
+    PREF_X(TrickFinished, trick_finished) \
+    PREF_X(UserGames, user_games) \
+    PREF_X(UserGamesRequest, user_games_request) \
+    PREF_X(Whisting, whisting)
+// clang-format on
+
+// Maps a method type to its member of the `Message.body` oneof
+template<typename Method>
+struct MethodTraits;
+
+#define PREF_X(Type, field)                                                                                            \
+    template<>                                                                                                         \
+    struct MethodTraits<Type> {                                                                                        \
+        static constexpr auto name = std::string_view{#Type};                                                          \
+        static constexpr auto tag = Message::k##Type;                                                                  \
+        [[nodiscard]] static auto get(const Message& msg) -> const Type&                                               \
+        {                                                                                                              \
+            return msg.field();                                                                                        \
+        }                                                                                                              \
+        [[nodiscard]] static auto mutableOf(Message& msg) -> Type*                                                     \
+        {                                                                                                              \
+            return msg.mutable_##field();                                                                              \
+        }                                                                                                              \
+    };
+PREF_MESSAGE_METHODS
+#undef PREF_X
+
+// the size of a table indexed by Message::BodyCase
+inline constexpr auto MessageTagsCount = 1uz + static_cast<std::size_t>(std::max({
+#define PREF_X(Type, field) static_cast<int>(Message::k##Type),
+    PREF_MESSAGE_METHODS
+#undef PREF_X
+}));
+
+template<typename Method>
 [[nodiscard]] constexpr auto methodName() noexcept -> std::string_view
 {
-    return "Unknown";
+    return MethodTraits<Method>::name;
 }
 
-#define PREF_DEFINE_METHOD_NAME(Type)                                                                                  \
-    template<>                                                                                                         \
-    [[nodiscard]]                                                                                                      \
-    constexpr auto methodName<Type>() noexcept -> std::string_view                                                     \
-    {                                                                                                                  \
-        return #Type;                                                                                                  \
-    }
-
-PREF_DEFINE_METHOD_NAME(AuthRequest)
-PREF_DEFINE_METHOD_NAME(AuthResponse)
-PREF_DEFINE_METHOD_NAME(Bidding)
-PREF_DEFINE_METHOD_NAME(DealCards)
-PREF_DEFINE_METHOD_NAME(DealFinished)
-PREF_DEFINE_METHOD_NAME(DiscardTalon)
-PREF_DEFINE_METHOD_NAME(Forehand)
-PREF_DEFINE_METHOD_NAME(GameState)
-PREF_DEFINE_METHOD_NAME(HowToPlay)
-PREF_DEFINE_METHOD_NAME(Log)
-PREF_DEFINE_METHOD_NAME(LoginRequest)
-PREF_DEFINE_METHOD_NAME(LoginResponse)
-PREF_DEFINE_METHOD_NAME(Logout)
-PREF_DEFINE_METHOD_NAME(MakeOffer)
-PREF_DEFINE_METHOD_NAME(MiserCards)
-PREF_DEFINE_METHOD_NAME(OpenTalon)
-PREF_DEFINE_METHOD_NAME(OpenWhistPlay)
-PREF_DEFINE_METHOD_NAME(PingPong)
-PREF_DEFINE_METHOD_NAME(PlayCard)
-PREF_DEFINE_METHOD_NAME(PlayerJoined)
-PREF_DEFINE_METHOD_NAME(PlayerLeft)
-PREF_DEFINE_METHOD_NAME(PlayerTurn)
-PREF_DEFINE_METHOD_NAME(ReadyCheck)
-PREF_DEFINE_METHOD_NAME(SpeechBubble)
-PREF_DEFINE_METHOD_NAME(TrickFinished)
-PREF_DEFINE_METHOD_NAME(UserGames)
-PREF_DEFINE_METHOD_NAME(Whisting)
-PREF_DEFINE_METHOD_NAME(AudioSignal)
+[[nodiscard]] constexpr auto methodName(const Message::BodyCase tag) noexcept -> std::string_view
+{
+    switch (tag) {
+#define PREF_X(Type, field)                                                                                            \
+    case Message::k##Type: return methodName<Type>();
+        PREF_MESSAGE_METHODS
+#undef PREF_X
+    case Message::BODY_NOT_SET: break;
+    }
+    return "Unknown";
+}
 
 template<typename Method>
 [[nodiscard]] auto makeMessage(const Method& method) -> Message
 {
     auto result = Message{};
-    result.set_method(std::string{methodName<Method>()});
-    result.set_payload(method.SerializeAsString());
+    *MethodTraits<Method>::mutableOf(result) = method;
     return result;
 }
 
 template<typename Method>
-[[nodiscard]] auto makeMethod(const Message& msg) -> std::optional<Method>
+    requires(not std::is_lvalue_reference_v<Method>)
+[[nodiscard]] auto makeMessage(Method&& method) -> Message
 {
-    auto result = Method{};
-    if (not result.ParseFromString(msg.payload())) {
-        const auto error = fmt::format("failed to make {} from string", methodName<Method>());
+    auto result = Message{};
+    *MethodTraits<Method>::mutableOf(result) = std::move(method);
+    return result;
+}
+
+// The serialized Message of the method, without building the envelope: its only field is the method, so it's the
+// method's tag and size followed by the method, written into a string of the exact size at once
+template<typename Method>
+[[nodiscard]] auto serializeMessage(const Method& method) -> std::string
+{
+    using Coded = google::protobuf::io::CodedOutputStream;
+    static constexpr auto lengthDelimited = 2u;
+    const auto key = (static_cast<std::uint32_t>(MethodTraits<Method>::tag) << 3) | lengthDelimited;
+    const auto size = method.ByteSizeLong();
+    auto result = std::string(Coded::VarintSize32(key) + Coded::VarintSize64(size) + size, '\0');
+    auto* out = reinterpret_cast<std::uint8_t*>(std::data(result));
+    out = Coded::WriteVarint32ToArray(key, out);
+    out = Coded::WriteVarint64ToArray(size, out);
+    method.SerializeWithCachedSizesToArray(out);
+    return result;
+}
+
+// the method is already parsed together with the envelope, so it's only a view into `msg`
+template<typename Method>
+[[nodiscard]] auto makeMethod(const Message& msg) -> const Method*
+{
+    if (msg.body_case() != MethodTraits<Method>::tag) {
+        const auto error = fmt::format("expected {}, got {}", methodName<Method>(), methodName(msg.body_case()));
         PREF_DW(error);
-        return {};
+        return nullptr;
     }
-    return result;
+    return &MethodTraits<Method>::get(msg);
+}
+
+// `sign` is -1 to take back a game that is about to be replaced
+inline auto addToTotals(UserGamesTotals& totals, const UserGame& game, const int sign = 1) -> void
+{
+    totals.set_games(totals.games() + sign);
+    totals.set_wins(totals.wins() + (game.mmr() > 0 ? sign : 0));
+    totals.set_losses(totals.losses() + (game.mmr() < 0 ? sign : 0));
+    totals.set_duration(totals.duration() + sign * game.duration());
+    totals.set_pool(totals.pool() + sign * game.pool());
+    totals.set_dump(totals.dump() + sign * game.dump());
+    totals.set_whists(totals.whists() + sign * game.whists());
+    totals.set_mmr(totals.mmr() + sign * game.mmr());
 }
 
 template<typename T>
@@ -58,12 +58,56 @@ inline constexpr auto FormatString = std::invoke([] {
 template<>
 inline constexpr std::array<char, 0> FormatString<0>;
 
+// A variable of a log line, formatted as `name: value` only when the line is logged
+template<typename T>
+struct LogVar {
+    std::string_view name;
+    const T& value;
+};
+
+template<typename T>
+LogVar(std::string_view, const T&) -> LogVar<T>;
+
+// Formatted as `, name: value` when it's shown, and as nothing otherwise
+template<typename T>
+struct MaybeLogVar {
+    LogVar<T> var;
+    bool isShown{};
+};
+
 } // namespace pref
 
+template<typename T>
+struct fmt::formatter<pref::LogVar<T>> {
+    constexpr auto parse(fmt::format_parse_context& ctx)
+    {
+        return ctx.begin();
+    }
+
+    auto format(const pref::LogVar<T>& var, fmt::format_context& ctx) const
+    {
+        return fmt::format_to(ctx.out(), "{}: {}", var.name, var.value);
+    }
+};
+
+template<typename T>
+struct fmt::formatter<pref::MaybeLogVar<T>> {
+    constexpr auto parse(fmt::format_parse_context& ctx)
+    {
+        return ctx.begin();
+    }
+
+    auto format(const pref::MaybeLogVar<T>& maybe, fmt::format_context& ctx) const
+    {
+        if (not maybe.isShown) { return ctx.out(); }
+        return fmt::format_to(ctx.out(), ", {}", maybe.var);
+    }
+};
+
 // clang-format off
-#define PREF_V(var) fmt::format("{}: {}", #var, var) // PREF VAR
-#define PREF_M(value) (not std::empty(value) ? fmt::format(", {}", PREF_V(value)) : "") // PREF (VAR) MAYBE
-#define PREF_B(value) ((value) ? fmt::format(", {}", PREF_V(value)) : "") // PREF (VAR) BOOL
+#define PREF_V(var) pref::LogVar{#var, var} // PREF VAR
+#define PREF_M(value) pref::MaybeLogVar{PREF_V(value), not std::empty(value)} // PREF (VAR) MAYBE
+#define PREF_B(value) pref::MaybeLogVar{PREF_V(value), static_cast<bool>(value)} // PREF (VAR) BOOL
 #define PREF_APPLY_0
 #define PREF_APPLY_1(arg) PREF_V(arg)
 #define PREF_APPLY_2(arg, ...) PREF_V(arg), PREF_APPLY_1(__VA_ARGS__)
@@ -77,9 +121,21 @@ inline constexpr std::array<char, 0> FormatString<0>;
 #define PREF_APPLY(...) PREF_GET_MACRO(__VA_ARGS__, PREF_APPLY_8, PREF_APPLY_7, PREF_APPLY_6, PREF_APPLY_5, PREF_APPLY_4, PREF_APPLY_3, PREF_APPLY_2, PREF_APPLY_1, PREF_APPLY_0) (__VA_ARGS__)
 // clang-format on
 
-#define PREF_I(...) SPDLOG_INFO(__VA_ARGS__ __VA_OPT__(, ) "") // PREF INFO
-#define PREF_W(...) SPDLOG_WARN(__VA_ARGS__ __VA_OPT__(, ) "") // PREF WARNING
-#define PREF_E(...) SPDLOG_ERROR(__VA_ARGS__ __VA_OPT__(, ) "") // PREF ERROR
+// The levels below SPDLOG_ACTIVE_LEVEL are compiled out, yet their arguments stay checked and used. Above it the
+// arguments are formatted only if the logger's level lets the line through
+#define PREF_LOG(severity, ...)                                                                                        \
+    do {                                                                                                               \
+        if constexpr (SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_##severity) {                                                \
+            SPDLOG_LOGGER_CALL(                                                                                        \
+                spdlog::default_logger_raw(),                                                                          \
+                static_cast<spdlog::level::level_enum>(SPDLOG_LEVEL_##severity),                                       \
+                __VA_ARGS__);                                                                                          \
+        }                                                                                                              \
+    } while (false)
+
+#define PREF_I(...) PREF_LOG(INFO, __VA_ARGS__ __VA_OPT__(, ) "") // PREF INFO
+#define PREF_W(...) PREF_LOG(WARN, __VA_ARGS__ __VA_OPT__(, ) "") // PREF WARNING
+#define PREF_E(...) PREF_LOG(ERROR, __VA_ARGS__ __VA_OPT__(, ) "") // PREF ERROR
 
 #define PREF_DUMP(level, ...)                                                                                          \
     level(                                                                                                             \
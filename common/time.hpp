@@ -24,9 +24,14 @@ namespace pref {
         .count();
 }
 
+[[nodiscard]] inline auto utcTimeSinceEpochInSec() -> std::int64_t
+{
+    return date::floor<std::chrono::seconds>(std::chrono::system_clock::now()).time_since_epoch().count();
+}
+
 [[nodiscard]] inline auto localTimeSinceEpochInSec() -> std::int64_t
 {
-    return toLocalTime(date::floor<std::chrono::seconds>(std::chrono::system_clock::now()).time_since_epoch().count());
+    return toLocalTime(utcTimeSinceEpochInSec());
 }
 
 [[nodiscard]] inline auto durationInSec(const std::int64_t start) -> std::int32_t
@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: AGPL-3.0-only
+// Copyright (c) 2025 Oleksandr Kozlov
+
+#pragma once
+
+#include "common/common.hpp"
+#include "proto/pref.pb.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+namespace pref {
+
+// The proto Card is CardId + 1 so that NO_CARD stays the default value
+static_assert(Card::SEVEN_OF_SPADES == 1 + std::to_underlying(makeCard(Rank::Seven, Suit::Spades)));
+static_assert(Card::ACE_OF_CLUBS == 1 + std::to_underlying(makeCard(Rank::Ace, Suit::Clubs)));
+static_assert(Card::TEN_OF_DIAMONDS == 1 + std::to_underlying(makeCard(Rank::Ten, Suit::Diamonds)));
+static_assert(Card::ACE_OF_HEARTS == DeckSize);
+static_assert(BidCode::BID_PASS == std::size(BidsRank));
+
+[[nodiscard]] constexpr auto toWireCard(const CardId card) noexcept -> Card
+{
+    return static_cast<Card>(std::to_underlying(card) + 1);
+}
+
+[[nodiscard]] constexpr auto fromWireCard(const int card) noexcept -> std::optional<CardId>
+{
+    if (card <= Card::NO_CARD or card > static_cast<int>(DeckSize)) { return std::nullopt; }
+    return static_cast<CardId>(card - 1);
+}
+
+[[nodiscard]] constexpr auto toWireHand(const CardMask hand) noexcept -> std::uint32_t
+{
+    return hand.bits();
+}
+
+[[nodiscard]] constexpr auto fromWireHand(const std::uint32_t hand) noexcept -> CardMask
+{
+    return CardMask{hand};
+}
+
+// NO_BID for an empty or an unknown bid
+[[nodiscard]] constexpr auto toBidCode(const std::string_view bid) noexcept -> BidCode
+{
+    return Bid::parse(bid).code();
+}
+
+// an empty string for NO_BID or an unknown code
+[[nodiscard]] constexpr auto fromBidCode(const int code) noexcept -> std::string_view
+{
+    return Bid::fromCode(code).text();
+}
+
+// A peer may send either encoding regardless of the negotiated one: a set compact field wins over the string
+[[nodiscard]] constexpr auto parseCard(const CardNameView name, const int card) noexcept -> std::optional<CardId>
+{
+    return (card != Card::NO_CARD) ? fromWireCard(card) : toCardId(name);
+}
+
+[[nodiscard]] constexpr auto parseBid(const std::string_view bid, const int code) noexcept -> Bid
+{
+    return (code != BidCode::NO_BID) ? Bid::fromCode(code) : Bid::parse(bid);
+}
+
+[[nodiscard]] constexpr auto parseHand(const auto& names, const std::uint32_t hand) -> CardMask
+{
+    if (hand != 0) { return fromWireHand(hand); }
+    auto result = CardMask{};
+    for (const auto& name : names) {
+        if (const auto card = toCardId(name)) { result.insert(*card); }
+    }
+    return result;
+}
+
+} // namespace pref
@@ -0,0 +1,526 @@
+// SPDX-License-Identifier: AGPL-3.0-only
+// Copyright (c) 2025 Oleksandr Kozlov
+
+#pragma once
+
+#include "common/common.hpp"
+#include "rules.hpp"
+#include "solver.hpp"
+#include "transport.hpp"
+
+#include <exec/async_scope.hpp>
+#include <exec/static_thread_pool.hpp>
+#include <stdexec/execution.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iterator>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace pref {
+
+// A deal from one player's side: its own hand and the hands shown to it are known, the others only by their sizes
+// and by the suits they have shown out of
+struct BotView {
+    using Seat = DealPosition::Seat;
+    using Hands = std::array<CardMask, NumberOfPlayers>;
+
+    Seat self{}; // who decides, on an open whist it also plays the passive whister's cards
+    DealPosition position{}; // with the known hands only
+    std::array<bool, NumberOfPlayers> isKnown{};
+    std::array<std::size_t, NumberOfPlayers> handSizes{};
+    std::array<std::uint8_t, NumberOfPlayers> voids{}; // a bit per Suit
+    CardMask hidden{}; // the cards of the unknown hands, plus the talon or the discarded cards while unseen
+    CardMask declarerCards{}; // hidden, but most likely the declarer's, i.e. the talon it has taken
+};
+
+[[nodiscard]] constexpr auto hasVoid(const std::uint8_t voids, const Suit suit) noexcept -> bool
+{
+    return ((voids >> std::to_underlying(suit)) & 1U) != 0;
+}
+
+// A layout of the hidden cards that fits the hand sizes and, unless a few tries fail, the voids too. Each card goes
+// to a free slot picked at random, so that all the layouts come out about equally likely
+template<std::uniform_random_bit_generator Random>
+[[nodiscard]] auto sampleHands(const BotView& view, Random& random) -> BotView::Hands
+{
+    static constexpr auto TriesWithVoids = 16;
+    using Seat = BotView::Seat;
+    auto cards = std::vector<CardId>(std::begin(view.hidden), std::end(view.hidden));
+    for (auto attempt = 0;; ++attempt) {
+        const auto keepsVoids = attempt < TriesWithVoids;
+        std::ranges::shuffle(cards, random);
+        std::ranges::stable_partition(cards, [&](const CardId card) { return view.declarerCards.contains(card); });
+        auto hands = view.position.hands;
+        auto need = std::array<std::size_t, NumberOfPlayers>{};
+        for (auto seat = Seat{}; seat < NumberOfPlayers; ++seat) {
+            need[seat] = view.isKnown[seat] ? 0 : view.handSizes[seat];
+        }
+        const auto needed = need[0] + need[1] + need[2];
+        assert(needed <= std::size(cards) and "the hidden cards fill the unknown hands");
+        auto rest = std::size(cards) - needed; // left out of the hands: the talon or its discarded cards
+        const auto deal = [&](const CardId card) {
+            const auto fits = [&](const Seat seat) {
+                return need[seat] != 0 and (not keepsVoids or not hasVoid(view.voids[seat], suitOf(card)));
+            };
+            if (const auto declarer = view.position.declarer; view.declarerCards.contains(card) and fits(declarer)) {
+                hands[declarer].insert(card);
+                --need[declarer];
+                return true;
+            }
+            auto slots = rest;
+            for (auto seat = Seat{}; seat < NumberOfPlayers; ++seat) { slots += fits(seat) ? need[seat] : 0; }
+            if (slots == 0) { return false; }
+            auto slot = std::uniform_int_distribution<std::size_t>{0, slots - 1}(random);
+            if (slot < rest) {
+                --rest;
+                return true;
+            }
+            slot -= rest;
+            for (auto seat = Seat{}; seat < NumberOfPlayers; ++seat) {
+                if (not fits(seat)) { continue; }
+                if (slot < need[seat]) {
+                    hands[seat].insert(card);
+                    --need[seat];
+                    return true;
+                }
+                slot -= need[seat];
+            }
+            std::unreachable();
+        };
+        if (std::ranges::all_of(cards, deal)) { return hands; }
+    }
+}
+
+// Runs the bots' Monte Carlo searches on a work-stealing pool of its own, so that the bots' thinking never takes the
+// shards' threads from the tables. A decision samples on all the threads at once until the budget or the samples
+// run out
+class BotPool {
+public:
+    using Hands = BotView::Hands;
+
+    struct Limits {
+        std::size_t threads = 2;
+        std::chrono::milliseconds budget{500}; // per decision
+        std::size_t maxSamples = 96; // per decision
+    };
+
+    struct Estimate {
+        std::vector<double> totals;
+        std::size_t samples{};
+    };
+
+    explicit BotPool(const Limits limits = {})
+        : m_limits{limits}
+        , m_pool{static_cast<std::uint32_t>(limits.threads)}
+    {
+        assert(limits.threads > 0);
+    }
+
+    // The sums over the sampled layouts of what `score` adds for each of the `options`
+    template<std::invocable<DoubleDummySolver&, const Hands&, std::span<double>> Score>
+    auto estimate(const BotView& view, const std::size_t options, const Score score) -> task<Estimate>
+    {
+        const auto workers = m_limits.threads;
+        const auto samplesPerWorker = std::max(1uz, (m_limits.maxSamples + workers - 1) / workers);
+        const auto deadline = std::chrono::steady_clock::now() + m_limits.budget;
+        const auto seed = std::random_device{}();
+        auto totals = std::vector(workers, std::vector<double>(options));
+        auto samples = std::vector<std::size_t>(workers);
+        auto errors = std::vector<std::exception_ptr>(workers); // a worker's error is the estimate's one
+        auto scope = ex::async_scope{};
+        for (auto worker = 0uz; worker < workers; ++worker) {
+            scope.spawn(stdx::starts_on(
+                m_pool.get_scheduler(),
+                stdx::just()
+                    | stdx::then([&, worker] {
+                          thread_local auto solver = DoubleDummySolver{};
+                          auto random = std::mt19937_64{seed + worker};
+                          do {
+                              score(solver, sampleHands(view, random), std::span{totals[worker]});
+                          } while (++samples[worker] < samplesPerWorker
+                                   and std::chrono::steady_clock::now() < deadline);
+                      })
+                    | stdx::upon_error([&, worker](const std::exception_ptr& error) noexcept {
+                          errors[worker] = error;
+                      })));
+        }
+        co_await scope.on_empty();
+        const auto error = std::ranges::find_if(errors, [](const std::exception_ptr& e) { return e != nullptr; });
+        if (error != std::ranges::end(errors)) { std::rethrow_exception(*error); }
+        auto result = Estimate{.totals = std::vector<double>(options)};
+        for (auto worker = 0uz; worker < workers; ++worker) {
+            std::ranges::transform(result.totals, totals[worker], std::begin(result.totals), std::plus{});
+            result.samples += samples[worker];
+        }
+        co_return result;
+    }
+
+private:
+    Limits m_limits;
+    ex::static_thread_pool m_pool;
+};
+
+// The players of a deal by seat and what they have chosen, to score its outcomes with calculateDealScore
+struct BotDeal {
+    std::array<PlayerId, NumberOfPlayers> ids{};
+    BotView::Seat declarer{};
+    ContractLevel contractLevel = ContractLevel::Six;
+    std::array<WhistingChoice, NumberOfPlayers> choices{}; // the declarer's one is unused
+    std::array<int, NumberOfPlayers> tricksTaken{};
+};
+
+inline constexpr auto TricksPerDeal = 10;
+
+// The deal's worth to the player in whists: the pool and the dump are settled with the other players ten whists a
+// point, as calculateFinalResult does, and the declarer pays the whists the whisters write on it
+[[nodiscard]] inline auto dealValue(const DealScore& score, const PlayerIdView playerId, const PlayerIdView declarerId)
+    -> double
+{
+    static constexpr auto price = 10.0;
+    static constexpr auto players = static_cast<double>(NumberOfPlayers);
+    auto result = 0.0;
+    for (const auto& [id, entry] : score) {
+        const auto points = price * (entry.pool - entry.dump) / players;
+        if (id == playerId) {
+            result += (points * (players - 1.0)) + entry.whist;
+        } else {
+            result -= points + (playerId == declarerId ? entry.whist : 0);
+        }
+    }
+    return result;
+}
+
+// The score of the deal ending with the declarer's `tricks`, the whisters share the rest evenly on top of the ones
+// they have already taken
+[[nodiscard]] inline auto scoreDeal(const BotDeal& deal, const int tricks) -> DealScore
+{
+    auto whisters = std::vector<Whister>{};
+    for (auto seat = BotView::Seat{}; seat < NumberOfPlayers; ++seat) {
+        if (seat != deal.declarer) { whisters.push_back({deal.ids[seat], deal.choices[seat], deal.tricksTaken[seat]}); }
+    }
+    assert(std::size(whisters) == WhistersCount);
+    auto& first = whisters[0];
+    auto& second = whisters[1];
+    const auto left = std::max(0, TricksPerDeal - tricks - first.tricksTaken - second.tricksTaken);
+    first.tricksTaken += (left + 1) / 2;
+    second.tricksTaken += left / 2;
+    return calculateDealScore({deal.ids[deal.declarer], deal.contractLevel, tricks}, whisters);
+}
+
+// The worth to the seat of each number of the declarer's tricks, from none to all of them
+[[nodiscard]] inline auto dealValues(const BotDeal& deal, const BotView::Seat seat)
+    -> std::array<double, TricksPerDeal + 1>
+{
+    auto result = std::array<double, TricksPerDeal + 1>{};
+    for (auto tricks = 0; tricks <= TricksPerDeal; ++tricks) {
+        result[static_cast<std::size_t>(tricks)] =
+            dealValue(scoreDeal(deal, tricks), deal.ids[seat], deal.ids[deal.declarer]);
+    }
+    return result;
+}
+
+// The bid of the contract, e.g. "8♥" for Eight on hearts or "10" for Ten without a trump
+[[nodiscard]] constexpr auto makeBid(const ContractLevel level, const std::optional<Suit> trump) noexcept -> Bid
+{
+    if (level == ContractLevel::Miser) { return PREF_MISER; }
+    const auto number = std::to_underlying(level) + 6; // Six is the first one
+    const auto bid = std::ranges::find_if(AllBids, [&](const Bid b) {
+        return b.level() == number and b.trump() == trump and not b.isWithoutTalon();
+    });
+    assert(bid != std::ranges::end(AllBids));
+    return *bid;
+}
+
+// The trumps a bot considers, the last one is no trump, and the levels it plays them at
+inline constexpr auto BotTrumps = std::array<std::optional<Suit>, SuitsCount + 1>{
+    Suit::Spades, Suit::Clubs, Suit::Diamonds, Suit::Hearts, std::nullopt};
+inline constexpr auto BotLevels = std::array{
+    ContractLevel::Six, ContractLevel::Seven, ContractLevel::Eight, ContractLevel::Nine, ContractLevel::Ten};
+inline constexpr auto MiserOption = std::size(BotTrumps); // estimated after the trumps
+inline constexpr auto TrickBins = static_cast<std::size_t>(TricksPerDeal + 1);
+
+using Discards = std::array<CardMask, std::size(BotTrumps) + 1>; // by option, taken out of the bot's hand
+
+// The expected worth to the seat from how many samples the declarer took each number of tricks in
+[[nodiscard]] inline auto expectedValue(
+    const BotDeal& deal, const BotView::Seat seat, const std::span<const double> histogram, const std::size_t samples)
+    -> double
+{
+    const auto values = dealValues(deal, seat);
+    auto result = 0.0;
+    for (auto tricks = 0uz; tricks < TrickBins; ++tricks) { result += histogram[tricks] * values[tricks]; }
+    return result / static_cast<double>(std::max(samples, 1uz));
+}
+
+// The histograms of the bot's tricks as the declarer on each trump, and on a miser if `withMiser`, one after another
+[[nodiscard]] inline auto estimateContracts(
+    BotPool& pool, const BotView& view, const bool withMiser, const Discards& discards = {})
+    -> task<BotPool::Estimate>
+{
+    const auto options = std::size(BotTrumps) + (withMiser ? 1 : 0);
+    const auto score = [&](DoubleDummySolver& solver, const auto& hands, const std::span<double> histogram) {
+        auto position = view.position;
+        position.hands = hands;
+        position.declarer = view.self;
+        for (auto option = 0uz; option < options; ++option) {
+            const auto isMiser = option == MiserOption;
+            position.hands[view.self] = hands[view.self] - discards[option];
+            position.contractLevel = isMiser ? ContractLevel::Miser : ContractLevel::Six;
+            position.trump = isMiser ? std::nullopt : BotTrumps[option];
+            histogram[(option * TrickBins) + static_cast<std::size_t>(solver.solve(position))] += 1.0;
+        }
+    };
+    co_return co_await pool.estimate(view, options * TrickBins, score);
+}
+
+struct Contract {
+    ContractLevel level = ContractLevel::Six;
+    std::optional<Suit> trump;
+    double value{};
+};
+
+// The contracts of the estimate, the most worth first, with both whisters whisting against the bot
+[[nodiscard]] inline auto rankContracts(
+    const BotView& view, BotDeal deal, const BotPool::Estimate& estimate, const bool withMiser) -> std::vector<Contract>
+{
+    deal.declarer = view.self;
+    deal.choices.fill(WhistingChoice::Whist);
+    const auto histograms = std::span<const double>{estimate.totals};
+    const auto add = [&](auto& result, const std::size_t option, const ContractLevel level) {
+        deal.contractLevel = level;
+        const auto histogram = histograms.subspan(option * TrickBins, TrickBins);
+        result.push_back({
+            .level = level,
+            .trump = level == ContractLevel::Miser ? std::nullopt : BotTrumps[option],
+            .value = expectedValue(deal, view.self, histogram, estimate.samples),
+        });
+    };
+    auto result = std::vector<Contract>{};
+    for (auto option = 0uz; option < std::size(BotTrumps); ++option) {
+        for (const auto level : BotLevels) { add(result, option, level); }
+    }
+    if (withMiser) { add(result, MiserOption, ContractLevel::Miser); }
+    std::ranges::stable_sort(result, std::greater{}, &Contract::value);
+    return result;
+}
+
+// The bidding so far as the client's bid menu sees it
+struct BidTurn {
+    static constexpr auto NoRank = std::size(BidsRank);
+
+    Bid myBid{}; // none before the first one
+    std::size_t currentRank = NoRank; // to bid above, one less for the forehand, who may hold it
+};
+
+// Whether the bot may make the bid on the turn, as the client's bid menu would allow it. A bot never bids without
+// the talon, and passes once it has bid a miser
+[[nodiscard]] constexpr auto isBidAllowed(const Bid bid, const BidTurn& turn) noexcept -> bool
+{
+    if (bid.isPass()) { return true; }
+    if (bid.isWithoutTalon() or turn.myBid == PREF_MISER) { return false; }
+    if (bid == PREF_MISER and not turn.myBid.empty()) { return false; }
+    return turn.currentRank == BidTurn::NoRank or bid.rank() > turn.currentRank;
+}
+
+// The cheapest bid allowed up to the best contract worth playing, or a miser when it is worth the most
+[[nodiscard]] inline auto chooseBid(BotPool& pool, const BotView& view, const BotDeal& deal, const BidTurn& turn)
+    -> task<Bid>
+{
+    const auto withMiser = isBidAllowed(PREF_MISER, turn);
+    const auto contracts = rankContracts(view, deal, co_await estimateContracts(pool, view, withMiser), withMiser);
+    const auto& best = contracts.front();
+    if (best.value <= 0.0) { co_return Bid{PREF_PASS}; }
+    if (best.level == ContractLevel::Miser) { co_return Bid{PREF_MISER}; }
+    auto cap = 0uz;
+    for (const auto& contract : contracts | rv::filter([](const Contract& c) { return c.value > 0.0; })) {
+        if (contract.level != ContractLevel::Miser) {
+            cap = std::max(cap, makeBid(contract.level, contract.trump).rank());
+        }
+    }
+    for (const auto bid : AllBids | rv::take(cap + 1)) {
+        if (not bid.isMiser() and not bid.isPass() and isBidAllowed(bid, turn)) { co_return bid; }
+    }
+    co_return Bid{PREF_PASS};
+}
+
+// The two cards a declarer drops: the low ones of its short side suits, rather than trumps or aces; on a miser the
+// highest ones
+[[nodiscard]] inline auto discardFor(const CardMask hand, const std::optional<Suit> trump, const bool isMiser)
+    -> CardMask
+{
+    const auto keeping = [&](const CardId card) { // the longer a card is kept the bigger
+        const auto rank = static_cast<int>(std::to_underlying(rankOf(card)));
+        if (isMiser) { return -rank; }
+        const auto suit = suitOf(card);
+        const auto length = static_cast<int>((hand & CardMask::of(suit)).size());
+        return (trump == suit ? 100 : 0) + (rankOf(card) == Rank::Ace ? 50 : 0) + (length * 8) + rank;
+    };
+    auto cards = std::vector<CardId>(std::begin(hand), std::end(hand));
+    std::ranges::stable_sort(cards, std::less{}, keeping);
+    assert(std::size(cards) >= 2);
+    return CardMask{cards[0], cards[1]};
+}
+
+struct TalonChoice {
+    Bid bid;
+    CardMask discarded;
+};
+
+// The final contract after taking the talon, at least the bid won, with the discard made for its trump
+[[nodiscard]] inline auto chooseTalon(
+    BotPool& pool, const BotView& view, const BotDeal& deal, const Bid bid) -> task<TalonChoice>
+{
+    const auto hand = view.position.hands[view.self];
+    if (bid.isMiser()) { co_return TalonChoice{.bid = bid, .discarded = discardFor(hand, std::nullopt, true)}; }
+    auto discards = Discards{};
+    for (auto option = 0uz; option < std::size(BotTrumps); ++option) {
+        discards[option] = discardFor(hand, BotTrumps[option], false);
+    }
+    const auto estimate = co_await estimateContracts(pool, view, false, discards);
+    for (const auto& contract : rankContracts(view, deal, estimate, false)) {
+        if (const auto final = makeBid(contract.level, contract.trump); final >= bid) {
+            const auto option
+                = static_cast<std::size_t>(std::ranges::find(BotTrumps, contract.trump) - std::begin(BotTrumps));
+            co_return TalonChoice{.bid = final, .discarded = discards[option]};
+        }
+    }
+    co_return TalonChoice{.bid = bid, .discarded = discardFor(hand, bid.trump(), false)};
+}
+
+// Whist when it is worth more than passing, given the other whister's choice, or Whist when it hasn't chosen yet.
+// A miser costs a whister nothing, so it is always caught
+[[nodiscard]] inline auto chooseWhisting(BotPool& pool, const BotView& view, BotDeal deal) -> task<std::string>
+{
+    using enum WhistingChoice;
+    if (deal.contractLevel == ContractLevel::Miser) { co_return PREF_WHIST; }
+    const auto self = view.self;
+    const auto partner = BotView::Seat{0 + 1 + 2} - self - deal.declarer; // the seat that is neither
+    const auto score = [&view](DoubleDummySolver& solver, const auto& hands, const std::span<double> histogram) {
+        auto position = view.position;
+        position.hands = hands;
+        histogram[static_cast<std::size_t>(solver.solve(position))] += 1.0;
+    };
+    const auto estimate = co_await pool.estimate(view, TrickBins, score);
+    const auto partnerChoice = deal.choices[partner];
+    deal.choices[self] = Whist;
+    deal.choices[partner] = partnerChoice == HalfWhist ? Pass : partnerChoice; // a whist cancels the half-whist
+    const auto whist = expectedValue(deal, self, estimate.totals, estimate.samples);
+    deal.choices[self] = Pass;
+    deal.choices[partner] = partnerChoice;
+    const auto made = static_cast<std::size_t>(declarerReqTricks(deal.contractLevel)); // unless the other whists
+    const auto pass = partnerChoice == Whist ? expectedValue(deal, self, estimate.totals, estimate.samples)
+                                             : dealValues(deal, self)[made];
+    co_return whist > pass ? PREF_WHIST : PREF_PASS;
+}
+
+[[nodiscard]] inline auto seatToMove(const DealPosition& position) noexcept -> BotView::Seat
+{
+    return (position.leader + std::size(position.trick)) % NumberOfPlayers;
+}
+
+// The card with the best average outcome for the bot over the sampled layouts
+[[nodiscard]] inline auto chooseCard(BotPool& pool, const BotView& view, const BotDeal& deal) -> task<CardId>
+{
+    const auto& position = view.position;
+    const auto leadSuit = std::empty(position.trick) ? std::nullopt : std::optional{suitOf(position.trick.front())};
+    const auto cards = playableCards(position.hands[seatToMove(position)], leadSuit, position.trump);
+    assert(not cards.empty());
+    if (cards.size() == 1) { co_return *std::begin(cards); }
+    const auto values = dealValues(deal, view.self);
+    const auto score = [&](DoubleDummySolver& solver, const auto& hands, const std::span<double> totals) {
+        auto sample = position;
+        sample.hands = hands;
+        for (const auto [card, tricks] : solver.evaluate(sample)) {
+            const auto declarerTricks = std::clamp(position.declarerTricks + tricks, 0, TricksPerDeal);
+            totals[std::to_underlying(card)] += values[static_cast<std::size_t>(declarerTricks)];
+        }
+    };
+    const auto estimate = co_await pool.estimate(view, DeckSize, score);
+    co_return *std::ranges::max_element(
+        cards, std::less{}, [&](const CardId card) { return estimate.totals[std::to_underlying(card)]; });
+}
+
+// A card for a pass game, where everyone wants the fewest tricks: the highest card that loses the trick, or the
+// highest one when they all win it, and the lowest card on a lead. The open talon card sets the lead suit if any
+[[nodiscard]] inline auto passGameCard(const BotView& view, const std::optional<Suit> talonSuit) -> CardId
+{
+    const auto& trick = view.position.trick;
+    const auto leadSuit = std::empty(trick) ? talonSuit : std::optional{talonSuit.value_or(suitOf(trick.front()))};
+    const auto cards = playableCards(view.position.hands[seatToMove(view.position)], leadSuit, std::nullopt);
+    assert(not cards.empty());
+    const auto byRank = [](const CardId card) { return rankOf(card); };
+    if (std::empty(trick)) { return *std::ranges::min_element(cards, std::less{}, byRank); }
+    auto best = trick.front();
+    for (const auto card : trick | rv::drop(1)) {
+        if (beats({.candidate = card, .best = best, .leadSuit = *leadSuit, .trump = std::nullopt})) { best = card; }
+    }
+    auto losing = CardMask{};
+    for (const auto card : cards) {
+        if (not beats({.candidate = card, .best = best, .leadSuit = *leadSuit, .trump = std::nullopt})) {
+            losing.insert(card);
+        }
+    }
+    if (not losing.empty()) { return *std::ranges::max_element(losing, std::less{}, byRank); }
+    return *std::ranges::max_element(cards, std::less{}, byRank);
+}
+
+// Random legal moves, for the bots that only drive a table and think nothing, e.g. in a benchmark
+
+template<std::uniform_random_bit_generator Random>
+[[nodiscard]] auto randomCardOf(const CardMask cards, Random& random) -> CardId
+{
+    assert(not cards.empty());
+    auto pick = std::uniform_int_distribution<std::size_t>{0, cards.size() - 1};
+    return *std::next(std::begin(cards), static_cast<std::ptrdiff_t>(pick(random)));
+}
+
+// Pass half of the time, otherwise the cheapest bid allowed
+template<std::uniform_random_bit_generator Random>
+[[nodiscard]] auto randomBid(const BidTurn& turn, Random& random) -> Bid
+{
+    const auto bid
+        = std::ranges::find_if(AllBids, [&](const Bid b) { return not b.isPass() and isBidAllowed(b, turn); });
+    if (bid == std::end(AllBids) or std::bernoulli_distribution{}(random)) { return PREF_PASS; }
+    return *bid;
+}
+
+// Any two cards of the declarer's hand, the contract stays the bid won
+template<std::uniform_random_bit_generator Random>
+[[nodiscard]] auto randomDiscard(const BotView& view, Random& random) -> CardMask
+{
+    const auto hand = view.position.hands[view.self];
+    auto result = CardMask{};
+    while (result.size() < 2) { result.insert(randomCardOf(hand - result, random)); }
+    return result;
+}
+
+template<std::uniform_random_bit_generator Random>
+[[nodiscard]] auto randomWhisting(const BotView& view, Random& random) -> std::string_view
+{
+    if (view.position.contractLevel == ContractLevel::Miser) { return PREF_WHIST; }
+    return std::bernoulli_distribution{}(random) ? PREF_WHIST : PREF_PASS;
+}
+
+// The open talon card sets the lead suit of a pass game trick if any
+template<std::uniform_random_bit_generator Random>
+[[nodiscard]] auto randomCard(const BotView& view, const std::optional<Suit> talonSuit, Random& random) -> CardId
+{
+    const auto& position = view.position;
+    const auto& trick = position.trick;
+    const auto leadSuit = std::empty(trick) ? talonSuit : std::optional{talonSuit.value_or(suitOf(trick.front()))};
+    return randomCardOf(playableCards(position.hands[seatToMove(position)], leadSuit, position.trump), random);
+}
+
+} // namespace pref
@@ -3,7 +3,6 @@
 
 #pragma once
 
-#include "auth.hpp"
 #include "common/time.hpp"
 #include "proto/pref.pb.h"
 
@@ -12,18 +11,19 @@
 #include <range/v3/all.hpp>
 
 #include <algorithm>
-#include <cerrno>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
-#include <cstring>
-#include <filesystem>
-#include <fstream>
 #include <functional>
 #include <iterator>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <tuple>
 #include <type_traits>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 namespace pref {
 
@@ -81,83 +81,352 @@ template<typename GameDataT>
     }
 }
 
-[[nodiscard]] inline auto userPlayerId(const GameData& data, const PlayerNameView playerName)
+// Heterogeneous lookup of string keys by std::string_view
+struct StringHash {
+    using is_transparent = void;
+
+    [[nodiscard]] auto operator()(const std::string_view key) const noexcept -> std::size_t
+    {
+        return std::hash<std::string_view>{}(key);
+    }
+};
+
+inline constexpr auto AuthTokenTtl = std::chrono::days{30}; // since the token was last used
+inline constexpr auto AuthTokenSweepInterval = std::chrono::hours{1};
+inline constexpr auto MaxAuthTokensPerUser = 8; // the least recently used token is evicted past it
+
+[[nodiscard]] inline auto authTokenExpiresAt(const AuthToken& token) -> std::int64_t
+{
+    return token.last_used_at() + std::chrono::seconds{AuthTokenTtl}.count();
+}
+
+// Buckets the auth tokens by the sweep tick they expire at, so a sweep only looks at the tokens due instead of all of
+// them. A token used after it was scheduled is not moved, it is rescheduled when its bucket comes due
+class AuthTokenWheel {
+public:
+    struct Entry {
+        PlayerId playerId;
+        std::string authToken;
+    };
+
+    static constexpr auto Interval = std::chrono::seconds{AuthTokenSweepInterval}.count();
+    static constexpr auto Buckets = static_cast<std::size_t>(std::chrono::seconds{AuthTokenTtl}.count() / Interval + 1);
+
+    auto schedule(const std::int64_t expiresAt, Entry entry) -> void
+    {
+        // a bucket already swept would only come due a whole revolution later
+        const auto tick = std::max((expiresAt + Interval - 1) / Interval, m_sweptTick + 1);
+        m_buckets[bucket(tick)].push_back(std::move(entry));
+    }
+
+    // Takes the entries of the buckets due since the last call, every bucket on the first call
+    [[nodiscard]] auto advance(const std::int64_t now) -> std::vector<Entry>
+    {
+        const auto tick = now / Interval;
+        const auto first = std::max(m_sweptTick + 1, tick - static_cast<std::int64_t>(Buckets) + 1);
+        auto result = std::vector<Entry>{};
+        for (auto i = first; i <= tick; ++i) {
+            auto& entries = m_buckets[bucket(i)];
+            std::ranges::move(entries, std::back_inserter(result));
+            entries.clear();
+        }
+        m_sweptTick = std::max(m_sweptTick, tick);
+        return result;
+    }
+
+private:
+    [[nodiscard]] static auto bucket(const std::int64_t tick) -> std::size_t
+    {
+        return static_cast<std::size_t>(tick) % Buckets;
+    }
+
+    std::vector<std::vector<Entry>> m_buckets = std::vector<std::vector<Entry>>(Buckets);
+    std::int64_t m_sweptTick{};
+};
+
+// Lookups over GameData without scanning it. Built once at load with makeGameDataIndex, then kept up to date by the
+// functions below that mutate GameData. Users are referred to by their position in GameData::users, so removing a
+// user (only pref-cli does) requires rebuilding the index
+struct GameDataIndex {
+    using Position = int;
+    template<typename Key>
+    using Map = std::unordered_map<Key, Position, StringHash, std::equal_to<>>;
+
+    Map<PlayerId> byPlayerId;
+    Map<PlayerName> byPlayerName;
+    Map<std::string> byAuthToken;
+    AuthTokenWheel authTokenExpiry;
+    std::int32_t lastGameId{};
+};
+
+inline auto indexUser(GameDataIndex& index, const User& user, const GameDataIndex::Position position) -> void
+{
+    index.byPlayerId.insert_or_assign(PlayerId{user.player_id()}, position);
+    index.byPlayerName.insert_or_assign(PlayerName{user.player_name()}, position);
+    for (const auto& token : user.tokens()) {
+        index.byAuthToken.insert_or_assign(std::string{token.hash()}, position);
+        index.authTokenExpiry.schedule(
+            authTokenExpiresAt(token),
+            {.playerId = PlayerId{user.player_id()}, .authToken = std::string{token.hash()}});
+    }
+    for (const auto& game : user.games()) { index.lastGameId = std::max(index.lastGameId, game.id()); }
+}
+
+[[nodiscard]] inline auto makeGameDataIndex(const GameData& data) -> GameDataIndex
+{
+    auto result = GameDataIndex{};
+    result.byPlayerId.reserve(std::size(data.users()));
+    result.byPlayerName.reserve(std::size(data.users()));
+    for (auto position = GameDataIndex::Position{}; position < data.users_size(); ++position) {
+        indexUser(result, data.users(position), position);
+    }
+    return result;
+}
+
+// The tokens stored before they had timestamps count as issued and used at `now`
+inline auto migrateLegacyAuthTokens(GameData& data, const std::int64_t now) -> void
+{
+    for (auto& user : *data.mutable_users()) {
+        for (const auto& hash : user.auth_tokens()) {
+            auto& token = *user.add_tokens();
+            token.set_hash(hash);
+            token.set_issued_at(now);
+            token.set_last_used_at(now);
+        }
+        user.clear_auth_tokens();
+    }
+}
+
+[[nodiscard]] inline auto findAuthToken(User& user, const std::string_view hash) -> AuthToken*
+{
+    const auto it = rng::find(*user.mutable_tokens(), hash, &AuthToken::hash);
+    return it != rng::end(*user.mutable_tokens()) ? &*it : nullptr;
+}
+
+[[nodiscard]] inline auto findAuthToken(const User& user, const std::string_view hash) -> const AuthToken*
+{
+    const auto it = rng::find(user.tokens(), hash, &AuthToken::hash);
+    return it != rng::end(user.tokens()) ? &*it : nullptr;
+}
+
+template<typename Key>
+[[nodiscard]] auto findPosition(const GameDataIndex::Map<Key>& map, const std::string_view key)
+    -> std::optional<GameDataIndex::Position>
+{
+    const auto it = map.find(key);
+    return it != std::end(map) ? std::optional{it->second} : std::nullopt;
+}
+
+[[nodiscard]] inline auto userByPlayerId(const GameData& data, const GameDataIndex& index, const PlayerIdView playerId)
+    -> std::optional<std::reference_wrapper<const User>>
+{
+    return findPosition(index.byPlayerId, playerId).transform([&](const auto position) {
+        return std::cref(data.users(position));
+    });
+}
+
+[[nodiscard]] inline auto userByPlayerId(GameData& data, const GameDataIndex& index, const PlayerIdView playerId)
+    -> std::optional<std::reference_wrapper<User>>
 {
-    return pref::find_value(data.users(), playerName, &User::player_name, &User::player_id);
+    return findPosition(index.byPlayerId, playerId).transform([&](const auto position) {
+        return std::ref(*data.mutable_users(position));
+    });
 }
 
-[[nodiscard]] inline auto playerPasswordHash(const GameData& data, const PlayerNameView playerName)
+[[nodiscard]] inline auto userPlayerId(
+    const GameData& data, const GameDataIndex& index, const PlayerNameView playerName) -> std::optional<PlayerIdView>
 {
-    return pref::find_value(data.users(), playerName, &User::player_name, &User::password);
+    return findPosition(index.byPlayerName, playerName).transform([&](const auto position) {
+        return PlayerIdView{data.users(position).player_id()};
+    });
 }
 
+[[nodiscard]] inline auto playerPasswordHash(
+    const GameData& data, const GameDataIndex& index, const PlayerNameView playerName)
+    -> std::optional<std::string_view>
+{
+    return findPosition(index.byPlayerName, playerName).transform([&](const auto position) {
+        return std::string_view{data.users(position).password()};
+    });
+}
+
+// A known token that has expired but is not swept yet is rejected as well
 [[nodiscard]] inline auto verifyPlayerIdAndAuthToken(
-    const GameData& data, const PlayerIdView playerId, const std::string_view authToken) -> bool
+    const GameData& data,
+    const GameDataIndex& index,
+    const PlayerIdView playerId,
+    const std::string_view authToken,
+    const std::int64_t now) -> bool
 {
     PREF_DI(playerId);
-    return userByPlayerId(data, playerId)
-        .transform([&](const User& user) { return rng::contains(user.auth_tokens(), authToken); })
+    return findPosition(index.byAuthToken, authToken)
+        .transform([&](const auto position) {
+            const auto& user = data.users(position);
+            const auto* token = findAuthToken(user, authToken);
+            return user.player_id() == playerId and token and now < authTokenExpiresAt(*token);
+        })
         .value_or(false);
 }
 
-[[nodiscard]] inline auto verifyPlayerNameAndPassword(
-    const GameData& data, const PlayerNameView playerName, const std::string_view password) -> bool
+inline auto addUser(GameData& data, GameDataIndex& index, User user) -> void
 {
-    PREF_DI(playerName);
-    return playerPasswordHash(data, playerName)
-        .transform([&](const std::string_view hash) { return verifyPassword(password, hash); })
-        .value_or(false);
+    if (index.byPlayerId.contains(user.player_id())) { return; }
+    indexUser(index, user, data.users_size());
+    *data.add_users() = std::move(user);
 }
 
-inline auto addOrUpdateUserGame(GameData& gameData, const PlayerIdView playerId, const UserGame& newGame) -> void
+inline auto addOrUpdateUserGame(
+    GameData& gameData, GameDataIndex& index, const PlayerIdView playerId, const UserGame& newGame) -> void
 {
-    auto& users = *gameData.mutable_users();
-    const auto userIt = rng::find(users, playerId, &User::player_id);
-    if (userIt == rng::end(users)) {
+    const auto position = findPosition(index.byPlayerId, playerId);
+    if (not position) {
         PREF_W("error: {} not found", PREF_V(playerId));
         return;
     }
-    auto& user = *userIt;
+    auto& user = *gameData.mutable_users(*position);
     auto& games = *user.mutable_games();
-    const auto gameIt = rng::find(games, newGame.id(), &UserGame::id);
-    if (gameIt != rng::end(games)) {
+    // the game being updated is almost always the last one
+    const auto gameIt = std::find_if(
+        std::rbegin(games), std::rend(games), [&](const UserGame& game) { return game.id() == newGame.id(); });
+    if (gameIt != std::rend(games)) {
         gameIt->MergeFrom(newGame);
     } else {
         user.add_games()->CopyFrom(newGame);
     }
+    index.lastGameId = std::max(index.lastGameId, newGame.id());
+}
+
+inline auto eraseAuthToken(GameDataIndex& index, User& user, const std::string_view serverAuthToken) -> std::size_t
+{
+    auto& tokens = *user.mutable_tokens();
+    const auto tokensCount = std::size(tokens);
+    tokens.erase(rng::remove(tokens, serverAuthToken, &AuthToken::hash), rng::end(tokens));
+    const auto tokensRemoved = tokensCount - std::size(tokens);
+    if (tokensRemoved != 0) {
+        if (const auto it = index.byAuthToken.find(serverAuthToken); it != std::end(index.byAuthToken)) {
+            index.byAuthToken.erase(it);
+        }
+    }
+    return tokensRemoved;
+}
+
+// Adding a token that is already there does nothing. Past MaxAuthTokensPerUser the least recently used one is evicted
+inline auto addAuthToken(
+    GameData& data,
+    GameDataIndex& index,
+    const PlayerIdView playerId,
+    const std::string_view serverAuthToken,
+    const std::int64_t issuedAt) -> void
+{
+    const auto position = findPosition(index.byPlayerId, playerId);
+    if (not position) { return; }
+    auto& user = *data.mutable_users(*position);
+    if (findAuthToken(user, serverAuthToken)) { return; }
+    auto& token = *user.add_tokens();
+    token.set_hash(serverAuthToken);
+    token.set_issued_at(issuedAt);
+    token.set_last_used_at(issuedAt);
+    index.byAuthToken.insert_or_assign(std::string{serverAuthToken}, *position);
+    index.authTokenExpiry.schedule(
+        authTokenExpiresAt(token), {.playerId = PlayerId{playerId}, .authToken = std::string{serverAuthToken}});
+    if (user.tokens_size() > MaxAuthTokensPerUser) {
+        const auto& leastRecentlyUsed = rng::min(user.tokens(), std::less{}, &AuthToken::last_used_at);
+        const auto evicted = std::string{leastRecentlyUsed.hash()};
+        std::ignore = eraseAuthToken(index, user, evicted);
+        PREF_DI(playerId, evicted);
+    }
+    const auto totalTokens = user.tokens_size();
+    PREF_DI(playerId, totalTokens);
 }
 
-// TODO: support token expiration
-inline auto addAuthToken(GameData& data, const PlayerIdView playerId, std::string serverAuthToken) -> void
+inline auto touchAuthToken(
+    GameData& data,
+    const GameDataIndex& index,
+    const PlayerIdView playerId,
+    const std::string_view serverAuthToken,
+    const std::int64_t usedAt) -> void
 {
-    userByPlayerId(data, playerId) | OnValue([&](User& user) {
-        user.add_auth_tokens(std::move(serverAuthToken));
-        const auto totalTokens = std::size(user.auth_tokens());
-        PREF_DI(playerId, totalTokens);
+    userByPlayerId(data, index, playerId) | OnValue([&](User& user) {
+        if (auto* token = findAuthToken(user, serverAuthToken)) {
+            token->set_last_used_at(std::max(token->last_used_at(), usedAt));
+        }
     });
 }
 
-inline auto revokeAuthToken(GameData& data, const PlayerIdView playerId, const std::string_view serverAuthToken) -> void
+inline auto revokeAuthToken(
+    GameData& data, GameDataIndex& index, const PlayerIdView playerId, const std::string_view serverAuthToken) -> void
 {
     PREF_DI(playerId);
-    userByPlayerId(data, playerId) | OnValue([&](User& user) {
-        auto& tokens = *user.mutable_auth_tokens();
-        const auto tokensCount = std::size(tokens);
-        tokens.erase(rng::remove(tokens, serverAuthToken), rng::end(tokens));
-        const auto tokensLeft = std::size(tokens);
-        const auto tokensRemoved = tokensCount - tokensLeft;
+    userByPlayerId(data, index, playerId) | OnValue([&](User& user) {
+        const auto tokensRemoved = eraseAuthToken(index, user, serverAuthToken);
+        const auto tokensLeft = user.tokens_size();
         PREF_DI(playerId, tokensRemoved, tokensLeft);
     });
 }
 
-[[nodiscard]] inline auto makeUserGames(const GameData& data, const PlayerId& playerId) -> std::string
-{ // clang-format off
-    return makeMessage(userByPlayerId(data, playerId).transform([&](const User& user) {
-        auto result = UserGames{};
-        for (const auto& game : user.games()) { *result.add_games() = game; }
-        return result;
-    }).value_or(UserGames{})).SerializeAsString();
-} // clang-format on
+// Sweeps the tokens due by `now`: returns the expired ones and reschedules the ones used since they were scheduled
+// Whether the token of an entry taken off the wheel is expired, it's scheduled again when it was used since
+[[nodiscard]] inline auto isAuthTokenExpired(
+    const GameData& data, GameDataIndex& index, AuthTokenWheel::Entry& entry, const std::int64_t now) -> bool
+{
+    const auto user = userByPlayerId(data, index, entry.playerId);
+    const auto* token = user ? findAuthToken(user->get(), entry.authToken) : nullptr;
+    if (not token) { return false; } // revoked or evicted meanwhile
+    if (const auto expiresAt = authTokenExpiresAt(*token); now < expiresAt) {
+        index.authTokenExpiry.schedule(expiresAt, std::move(entry));
+        return false;
+    }
+    return true;
+}
+
+[[nodiscard]] inline auto expiredAuthTokens(const GameData& data, GameDataIndex& index, const std::int64_t now)
+    -> std::vector<AuthTokenWheel::Entry>
+{
+    auto result = std::vector<AuthTokenWheel::Entry>{};
+    for (auto& entry : index.authTokenExpiry.advance(now)) {
+        if (isAuthTokenExpired(data, index, entry, now)) { result.push_back(std::move(entry)); }
+    }
+    return result;
+}
+
+inline constexpr auto UserGamesPageSize = 30;
+inline constexpr auto MaxUserGamesPageSize = 100;
+
+// The games are kept in the order of their ids, so a page is found by a binary search of its cursor
+[[nodiscard]] inline auto makeUserGames(const GameData& data, const GameDataIndex& index, const PlayerIdView playerId,
+    const std::int32_t beforeId, const std::int32_t limit) -> std::string
+{
+    auto result = UserGames{};
+    const auto user = userByPlayerId(data, index, playerId);
+    if (not user) { return serializeMessage(result); }
+    const auto& games = user->get().games();
+    const auto pageSize = std::clamp(limit > 0 ? limit : UserGamesPageSize, 1, MaxUserGamesPageSize);
+    const auto last = (beforeId > 0) ? rng::lower_bound(games, beforeId, rng::less{}, &UserGame::id) : rng::end(games);
+    const auto first = std::prev(last, std::min<std::ptrdiff_t>(pageSize, std::distance(rng::begin(games), last)));
+    for (const auto& game : rng::subrange(first, last)) { *result.add_games() = game; }
+    result.set_has_more(first != rng::begin(games));
+    if (beforeId <= 0) {
+        for (const auto& game : games) { addToTotals(*result.mutable_totals(), game); }
+    }
+    return serializeMessage(result);
+}
+
+// The game just recorded, which is almost always the last one
+[[nodiscard]] inline auto makeUserGameUpdate(
+    const GameData& data, const GameDataIndex& index, const PlayerIdView playerId, const std::int32_t gameId)
+    -> std::optional<std::string>
+{
+    const auto user = userByPlayerId(data, index, playerId);
+    if (not user) { return std::nullopt; }
+    const auto& games = user->get().games();
+    const auto newestFirst = games | rv::reverse;
+    const auto game = rng::find(newestFirst, gameId, &UserGame::id);
+    if (game == rng::end(newestFirst)) { return std::nullopt; }
+    auto result = UserGames{};
+    *result.add_games() = *game;
+    result.set_is_update(true);
+    return serializeMessage(result);
+}
 
 [[nodiscard]] inline auto makeUserGame(
     const std::int32_t gameId,
@@ -188,42 +457,4 @@ inline auto revokeAuthToken(GameData& data, const PlayerIdView playerId, const s
     return result;
 }
 
-inline auto storeGameData(const fs::path& path, const GameData& gameData) -> void
-{
-    auto out = std::ofstream{path, std::ios::binary};
-    if (not out) {
-        PREF_W("error: {}, {}", std::strerror(errno), PREF_V(path));
-        return;
-    }
-    if (not gameData.SerializeToOstream(&out)) {
-        PREF_W("error: failed to serialize GameData, {}", PREF_V(path));
-        return;
-    }
-}
-
-[[nodiscard]] inline auto loadGameData(const fs::path& path) -> GameData
-{
-    PREF_DI(path);
-    auto in = std::ifstream{path, std::ios::binary};
-    if (not in) {
-        PREF_W("error: {}, {}", std::strerror(errno), PREF_V(path));
-        return {};
-    }
-    auto result = GameData{};
-    if (not result.ParseFromIstream(&in)) {
-        PREF_W("error: failed to parse GameData, {}", PREF_V(path));
-        return {};
-    }
-    return result;
-}
-
-[[nodiscard]] inline auto lastGameId(const GameData& gameData) -> std::int32_t
-{
-    auto result = std::int32_t{};
-    for (const auto& user : gameData.users()) {
-        for (const auto& game : user.games()) { result = std::max(result, game.id()); }
-    }
-    return result;
-}
-
 } // namespace pref
@@ -0,0 +1,608 @@
+// SPDX-License-Identifier: AGPL-3.0-only
+// Copyright (c) 2025 Oleksandr Kozlov
+
+#pragma once
+
+#include "common/time.hpp"
+#include "game_data.hpp"
+#include "metrics.hpp"
+#include "proto/pref.pb.h"
+
+#include <boost/crc.hpp>
+#include <common/common.hpp>
+#include <common/logger.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// GameData lives in two files: a snapshot `<path>` and a journal `<path>.journal` of the changes made since the
+// snapshot was written. The journal only grows by small appended records, and it is folded into a new snapshot once
+// it outgrows the snapshot itself.
+
+namespace pref {
+
+// A frame is the payload size and the CRC-32 of the payload, both fixed32 little-endian, followed by the payload
+inline constexpr auto JournalFrameHeaderSize = 2 * sizeof(std::uint32_t);
+inline constexpr auto JournalCompactionMinSize = std::uintmax_t{1} << 20; // 1 MiB
+
+[[nodiscard]] inline auto journalPath(const fs::path& snapshotPath) -> fs::path
+{
+    auto result = snapshotPath;
+    result += ".journal";
+    return result;
+}
+
+[[nodiscard]] inline auto makeUserAdded(User user) -> JournalRecord
+{
+    auto result = JournalRecord{};
+    *result.mutable_user_added() = std::move(user);
+    return result;
+}
+
+[[nodiscard]] inline auto makeAuthTokenChange(
+    const PlayerIdView playerId, const std::string_view authToken, const std::int64_t timestamp = {})
+    -> AuthTokenChange
+{
+    auto result = AuthTokenChange{};
+    result.set_player_id(playerId);
+    result.set_auth_token(authToken);
+    result.set_timestamp(timestamp);
+    return result;
+}
+
+[[nodiscard]] inline auto makeAuthTokenAdded(
+    const PlayerIdView playerId, const std::string_view authToken, const std::int64_t issuedAt) -> JournalRecord
+{
+    auto result = JournalRecord{};
+    *result.mutable_auth_token_added() = makeAuthTokenChange(playerId, authToken, issuedAt);
+    return result;
+}
+
+[[nodiscard]] inline auto makeAuthTokenUsed(
+    const PlayerIdView playerId, const std::string_view authToken, const std::int64_t usedAt) -> JournalRecord
+{
+    auto result = JournalRecord{};
+    *result.mutable_auth_token_used() = makeAuthTokenChange(playerId, authToken, usedAt);
+    return result;
+}
+
+[[nodiscard]] inline auto makeAuthTokenRevoked(const PlayerIdView playerId, const std::string_view authToken)
+    -> JournalRecord
+{
+    auto result = JournalRecord{};
+    *result.mutable_auth_token_revoked() = makeAuthTokenChange(playerId, authToken);
+    return result;
+}
+
+[[nodiscard]] inline auto makeUserGameUpserted(const PlayerIdView playerId, const UserGame& game) -> JournalRecord
+{
+    auto result = JournalRecord{};
+    auto& change = *result.mutable_user_game_upserted();
+    change.set_player_id(playerId);
+    *change.mutable_game() = game;
+    return result;
+}
+
+// Every change is idempotent, see JournalRecord
+inline auto applyRecord(GameData& data, GameDataIndex& index, const JournalRecord& record) -> void
+{
+    switch (record.change_case()) {
+    case JournalRecord::kUserAdded: addUser(data, index, record.user_added()); return;
+    case JournalRecord::kAuthTokenAdded: {
+        const auto& change = record.auth_token_added();
+        addAuthToken(data, index, change.player_id(), change.auth_token(), change.timestamp());
+        return;
+    }
+    case JournalRecord::kAuthTokenUsed: {
+        const auto& change = record.auth_token_used();
+        touchAuthToken(data, index, change.player_id(), change.auth_token(), change.timestamp());
+        return;
+    }
+    case JournalRecord::kAuthTokenRevoked: {
+        const auto& change = record.auth_token_revoked();
+        revokeAuthToken(data, index, change.player_id(), change.auth_token());
+        return;
+    }
+    case JournalRecord::kUserGameUpserted: {
+        const auto& change = record.user_game_upserted();
+        addOrUpdateUserGame(data, index, change.player_id(), change.game());
+        return;
+    }
+    case JournalRecord::CHANGE_NOT_SET: break;
+    }
+    PREF_W("error: empty journal record");
+}
+
+[[nodiscard]] inline auto checksum(const std::string_view bytes) -> std::uint32_t
+{
+    auto crc = boost::crc_32_type{};
+    crc.process_bytes(std::data(bytes), std::size(bytes));
+    return crc.checksum();
+}
+
+inline auto appendFixed32(std::string& out, const std::uint32_t value) -> void
+{
+    for (auto shift = 0; shift < 32; shift += 8) { out.push_back(static_cast<char>((value >> shift) & 0xFFu)); }
+}
+
+[[nodiscard]] inline auto readFixed32(const std::string_view in) -> std::uint32_t
+{
+    auto result = std::uint32_t{};
+    for (auto i = std::size_t{}; i < sizeof(std::uint32_t); ++i) {
+        result |= std::uint32_t{static_cast<unsigned char>(in[i])} << (i * 8);
+    }
+    return result;
+}
+
+// Frames a journal record, or any other message appended to a file of such frames, e.g. a TableRecord
+[[nodiscard]] inline auto frameRecord(const google::protobuf::MessageLite& record) -> std::string
+{
+    const auto payload = record.SerializeAsString();
+    auto result = std::string{};
+    result.reserve(JournalFrameHeaderSize + std::size(payload));
+    appendFixed32(result, static_cast<std::uint32_t>(std::size(payload)));
+    appendFixed32(result, checksum(payload));
+    result += payload;
+    return result;
+}
+
+// Calls `onFrame` with the payload of every complete frame until it returns false, and returns the size of the valid
+// prefix: a tail torn by a crash mid-append or corrupted on disk ends the read
+[[nodiscard]] inline auto readFrames(const std::string_view bytes, const std::invocable<std::string_view> auto& onFrame)
+    -> std::size_t
+{
+    auto offset = std::size_t{};
+    while (std::size(bytes) - offset >= JournalFrameHeaderSize) {
+        const auto size = readFixed32(bytes.substr(offset));
+        const auto expectedChecksum = readFixed32(bytes.substr(offset + sizeof(std::uint32_t)));
+        const auto payloadOffset = offset + JournalFrameHeaderSize;
+        if (std::size(bytes) - payloadOffset < size) { break; }
+        const auto payload = bytes.substr(payloadOffset, size);
+        if (checksum(payload) != expectedChecksum or not onFrame(payload)) { break; }
+        offset = payloadOffset + size;
+    }
+    return offset;
+}
+
+// Applies the complete records and returns the size of the valid prefix
+[[nodiscard]] inline auto replayJournal(GameData& data, GameDataIndex& index, const std::string_view journal)
+    -> std::size_t
+{
+    auto records = std::size_t{};
+    const auto offset = readFrames(journal, [&](const std::string_view payload) {
+        auto record = JournalRecord{};
+        if (not record.ParseFromArray(std::data(payload), static_cast<int>(std::size(payload)))) { return false; }
+        applyRecord(data, index, record);
+        ++records;
+        return true;
+    });
+    if (offset != std::size(journal)) {
+        const auto droppedBytes = std::size(journal) - offset;
+        PREF_W("error: corrupted journal tail, {}, {}", PREF_V(records), PREF_V(droppedBytes));
+    }
+    return offset;
+}
+
+[[nodiscard]] inline auto writeAll(const int fd, std::string_view bytes) -> bool
+{
+    while (not std::empty(bytes)) {
+        const auto written = ::write(fd, std::data(bytes), std::size(bytes));
+        if (written < 0) {
+            if (errno == EINTR) { continue; }
+            return false;
+        }
+        bytes.remove_prefix(static_cast<std::size_t>(written));
+    }
+    return true;
+}
+
+// How a sink of a BackgroundWriter makes the batches it appends durable
+enum class FlushPolicy {
+    None, // a crash may lose the last batches, e.g. a recording's
+    DataSync, // every batch is on disk once written, e.g. the journal's
+};
+
+[[nodiscard]] inline auto appendToFile(const int fd, const std::string_view bytes, const FlushPolicy flush) -> bool
+{
+    return writeAll(fd, bytes) and (flush == FlushPolicy::None or ::fdatasync(fd) == 0);
+}
+
+// Makes a rename or a newly created file in the directory durable
+inline auto syncDirectory(const fs::path& path) -> void
+{
+    const auto dir = path.has_parent_path() ? path.parent_path() : fs::path{"."};
+    const auto fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        PREF_W("error: {}, {}", std::strerror(errno), PREF_V(dir));
+        return;
+    }
+    if (::fsync(fd) != 0) { PREF_W("error: {}, {}", std::strerror(errno), PREF_V(dir)); }
+    ::close(fd);
+}
+
+// Writes a temporary file and renames it over the target, so a crash leaves either the old or the new content
+[[nodiscard]] inline auto writeFileAtomically(const fs::path& path, const std::string_view bytes) -> bool
+{
+    auto tmpPath = path;
+    tmpPath += ".tmp";
+    const auto fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        PREF_W("error: {}, {}", std::strerror(errno), PREF_V(tmpPath));
+        return false;
+    }
+    const auto isWritten = writeAll(fd, bytes) and ::fsync(fd) == 0;
+    if (not isWritten) { PREF_W("error: {}, {}", std::strerror(errno), PREF_V(tmpPath)); }
+    ::close(fd);
+    auto error = std::error_code{};
+    if (isWritten) { fs::rename(tmpPath, path, error); }
+    if (not isWritten or error) {
+        if (error) { PREF_W("error: {}, {}", error.message(), PREF_V(path)); }
+        fs::remove(tmpPath, error);
+        return false;
+    }
+    syncDirectory(path);
+    return true;
+}
+
+[[nodiscard]] inline auto readFile(const fs::path& path) -> std::optional<std::string>
+{
+    auto in = std::ifstream{path, std::ios::binary};
+    if (not in) { return std::nullopt; }
+    return std::string{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+}
+
+// Replays the journal on top of the snapshot, a torn journal tail is cut off so that new appends follow valid records
+[[nodiscard]] inline auto loadGameData(const fs::path& path, GameDataIndex& index) -> GameData
+{
+    PREF_DI(path);
+    auto result = GameData{};
+    if (const auto snapshot = readFile(path)) {
+        if (not result.ParseFromString(*snapshot)) {
+            PREF_W("error: failed to parse GameData, {}", PREF_V(path));
+            index = {};
+            return {};
+        }
+    } else {
+        PREF_W("error: {}, {}", std::strerror(errno), PREF_V(path));
+    }
+    migrateLegacyAuthTokens(result, utcTimeSinceEpochInSec());
+    index = makeGameDataIndex(result);
+    const auto journal = journalPath(path);
+    if (const auto records = readFile(journal)) {
+        const auto validSize = replayJournal(result, index, *records);
+        if (validSize != std::size(*records)) {
+            auto error = std::error_code{};
+            fs::resize_file(journal, validSize, error);
+            if (error) { PREF_W("error: {}, {}", error.message(), PREF_V(journal)); }
+        }
+    }
+    return result;
+}
+
+[[nodiscard]] inline auto loadGameData(const fs::path& path) -> GameData
+{
+    auto index = GameDataIndex{};
+    return loadGameData(path, index);
+}
+
+// Folds the journal into a new snapshot
+inline auto compactGameData(const fs::path& path, const GameData& gameData) -> bool
+{
+    if (not writeFileAtomically(path, gameData.SerializeAsString())) { return false; }
+    const auto journal = journalPath(path);
+    auto error = std::error_code{};
+    if (fs::exists(journal, error)) { fs::resize_file(journal, 0, error); }
+    if (error) {
+        PREF_W("error: {}, {}", error.message(), PREF_V(journal));
+        return false;
+    }
+    return true;
+}
+
+// Appends change records to the journal file. The records of a batch are written and synced once by `commit`
+class Journal {
+public:
+    static constexpr auto Flush = FlushPolicy::DataSync; // the changes have to survive a crash
+
+    Journal() = default;
+    Journal(const Journal&) = delete;
+    Journal(Journal&&) = delete;
+    auto operator=(const Journal&) -> Journal& = delete;
+    auto operator=(Journal&&) -> Journal& = delete;
+
+    ~Journal()
+    {
+        if (isOpen()) { ::close(m_fd); }
+    }
+
+    auto open(fs::path snapshotPath) -> bool
+    {
+        const auto path = journalPath(snapshotPath);
+        m_fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+        if (not isOpen()) {
+            PREF_W("error: {}, {}", std::strerror(errno), PREF_V(path));
+            return false;
+        }
+        syncDirectory(path);
+        auto error = std::error_code{};
+        m_journalSize = fs::file_size(path, error);
+        if (error) { m_journalSize = 0; }
+        m_snapshotSize = fs::file_size(snapshotPath, error);
+        if (error) { m_snapshotSize = 0; }
+        m_snapshotPath = std::move(snapshotPath);
+        return true;
+    }
+
+    [[nodiscard]] auto isOpen() const noexcept -> bool
+    {
+        return m_fd >= 0;
+    }
+
+    // Without a journal file the changes are kept in memory only
+    auto append(const JournalRecord& record) -> void
+    {
+        if (isOpen()) { m_batch += frameRecord(record); }
+    }
+
+    // Returns whether the batch is durable. `makeSnapshot` has to return data containing the appended changes, it is
+    // only called when the journal is compacted
+    auto commit(const std::invocable auto& makeSnapshot) -> bool
+    {
+        if (not isOpen() or std::empty(m_batch)) { return isOpen(); }
+        if (not appendToFile(m_fd, m_batch, Flush)) {
+            const auto batchSize = std::size(m_batch);
+            PREF_W("error: {}, {}, {}", std::strerror(errno), PREF_V(m_snapshotPath), PREF_V(batchSize));
+            // drop a partially written batch, so that the next one follows complete records
+            if (::ftruncate(m_fd, static_cast<off_t>(m_journalSize)) != 0) {
+                PREF_W("error: {}, {}", std::strerror(errno), PREF_V(m_snapshotPath));
+            }
+            m_batch.clear();
+            return compact(makeSnapshot()); // the snapshot has the changes, so they are written with it instead
+        }
+        m_journalSize += std::size(m_batch);
+        m_batch.clear();
+        if (m_journalSize > std::max(m_snapshotSize, JournalCompactionMinSize)) { compact(makeSnapshot()); }
+        return true;
+    }
+
+private:
+    auto compact(const GameData& data) -> bool
+    {
+        const auto snapshot = data.SerializeAsString();
+        if (not writeFileAtomically(m_snapshotPath, snapshot)) { return false; }
+        if (::ftruncate(m_fd, 0) != 0) {
+            PREF_W("error: {}, {}", std::strerror(errno), PREF_V(m_snapshotPath));
+            return true; // the snapshot is written, the journal left over has only idempotent records
+        }
+        PREF_I("compacted, {}, journalSize: {}", PREF_V(m_snapshotPath), m_journalSize);
+        m_journalSize = 0;
+        m_snapshotSize = std::size(snapshot);
+        return true;
+    }
+
+    fs::path m_snapshotPath;
+    int m_fd = -1;
+    std::string m_batch;
+    std::uintmax_t m_journalSize{};
+    std::uintmax_t m_snapshotSize{};
+};
+
+// Hands the items queued by any thread to `Sink::write` on a thread of its own, so that the threads never wait on the
+// disk. The items queued while a batch is being written, or within `Sink::CoalescingDelay` of the first one, are
+// coalesced into the next batch: one write however many items it has. The sink writes the batch the way its
+// `Sink::Flush` policy says, and is closed once the items left are written on stop
+template<typename Sink>
+class BackgroundWriter {
+public:
+    using Item = Sink::Item;
+    using Sequence = std::uint64_t;
+    using OnWritten = std::move_only_function<void(bool isWritten)>;
+
+    BackgroundWriter() = default;
+    BackgroundWriter(const BackgroundWriter&) = delete;
+    BackgroundWriter(BackgroundWriter&&) = delete;
+    auto operator=(const BackgroundWriter&) -> BackgroundWriter& = delete;
+    auto operator=(BackgroundWriter&&) -> BackgroundWriter& = delete;
+
+    ~BackgroundWriter()
+    {
+        stop();
+    }
+
+    // Only touched by the writer thread once it is started
+    [[nodiscard]] auto sink() noexcept -> Sink&
+    {
+        return m_sink;
+    }
+
+    [[nodiscard]] auto sink() const noexcept -> const Sink&
+    {
+        return m_sink;
+    }
+
+    auto start() -> void
+    {
+        m_thread = std::jthread{[this](const std::stop_token stop) { run(stop); }};
+    }
+
+    [[nodiscard]] auto isRunning() const noexcept -> bool
+    {
+        return m_thread.joinable();
+    }
+
+    // Never blocks on the disk, and only wakes the writer up when the queue was idle. Dropped when it is not running
+    auto append(Item item) -> void
+    {
+        if (not isRunning()) { return; }
+        auto wasIdle = false;
+        {
+            const auto lock = std::scoped_lock{m_mutex};
+            wasIdle = std::empty(m_pending);
+            m_pending.push_back(std::move(item));
+            ++m_appended;
+        }
+        if (wasIdle) { m_wakeUp.notify_one(); }
+    }
+
+    // `onWritten` is called on the writer thread once the items appended so far are written, or at once with false
+    // when it is not running
+    auto flush(OnWritten onWritten) -> void
+    {
+        if (not isRunning()) {
+            if (onWritten) { onWritten(false); }
+            return;
+        }
+        {
+            const auto lock = std::scoped_lock{m_mutex};
+            if (onWritten) { m_waiters.push_back(std::move(onWritten)); }
+        }
+        m_wakeUp.notify_one();
+    }
+
+    // The number of items the sink has written
+    [[nodiscard]] auto written() const noexcept -> Sequence
+    {
+        return m_written.load(std::memory_order_acquire);
+    }
+
+    // Writes the items left and joins the writer thread
+    auto stop() -> void
+    {
+        if (not isRunning()) { return; }
+        m_thread.request_stop();
+        m_thread.join();
+    }
+
+private:
+    auto run(const std::stop_token stop) -> void
+    {
+        auto lock = std::unique_lock{m_mutex};
+        while (true) {
+            m_wakeUp.wait(lock, stop, [this] { return not std::empty(m_pending) or not std::empty(m_waiters); });
+            if (std::empty(m_pending) and std::empty(m_waiters)) { break; } // stopped with nothing left to write
+            if (not stop.stop_requested()) {
+                m_wakeUp.wait_for(lock, stop, Sink::CoalescingDelay, [] { return false; });
+            }
+            const auto batch = std::exchange(m_pending, {});
+            auto waiters = std::exchange(m_waiters, {});
+            const auto batchEnd = m_appended;
+            lock.unlock();
+            const auto isWritten = m_sink.write(batch);
+            if (isWritten) { m_written.store(batchEnd, std::memory_order_release); }
+            for (auto& onWritten : waiters) { onWritten(isWritten); }
+            lock.lock();
+        }
+        m_sink.close();
+    }
+
+    Sink m_sink;
+    std::mutex m_mutex;
+    std::condition_variable_any m_wakeUp;
+    std::vector<Item> m_pending;
+    std::vector<OnWritten> m_waiters;
+    Sequence m_appended{};
+    std::atomic<Sequence> m_written{};
+    std::jthread m_thread; // the last member, so that it is joined before the rest is destroyed
+};
+
+// Owns the journal on a BackgroundWriter, so that the tables never wait on the disk. The records of a burst are
+// written and synced once, e.g. for a login storm after a restart
+class JournalWriter {
+public:
+    using Sequence = std::uint64_t;
+    using OnDurable = std::move_only_function<void(bool isDurable)>;
+    using MakeSnapshot = std::function<GameData()>;
+
+    // `makeSnapshot` is called on the writer thread when the journal is compacted
+    auto open(fs::path snapshotPath, MakeSnapshot makeSnapshot) -> bool
+    {
+        if (not m_writer.sink().journal.open(std::move(snapshotPath))) { return false; }
+        m_writer.sink().makeSnapshot = std::move(makeSnapshot);
+        m_writer.start();
+        return true;
+    }
+
+    // Without a journal file the changes are kept in memory only
+    auto append(JournalRecord record) -> void
+    {
+        m_writer.append(std::move(record));
+    }
+
+    // Never blocks on the disk. `onDurable` is called on the writer thread once the records appended so far are synced
+    auto commit(OnDurable onDurable = {}) -> void
+    {
+        m_writer.flush(std::move(onDurable));
+    }
+
+    // The number of records known to be on disk
+    [[nodiscard]] auto durable() const noexcept -> Sequence
+    {
+        return m_writer.written();
+    }
+
+    // Writes the records left and joins the writer thread
+    auto stop() -> void
+    {
+        m_writer.stop();
+    }
+
+private:
+    struct Sink {
+        using Item = JournalRecord;
+
+        // How long the writer lets a burst gather after its first record
+        static constexpr auto CoalescingDelay = 20ms;
+
+        auto write(const std::vector<JournalRecord>& batch) -> bool
+        {
+            const auto started = MetricsClock::now();
+            for (const auto& record : batch) { journal.append(record); }
+            const auto isDurable = journal.commit(makeSnapshot);
+            observeSince(localMetrics().journalCommits, started);
+            const auto batchSize = std::size(batch);
+            PREF_DI(batchSize, isDurable);
+            return isDurable;
+        }
+
+        auto close() -> void
+        {
+        }
+
+        Journal journal;
+        MakeSnapshot makeSnapshot;
+    };
+
+    BackgroundWriter<Sink> m_writer;
+};
+
+// Applies the change to the in-memory data and queues it for the next commit
+inline auto recordChange(GameData& data, GameDataIndex& index, auto& journal, const JournalRecord& record) -> void
+{
+    applyRecord(data, index, record);
+    journal.append(record);
+}
+
+} // namespace pref
@@ -3,6 +3,8 @@
 
 #include "common/logger.hpp"
 #include "game_data.hpp"
+#include "journal.hpp"
+#include "options.hpp"
 #include "proto/pref.pb.h"
 #include "server.hpp"
 #include "transport.hpp"
@@ -11,19 +13,26 @@
 #include <boost/system.hpp>
 #include <docopt/docopt.h>
 #include <exec/when_any.hpp>
-#include <execpools/asio/asio_thread_pool.hpp>
+#include <spdlog/async.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
 #include <stdexec/execution.hpp>
 
+#include <algorithm>
 #include <coroutine>
 #include <csignal>
+#include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <exception>
 #include <filesystem>
 #include <gsl/gsl>
 #include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -36,21 +45,66 @@ namespace {
 #define PREF_SSL_OPTS ""
 #endif // PREF_SSL
 
-auto handleSignals() -> task<>
+auto handleSignals(net::any_io_executor ex) -> task<>
 {
-    auto signals = SignalSet{ctx().ex, SIGINT, SIGTERM};
+    auto signals = SignalSet{std::move(ex), SIGINT, SIGTERM};
     const auto [result, signal] = co_await signals.async_wait();
     PREF_I("{}, signal: {} ({})", PREF_V(result), signal == SIGINT ? "SIGINT" : "SIGTERM", signal);
 }
 
 constexpr auto Usage = R"(
 Usage:
-    server <address> <port> [<data>])" PREF_SSL_OPTS R"(
+    server <address> <port> [<data>] [--threads=<n>] [--bot-threads=<n>] [--log-queue=<n>]
+           [--slow-consumer=<policy>] [--deflate=<bytes>] [--deflate-window=<bits>]
+           [--deflate-memory=<level>] [--acceptors=<n>] [--record=<dir>])" PREF_SSL_OPTS R"(
 
 Options:
-    -h --help     Show this screen.
+    -h --help           Show this screen.
+    --threads=<n>       Number of threads to run the tables on, 0 means all cores [default: 0].
+    --bot-threads=<n>   Number of threads the bots think on, 0 means all cores [default: 2].
+    --log-queue=<n>     Number of log lines waiting to be written before the oldest are dropped [default: 8192].
+    --slow-consumer=<policy>
+                        What a table does with a message for a client that has 128 of them unsent yet: wait, drop,
+                        disconnect, or collapse the game states set aside without waiting [default: wait].
+    --deflate=<bytes>   Compresses the messages from this size on, 0 means never [default: 512].
+    --deflate-window=<bits>
+                        The 9 to 15 bits of the compression window each connection keeps [default: 15].
+    --deflate-memory=<level>
+                        The 1 to 9 level of the memory each connection compresses with [default: 8].
+    --acceptors=<n>     Number of threads accepting the connections on the port with SO_REUSEPORT, each running the
+                        handshakes, the sessions then run on the tables' threads [default: 1].
+    --record=<dir>      Records every table into a file of the directory, for pref-replay to play it again.
 )";
 
+// The lines are formatted by the threads logging them, but written by a thread of its own, so that a slow terminal
+// or disk never holds up a table. A full queue overwrites its oldest lines instead of blocking
+auto useAsyncLogger(const std::size_t queueSize) -> void
+{
+    spdlog::init_thread_pool(queueSize, 1);
+    spdlog::set_default_logger(std::make_shared<spdlog::async_logger>(
+        "server",
+        std::make_shared<spdlog::sinks::stdout_color_sink_mt>(),
+        spdlog::thread_pool(),
+        spdlog::async_overflow_policy::overrun_oldest));
+}
+
+[[nodiscard]] auto slowConsumerPolicy(const std::string_view policy) -> SlowConsumer
+{
+    if (const auto result = parseSlowConsumer(policy)) { return *result; }
+    throw std::invalid_argument{fmt::format("unknown slow consumer policy: {}", policy)};
+}
+
+[[nodiscard]] auto deflateOptions(const long threshold, const long windowBits, const long memLevel) -> Deflate
+{
+    if (windowBits < 9 or windowBits > 15 or memLevel < 1 or memLevel > 9) {
+        throw std::invalid_argument{fmt::format("wrong deflate {} or {}", PREF_V(windowBits), PREF_V(memLevel))};
+    }
+    return {
+        .threshold = gsl::narrow<std::size_t>(threshold),
+        .windowBits = gsl::narrow<int>(windowBits),
+        .memLevel = gsl::narrow<int>(memLevel)};
+}
+
 } // namespace
 } // namespace pref
 
@@ -60,33 +114,48 @@ auto main(const int argc, const char* const argv[]) -> int
         const auto args = docopt::docopt(pref::Usage, {std::next(argv), std::next(argv, argc)});
         auto const address = net::ip::make_address(args.at("<address>").asString());
         auto const port = gsl::narrow<std::uint16_t>(args.at("<port>").asLong());
+        pref::useAsyncLogger(gsl::narrow<std::size_t>(args.at("--log-queue").asLong()));
         spdlog::set_pattern("[%Y-%m-%d %H:%M:%S][%^%l%$][%t][%!] %v");
-        auto pool = execpools::asio_thread_pool{1};
-        auto ex = pool.get_executor();
-        auto& ctx = pref::ctx(ex);
+        auto registry = pref::TableRegistry{
+            pref::threadsCount(args.at("--threads").asLong()),
+            {.threads = pref::threadsCount(args.at("--bot-threads").asLong())},
+            {.slowConsumer = pref::slowConsumerPolicy(args.at("--slow-consumer").asString()),
+             .deflate = pref::deflateOptions(
+                 args.at("--deflate").asLong(),
+                 args.at("--deflate-window").asLong(),
+                 args.at("--deflate-memory").asLong()),
+             .acceptors = gsl::narrow<std::size_t>(args.at("--acceptors").asLong())}};
+        auto& storage = registry.storage();
         if (args.contains("<data>") and args.at("<data>").isString()) {
-            ctx.gameDataPath = args.at("<data>").asString();
-            ctx.gameData = pref::loadGameData(ctx.gameDataPath);
+            storage.gameDataPath = args.at("<data>").asString();
+            storage.gameData = pref::loadGameData(storage.gameDataPath, storage.index);
+            storage.journal.open(storage.gameDataPath, [&storage] {
+                const auto lock = std::scoped_lock{storage.mutex};
+                return storage.gameData;
+            });
         } else {
             PREF_W("game data is not provided");
         }
-        ctx.gameId = pref::lastGameId(ctx.gameData);
+        storage.gameId = storage.index.lastGameId;
+        if (args.at("--record").isString()) { registry.record(args.at("--record").asString()); }
 #ifdef PREF_SSL
         auto accept = pref::createAcceptor(
             pref::loadCertificate(
                 args.at("--cert").asString(), args.at("--key").asString(), args.at("--dh").asString()),
             {address, port},
-            std::move(ex));
+            registry);
 #else // PREF_SSL
-        auto accept = pref::createAcceptor({address, port}, std::move(ex));
+        auto accept = pref::createAcceptor({address, port}, registry);
 #endif // PREF_SSL
-        auto sch = pool.get_scheduler();
+        auto sch = registry.scheduler();
         stdx::sync_wait(
             ex::when_any(
                 stdx::starts_on(sch, std::move(accept)), //
-                stdx::starts_on(sch, pref::handleSignals())));
+                stdx::starts_on(sch, pref::sweepAuthTokens(registry)),
+                stdx::starts_on(sch, pref::handleSignals(registry.executor()))));
         PREF_I("shutdown");
-        ctx.shutdown();
+        registry.shutdown();
+        storage.journal.stop();
         return EXIT_SUCCESS;
     } catch (const std::exception& error) {
         PREF_DE(error);
@@ -0,0 +1,244 @@
+// SPDX-License-Identifier: AGPL-3.0-only
+// Copyright (c) 2025 Oleksandr Kozlov
+
+#pragma once
+
+#include "common/common.hpp"
+#include "proto/pref.pb.h"
+
+#include <fmt/format.h>
+#include <range/v3/all.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Counters for the Prometheus `/metrics` route. Every thread writes counters of its own, with plain relaxed stores
+// and no contention, and a scrape sums them over the threads
+
+namespace pref {
+
+using MetricsClock = std::chrono::steady_clock;
+
+// Upper bounds of the buckets: microseconds for the latencies, frames for the channels holding up to 128 of them
+inline constexpr auto LatencyBuckets = std::to_array<std::uint64_t>(
+    {50, 100, 250, 500, 1'000, 2'500, 5'000, 10'000, 25'000, 50'000, 100'000, 250'000, 500'000, 1'000'000, 2'500'000});
+inline constexpr auto DepthBuckets = std::to_array<std::uint64_t>({0, 1, 2, 4, 8, 16, 32, 64, 96, 127});
+
+// Only its thread writes the counter, the others may read it at any time
+class LocalCounter {
+public:
+    auto add(const std::uint64_t value) noexcept -> void
+    {
+        m_value.store(m_value.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] auto value() const noexcept -> std::uint64_t
+    {
+        return m_value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<std::uint64_t> m_value;
+};
+
+template<const auto& Bounds>
+struct LocalHistogram {
+    std::array<LocalCounter, std::size(Bounds) + 1> buckets; // not cumulative, the last one is +Inf
+    LocalCounter sum;
+
+    auto observe(const std::uint64_t value) noexcept -> void
+    {
+        buckets[static_cast<std::size_t>(rng::distance(rng::begin(Bounds), rng::lower_bound(Bounds, value)))].add(1);
+        sum.add(value);
+    }
+};
+
+using LatencyHistogram = LocalHistogram<LatencyBuckets>;
+using DepthHistogram = LocalHistogram<DepthBuckets>;
+
+struct ThreadMetrics {
+    std::array<LatencyHistogram, MessageTagsCount> methods; // dispatchMessage, indexed by Message::BodyCase
+    LatencyHistogram writes; // a frame's WebSocket write
+    LatencyHistogram journalCommits; // a batch's write and fdatasync
+    LatencyHistogram passwordChecks; // Argon2
+    DepthHistogram channelDepth; // the frames already queued when one more is sent
+    LocalCounter channelFull; // the frames finding a channel full
+    LocalCounter framesDropped; // by SlowConsumer::Drop
+    LocalCounter slowConsumersDisconnected; // by SlowConsumer::Disconnect
+    LocalCounter framesCollapsed; // by SlowConsumer::Collapse
+    LocalCounter spectatorLags; // the spectators who missed a frame and wait for a snapshot
+    LocalCounter relayedDropped; // the relayed frames finding a relay queue full
+    LocalCounter relayLimited; // the relayed messages over their sender's rate or size
+};
+
+class Metrics {
+public:
+    // Live for the whole process: a thread's counts stay in the totals after it exits
+    [[nodiscard]] auto addThread() -> ThreadMetrics&
+    {
+        const auto lock = std::scoped_lock{m_mutex};
+        return *m_threads.emplace_back(std::make_unique<ThreadMetrics>());
+    }
+
+    // The Prometheus text format of the totals
+    [[nodiscard]] auto render(std::size_t tables) const -> std::string;
+
+    std::atomic<std::int64_t> sessions; // connected WebSockets
+
+private:
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<ThreadMetrics>> m_threads;
+};
+
+[[nodiscard]] inline auto metrics() -> Metrics&
+{
+    static auto instance = Metrics{};
+    return instance;
+}
+
+[[nodiscard]] inline auto localMetrics() -> ThreadMetrics&
+{
+    thread_local auto& local = metrics().addThread();
+    return local;
+}
+
+inline auto observeSince(LatencyHistogram& histogram, const MetricsClock::time_point started) noexcept -> void
+{
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(MetricsClock::now() - started);
+    histogram.observe(static_cast<std::uint64_t>(elapsed.count()));
+}
+
+namespace detail {
+
+template<const auto& Bounds>
+struct HistogramTotal {
+    std::array<std::uint64_t, std::size(Bounds) + 1> buckets{};
+    std::uint64_t sum{};
+
+    auto add(const LocalHistogram<Bounds>& histogram) -> void
+    {
+        for (auto i = 0uz; i < std::size(buckets); ++i) { buckets[i] += histogram.buckets[i].value(); }
+        sum += histogram.sum.value();
+    }
+
+    [[nodiscard]] auto count() const -> std::uint64_t
+    {
+        return rng::accumulate(buckets, std::uint64_t{});
+    }
+};
+
+inline auto appendHeader(std::string& out, const std::string_view name, const std::string_view type,
+    const std::string_view help) -> void
+{
+    fmt::format_to(std::back_inserter(out), "# HELP {} {}\n# TYPE {} {}\n", name, help, name, type);
+}
+
+// `perUnit` turns the bounds and the sum into the unit of the metric, e.g. microseconds into seconds
+template<const auto& Bounds>
+auto appendHistogram(std::string& out, const std::string_view name, const std::string_view labels,
+    const HistogramTotal<Bounds>& total, const double perUnit) -> void
+{
+    const auto separator = std::empty(labels) ? "" : ",";
+    auto cumulative = std::uint64_t{};
+    for (auto i = 0uz; i < std::size(Bounds); ++i) {
+        cumulative += total.buckets[i];
+        const auto bound = static_cast<double>(Bounds[i]) / perUnit;
+        fmt::format_to(
+            std::back_inserter(out), "{}_bucket{{{}{}le=\"{}\"}} {}\n", name, labels, separator, bound, cumulative);
+    }
+    const auto count = total.count();
+    fmt::format_to(std::back_inserter(out), "{}_bucket{{{}{}le=\"+Inf\"}} {}\n", name, labels, separator, count);
+    const auto braced = std::empty(labels) ? std::string{} : fmt::format("{{{}}}", labels);
+    fmt::format_to(std::back_inserter(out), "{}_sum{} {}\n", name, braced, static_cast<double>(total.sum) / perUnit);
+    fmt::format_to(std::back_inserter(out), "{}_count{} {}\n", name, braced, count);
+}
+
+} // namespace detail
+
+inline auto Metrics::render(const std::size_t tables) const -> std::string
+{
+    static constexpr auto seconds = 1e6; // the latencies are in microseconds
+    auto methods = std::array<detail::HistogramTotal<LatencyBuckets>, MessageTagsCount>{};
+    auto writes = detail::HistogramTotal<LatencyBuckets>{};
+    auto journalCommits = detail::HistogramTotal<LatencyBuckets>{};
+    auto passwordChecks = detail::HistogramTotal<LatencyBuckets>{};
+    auto channelDepth = detail::HistogramTotal<DepthBuckets>{};
+    auto channelFull = std::uint64_t{};
+    auto framesDropped = std::uint64_t{};
+    auto slowConsumersDisconnected = std::uint64_t{};
+    auto framesCollapsed = std::uint64_t{};
+    auto spectatorLags = std::uint64_t{};
+    auto relayedDropped = std::uint64_t{};
+    auto relayLimited = std::uint64_t{};
+    {
+        const auto lock = std::scoped_lock{m_mutex};
+        for (const auto& thread : m_threads) {
+            for (auto tag = 0uz; tag < MessageTagsCount; ++tag) { methods[tag].add(thread->methods[tag]); }
+            writes.add(thread->writes);
+            journalCommits.add(thread->journalCommits);
+            passwordChecks.add(thread->passwordChecks);
+            channelDepth.add(thread->channelDepth);
+            channelFull += thread->channelFull.value();
+            framesDropped += thread->framesDropped.value();
+            slowConsumersDisconnected += thread->slowConsumersDisconnected.value();
+            framesCollapsed += thread->framesCollapsed.value();
+            spectatorLags += thread->spectatorLags.value();
+            relayedDropped += thread->relayedDropped.value();
+            relayLimited += thread->relayLimited.value();
+        }
+    }
+    auto result = std::string{};
+    detail::appendHeader(result, "pref_method_duration_seconds", "histogram", "Time a method takes to handle.");
+    for (auto tag = 0uz; tag < MessageTagsCount; ++tag) {
+        if (methods[tag].count() == 0) { continue; }
+        const auto labels = fmt::format("method=\"{}\"", methodName(static_cast<Message::BodyCase>(tag)));
+        detail::appendHistogram(result, "pref_method_duration_seconds", labels, methods[tag], seconds);
+    }
+    detail::appendHeader(result, "pref_write_duration_seconds", "histogram", "Time a WebSocket write takes.");
+    detail::appendHistogram(result, "pref_write_duration_seconds", "", writes, seconds);
+    detail::appendHeader(
+        result, "pref_journal_commit_duration_seconds", "histogram", "Time a journal batch takes to write and sync.");
+    detail::appendHistogram(result, "pref_journal_commit_duration_seconds", "", journalCommits, seconds);
+    detail::appendHeader(
+        result, "pref_password_check_duration_seconds", "histogram", "Time an Argon2 password check takes.");
+    detail::appendHistogram(result, "pref_password_check_duration_seconds", "", passwordChecks, seconds);
+    detail::appendHeader(
+        result, "pref_channel_depth_frames", "histogram", "Frames queued in a channel when one more is sent.");
+    detail::appendHistogram(result, "pref_channel_depth_frames", "", channelDepth, 1.0);
+    detail::appendHeader(result, "pref_channel_full_total", "counter", "Frames that found a channel full.");
+    fmt::format_to(std::back_inserter(result), "pref_channel_full_total {}\n", channelFull);
+    detail::appendHeader(result, "pref_frames_dropped_total", "counter", "Frames dropped for a slow client.");
+    fmt::format_to(std::back_inserter(result), "pref_frames_dropped_total {}\n", framesDropped);
+    detail::appendHeader(
+        result, "pref_slow_consumers_disconnected_total", "counter", "Clients disconnected for being slow.");
+    fmt::format_to(
+        std::back_inserter(result), "pref_slow_consumers_disconnected_total {}\n", slowConsumersDisconnected);
+    detail::appendHeader(
+        result, "pref_frames_collapsed_total", "counter", "State frames skipped for a later one in the queue.");
+    fmt::format_to(std::back_inserter(result), "pref_frames_collapsed_total {}\n", framesCollapsed);
+    detail::appendHeader(
+        result, "pref_spectator_lags_total", "counter", "Spectators who missed a frame and waited for a snapshot.");
+    fmt::format_to(std::back_inserter(result), "pref_spectator_lags_total {}\n", spectatorLags);
+    detail::appendHeader(
+        result, "pref_relayed_dropped_total", "counter", "Voice signals and chat messages dropped for a full queue.");
+    fmt::format_to(std::back_inserter(result), "pref_relayed_dropped_total {}\n", relayedDropped);
+    detail::appendHeader(
+        result, "pref_relay_limited_total", "counter", "Voice signals and chat messages over the rate or size.");
+    fmt::format_to(std::back_inserter(result), "pref_relay_limited_total {}\n", relayLimited);
+    detail::appendHeader(result, "pref_sessions", "gauge", "Connected WebSocket sessions.");
+    fmt::format_to(std::back_inserter(result), "pref_sessions {}\n", sessions.load(std::memory_order_relaxed));
+    detail::appendHeader(result, "pref_tables", "gauge", "Open tables.");
+    fmt::format_to(std::back_inserter(result), "pref_tables {}\n", tables);
+    return result;
+}
+
+} // namespace pref
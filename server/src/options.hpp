@@ -0,0 +1,23 @@
+// SPDX-License-Identifier: AGPL-3.0-only
+// Copyright (c) 2025 Oleksandr Kozlov
+
+#pragma once
+
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+
+// The command line options the server and its tools parse the same way
+
+namespace pref {
+
+// A count of threads, 0 or less means all the cores
+[[nodiscard]] inline auto threadsCount(const long threads) -> std::size_t
+{
+    if (threads > 0) { return gsl::narrow<std::size_t>(threads); }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+} // namespace pref
@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: AGPL-3.0-only
+// Copyright (c) 2025 Oleksandr Kozlov
+
+#include "common/logger.hpp"
+#include "options.hpp"
+#include "proto/pref.pb.h"
+#include "server.hpp"
+
+#include <docopt/docopt.h>
+#include <exec/async_scope.hpp>
+#include <gsl/gsl>
+#include <spdlog/spdlog.h>
+#include <stdexec/execution.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iterator>
+#include <new>
+#include <print>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+std::atomic<std::size_t> allocations; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+} // namespace
+
+// Counts every allocation of the process, the game's ones are most of them while the deals are played
+auto operator new(const std::size_t size) -> void*
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto* const result = std::malloc(std::max(size, std::size_t{1})); result) { return result; }
+    throw std::bad_alloc{};
+}
+
+auto operator delete(void* const ptr) noexcept -> void
+{
+    std::free(ptr);
+}
+
+auto operator delete(void* const ptr, std::size_t) noexcept -> void
+{
+    std::free(ptr);
+}
+
+namespace pref {
+namespace {
+
+constexpr std::string_view Usage = R"(
+Preferans benchmark: headless tables of bots making random legal moves
+
+Usage:
+  pref-bench [--deals=<n>] [--tables=<n>] [--seed=<n>]
+  pref-bench (-h | --help)
+
+Options:
+  -h --help       Show this screen.
+  --deals=<n>     Number of deals to play in total [default: 100000].
+  --tables=<n>    Number of tables playing at once, each on a thread of its own, 0 means all cores [default: 1].
+  --seed=<n>      Seed of the first table, the next ones get the following seeds [default: 1].
+)";
+
+[[nodiscard]] auto merge(HeadlessStats result, const HeadlessStats& other) -> HeadlessStats
+{
+    result.games += other.games;
+    result.deals += other.deals;
+    for (auto&& [stage, otherStage] : rv::zip(result.stages, other.stages)) {
+        stage.moves += otherStage.moves;
+        stage.total += otherStage.total;
+        stage.max = std::max(stage.max, otherStage.max);
+    }
+    return result;
+}
+
+auto report(const HeadlessStats& stats, const std::chrono::duration<double> elapsed, const std::size_t allocated)
+    -> void
+{
+    using Micros = std::chrono::duration<double, std::micro>;
+    const auto deals = static_cast<double>(std::max(stats.deals, std::size_t{1}));
+    std::println("games: {}, deals: {}, elapsed: {:.3f}s", stats.games, stats.deals, elapsed.count());
+    std::println("deals/sec: {:.0f}", static_cast<double>(stats.deals) / elapsed.count());
+    std::println("allocations/deal: {:.1f}", static_cast<double>(allocated) / deals);
+    std::println("{:<14} | {:>10} | {:>10} | {:>10}", "stage", "moves", "mean, us", "max, us");
+    for (auto stage = 0; stage < GameStage_ARRAYSIZE; ++stage) {
+        const auto& moves = stats.stages[static_cast<std::size_t>(stage)];
+        if (moves.moves == 0) { continue; }
+        std::println(
+            "{:<14} | {:>10} | {:>10.2f} | {:>10.2f}",
+            GameStage_Name(static_cast<GameStage>(stage)),
+            moves.moves,
+            Micros{moves.total}.count() / static_cast<double>(moves.moves),
+            Micros{moves.max}.count());
+    }
+}
+
+} // namespace
+} // namespace pref
+
+auto main(const int argc, const char* const argv[]) -> int
+{
+    try {
+        const auto args = docopt::docopt(std::string{pref::Usage}, {std::next(argv), std::next(argv, argc)});
+        const auto deals = gsl::narrow<std::size_t>(args.at("--deals").asLong());
+        const auto tables = pref::threadsCount(args.at("--tables").asLong());
+        const auto seed = gsl::narrow<std::uint64_t>(args.at("--seed").asLong());
+        spdlog::set_level(spdlog::level::warn); // the tables log every move
+        auto registry = pref::TableRegistry{tables, {.threads = 1}};
+        auto results = std::vector<pref::HeadlessStats>(tables);
+        auto scope = exec::async_scope{};
+        const auto allocatedBefore = allocations.load(std::memory_order_relaxed);
+        const auto started = std::chrono::steady_clock::now();
+        for (auto table = 0uz; table < tables; ++table) {
+            const auto tableDeals = (deals / tables) + (table < deals % tables ? 1uz : 0uz);
+            scope.spawn(
+                stdx::starts_on(registry.scheduler(), pref::playHeadless(registry, tableDeals, seed + table))
+                | stdx::then([&results, table](const pref::HeadlessStats stats) noexcept { results[table] = stats; })
+                | stdx::upon_error(pref::Detached("playHeadless")));
+        }
+        stdx::sync_wait(scope.on_empty());
+        const auto elapsed = std::chrono::steady_clock::now() - started;
+        const auto allocated = allocations.load(std::memory_order_relaxed) - allocatedBefore;
+        pref::report(std::ranges::fold_left(results, pref::HeadlessStats{}, pref::merge), elapsed, allocated);
+        registry.shutdown();
+        return EXIT_SUCCESS;
+    } catch (const std::exception& error) {
+        PREF_DE(error);
+    } catch (...) {
+        PREF_E("error: unknown");
+    }
+    return EXIT_FAILURE;
+}
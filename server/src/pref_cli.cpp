@@ -6,11 +6,14 @@
 #include "common/logger.hpp"
 #include "common/time.hpp"
 #include "game_data.hpp"
+#include "journal.hpp"
 #include "proto/pref.pb.h"
 
 #include <docopt/docopt.h>
+#include <gsl/gsl>
 #include <range/v3/all.hpp>
 
+#include <algorithm>
 #include <charconv>
 #include <cstdint>
 #include <filesystem>
@@ -18,6 +21,7 @@
 #include <iterator>
 #include <optional>
 #include <print>
+#include <set>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -30,6 +34,7 @@ Preferans CLI
 
 Usage:
   pref-cli <path> add --user <name> <password>
+  pref-cli <path> add --users <prefix> <count> <password>
   pref-cli <path> show --users
   pref-cli <path> show --user <id>
   pref-cli <path> show --games <id>
@@ -38,6 +43,7 @@ Usage:
   pref-cli <path> remove --games <id>
   pref-cli <path> remove --game <id> <game>
   pref-cli <path> remove --tokens <id> [--token=<token>]
+  pref-cli <path> compact
   pref-cli (-h | --help)
 )";
 
@@ -62,15 +68,35 @@ auto showUser(const GameData& data, const PlayerIdView playerId) -> void
         std::println("Name:     {}", user.player_name());
         std::println("ID:       {}", user.player_id());
         std::println("Password: {}", user.password());
-        std::println("Tokens:   {}", user.auth_tokens_size());
+        std::println("Tokens:   {}", user.tokens_size());
         std::println("Games:    {}", user.games_size());
     });
 }
 
+[[nodiscard]] auto formatAge(const std::int64_t sec) -> std::string
+{
+    static constexpr auto minute = std::int64_t{60};
+    static constexpr auto hour = 60 * minute;
+    static constexpr auto day = 24 * hour;
+    if (sec >= day) { return fmt::format("{}d {}h", sec / day, sec % day / hour); }
+    if (sec >= hour) { return fmt::format("{}h {}m", sec / hour, sec % hour / minute); }
+    if (sec >= minute) { return fmt::format("{}m", sec / minute); }
+    return fmt::format("{}s", std::max(sec, std::int64_t{}));
+}
+
 auto showTokens(const GameData& data, const PlayerIdView playerId) -> void
 {
-    userByPlayerId(data, playerId) | LogOnNone(playerId) | OnValue([](const User& user) {
-        rng::for_each(user.auth_tokens(), [](const std::string_view token) { std::println("{}", token); });
+    const auto now = utcTimeSinceEpochInSec();
+    userByPlayerId(data, playerId) | LogOnNone(playerId) | OnValue([now](const User& user) {
+        rng::for_each(user.tokens(), [now](const AuthToken& token) {
+            const auto expiresIn = authTokenExpiresAt(token) - now;
+            std::println(
+                "{} | issued {} ago | used {} ago | {}",
+                token.hash(),
+                formatAge(now - token.issued_at()),
+                formatAge(now - token.last_used_at()),
+                expiresIn > 0 ? fmt::format("expires in {}", formatAge(expiresIn)) : std::string{"expired"});
+        });
     });
 }
 
@@ -97,11 +123,11 @@ auto removeTokens(GameData& data, const PlayerIdView playerId, const std::option
 {
     userByPlayerId(data, playerId) | LogOnNone(playerId) | OnValue([&authToken, playerId](User& user) {
         authToken | OnNone([&user, playerId] {
-            PREF_I("Removed {} tokens for {}", user.auth_tokens_size(), PREF_V(playerId));
-            user.clear_auth_tokens();
+            PREF_I("Removed {} tokens for {}", user.tokens_size(), PREF_V(playerId));
+            user.clear_tokens();
         }) | OnValue([&user, playerId](const std::string& token) {
-            auto& tokens = *user.mutable_auth_tokens();
-            const auto it = rng::remove(tokens, token);
+            auto& tokens = *user.mutable_tokens();
+            const auto it = rng::remove(tokens, token, &AuthToken::hash);
             if (it == rng::end(tokens)) {
                 PREF_W("{} not found for {}", PREF_V(token), PREF_V(playerId));
                 return;
@@ -122,6 +148,25 @@ auto addUser(GameData& data, const PlayerName& name, const std::string& password
     PREF_I("Added profileId: {}", newUser.player_id());
 }
 
+// Users <prefix>1 to <prefix><count> for pref-load, the existing ones kept as they are
+auto addUsers(GameData& data, const std::string_view prefix, const int count, const std::string& password) -> void
+{
+    const auto names = data.users() | rv::transform(&User::player_name) | rng::to<std::set<std::string>>();
+    const auto hash = hashPassword(password); // the same for all of them, hashing is slow on purpose
+    auto added = 0;
+    for (auto number = 1; number <= count; ++number) {
+        auto name = fmt::format("{}{}", prefix, number);
+        if (names.contains(name)) { continue; }
+        auto& newUser = *data.add_users();
+        newUser.set_player_id(generateUuid());
+        newUser.set_player_name(std::move(name));
+        newUser.set_password(hash);
+        newUser.set_version(1);
+        ++added;
+    }
+    PREF_I("Added {} users", added);
+}
+
 auto removeUser(GameData& data, const PlayerNameView playerId) -> void
 {
     auto& users = *data.mutable_users();
@@ -196,12 +241,17 @@ auto main(int argc, char** argv) -> int
                     pref::removeGame(data, args.at("<id>").asString(), num);
                 }
             }
-            pref::storeGameData(path, data);
+            pref::compactGameData(path, data);
+        } else if (args.at("compact").asBool()) {
+            pref::compactGameData(path, data);
         } else if (args.at("add").asBool()) {
             if (args.at("--user").asBool()) {
                 pref::addUser(data, args.at("<name>").asString(), args.at("<password>").asString());
+            } else if (args.at("--users").asBool()) {
+                const auto count = gsl::narrow<int>(args.at("<count>").asLong());
+                pref::addUsers(data, args.at("<prefix>").asString(), count, args.at("<password>").asString());
             }
-            pref::storeGameData(path, data);
+            pref::compactGameData(path, data);
         }
         return 1;
     } catch (...) {
@@ -0,0 +1,535 @@
+// SPDX-License-Identifier: AGPL-3.0-only
+// Copyright (c) 2025 Oleksandr Kozlov
+
+#include "bot.hpp"
+#include "common/common.hpp"
+#include "common/logger.hpp"
+#include "common/wire.hpp"
+#include "options.hpp"
+#include "proto/pref.pb.h"
+#include "rules.hpp"
+#include "serialization.hpp"
+#include "server.hpp"
+#include "transport.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+#include <docopt/docopt.h>
+#include <exec/async_scope.hpp>
+#include <exec/scope.hpp>
+#include <gsl/gsl>
+#include <spdlog/spdlog.h>
+#include <stdexec/execution.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <print>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace pref {
+namespace {
+
+constexpr std::string_view Usage = R"(
+Preferans load generator: clients that log in and play random legal moves
+
+Usage:
+  pref-load <host> <port> [--clients=<n>] [--deals=<n>] [--users=<prefix>] [--password=<password>]
+            [--threads=<n>] [--interval=<ms>] [--pid=<pid>] [--deflate]
+  pref-load (-h | --help)
+
+Options:
+  -h --help              Show this screen.
+  --clients=<n>          Number of clients, each logs in as a user of its own [default: 300].
+  --deals=<n>            Number of deals each client plays before it logs out [default: 10].
+  --users=<prefix>       Users are named <prefix>1 to <prefix><n>, see `pref-cli add --users` [default: load].
+  --password=<password>  Password of the users [default: load].
+  --threads=<n>          Number of threads to run the clients on, 0 means all cores [default: 0].
+  --interval=<ms>        Delay between the clients' connects [default: 5].
+  --pid=<pid>            The server's process, on this host, to measure the memory per session of.
+  --deflate              Offer permessage-deflate, as the browsers do.
+)";
+
+// Plain WebSocket: with PREF_SSL the server is expected behind a TLS terminating proxy for a load test
+using ClientStream = netx::use_sender_t::as_default_on_t<web::stream<beast::tcp_stream>>;
+using Resolver = netx::use_sender_t::as_default_on_t<tcp::resolver>;
+using Clock = std::chrono::steady_clock;
+using Samples = std::vector<Clock::duration>;
+
+inline constexpr auto MaxLoginAttempts = 20;
+inline constexpr auto FirstLoginBackoff = 100ms;
+inline constexpr auto MaxLoginBackoff = 5s;
+
+struct Options {
+    std::string host;
+    std::string port;
+    std::string users;
+    std::string password;
+    std::size_t clients{};
+    std::size_t deals{};
+    std::chrono::milliseconds interval{};
+    std::optional<long> pid;
+    bool deflate{};
+};
+
+struct LoadStats {
+    Samples connect; // TCP and WebSocket handshakes
+    Samples login; // LoginRequest -> LoginResponse, the Argon2 check included
+    Samples playCard; // PlayCard -> the next PlayerTurn
+    std::size_t loginRejections{}; // too many password checks in flight
+    std::size_t failures{};
+    std::size_t games{};
+    std::size_t deals{};
+
+    auto merge(LoadStats&& other) -> void
+    {
+        rng::move(other.connect, std::back_inserter(connect));
+        rng::move(other.login, std::back_inserter(login));
+        rng::move(other.playCard, std::back_inserter(playCard));
+        loginRejections += other.loginRejections;
+        failures += other.failures;
+        games += other.games;
+        deals += other.deals;
+    }
+};
+
+// The server's resident memory in KiB, std::nullopt when it can't be read
+[[nodiscard]] auto residentMemory(const long pid) -> std::optional<std::size_t>
+{
+    auto status = std::ifstream{fmt::format("/proc/{}/status", pid)};
+    for (auto line = std::string{}; std::getline(status, line);) {
+        if (line.starts_with("VmRSS:")) { return std::stoul(line.substr(std::size("VmRSS:") - 1)); }
+    }
+    return std::nullopt;
+}
+
+// What a client knows of its table, enough to make random legal moves for its turns
+class LoadClient {
+public:
+    explicit LoadClient(const std::uint64_t seed)
+        : m_random{seed}
+    {
+    }
+
+    // A ready check to request, if it completes the table
+    [[nodiscard]] auto join(const LoginResponse& response) -> std::vector<Message>
+    {
+        m_self = response.player_id();
+        for (const auto& player : response.players()) { m_players.insert(player.player_id()); }
+        m_players.insert(m_self);
+        m_isDealing = response.stage() != GameStage::UNKNOWN;
+        if (not isReadyCheckRequester()) { return {}; }
+        return {readyCheck(ReadyCheckState::REQUESTED)};
+    }
+
+    [[nodiscard]] auto self() const noexcept -> const PlayerId&
+    {
+        return m_self;
+    }
+
+    // The messages to answer with, if any. Counts the deals and the games played into `stats`
+    [[nodiscard]] auto handle(const Message& msg, LoadStats& stats) -> std::vector<Message>
+    {
+        auto result = std::vector<Message>{};
+        const auto requestReadyCheck = [&] {
+            if (isReadyCheckRequester()) { result.push_back(readyCheck(ReadyCheckState::REQUESTED)); }
+        };
+        switch (msg.body_case()) {
+        case Message::kPlayerJoined:
+            m_players.insert(msg.player_joined().player_id());
+            requestReadyCheck();
+            break;
+        case Message::kPlayerLeft: m_players.erase(msg.player_left().player_id()); break;
+        case Message::kReadyCheck:
+            if (msg.ready_check().state() == ReadyCheckState::REQUESTED and msg.ready_check().player_id() != m_self
+                and not m_isDealing) {
+                result.push_back(readyCheck(ReadyCheckState::ACCEPTED));
+            }
+            break;
+        case Message::kDealCards: {
+            const auto& dealCards = msg.deal_cards();
+            m_hands[dealCards.player_id()] = parseHand(dealCards.cards(), dealCards.hand());
+            m_isDealing = true;
+            break;
+        }
+        case Message::kBidding: {
+            const auto& bidding = msg.bidding();
+            m_bids[bidding.player_id()] = parseBid(bidding.bid(), bidding.bid_code());
+            break;
+        }
+        case Message::kOpenTalon: m_talonCard = parseCard(msg.open_talon().card(), msg.open_talon().card_id()); break;
+        case Message::kOpenWhistPlay:
+            m_openWhist = {msg.open_whist_play().active_whister_id(), msg.open_whist_play().passive_whister_id()};
+            break;
+        case Message::kPlayCard: {
+            const auto& playCard = msg.play_card();
+            if (const auto card = parseCard(playCard.card(), playCard.card_id())) {
+                m_trick.push_back(*card);
+                if (const auto it = m_hands.find(playCard.player_id()); it != std::end(m_hands)) {
+                    it->second.erase(*card);
+                }
+            }
+            break;
+        }
+        case Message::kTrickFinished:
+            m_trick.clear();
+            m_talonCard.reset(); // the next one opens, if any, before the next trick
+            break;
+        case Message::kDealFinished:
+            ++stats.deals;
+            clearDeal();
+            if (msg.deal_finished().is_game_over()) {
+                ++stats.games;
+                m_isDealing = false;
+                requestReadyCheck();
+            }
+            break;
+        case Message::kPlayerTurn:
+            if (auto move = makeMove(msg.player_turn())) { result.push_back(*std::move(move)); }
+            break;
+        default: break;
+        }
+        return result;
+    }
+
+private:
+    // The client with the lowest id requests once the table is full, bots never request
+    [[nodiscard]] auto isReadyCheckRequester() const -> bool
+    {
+        if (m_isDealing or std::size(m_players) != NumberOfPlayers) { return false; }
+        const auto clients = m_players | rv::filter([](const PlayerId& id) { return not id.starts_with("bot:"); });
+        return not rng::empty(clients) and *rng::begin(clients) == m_self;
+    }
+
+    [[nodiscard]] auto readyCheck(const ReadyCheckState state) const -> Message
+    {
+        auto result = ReadyCheck{};
+        result.set_player_id(m_self);
+        result.set_state(state);
+        return makeMessage(std::move(result));
+    }
+
+    auto clearDeal() -> void
+    {
+        m_hands.clear();
+        m_bids.clear();
+        m_trick.clear();
+        m_talonCard.reset();
+        m_openWhist.reset();
+    }
+
+    [[nodiscard]] auto declarerBid() const -> Bid
+    {
+        const auto it = rng::find_if(m_bids, [](const auto& bid) { return not bid.second.isPass(); });
+        return it == rng::end(m_bids) ? Bid{} : it->second;
+    }
+
+    // The turn is the client's own, or the passive whister's that it plays for on an open whist
+    [[nodiscard]] auto makeMove(const PlayerTurn& turn) -> std::optional<Message>
+    {
+        using enum GameStage;
+        const auto& playerId = turn.player_id();
+        const auto isPassiveWhister = m_openWhist and m_openWhist->second == playerId;
+        const auto& moverId = (turn.stage() == PLAYING and isPassiveWhister) ? m_openWhist->first : playerId;
+        if (moverId != m_self) { return std::nullopt; }
+        auto& hand = m_hands[playerId];
+        switch (turn.stage()) {
+        case BIDDING: {
+            // always above the highest bid, the forehand's right to hold it aside
+            auto bidTurn = BidTurn{.myBid = m_bids[m_self]};
+            const auto raise = [&](const std::size_t rank) {
+                bidTurn.currentRank
+                    = (bidTurn.currentRank == BidTurn::NoRank) ? rank : std::max(bidTurn.currentRank, rank);
+            };
+            for (const auto bid : m_bids | rv::values) {
+                if (not bid.isPass() and not bid.empty()) { raise(bid.rank()); }
+            }
+            if (parseBid(turn.min_bid(), turn.min_bid_code()) == PREF_SEVEN) { raise(Bid{PREF_SIX}.rank()); }
+            auto bidding = Bidding{};
+            bidding.set_player_id(m_self);
+            const auto bid = randomBid(bidTurn, m_random);
+            bidding.set_bid(bid.text());
+            bidding.set_bid_code(bid.code());
+            return makeMessage(std::move(bidding));
+        }
+        case TALON_PICKING: {
+            for (const auto& card : turn.talon_cards()) {
+                if (const auto id = fromWireCard(card)) { hand.insert(*id); }
+            }
+            for (const auto& name : turn.talon()) {
+                if (const auto id = toCardId(name)) { hand.insert(*id); }
+            }
+            auto discarded = CardMask{};
+            while (discarded.size() < 2) { discarded.insert(randomCardOf(hand - discarded, m_random)); }
+            hand = hand - discarded;
+            const auto bid = m_bids[m_self];
+            auto discardTalon = DiscardTalon{};
+            discardTalon.set_player_id(m_self);
+            discardTalon.set_bid(bid.text());
+            discardTalon.set_bid_code(bid.code());
+            discardTalon.set_cards_mask(toWireHand(discarded));
+            return makeMessage(std::move(discardTalon));
+        }
+        case WHISTING: {
+            auto whisting = Whisting{};
+            whisting.set_player_id(m_self);
+            const auto isMiser = declarerBid().isMiser();
+            whisting.set_choice(isMiser or std::bernoulli_distribution{}(m_random) ? PREF_WHIST : PREF_PASS);
+            return makeMessage(std::move(whisting));
+        }
+        case HOW_TO_PLAY: {
+            auto howToPlay = HowToPlay{};
+            howToPlay.set_player_id(m_self);
+            howToPlay.set_choice(PREF_CLOSED);
+            return makeMessage(std::move(howToPlay));
+        }
+        case PLAYING: {
+            if (hand.empty()) { return std::nullopt; } // not shown to the client
+            const auto talonSuit = m_talonCard.transform(suitOf);
+            const auto leadSuit
+                = std::empty(m_trick) ? talonSuit : std::optional{talonSuit.value_or(suitOf(m_trick.front()))};
+            const auto trump = m_talonCard ? std::nullopt : declarerBid().trump();
+            auto playCard = PlayCard{};
+            playCard.set_player_id(playerId);
+            playCard.set_card_id(toWireCard(randomCardOf(playableCards(hand, leadSuit, trump), m_random)));
+            return makeMessage(std::move(playCard));
+        }
+        default: return std::nullopt;
+        }
+    }
+
+    std::mt19937_64 m_random;
+    PlayerId m_self;
+    std::set<PlayerId> m_players;
+    std::map<PlayerId, CardMask> m_hands; // its own and the ones shown to it
+    std::map<PlayerId, Bid> m_bids; // the last of each player, the final contract after the talon
+    std::vector<CardId> m_trick;
+    std::optional<CardId> m_talonCard; // opened for a pass game trick
+    std::optional<std::pair<PlayerId, PlayerId>> m_openWhist; // the active and the passive whister
+    bool m_isDealing{}; // a game is on, no ready checks
+};
+
+auto send(ClientStream& ws, const Message& msg) -> task<>
+{
+    const auto payload = msg.SerializeAsString();
+    co_await ws.async_write(net::buffer(payload), netx::use_sender);
+}
+
+[[nodiscard]] auto receive(ClientStream& ws, beast::flat_buffer& buf) -> task<std::optional<Message>>
+{
+    co_await ws.async_read(buf, netx::use_sender);
+    auto _ = ex::scope_guard{[&] noexcept { buf.consume(buf.size()); }};
+    co_return makeMessage(buf.data().data(), buf.size());
+}
+
+// Logs in, retrying with a backoff while the server has too many password checks in flight
+[[nodiscard]] auto login(ClientStream& ws, beast::flat_buffer& buf, const Options& options, const std::size_t number,
+    LoadStats& stats) -> task<std::optional<LoginResponse>>
+{
+    auto backoff = std::chrono::milliseconds{FirstLoginBackoff};
+    for (auto attempt = 1; attempt <= MaxLoginAttempts; ++attempt) {
+        auto loginRequest = LoginRequest{};
+        loginRequest.set_player_name(fmt::format("{}{}", options.users, number));
+        loginRequest.set_password(options.password);
+        loginRequest.set_wire_format(WireFormat::WIRE_COMPACT);
+        const auto sent = Clock::now();
+        co_await send(ws, makeMessage(std::move(loginRequest)));
+        auto msg = co_await receive(ws, buf);
+        if (not msg or msg->body_case() != Message::kLoginResponse) { continue; }
+        const auto& response = msg->login_response();
+        if (std::empty(response.error())) {
+            stats.login.push_back(Clock::now() - sent);
+            co_return response;
+        }
+        if (not response.error().contains("too many login attempts")) {
+            PREF_W("error: {}, {}", response.error(), PREF_V(number));
+            co_return std::nullopt;
+        }
+        ++stats.loginRejections;
+        co_await sleepFor(backoff, ws.get_executor());
+        backoff = std::min(backoff * 2, std::chrono::milliseconds{MaxLoginBackoff});
+    }
+    co_return std::nullopt;
+}
+
+// The server's memory before the clients connect and after they have all tried to log in
+struct MemoryProbe {
+    std::optional<long> pid;
+    std::size_t clients{};
+    std::optional<std::size_t> before;
+    std::optional<std::size_t> after;
+    std::atomic<std::size_t> loginsDone;
+
+    auto loginDone() -> void
+    {
+        if (++loginsDone == clients and pid) { after = residentMemory(*pid); }
+    }
+};
+
+// A client plays until it has seen the deals, then it logs out
+auto runClient(const Options& options, const std::size_t number, net::any_io_executor ex, MemoryProbe& memory)
+    -> task<LoadStats>
+{
+    auto stats = LoadStats{};
+    auto hasTriedLogin = false;
+    try {
+        co_await sleepFor(options.interval * static_cast<long>(number - 1), ex);
+        auto ws = ClientStream{ex};
+        auto resolver = Resolver{ex};
+        const auto connecting = Clock::now();
+        const auto endpoints = co_await resolver.async_resolve(options.host, options.port);
+        co_await beast::get_lowest_layer(ws).async_connect(endpoints, netx::use_sender);
+        beast::get_lowest_layer(ws).expires_never(); // the WebSocket timeouts take over
+        ws.binary(true);
+        ws.set_option(web::stream_base::timeout::suggested(beast::role_type::client));
+        if (options.deflate) {
+            auto deflate = web::permessage_deflate{};
+            deflate.client_enable = true;
+            ws.set_option(deflate);
+        }
+        co_await ws.async_handshake(options.host, "/", netx::use_sender);
+        stats.connect.push_back(Clock::now() - connecting);
+        auto buf = beast::flat_buffer{};
+        const auto response = co_await login(ws, buf, options, number, stats);
+        hasTriedLogin = true;
+        memory.loginDone();
+        if (not response) {
+            ++stats.failures;
+            co_return stats;
+        }
+        auto client = LoadClient{number};
+        for (const auto& msg : client.join(*response)) { co_await send(ws, msg); }
+        auto playCardSent = std::optional<Clock::time_point>{};
+        while (stats.deals < options.deals) {
+            const auto msg = co_await receive(ws, buf);
+            if (not msg) { continue; }
+            if (msg->body_case() == Message::kPlayerTurn and playCardSent) {
+                stats.playCard.push_back(Clock::now() - *playCardSent);
+            }
+            if (msg->body_case() == Message::kPlayerTurn or msg->body_case() == Message::kDealFinished) {
+                playCardSent.reset(); // the next deal's first turn comes after a pause
+            }
+            for (const auto& reply : client.handle(*msg, stats)) {
+                if (reply.body_case() == Message::kPlayCard) { playCardSent = Clock::now(); }
+                co_await send(ws, reply);
+            }
+        }
+        auto logout = Logout{};
+        logout.set_player_id(client.self());
+        logout.set_auth_token(response->auth_token());
+        co_await send(ws, makeMessage(std::move(logout)));
+        co_await ws.async_close(web::close_code::normal, netx::use_sender);
+    } catch (const std::exception& error) {
+        ++stats.failures;
+        PREF_W("error: {}, {}", error.what(), PREF_V(number));
+        if (not hasTriedLogin) { memory.loginDone(); }
+    }
+    co_return stats;
+}
+
+auto printPercentiles(const std::string_view name, Samples& samples) -> void
+{
+    using Millis = std::chrono::duration<double, std::milli>;
+    if (std::empty(samples)) {
+        std::println("{:<22} | no samples", name);
+        return;
+    }
+    rng::sort(samples);
+    const auto at = [&](const double p) {
+        const auto index = static_cast<std::size_t>(p * static_cast<double>(std::size(samples) - 1));
+        return Millis{samples[index]}.count();
+    };
+    std::println(
+        "{:<22} | {:>8} | {:>8.2f} | {:>8.2f} | {:>8.2f} | {:>8.2f}",
+        name,
+        std::size(samples),
+        at(0.50),
+        at(0.99),
+        at(0.999),
+        Millis{samples.back()}.count());
+}
+
+auto report(LoadStats& stats, const MemoryProbe& memory, const std::chrono::duration<double> elapsed) -> void
+{
+    const auto sessions = std::size(stats.login);
+    std::println(
+        "clients: {}, sessions: {}, failures: {}, login rejections: {}",
+        memory.clients,
+        sessions,
+        stats.failures,
+        stats.loginRejections);
+    std::println("games: {}, deals: {}, elapsed: {:.1f}s", stats.games, stats.deals, elapsed.count());
+    std::println("{:<22} | {:>8} | {:>8} | {:>8} | {:>8} | {:>8}", "ms", "samples", "p50", "p99", "p999", "max");
+    printPercentiles("connect", stats.connect);
+    printPercentiles("login", stats.login);
+    printPercentiles("PlayCard -> PlayerTurn", stats.playCard);
+    if (memory.before and memory.after and sessions != 0) {
+        const auto grown = static_cast<double>(*memory.after) - static_cast<double>(*memory.before);
+        std::println("memory per session: {:.1f} KiB", grown / static_cast<double>(sessions));
+    }
+}
+
+} // namespace
+} // namespace pref
+
+auto main(const int argc, const char* const argv[]) -> int
+{
+    try {
+        const auto args = docopt::docopt(std::string{pref::Usage}, {std::next(argv), std::next(argv, argc)});
+        const auto options = pref::Options{
+            .host = args.at("<host>").asString(),
+            .port = args.at("<port>").asString(),
+            .users = args.at("--users").asString(),
+            .password = args.at("--password").asString(),
+            .clients = gsl::narrow<std::size_t>(args.at("--clients").asLong()),
+            .deals = gsl::narrow<std::size_t>(args.at("--deals").asLong()),
+            .interval = std::chrono::milliseconds{args.at("--interval").asLong()},
+            .pid = args.at("--pid").isString() ? std::optional{args.at("--pid").asLong()} : std::nullopt,
+            .deflate = args.at("--deflate").asBool(),
+        };
+        spdlog::set_level(spdlog::level::warn);
+        auto shards = std::vector<std::unique_ptr<pref::Shard>>{};
+        for (auto i = pref::threadsCount(args.at("--threads").asLong()); i > 0; --i) {
+            shards.push_back(std::make_unique<pref::Shard>(1)); // a client's stream is only used from its thread
+        }
+        auto memory = pref::MemoryProbe{.pid = options.pid, .clients = options.clients};
+        if (options.pid) { memory.before = pref::residentMemory(*options.pid); }
+        auto total = pref::LoadStats{};
+        auto mutex = std::mutex{};
+        auto scope = exec::async_scope{};
+        const auto started = pref::Clock::now();
+        for (auto number = 1uz; number <= options.clients; ++number) {
+            auto& shard = *shards[number % std::size(shards)];
+            scope.spawn(
+                stdx::starts_on(shard.get_scheduler(), pref::runClient(options, number, shard.get_executor(), memory))
+                | stdx::then([&](pref::LoadStats stats) noexcept {
+                      const auto lock = std::scoped_lock{mutex};
+                      total.merge(std::move(stats));
+                  })
+                | stdx::upon_error(pref::Detached("runClient")));
+        }
+        stdx::sync_wait(scope.on_empty());
+        pref::report(total, memory, pref::Clock::now() - started);
+        return total.failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    } catch (const std::exception& error) {
+        PREF_DE(error);
+    } catch (...) {
+        PREF_E("error: unknown");
+    }
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: AGPL-3.0-only
+// Copyright (c) 2025 Oleksandr Kozlov
+
+#include "common/logger.hpp"
+#include "journal.hpp"
+#include "proto/pref.pb.h"
+#include "recording.hpp"
+#include "server.hpp"
+
+#include <docopt/docopt.h>
+#include <gsl/gsl>
+#include <spdlog/spdlog.h>
+#include <stdexec/execution.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <iterator>
+#include <print>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace pref {
+namespace {
+
+constexpr std::string_view Usage = R"(
+Preferans replay: plays a table recorded by `server --record=<dir>` again, as fast as it goes
+
+Usage:
+  pref-replay <recording> [--repeat=<n>] [--verbose]
+  pref-replay (-h | --help)
+
+Options:
+  -h --help       Show this screen.
+  --repeat=<n>    Number of times to play the recording, e.g. for a profiler to sample [default: 1].
+  --verbose       Logs what the table does, like the server would.
+
+Prints a line per seat with the count and the CRC-32 of the frames the seat was sent: two builds playing the
+recording the same way print the same lines, and the replays of one build that differ are an error.
+)";
+
+[[nodiscard]] auto isSame(const ReplayStats& lhs, const ReplayStats& rhs) -> bool
+{
+    return lhs.messages == rhs.messages
+        and lhs.deals == rhs.deals
+        and rng::equal(lhs.seats, rhs.seats, [](const auto& l, const auto& r) {
+               return l.first == r.first and l.second.frames == r.second.frames
+                   and l.second.crc.checksum() == r.second.crc.checksum();
+           });
+}
+
+auto report(const ReplayStats& stats, const std::size_t repeats, const std::chrono::duration<double> elapsed) -> void
+{
+    const auto messages = static_cast<double>(stats.messages * repeats);
+    std::println("messages: {}, deals: {}, elapsed: {:.3f}s", stats.messages, stats.deals, elapsed.count());
+    std::println("messages/sec: {:.0f}", messages / elapsed.count());
+    for (const auto& [playerId, seat] : stats.seats) {
+        std::println("seat {}: {} frames, crc32 {:08x}", playerId, seat.frames, seat.crc.checksum());
+    }
+}
+
+} // namespace
+} // namespace pref
+
+auto main(const int argc, const char* const argv[]) -> int
+{
+    try {
+        const auto args = docopt::docopt(std::string{pref::Usage}, {std::next(argv), std::next(argv, argc)});
+        const auto path = fs::path{args.at("<recording>").asString()};
+        const auto repeats = gsl::narrow<std::size_t>(args.at("--repeat").asLong());
+        if (not args.at("--verbose").asBool()) { spdlog::set_level(spdlog::level::warn); } // the tables log every move
+        const auto bytes = pref::readFile(path);
+        if (not bytes) { throw std::runtime_error{fmt::format("failed to read {}", path.string())}; }
+        const auto records = pref::parseRecording(*bytes);
+        auto registry = pref::TableRegistry{1, {.threads = 1}};
+        auto results = std::vector<pref::ReplayStats>{};
+        const auto started = std::chrono::steady_clock::now();
+        for (auto repeat = 0uz; repeat < repeats; ++repeat) {
+            auto [stats] = stdx::sync_wait(
+                stdx::starts_on(registry.scheduler(), pref::replayRecording(registry, records))).value();
+            results.push_back(std::move(stats));
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - started;
+        registry.shutdown();
+        if (std::empty(results)) { return EXIT_SUCCESS; }
+        pref::report(results.front(), repeats, elapsed);
+        const auto diverged = rng::count_if(results, [&](const auto& stats) {
+            return not pref::isSame(stats, results.front());
+        });
+        if (diverged != 0) {
+            std::println("error: {} of the {} replays diverged from the first one", diverged, repeats);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    } catch (const std::exception& error) {
+        PREF_DE(error);
+    } catch (...) {
+        PREF_E("error: unknown");
+    }
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,253 @@
+// SPDX-License-Identifier: AGPL-3.0-only
+// Copyright (c) 2025 Oleksandr Kozlov
+
+#pragma once
+
+#include "common/time.hpp"
+#include "journal.hpp"
+#include "proto/pref.pb.h"
+
+#include <common/common.hpp>
+#include <common/logger.hpp>
+#include <fmt/format.h>
+#include <range/v3/all.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+// A table's recording is a file of TableRecord frames, framed like the journal's records: the seed the table deals
+// with, and then the seatings, the messages and the next deals in the order the table handled them. `pref-replay`
+// plays it again, e.g. to reproduce a crash, to profile the same game every time, or to compare what two builds send.
+
+namespace pref {
+
+// The files of the recordings for a BackgroundWriter, one per table
+class RecordingFiles {
+public:
+    using TableId = std::uint64_t;
+    using Item = std::pair<TableId, std::string>;
+
+    // How long the writer lets the frames gather after the first one
+    static constexpr auto CoalescingDelay = 100ms;
+    static constexpr auto Flush = FlushPolicy::None; // the torn tails a crash leaves are cut off when read
+
+    RecordingFiles() = default;
+    RecordingFiles(const RecordingFiles&) = delete;
+    RecordingFiles(RecordingFiles&&) = delete;
+    auto operator=(const RecordingFiles&) -> RecordingFiles& = delete;
+    auto operator=(RecordingFiles&&) -> RecordingFiles& = delete;
+
+    ~RecordingFiles()
+    {
+        close();
+    }
+
+    auto open(fs::path dir) -> bool
+    {
+        auto error = std::error_code{};
+        fs::create_directories(dir, error);
+        if (error) {
+            PREF_W("error: {}, {}", error.message(), PREF_V(dir));
+            return false;
+        }
+        m_dir = std::move(dir);
+        m_started = utcTimeSinceEpochInSec();
+        return true;
+    }
+
+    // The files of a run of the server are named by the time it started, so that a restart never appends to them
+    [[nodiscard]] auto path(const TableId tableId) const -> fs::path
+    {
+        return m_dir / fmt::format("{}-table-{}.rec", m_started, tableId);
+    }
+
+    // One write per table however many frames it has in the batch
+    auto write(const std::vector<Item>& batch) -> bool
+    {
+        auto frames = std::map<TableId, std::string>{};
+        for (const auto& [tableId, frame] : batch) { frames[tableId] += frame; }
+        auto isWritten = true;
+        for (const auto& [tableId, bytes] : frames) {
+            const auto fd = file(tableId);
+            if (fd >= 0 and not appendToFile(fd, bytes, Flush)) {
+                const auto batchSize = std::size(bytes);
+                PREF_W("error: {}, {}, {}", std::strerror(errno), PREF_V(tableId), PREF_V(batchSize));
+                isWritten = false;
+            }
+        }
+        return isWritten;
+    }
+
+    auto close() -> void
+    {
+        for (const auto fd : m_files | rv::values) {
+            if (fd >= 0) { ::close(fd); }
+        }
+        m_files.clear();
+    }
+
+private:
+    // A file that fails to open is not tried again, the table goes unrecorded
+    [[nodiscard]] auto file(const TableId tableId) -> int
+    {
+        if (const auto it = m_files.find(tableId); it != std::end(m_files)) { return it->second; }
+        const auto tablePath = path(tableId);
+        const auto fd = ::open(tablePath.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+        if (fd < 0) { PREF_W("error: {}, {}", std::strerror(errno), PREF_V(tablePath)); }
+        m_files.emplace(tableId, fd);
+        return fd;
+    }
+
+    fs::path m_dir;
+    std::int64_t m_started{};
+    std::map<TableId, int> m_files;
+};
+
+// Writes the recordings of all the tables on a BackgroundWriter, so that the tables never wait on the disk. Nothing
+// is synced: a crash loses the last moments of the tables
+class RecordingWriter {
+public:
+    using TableId = RecordingFiles::TableId;
+
+    auto open(fs::path dir) -> bool
+    {
+        if (not m_writer.sink().open(std::move(dir))) { return false; }
+        m_writer.start();
+        return true;
+    }
+
+    [[nodiscard]] auto isOpen() const noexcept -> bool
+    {
+        return m_writer.isRunning();
+    }
+
+    [[nodiscard]] auto path(const TableId tableId) const -> fs::path
+    {
+        return m_writer.sink().path(tableId);
+    }
+
+    // Never blocks on the disk
+    auto append(const TableId tableId, std::string frame) -> void
+    {
+        m_writer.append({tableId, std::move(frame)});
+    }
+
+    // Writes the frames left and joins the writer thread
+    auto stop() -> void
+    {
+        m_writer.stop();
+    }
+
+private:
+    BackgroundWriter<RecordingFiles> m_writer;
+};
+
+// Records what a table handles, from the table's thread. A table that is not recorded has a default one, which does
+// nothing
+class TableRecorder {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TableRecorder() = default;
+
+    TableRecorder(RecordingWriter& writer, const RecordingWriter::TableId tableId)
+        : m_writer{&writer}
+        , m_tableId{tableId}
+        , m_opened{Clock::now()}
+    {
+    }
+
+    [[nodiscard]] auto isRecording() const noexcept -> bool
+    {
+        return m_writer != nullptr;
+    }
+
+    // the seed the cards are dealt with from now on
+    auto seeded(const std::uint64_t seed) -> void
+    {
+        if (not isRecording()) { return; }
+        auto record = TableRecord{};
+        record.set_seed(seed);
+        append(record);
+    }
+
+    auto seated(const std::string_view playerId, const std::string_view playerName, const bool isBot) -> void
+    {
+        if (not isRecording()) { return; }
+        auto record = TableRecord{};
+        auto& seated = *record.mutable_seated();
+        seated.set_player_id(playerId);
+        seated.set_player_name(playerName);
+        seated.set_is_bot(isBot);
+        append(record);
+    }
+
+    auto left(const std::string_view playerId) -> void
+    {
+        if (not isRecording()) { return; }
+        auto record = TableRecord{};
+        record.set_left(playerId);
+        append(record);
+    }
+
+    auto message(const Message& msg) -> void
+    {
+        if (not isRecording()) { return; }
+        auto record = TableRecord{};
+        *record.mutable_message() = msg;
+        append(record);
+    }
+
+    // the next deal is dealt, after the messages handled while the last one's result was shown
+    auto nextDeal() -> void
+    {
+        if (not isRecording()) { return; }
+        auto record = TableRecord{};
+        record.set_next_deal(true);
+        append(record);
+    }
+
+private:
+    auto append(TableRecord& record) -> void
+    {
+        const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - m_opened);
+        record.set_elapsed_us(elapsed.count());
+        m_writer->append(m_tableId, frameRecord(record));
+    }
+
+    RecordingWriter* m_writer{};
+    RecordingWriter::TableId m_tableId{};
+    Clock::time_point m_opened;
+};
+
+// The records up to a torn or corrupted tail, e.g. the frames being written when the server crashed
+[[nodiscard]] inline auto parseRecording(const std::string_view bytes) -> std::vector<TableRecord>
+{
+    auto result = std::vector<TableRecord>{};
+    const auto offset = readFrames(bytes, [&](const std::string_view payload) {
+        auto record = TableRecord{};
+        if (not record.ParseFromArray(std::data(payload), static_cast<int>(std::size(payload)))) { return false; }
+        result.push_back(std::move(record));
+        return true;
+    });
+    if (offset != std::size(bytes)) {
+        const auto records = std::size(result);
+        const auto droppedBytes = std::size(bytes) - offset;
+        PREF_W("error: corrupted recording tail, {}, {}", PREF_V(records), PREF_V(droppedBytes));
+    }
+    return result;
+}
+
+} // namespace pref
@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: AGPL-3.0-only
+// Copyright (c) 2025 Oleksandr Kozlov
+
+#pragma once
+
+#include "common/common.hpp"
+
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace pref {
+
+enum class ContractLevel {
+    Six,
+    Seven,
+    Eight,
+    Nine,
+    Ten,
+    Miser,
+};
+
+[[nodiscard]] constexpr auto makeContractLevel(const Bid contract) noexcept -> ContractLevel
+{
+    if (contract.isMiser()) { return ContractLevel::Miser; }
+    if (contract.level() == 0) { std::unreachable(); } // a pass or no bid
+    return static_cast<ContractLevel>(contract.level() - 6); // Six is the first one
+}
+
+[[nodiscard]] constexpr auto contractPrice(const ContractLevel level) noexcept -> int
+{
+    using enum ContractLevel;
+    switch (level) {
+    case Six: return 2;
+    case Seven: return 4;
+    case Eight: return 6;
+    case Nine: return 8;
+    case Ten: [[fallthrough]];
+    case Miser: return 10;
+    };
+    std::unreachable();
+}
+
+[[nodiscard]] constexpr auto declarerReqTricks(const ContractLevel level) noexcept -> int
+{
+    using enum ContractLevel;
+    switch (level) {
+    case Six: return 6;
+    case Seven: return 7;
+    case Eight: return 8;
+    case Nine: return 9;
+    case Ten: return 10;
+    case Miser: return 0;
+    };
+    std::unreachable();
+}
+
+[[nodiscard]] constexpr auto twoWhistersReqTricks(const ContractLevel level) noexcept -> int
+{
+    using enum ContractLevel;
+    switch (level) {
+    case Six: return 4;
+    case Seven: return 2;
+    case Eight:
+    case Nine: [[fallthrough]];
+    case Ten: return 1;
+    case Miser: return 0;
+    };
+    std::unreachable();
+}
+
+[[nodiscard]] constexpr auto oneWhisterReqTricks(const ContractLevel level) noexcept -> int
+{
+    using enum ContractLevel;
+    switch (level) {
+    case Six: return 2;
+    case Seven:
+    case Eight:
+    case Nine: [[fallthrough]];
+    case Ten: return 1;
+    case Miser: return 0;
+    };
+    std::unreachable();
+}
+
+// A miser is fulfilled by taking at most declarerReqTricks, any other contract by taking at least that many
+[[nodiscard]] constexpr auto hasFulfilledContract(const ContractLevel level, const int tricksTaken) noexcept -> bool
+{
+    return level == ContractLevel::Miser ? tricksTaken <= declarerReqTricks(level)
+                                         : tricksTaken >= declarerReqTricks(level);
+}
+
+enum class WhistingChoice {
+    Pass,
+    Whist,
+    HalfWhist,
+    PassWhist,
+    PassPass,
+};
+
+struct Whister {
+    PlayerId id;
+    WhistingChoice choice = WhistingChoice::Pass;
+    int tricksTaken{};
+};
+
+struct Declarer {
+    PlayerId id;
+    ContractLevel contractLevel = ContractLevel::Six;
+    int tricksTaken{};
+};
+
+[[nodiscard]] auto calculateDealScore(const Declarer& declarer, const std::vector<Whister>& whisters) -> DealScore;
+
+struct Beat {
+    CardId candidate{};
+    CardId best{};
+    Suit leadSuit{};
+    std::optional<Suit> trump;
+};
+
+[[nodiscard]] constexpr auto beats(const Beat beat) noexcept -> bool
+{
+    const auto [candidate, best, leadSuit, trump] = beat;
+    const auto candidateSuit = suitOf(candidate);
+    const auto bestSuit = suitOf(best);
+    if (candidateSuit == bestSuit) { return rankOf(candidate) > rankOf(best); }
+    if (trump and (candidateSuit == *trump)) { return true; }
+    if (trump and (bestSuit == *trump)) { return false; }
+    return candidateSuit == leadSuit;
+}
+
+// The cards of the hand allowed on a trick: the lead suit if any, otherwise trumps if any, otherwise every card
+[[nodiscard]] constexpr auto playableCards(
+    const CardMask hand, const std::optional<Suit> leadSuit, const std::optional<Suit> trump) noexcept -> CardMask
+{
+    if (not leadSuit) { return hand; }
+    if (const auto follow = hand & CardMask::of(*leadSuit); not follow.empty()) { return follow; }
+    if (trump) {
+        if (const auto trumps = hand & CardMask::of(*trump); not trumps.empty()) { return trumps; }
+    }
+    return hand;
+}
+
+} // namespace pref
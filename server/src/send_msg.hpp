@@ -14,12 +14,13 @@
 #include <range/v3/all.hpp>
 
 #include <cassert>
+#include <concepts>
 #include <coroutine>
 #include <functional>
 #include <iterator>
 #include <map>
+#include <mutex>
 #include <optional>
-#include <set>
 #include <span>
 #include <string>
 #include <tuple>
@@ -29,225 +30,289 @@
 
 namespace pref {
 
-using PlayerTurnData = std::tuple<Player::Id, GameStage, std::string, bool, int, CardsNames>;
+using PlayerTurnData = std::tuple<Player::Id, GameStage, Bid, bool, int, std::vector<CardId>>;
 
-[[nodiscard]] inline auto players() -> decltype(auto)
+[[nodiscard]] inline auto players(const Context& ctx) -> decltype(auto)
 {
-    return ctx().players | rv::values;
+    return ctx.players | rv::values;
 }
 
-[[nodiscard]] inline auto findDeclarerId()
+[[nodiscard]] inline auto findDeclarerId(const Context& ctx)
 {
-    const auto players = pref::players();
+    const auto players = pref::players(ctx);
     return pref::find_if(
         players,
-        [](const std::string_view bid) { return not std::empty(bid) and bid != PREF_PASS; },
+        [](const Bid bid) { return not bid.empty() and not bid.isPass(); },
         &Player::bid,
         &Player::id);
 }
 
-[[nodiscard]] inline auto getDeclarer() -> Player&
+[[nodiscard]] inline auto getDeclarer(const Context& ctx) -> Player&
 {
-    const auto declarerId = findDeclarerId();
-    assert(declarerId and ctx().players.contains(*declarerId) and "declarer exists");
-    return ctx().players.at(*declarerId);
+    const auto declarerId = findDeclarerId(ctx);
+    assert(declarerId and ctx.players.contains(*declarerId) and "declarer exists");
+    return ctx.players.at(*declarerId);
 }
 
-[[nodiscard]] inline auto playersIdents() -> PlayersIdents
+[[nodiscard]] inline auto playersIdents(const Context& ctx) -> PlayersIdents
 {
-    return players()
+    return players(ctx)
         | rv::transform([](const Player& player) { return PlayerIdent{player.id, player.name}; })
         | rng::to_vector;
 }
 
-inline auto sendToAll(std::string payload) -> task<>
+[[nodiscard]] inline auto channelsOf(const Context& ctx, const Player::IdView excludedId = {}) -> Channels
 {
-    const auto channels = players() //
-        | rv::transform([](const Player& player) { return player.conn.ch; })
-        | rng::to_vector;
-    co_await sendToMany(channels, std::move(payload));
+    auto result = Channels{};
+    for (const auto& player : players(ctx)) {
+        if (player.id != excludedId) { result.push_back(player.conn.ch); }
+    }
+    return result;
 }
 
-inline auto forwardToOne(const Player::IdView playerId, const Message& msg) -> task<>
+// what the players are sent goes to the spectators too, before the players' sends may wait for room
+inline auto publishToSpectators(const Context& ctx, const Frame& frame) -> void
 {
-    return sendToOne(ctx().player(playerId).conn.ch, msg.SerializeAsString());
+    if (ctx.spectators.isWatched()) { ctx.spectators.publish(ctx.snapshot.version, frame); }
 }
 
-inline auto forwardToAll(const Message& msg) -> task<>
+inline auto sendToAll(const Context& ctx, std::string payload) -> task<>
 {
-    return sendToAll(msg.SerializeAsString());
+    ++ctx.snapshot.version;
+    const auto channels = channelsOf(ctx);
+    const auto frame = makeFrame(std::move(payload));
+    publishToSpectators(ctx, frame);
+    co_await sendToMany(channels, frame);
 }
 
-inline auto sendToAllExcept(std::string payload, const Player::IdView excludedId) -> task<>
+// players who negotiated the same wire format share one serialized frame
+struct FormatGroup {
+    WireFormat format = WireFormat::WIRE_TEXT;
+    Channels channels;
+    Frame frame;
+};
+
+// As sendToMany over all the groups at once, so that a slow player of one group doesn't hold up the other groups
+inline auto sendToGroups(const std::vector<FormatGroup> groups) -> task<>
 {
-    const auto channels = pref::players()
-        | rv::filter(notEqualTo(excludedId), &Player::id)
-        | rv::transform([](const Player& player) { return player.conn.ch; })
-        | rng::to_vector;
-    co_await sendToMany(channels, std::move(payload));
+    auto scope = ex::async_scope{};
+    const auto sch = co_await stdx::get_scheduler();
+    for (const auto& group : groups) {
+        for (const auto& ch : group.channels) {
+            assert(ch);
+            if (trySend(*ch, group.frame)) { scope.spawn(stdx::starts_on(sch, sendWhenRoom(ch, group.frame))); }
+        }
+    }
+    co_await scope.on_empty();
 }
 
-inline auto forwardToAllExcept(const Message& msg, const Player::IdView excludedId) -> task<>
+// `makePayload` is called eagerly, once per wire format in use, so it may capture the caller's locals by reference
+inline auto sendToAllExcept(
+    const Context& ctx, const std::invocable<WireFormat> auto& makePayload, const Player::IdView excludedId) -> task<>
 {
-    return sendToAllExcept(msg.SerializeAsString(), excludedId);
+    ++ctx.snapshot.version;
+    auto groups = std::vector<FormatGroup>{};
+    for (const auto& player : players(ctx) | rv::filter(notEqualTo(excludedId), &Player::id)) {
+        auto group = rng::find(groups, player.wireFormat, &FormatGroup::format);
+        if (group == rng::end(groups)) {
+            groups.push_back({.format = player.wireFormat, .frame = makeFrame(makePayload(player.wireFormat))});
+            group = std::prev(rng::end(groups));
+        }
+        group->channels.push_back(player.conn.ch);
+    }
+    if (ctx.spectators.isWatched()) {
+        const auto compact = rng::find(groups, WireFormat::WIRE_COMPACT, &FormatGroup::format);
+        publishToSpectators(
+            ctx, compact != rng::end(groups) ? compact->frame : makeFrame(makePayload(WireFormat::WIRE_COMPACT)));
+    }
+    return sendToGroups(std::move(groups));
 }
 
-inline auto sendLoginResponse(
-    const ChannelPtr& ch, std::string error, const Player::IdView playerId = {}, std::string authToken = {}) -> task<>
+inline auto sendToAll(const Context& ctx, const std::invocable<WireFormat> auto& makePayload) -> task<>
 {
-    co_await sendToOne(
-        ch, makeLoginResponse(ctx().stage, playerId, std::move(authToken), playersIdents(), std::move(error)));
+    return sendToAllExcept(ctx, makePayload, {});
 }
 
-inline auto sendAuthResponse(const ChannelPtr& ch, std::string error, const Player::NameView playerName = {}) -> task<>
+// The relayed messages go to the players' relay queues, which never wait and drop what overflows, and not to the
+// bots or the spectators: they aren't the table's state
+inline auto relayTo(const Player& player, const Frame& frame) -> void
 {
-    co_await sendToOne(ch, makeAuthResponse(ctx().stage, playerName, playersIdents(), std::move(error)));
+    if (player.isBot or not player.conn.ch) { return; }
+    if (not player.conn.ch->relay(frame)) { localMetrics().relayedDropped.add(1); }
 }
 
-inline auto sendPlayerJoined(const PlayerSession& session) -> task<>
+inline auto relayToOne(const Context& ctx, const Player::IdView playerId, const Message& msg) -> void
 {
-    return sendToAllExcept(makePlayerJoined(session.playerName, session.playerId), session.playerId);
+    if (const auto it = ctx.players.find(playerId); it != std::end(ctx.players)) {
+        relayTo(it->second, makeFrame(msg.SerializeAsString()));
+    }
 }
 
-inline auto sendPlayerLeft(Player::Id playerId) -> task<>
+inline auto relayToAllExcept(const Context& ctx, const Message& msg, const Player::IdView excludedId) -> void
 {
-    return sendToAll(makePlayerLeft(std::move(playerId)));
+    const auto frame = makeFrame(msg.SerializeAsString());
+    for (const auto& player : players(ctx) | rv::filter(notEqualTo(excludedId), &Player::id)) {
+        relayTo(player, frame);
+    }
 }
 
-inline auto sendReadyCheckToOne(const ChannelPtr& ch, const Player::IdView playerId, const ReadyCheckState state)
-    -> task<>
+inline auto forwardToAll(const Context& ctx, const Message& msg) -> task<>
 {
-    co_await sendToOne(ch, makeReadyCheck(playerId, state));
+    return sendToAll(ctx, msg.SerializeAsString());
 }
 
-inline auto sendForehand() -> task<>
+inline auto sendToAllExcept(const Context& ctx, std::string payload, const Player::IdView excludedId) -> task<>
 {
-    return sendToAll(makeForehand(ctx().forehandId));
+    ++ctx.snapshot.version;
+    const auto channels = channelsOf(ctx, excludedId);
+    const auto frame = makeFrame(std::move(payload));
+    publishToSpectators(ctx, frame);
+    co_await sendToMany(channels, frame);
 }
 
-inline auto sendDealCardsExcept(const Player::IdView playerId, const Hand& hand) -> task<>
+inline auto forwardToAllExcept(const Context& ctx, const Message& msg, const Player::IdView excludedId) -> task<>
 {
-    return sendToAllExcept(makeDealCards(playerId, hand | rng::to_vector), playerId);
+    return sendToAllExcept(ctx, msg.SerializeAsString(), excludedId);
 }
 
-inline auto sendDealCardsFor(const ChannelPtr& ch, const Player::IdView playerId, const Hand& hand) -> task<>
+inline auto sendLoginResponse(const ChannelPtr& ch, std::string error) -> task<>
 {
-    co_await sendToOne(ch, makeDealCards(playerId, hand | rng::to_vector));
+    co_await sendToOne(ch, makeLoginResponse(GameStage::UNKNOWN, {}, {}, {}, std::move(error)));
 }
 
-inline auto sendPlayerTurn(const PlayerTurnData& playerTurn) -> task<>
+inline auto sendLoginResponse(
+    const Context& ctx,
+    const ChannelPtr& ch,
+    const Player::IdView playerId,
+    std::string authToken,
+    const WireFormat format) -> task<>
 {
-    const auto& [playerId, stage, minBid, canHalfWhist, passRound, talon] = playerTurn;
-    return sendToAll(makePlayerTurn(playerId, stage, minBid, canHalfWhist, passRound, talon));
+    co_await sendToOne(
+        ch, makeLoginResponse(ctx.stage, playerId, std::move(authToken), playersIdents(ctx), {}, format));
 }
 
-inline auto sendBiddingToOne(const ChannelPtr& ch, const Player::IdView playerId, const std::string_view bid) -> task<>
+inline auto sendAuthResponse(const ChannelPtr& ch, std::string error) -> task<>
 {
-    return sendToOne(ch, makeBidding(playerId, bid));
+    co_await sendToOne(ch, makeAuthResponse(GameStage::UNKNOWN, {}, {}, std::move(error)));
 }
 
-inline auto sendBidding(const Player::IdView playerId, const std::string_view bid) -> task<>
+inline auto sendAuthResponse(
+    const Context& ctx, const ChannelPtr& ch, const Player::NameView playerName, const WireFormat format) -> task<>
 {
-    return sendToAllExcept(makeBidding(playerId, bid), playerId);
+    co_await sendToOne(ch, makeAuthResponse(ctx.stage, playerName, playersIdents(ctx), {}, format));
 }
 
-inline auto sendWhistingToOne(const ChannelPtr& ch, const Player::IdView playerId, const std::string_view choice)
-    -> task<>
+inline auto sendPlayerJoined(const Context& ctx, const PlayerSession& session) -> task<>
+{
+    return sendToAllExcept(ctx, makePlayerJoined(session.playerName, session.playerId), session.playerId);
+}
+
+inline auto sendPlayerLeft(const Context& ctx, Player::Id playerId) -> task<>
 {
-    return sendToOne(ch, makeWhisting(playerId, choice));
+    return sendToAll(ctx, makePlayerLeft(std::move(playerId)));
 }
 
-inline auto sendHowToPlayToOne(const ChannelPtr& ch, const Player::IdView playerId, const std::string_view choice)
+inline auto sendReadyCheckToOne(const ChannelPtr& ch, const Player::IdView playerId, const ReadyCheckState state)
     -> task<>
 {
-    return sendToOne(ch, makeHowToPlay(playerId, choice));
+    co_await sendToOne(ch, makeReadyCheck(playerId, state));
+}
+
+inline auto sendForehand(const Context& ctx) -> task<>
+{
+    return sendToAll(ctx, makeForehand(ctx.forehandId));
 }
 
-inline auto sendWhisting(const Player::IdView playerId, const std::string_view choice) -> task<>
+inline auto sendDealCardsExcept(const Context& ctx, const Player::IdView playerId, const Hand hand) -> task<>
 {
-    return sendToAll(makeWhisting(playerId, choice));
+    return sendToAllExcept(
+        ctx, [&](const WireFormat format) { return makeDealCards(playerId, hand, format); }, playerId);
 }
 
-inline auto sendOpenWhistPlayToOne(
-    const ChannelPtr& ch, const Player::IdView activeWhisterId, const Player::IdView passiveWhisterId) -> task<>
+inline auto sendDealCardsFor(const Player& to, const Player::IdView playerId, const Hand hand) -> task<>
 {
-    return sendToOne(ch, makeOpenWhistPlay(activeWhisterId, passiveWhisterId));
+    co_await sendToOne(to.conn.ch, makeDealCards(playerId, hand, to.wireFormat));
 }
 
-inline auto sendOpenWhistPlay(const Player::IdView activeWhisterId, const Player::IdView passiveWhisterId) -> task<>
+inline auto sendPlayerTurn(const Context& ctx, const PlayerTurnData& playerTurn) -> task<>
 {
-    return sendToAll(makeOpenWhistPlay(activeWhisterId, passiveWhisterId));
+    const auto& [playerId, stage, minBid, canHalfWhist, passRound, talon] = playerTurn;
+    return sendToAll(ctx, [&](const WireFormat format) {
+        return makePlayerTurn(playerId, stage, minBid, canHalfWhist, passRound, talon, format);
+    });
 }
 
-inline auto sendOpenTalonToOne(const ChannelPtr& ch) -> task<>
+inline auto sendBidding(const Context& ctx, const Player::IdView playerId, const Bid bid) -> task<>
 {
-    return sendToOne(ch, makeOpenTalon(ctx().talon.current));
+    return sendToAllExcept(
+        ctx, [&](const WireFormat format) { return makeBidding(playerId, bid, format); }, playerId);
 }
 
-inline auto sendOpenTalon() -> task<>
+inline auto sendWhisting(const Context& ctx, const Player::IdView playerId, const std::string_view choice) -> task<>
 {
-    assert(ctx().talon.open < std::size(ctx().talon.cards));
-    ctx().talon.current = ctx().talon.cards[ctx().talon.open];
-    return sendToAll(makeOpenTalon(ctx().talon.current));
+    return sendToAll(ctx, makeWhisting(playerId, choice));
 }
 
-// TODO: combine sendMiserCardsToOne() and sendMiserCards()
-inline auto sendMiserCardsToOne(const ChannelPtr& ch) -> task<>
+inline auto sendOpenWhistPlay(
+    const Context& ctx, const Player::IdView activeWhisterId, const Player::IdView passiveWhisterId) -> task<>
 {
-    const auto& declarer = getDeclarer();
-    const auto& discardedCards = ctx().talon.discardedCards;
-    auto played = declarer.playedCards
-        | rv::remove_if([&](const CardNameView card) { return rng::contains(discardedCards, card); })
-        | rng::to_vector;
-    auto remaining = rv::concat(declarer.hand, std::empty(discardedCards) ? ctx().talon.cards : discardedCards)
-        | rv::remove_if([&](const CardNameView card) { return rng::contains(played, card); })
-        | rng::to_vector;
-    return sendToOne(ch, makeMiserCards(std::move(remaining), std::move(played)));
+    return sendToAll(ctx, makeOpenWhistPlay(activeWhisterId, passiveWhisterId));
 }
 
-inline auto sendMiserCards() -> task<>
+inline auto sendOpenTalon(Context& ctx) -> task<>
 {
-    const auto& declarer = getDeclarer();
-    const auto& discardedCards = ctx().talon.discardedCards;
-    auto played = declarer.playedCards
-        | rv::remove_if([&](const CardNameView card) { return rng::contains(discardedCards, card); })
-        | rng::to_vector;
-    auto remaining = rv::concat(declarer.hand, std::empty(discardedCards) ? ctx().talon.cards : discardedCards)
-        | rv::remove_if([&](const CardNameView card) { return rng::contains(played, card); })
-        | rng::to_vector;
-    return sendToAll(makeMiserCards(std::move(remaining), std::move(played)));
+    assert(ctx.talon.open < std::size(ctx.talon.cards));
+    const auto card = ctx.talon.cards[ctx.talon.open];
+    ctx.talon.current = card;
+    return sendToAll(ctx, [&](const WireFormat format) { return makeOpenTalon(card, format); });
 }
 
-inline auto sendGameState(const ChannelPtr& ch) -> task<>
+// the declarer's cards which are still in the game and the ones already played, without the discarded talon
+[[nodiscard]] inline auto makeDeclarerMiserCards(const Context& ctx) -> std::pair<CardMask, CardMask>
 {
-    const auto playersTakenTricks = players()
+    const auto& declarer = getDeclarer(ctx);
+    const auto discarded = toCardMask(ctx.talon.discardedCards);
+    const auto played = toCardMask(declarer.playedCards) - discarded;
+    const auto remaining = (declarer.hand | (discarded.empty() ? toCardMask(ctx.talon.cards) : discarded)) - played;
+    return {remaining, played};
+}
+
+inline auto sendMiserCards(const Context& ctx) -> task<>
+{
+    const auto [remaining, played] = makeDeclarerMiserCards(ctx);
+    return sendToAll(ctx, [&](const WireFormat format) { return makeMiserCards(remaining, played, format); });
+}
+
+[[nodiscard]] inline auto makeTableGameState(const Context& ctx, const WireFormat format) -> std::string
+{
+    const auto playersTakenTricks = players(ctx)
         | rv::transform([](const Player& player) { return std::pair{player.id, player.tricksTaken}; })
         | rng::to_vector;
 
-    const auto cardsLeft = players()
+    const auto cardsLeft = players(ctx)
         | rv::transform([](const Player& player) {
                                return std::pair{player.id, static_cast<int>(std::ssize(player.hand))};
                            })
         | rng::to_vector;
-    co_await sendToOne(ch, makeGameState(ctx().lastTrick, playersTakenTricks, cardsLeft));
+    return makeGameState(ctx.lastTrick, playersTakenTricks, cardsLeft, format);
 }
 
-inline auto sendPlayedCards(const ChannelPtr& ch) -> task<>
+inline auto sendPlayCard(const Context& ctx, const Player::IdView playerId, const CardId card) -> task<>
 {
-    for (const auto& card : ctx().trick) { co_await sendToOne(ch, makePlayCard(card.playerId, card.name)); }
+    return sendToAll(ctx, [&](const WireFormat format) { return makePlayCard(playerId, card, format); });
 }
 
-inline auto sendTrickFinished() -> task<>
+inline auto sendTrickFinished(const Context& ctx) -> task<>
 {
-    const auto playersTakenTricks = players()
+    const auto playersTakenTricks = players(ctx)
         | rv::transform([](const Player& player) { return std::pair{player.id, player.tricksTaken}; })
         | rng::to_vector;
-    return sendToAll(makeTrickFinished(playersTakenTricks));
+    return sendToAll(ctx, makeTrickFinished(playersTakenTricks));
 }
 
-inline auto sendDealFinished(const bool isGameOver) -> task<>
+inline auto sendDealFinished(const Context& ctx, const bool isGameOver) -> task<>
 {
-    return sendToAll(makeDealFinished(ctx().scoreSheet, isGameOver));
+    return sendToAll(ctx, makeDealFinished(ctx.scoreSheet, isGameOver));
 }
 
 inline auto sendPingPong(const Message& msg, const ChannelPtr& ch) -> task<>
@@ -255,14 +320,16 @@ inline auto sendPingPong(const Message& msg, const ChannelPtr& ch) -> task<>
     co_await sendToOne(ch, msg.SerializeAsString());
 }
 
-inline auto sendUserGames(const Player& player) -> task<>
-{
-    co_await sendToOne(player.conn.ch, makeUserGames(ctx().gameData, player.id));
-}
-
-inline auto sendUserGames() -> task<>
+// Only the game of this table, the clients ask for the pages of the others with UserGamesRequest
+inline auto sendUserGameUpdates(const Context& ctx) -> task<>
 {
-    for (const auto& player : players()) { co_await sendUserGames(player); }
+    for (const auto& player : players(ctx) | rv::filter(std::logical_not{}, &Player::isBot)) {
+        auto update = std::invoke([&] {
+            const auto lock = std::scoped_lock{ctx.storage.mutex};
+            return makeUserGameUpdate(ctx.storage.gameData, ctx.storage.index, player.id, ctx.gameId);
+        });
+        if (update) { co_await sendToOne(player.conn.ch, *std::move(update)); }
+    }
 }
 
 } // namespace pref
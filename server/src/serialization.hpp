@@ -5,8 +5,11 @@
 
 #include "common/common.hpp"
 #include "common/logger.hpp"
+#include "common/wire.hpp"
 #include "proto/pref.pb.h"
 
+#include <google/protobuf/arena.h>
+
 #include <concepts>
 #include <cstddef>
 #include <iterator>
@@ -33,19 +36,44 @@ auto moveVectorToRepeated(std::vector<T>& input, MutRepeatedField& output) -> vo
     return {};
 }
 
+// Parses into the arena, which the caller resets once it's done with the message: the message and its strings take
+// no allocation of their own, and a reset arena reuses its first block
+[[nodiscard]] inline auto makeMessage(google::protobuf::Arena& arena, const void* data, const std::size_t size)
+    -> const Message*
+{
+    auto* const result = google::protobuf::Arena::Create<Message>(&arena);
+    if (result->ParseFromArray(data, static_cast<int>(size))) { return result; }
+    PREF_W("error: failed to make Message from array");
+    return nullptr;
+}
+
+// the server speaks every format it knows, anything else falls back to text
+[[nodiscard]] inline auto negotiateWireFormat(const int requested) -> WireFormat
+{
+    return WireFormat_IsValid(requested) ? static_cast<WireFormat>(requested) : WireFormat::WIRE_TEXT;
+}
+
 [[nodiscard]] inline auto makeLoginResponse(
     const GameStage stage,
     const PlayerIdView playerId,
     std::string authToken,
     const PlayersIdentsView players,
-    std::string error) -> std::string
+    std::string error,
+    const WireFormat format = WireFormat::WIRE_TEXT) -> std::string
 {
-    PREF_I("stage: {}, {}, {}{}", GameStage_Name(stage), PREF_V(players), PREF_V(playerId), PREF_M(error));
+    PREF_I(
+        "stage: {}, {}, {}, format: {}{}",
+        GameStage_Name(stage),
+        PREF_V(players),
+        PREF_V(playerId),
+        WireFormat_Name(format),
+        PREF_M(error));
     auto result = LoginResponse{};
     result.set_stage(stage);
+    result.set_wire_format(format);
     if (not std::empty(error)) {
         result.set_error(std::move(error));
-        return makeMessage(result).SerializeAsString();
+        return serializeMessage(result);
     }
     result.set_player_id(playerId);
     result.set_auth_token(std::move(authToken));
@@ -54,19 +82,29 @@ auto moveVectorToRepeated(std::vector<T>& input, MutRepeatedField& output) -> vo
         p->set_player_id(id);
         p->set_player_name(name);
     }
-    return makeMessage(result).SerializeAsString();
+    return serializeMessage(result);
 }
 
 [[nodiscard]] inline auto makeAuthResponse(
-    const GameStage stage, const PlayerNameView playerName, const PlayersIdentsView players, std::string error)
-    -> std::string
+    const GameStage stage,
+    const PlayerNameView playerName,
+    const PlayersIdentsView players,
+    std::string error,
+    const WireFormat format = WireFormat::WIRE_TEXT) -> std::string
 {
-    PREF_I("stage: {}, {}, {}{}", GameStage_Name(stage), PREF_V(playerName), PREF_V(players), PREF_M(error));
+    PREF_I(
+        "stage: {}, {}, {}, format: {}{}",
+        GameStage_Name(stage),
+        PREF_V(playerName),
+        PREF_V(players),
+        WireFormat_Name(format),
+        PREF_M(error));
     auto result = AuthResponse{};
     result.set_stage(stage);
+    result.set_wire_format(format);
     if (not std::empty(error)) {
         result.set_error(std::move(error));
-        return makeMessage(result).SerializeAsString();
+        return serializeMessage(result);
     }
     result.set_player_name(playerName);
     for (const auto& [id, name] : players) {
@@ -74,7 +112,7 @@ auto moveVectorToRepeated(std::vector<T>& input, MutRepeatedField& output) -> vo
         p->set_player_id(id);
         p->set_player_name(name);
     }
-    return makeMessage(result).SerializeAsString();
+    return serializeMessage(result);
 }
 
 [[nodiscard]] inline auto makePlayerJoined(const PlayerNameView playerName, const PlayerIdView playerId) -> std::string
@@ -83,7 +121,7 @@ auto moveVectorToRepeated(std::vector<T>& input, MutRepeatedField& output) -> vo
     auto result = PlayerJoined{};
     result.set_player_id(playerId);
     result.set_player_name(playerName);
-    return makeMessage(result).SerializeAsString();
+    return serializeMessage(result);
 }
 
 [[nodiscard]] inline auto makePlayerLeft(PlayerId playerId) -> std::string
@@ -91,7 +129,7 @@ auto moveVectorToRepeated(std::vector<T>& input, MutRepeatedField& output) -> vo
     PREF_DI(playerId);
     auto result = PlayerLeft{};
     result.set_player_id(std::move(playerId));
-    return makeMessage(result).SerializeAsString();
+    return serializeMessage(result);
 }
 
 [[nodiscard]] inline auto makeReadyCheck(const PlayerIdView playerId, const ReadyCheckState state) -> std::string
@@ -100,7 +138,7 @@ auto moveVectorToRepeated(std::vector<T>& input, MutRepeatedField& output) -> vo
     auto result = ReadyCheck{};
     result.set_player_id(playerId);
     result.set_state(state);
-    return makeMessage(result).SerializeAsString();
+    return serializeMessage(result);
 }
 
 [[nodiscard]] inline auto makeForehand(const PlayerIdView playerId) -> std::string
@@ -108,25 +146,31 @@ auto moveVectorToRepeated(std::vector<T>& input, MutRepeatedField& output) -> vo
     PREF_DI(playerId);
     auto result = Forehand{};
     result.set_player_id(playerId);
-    return makeMessage(result).SerializeAsString();
+    return serializeMessage(result);
 }
 
-[[nodiscard]] inline auto makeDealCards(const PlayerIdView playerId, const CardsNamesView hand) -> std::string
+[[nodiscard]] inline auto makeDealCards(const PlayerIdView playerId, const CardMask hand, const WireFormat format)
+    -> std::string
 {
     PREF_DI(playerId, hand);
     auto result = DealCards{};
     result.set_player_id(playerId);
-    for (const auto& card : hand) { result.add_cards(card); }
-    return makeMessage(result).SerializeAsString();
+    if (format == WireFormat::WIRE_COMPACT) {
+        result.set_hand(toWireHand(hand));
+    } else {
+        for (const auto card : hand) { result.add_cards(toCardName(card)); }
+    }
+    return serializeMessage(result);
 }
 
 [[nodiscard]] inline auto makePlayerTurn(
     const PlayerIdView playerId,
     const GameStage stage,
-    std::string_view minBid,
+    const Bid minBid,
     const bool canHalfWhist,
     const int passRound,
-    const CardsNamesView talon) -> std::string
+    const std::span<const CardId> talon,
+    const WireFormat format) -> std::string
 {
     PREF_I(
         "{}, {}, {}{}{}",
@@ -139,20 +183,33 @@ auto moveVectorToRepeated(std::vector<T>& input, MutRepeatedField& output) -> vo
     auto result = PlayerTurn{};
     result.set_player_id(playerId);
     result.set_stage(stage);
-    result.set_min_bid(std::move(minBid));
     result.set_can_half_whist(canHalfWhist);
     result.set_pass_round(passRound);
-    for (const auto& card : talon) { result.add_talon(card); }
-    return makeMessage(result).SerializeAsString();
+    if ((format == WireFormat::WIRE_COMPACT) and not minBid.empty()) {
+        result.set_min_bid_code(minBid.code());
+    } else {
+        result.set_min_bid(minBid.text());
+    }
+    if (format == WireFormat::WIRE_COMPACT) {
+        for (const auto card : talon) { result.add_talon_cards(toWireCard(card)); }
+    } else {
+        for (const auto card : talon) { result.add_talon(toCardName(card)); }
+    }
+    return serializeMessage(result);
 }
 
-[[nodiscard]] inline auto makeBidding(const PlayerIdView playerId, const std::string_view bid) -> std::string
+[[nodiscard]] inline auto makeBidding(const PlayerIdView playerId, const Bid bid, const WireFormat format)
+    -> std::string
 {
     PREF_DI(playerId, bid);
     auto result = Bidding{};
     result.set_player_id(playerId);
-    result.set_bid(bid);
-    return makeMessage(result).SerializeAsString();
+    if ((format == WireFormat::WIRE_COMPACT) and not bid.empty()) {
+        result.set_bid_code(bid.code());
+    } else {
+        result.set_bid(bid.text());
+    }
+    return serializeMessage(result);
 }
 
 [[nodiscard]] inline auto makeWhisting(const PlayerIdView playerId, const std::string_view choice) -> std::string
@@ -161,7 +218,7 @@ auto moveVectorToRepeated(std::vector<T>& input, MutRepeatedField& output) -> vo
     auto result = Whisting{};
     result.set_player_id(playerId);
     result.set_choice(choice);
-    return makeMessage(result).SerializeAsString();
+    return serializeMessage(result);
 }
 
 [[nodiscard]] inline auto makeHowToPlay(const PlayerIdView playerId, const std::string_view choice) -> std::string
@@ -170,7 +227,7 @@ auto moveVectorToRepeated(std::vector<T>& input, MutRepeatedField& output) -> vo
     auto result = HowToPlay{};
     result.set_player_id(playerId);
     result.set_choice(choice);
-    return makeMessage(result).SerializeAsString();
+    return serializeMessage(result);
 }
 
 [[nodiscard]] inline auto makeOpenWhistPlay(const PlayerIdView activeWhisterId, const PlayerIdView passiveWhisterId)
@@ -180,43 +237,65 @@ auto moveVectorToRepeated(std::vector<T>& input, MutRepeatedField& output) -> vo
     auto result = OpenWhistPlay{};
     result.set_active_whister_id(activeWhisterId);
     result.set_passive_whister_id(passiveWhisterId);
-    return makeMessage(result).SerializeAsString();
+    return serializeMessage(result);
 }
 
-[[nodiscard]] inline auto makeOpenTalon(const CardNameView card) -> std::string
+[[nodiscard]] inline auto makeOpenTalon(const CardId card, const WireFormat format) -> std::string
 {
     PREF_DI(card);
     auto result = OpenTalon{};
-    result.set_card(card);
-    return makeMessage(result).SerializeAsString();
+    if (format == WireFormat::WIRE_COMPACT) {
+        result.set_card_id(toWireCard(card));
+    } else {
+        result.set_card(toCardName(card));
+    }
+    return serializeMessage(result);
 }
 
-[[nodiscard]] inline auto makeMiserCards(CardsNames remainingCards, CardsNames playedCards) -> std::string
+[[nodiscard]] inline auto makeMiserCards(const CardMask remaining, const CardMask played, const WireFormat format)
+    -> std::string
 {
-    PREF_DI(remainingCards, playedCards);
+    PREF_DI(remaining, played);
     auto result = MiserCards{};
+    if (format == WireFormat::WIRE_COMPACT) {
+        result.set_remaining_mask(toWireHand(remaining));
+        result.set_played_mask(toWireHand(played));
+        return serializeMessage(result);
+    }
+    auto remainingCards = toCardsNames(remaining);
+    auto playedCards = toCardsNames(played);
     moveVectorToRepeated(remainingCards, *result.mutable_remaining_cards());
     moveVectorToRepeated(playedCards, *result.mutable_played_cards());
-    return makeMessage(result).SerializeAsString();
+    return serializeMessage(result);
 }
 
-[[nodiscard]] inline auto makePlayCard(const PlayerIdView playerId, const CardNameView cardName) -> std::string
+[[nodiscard]] inline auto makePlayCard(const PlayerIdView playerId, const CardId card, const WireFormat format)
+    -> std::string
 {
-    PREF_DI(playerId, cardName);
+    PREF_DI(playerId, card);
     auto result = PlayCard{};
     result.set_player_id(playerId);
-    result.set_card(cardName);
-    return makeMessage(result).SerializeAsString();
+    if (format == WireFormat::WIRE_COMPACT) {
+        result.set_card_id(toWireCard(card));
+    } else {
+        result.set_card(toCardName(card));
+    }
+    return serializeMessage(result);
 }
 
 [[nodiscard]] inline auto makeGameState(
-    const std::span<const CardName> lastTrick,
+    const std::span<const CardId> lastTrick,
     const std::span<const std::pair<PlayerId, int>> playersTakenTricks,
-    const std::span<const std::pair<PlayerId, int>> playersCardsLeft) -> std::string
+    const std::span<const std::pair<PlayerId, int>> playersCardsLeft,
+    const WireFormat format) -> std::string
 {
     PREF_DI(lastTrick, playersTakenTricks, playersCardsLeft);
     auto result = GameState{};
-    for (const auto& card : lastTrick) { result.add_last_trick(card); }
+    if (format == WireFormat::WIRE_COMPACT) {
+        for (const auto card : lastTrick) { result.add_last_trick_cards(toWireCard(card)); }
+    } else {
+        for (const auto card : lastTrick) { result.add_last_trick(toCardName(card)); }
+    }
     for (const auto& [playerId, tricksTaken] : playersTakenTricks) {
         auto* tricks = result.add_taken_tricks();
         tricks->set_player_id(playerId);
@@ -227,7 +306,7 @@ auto moveVectorToRepeated(std::vector<T>& input, MutRepeatedField& output) -> vo
         left->set_player_id(playerId);
         left->set_count(cardsLeft);
     }
-    return makeMessage(result).SerializeAsString();
+    return serializeMessage(result);
 }
 
 [[nodiscard]] inline auto makeTrickFinished(const std::span<const std::pair<PlayerId, int>> playersTakenTricks)
@@ -240,7 +319,7 @@ auto moveVectorToRepeated(std::vector<T>& input, MutRepeatedField& output) -> vo
         tricks->set_player_id(playerId);
         tricks->set_taken(tricksTaken);
     }
-    return makeMessage(result).SerializeAsString();
+    return serializeMessage(result);
 }
 
 [[nodiscard]] inline auto makeDealFinished(const ScoreSheet& scoreSheet, const auto isGameOver) -> std::string
@@ -255,7 +334,7 @@ auto moveVectorToRepeated(std::vector<T>& input, MutRepeatedField& output) -> vo
         }
     }
     result.set_is_game_over(isGameOver);
-    return makeMessage(result).SerializeAsString();
+    return serializeMessage(result);
 }
 
 } // namespace pref
@@ -4,9 +4,13 @@
 #include "server.hpp"
 
 #include "auth.hpp"
+#include "bot.hpp"
 #include "common/common.hpp"
 #include "common/time.hpp"
+#include "common/wire.hpp"
 #include "game_data.hpp"
+#include "journal.hpp"
+#include "metrics.hpp"
 #include "proto/pref.pb.h"
 #include "send_msg.hpp"
 #include "serialization.hpp"
@@ -25,6 +29,7 @@
 #include <functional>
 #include <iterator>
 #include <memory>
+#include <mutex>
 #include <random>
 #include <ranges>
 #include <tuple>
@@ -33,138 +38,71 @@
 namespace pref {
 namespace {
 
-auto setWhoseTurn(const Context::Players::const_iterator it) -> void
+auto setWhoseTurn(Context& ctx, const Context::Players::const_iterator it) -> void
 {
-    ctx().whoseTurnIt = it;
+    ctx.whoseTurnIt = it;
 }
 
-auto setForehandId() -> void
+auto setForehandId(Context& ctx) -> void
 {
-    ctx().forehandId = ctx().whoseTurnId();
-    PREF_I("playerId: {}", ctx().forehandId);
+    ctx.forehandId = ctx.whoseTurnId();
+    PREF_I("playerId: {}", ctx.forehandId);
 }
 
-auto resetWhoseTurn() -> void
+auto resetWhoseTurn(Context& ctx) -> void
 {
-    assert((std::size(ctx().players) == NumberOfPlayers) and "all players joined");
-    setWhoseTurn(std::cbegin(ctx().players));
+    assert((std::size(ctx.players) == NumberOfPlayers) and "all players joined");
+    setWhoseTurn(ctx, std::cbegin(ctx.players));
 }
 
-auto advanceWhoseTurn() -> void
+auto advanceWhoseTurn(Context& ctx) -> void
 {
-    assert((std::size(ctx().players) == NumberOfPlayers) and "all players joined");
-    if (const auto nextTurnIt = std::next(ctx().whoseTurnIt); nextTurnIt != std::cend(ctx().players)) {
-        setWhoseTurn(nextTurnIt);
+    assert((std::size(ctx.players) == NumberOfPlayers) and "all players joined");
+    if (const auto nextTurnIt = std::next(ctx.whoseTurnIt); nextTurnIt != std::cend(ctx.players)) {
+        setWhoseTurn(ctx, nextTurnIt);
     } else {
-        resetWhoseTurn();
+        resetWhoseTurn(ctx);
     }
-    PREF_I("playerId: {}", ctx().whoseTurnId());
+    PREF_I("playerId: {}", ctx.whoseTurnId());
 }
 
-auto forehandsTurn() -> void
+auto forehandsTurn(Context& ctx) -> void
 {
     PREF_I();
-    assert(ctx().players.contains(ctx().forehandId) and "forehand player exists");
-    setWhoseTurn(ctx().players.find(ctx().forehandId));
+    assert(ctx.players.contains(ctx.forehandId) and "forehand player exists");
+    setWhoseTurn(ctx, ctx.players.find(ctx.forehandId));
 }
 
-auto advanceWhoseTurn(const GameStage stage) -> void
+auto advanceWhoseTurn(Context& ctx, const GameStage stage) -> void
 {
     using enum GameStage;
     PREF_I("stage: {}", GameStage_Name(stage));
-    advanceWhoseTurn();
+    advanceWhoseTurn(ctx);
     if (not rng::contains(std::array{BIDDING, TALON_PICKING, WITHOUT_TALON}, stage)) { return; }
-    while (ctx().player(ctx().whoseTurnId()).bid == PREF_PASS) { advanceWhoseTurn(); }
+    while (ctx.player(ctx.whoseTurnId()).bid.isPass()) { advanceWhoseTurn(ctx); }
 }
 
-auto setNextDealTurn() -> void
+auto setNextDealTurn(Context& ctx) -> void
 {
-    assert((std::size(ctx().players) == NumberOfPlayers) and "all players joined");
-    assert(ctx().players.contains(ctx().forehandId) and "forehand player exists");
-    const auto nextIt = std::next(ctx().players.find(ctx().forehandId));
-    setWhoseTurn(nextIt != std::cend(ctx().players) ? nextIt : std::cbegin(ctx().players));
-    setForehandId();
+    assert((std::size(ctx.players) == NumberOfPlayers) and "all players joined");
+    assert(ctx.players.contains(ctx.forehandId) and "forehand player exists");
+    const auto nextIt = std::next(ctx.players.find(ctx.forehandId));
+    setWhoseTurn(ctx, nextIt != std::cend(ctx.players) ? nextIt : std::cbegin(ctx.players));
+    setForehandId(ctx);
 }
 
-[[nodiscard]] auto decideTrickWinner() -> Player::Id
+[[nodiscard]] auto decideTrickWinner(Context& ctx) -> Player::Id
 {
-    const auto winnerId = decideTrickWinner(ctx().trick, ctx().trump);
-    const auto winnerName = ctx().playerName(winnerId);
-    const auto tricksTaken = ++ctx().player(winnerId).tricksTaken;
+    const auto winnerId = decideTrickWinner(ctx.trick, ctx.trump, ctx.talon.current);
+    ctx.talon.current.reset();
+    const auto winnerName = ctx.playerName(winnerId);
+    const auto tricksTaken = ++ctx.player(winnerId).tricksTaken;
     PREF_DI(winnerName, winnerId, tricksTaken);
-    ctx().lastTrick = ctx().trick | rv::transform(&PlayedCard::name) | rng::to_vector;
-    ctx().trick.clear();
+    ctx.lastTrick = ctx.trick | rv::transform(&PlayedCard::card) | rng::to_vector;
+    ctx.trick.clear();
     return winnerId;
 }
 
-[[nodiscard]] constexpr auto makeContractLevel(const std::string_view contract) noexcept -> ContractLevel
-{
-    using enum ContractLevel;
-    if (contract.starts_with(PREF_SIX)) { return Six; }
-    if (contract.starts_with(PREF_SEVEN)) { return Seven; }
-    if (contract.starts_with(PREF_EIGHT)) { return Eight; }
-    if (contract.starts_with(PREF_NINE)) { return Nine; }
-    if (contract.starts_with(PREF_TEN)) { return Ten; }
-    if (contract.starts_with(PREF_MIS)) { return Miser; }
-    std::unreachable();
-}
-
-[[nodiscard]] constexpr auto contractPrice(const ContractLevel level) noexcept -> int
-{
-    using enum ContractLevel;
-    switch (level) {
-    case Six: return 2;
-    case Seven: return 4;
-    case Eight: return 6;
-    case Nine: return 8;
-    case Ten: [[fallthrough]];
-    case Miser: return 10;
-    };
-    std::unreachable();
-}
-
-[[nodiscard]] constexpr auto declarerReqTricks(const ContractLevel level) noexcept -> int
-{
-    using enum ContractLevel;
-    switch (level) {
-    case Six: return 6;
-    case Seven: return 7;
-    case Eight: return 8;
-    case Nine: return 9;
-    case Ten: return 10;
-    case Miser: return 0;
-    };
-    std::unreachable();
-}
-
-[[nodiscard]] constexpr auto twoWhistersReqTricks(const ContractLevel level) noexcept -> int
-{
-    using enum ContractLevel;
-    switch (level) {
-    case Six: return 4;
-    case Seven: return 2;
-    case Eight:
-    case Nine: [[fallthrough]];
-    case Ten: return 1;
-    case Miser: return 0;
-    };
-    std::unreachable();
-}
-
-[[nodiscard]] constexpr auto oneWhisterReqTricks(const ContractLevel level) noexcept -> int
-{
-    using enum ContractLevel;
-    switch (level) {
-    case Six: return 2;
-    case Seven:
-    case Eight:
-    case Nine: [[fallthrough]];
-    case Ten: return 1;
-    case Miser: return 0;
-    };
-    std::unreachable();
-}
-
 [[nodiscard]] constexpr auto makeWhistingChoice(const std::string_view choice) noexcept -> WhistingChoice
 {
     using enum WhistingChoice;
@@ -177,24 +115,24 @@ auto setNextDealTurn() -> void
     std::unreachable();
 }
 
-[[nodiscard]] auto findPasserIds() -> std::vector<Player::Id>
+[[nodiscard]] auto findPasserIds(Context& ctx) -> std::vector<Player::Id>
 {
-    return players() | rv::filter(equalTo(PREF_PASS), &Player::bid) | rv::transform(&Player::id) | rng::to_vector;
+    return players(ctx) | rv::filter(&Bid::isPass, &Player::bid) | rv::transform(&Player::id) | rng::to_vector;
 }
 
-[[nodiscard]] auto getTwoPassers() -> std::array<std::reference_wrapper<Player>, 2>
+[[nodiscard]] auto getTwoPassers(Context& ctx) -> std::array<std::reference_wrapper<Player>, 2>
 {
-    const auto whisterIds = findPasserIds();
+    const auto whisterIds = findPasserIds(ctx);
     assert(std::size(whisterIds) == 2 and "there are two passers");
     const auto& w0 = whisterIds[0];
     const auto& w1 = whisterIds[1];
-    assert(ctx().players.contains(w0) and ctx().players.contains(w1) and "whisters exist");
-    return {ctx().players.at(w0), ctx().players.at(w1)};
+    assert(ctx.players.contains(w0) and ctx.players.contains(w1) and "whisters exist");
+    return {ctx.players.at(w0), ctx.players.at(w1)};
 }
 
-[[nodiscard]] auto getOneOrTwoWhisters() -> std::vector<std::reference_wrapper<Player>>
+[[nodiscard]] auto getOneOrTwoWhisters(Context& ctx) -> std::vector<std::reference_wrapper<Player>>
 {
-    const auto passers = getTwoPassers();
+    const auto passers = getTwoPassers(ctx);
     auto result = passers // clang-format off
         | rv::filter([](const std::string_view choice) {
             return std::ranges::contains_subrange(choice, std::string_view{PREF_WHIST});
@@ -204,64 +142,69 @@ auto setNextDealTurn() -> void
     return result;
 }
 
-[[nodiscard]] auto isNewPlayer(const Player::IdView playerId) -> bool
+[[nodiscard]] auto isNewPlayer(Context& ctx, const Player::IdView playerId) -> bool
 {
-    return std::empty(playerId) or not ctx().players.contains(playerId);
+    return std::empty(playerId) or not ctx.players.contains(playerId);
 }
 
-auto joinPlayer(const ChannelPtr& ch, const Player::IdView playerId, PlayerSession& session) -> void
+auto joinPlayer(Context& ctx, const ChannelPtr& ch, const Player::IdView playerId, PlayerSession& session) -> void
 {
     session.playerId = playerId;
+    session.table = &ctx;
     ++session.id;
     assert(session.id == 1);
     PREF_DI(session.playerId, session.playerName, session.id);
-    ctx().players.emplace(session.playerId, Player{session.playerId, session.playerName, session.id, ch});
+    ctx.players.emplace(session.playerId, Player{session.playerId, session.playerName, session.id, ch});
+    ctx.player(session.playerId).wireFormat = session.wireFormat;
+    ctx.recorder.seated(session.playerId, session.playerName, false);
 }
 
-auto prepareNewSession(const Player::IdView playerId, PlayerSession& session) -> task<>
+auto prepareNewSession(Context& ctx, const Player::IdView playerId, PlayerSession& session) -> task<>
 {
     PREF_I("{}, {}, {}{}", PREF_V(playerId), PREF_V(session.playerName), PREF_V(session.id), PREF_M(session.playerId));
-    auto& player = ctx().player(playerId);
+    auto& player = ctx.player(playerId);
     session.id = ++player.sessionId;
     session.playerId = playerId;
+    session.table = &ctx;
     session.playerName = player.name; // keep the first connected player's name
+    player.wireFormat = session.wireFormat; // the new tab might speak another format
     if (player.conn.reconnectTimer) { player.conn.cancelReconnectTimer(); }
     // the channel might be already close
     if (player.conn.ch->is_open()) { co_await player.conn.closeStream(); }
 }
 
-auto addCardToHand(const Player::IdView playerId, const CardName& card) -> void
+auto addCardToHand(Context& ctx, const Player::IdView playerId, const CardId card) -> void
 {
-    assert(not ctx().player(playerId).hand.contains(card) and "card doesn't exists");
-    ctx().player(playerId).hand.insert(card);
+    assert(not ctx.player(playerId).hand.contains(card) and "card doesn't exists");
+    ctx.player(playerId).hand.insert(card);
 }
 
-[[nodiscard]] auto makePlayerTurnData() -> PlayerTurnData
+[[nodiscard]] auto makePlayerTurnData(Context& ctx) -> PlayerTurnData
 {
     using enum GameStage;
-    const auto playerId = ctx().whoseTurnId();
+    const auto playerId = ctx.whoseTurnId();
     auto canHalfWhist = false; // default;
-    auto talon = CardsNames{};
-    if (ctx().stage == TALON_PICKING) {
-        assert((std::size(ctx().talon.cards) == 2) and "talon is two cards");
-        talon = ctx().talon.cards;
-    } else if (ctx().stage == WHISTING) {
-        if (const auto contractLevel = makeContractLevel(getDeclarer().bid);
+    auto talon = std::vector<CardId>{};
+    if (ctx.stage == TALON_PICKING) {
+        assert((std::size(ctx.talon.cards) == 2) and "talon is two cards");
+        talon = ctx.talon.cards;
+    } else if (ctx.stage == WHISTING) {
+        if (const auto contractLevel = makeContractLevel(getDeclarer(ctx).bid);
             contractLevel == ContractLevel::Six or contractLevel == ContractLevel::Seven) {
             const auto checkHalfWhist = [&](const Player& self, const Player& other) {
                 return self.id == playerId and std::empty(self.whistingChoice) and other.whistingChoice == PREF_PASS;
             };
-            if (const auto& [p0, p1] = getTwoPassers(); checkHalfWhist(p0, p1) or checkHalfWhist(p1, p0)) {
+            if (const auto& [p0, p1] = getTwoPassers(ctx); checkHalfWhist(p0, p1) or checkHalfWhist(p1, p0)) {
                 canHalfWhist = true;
             }
         }
     }
     return {
         std::string{playerId},
-        ctx().stage,
-        std::string{ctx().passGame.minBid()},
+        ctx.stage,
+        ctx.passGame.minBid(),
         canHalfWhist,
-        ctx().passGame.round,
+        ctx.passGame.round,
         talon};
 }
 
@@ -280,23 +223,120 @@ auto addCardToHand(const Player::IdView playerId, const CardName& card) -> void
     return playerItByWhistingChoice(players, choice)->second;
 }
 
-auto openCardsAndLetAnotherWhisterPlay() -> task<>
+auto openCardsAndLetAnotherWhisterPlay(Context& ctx) -> task<>
 {
-    const auto& activeWhister = playerByWhistingChoice(ctx().players, WhistingChoice::Whist);
-    const auto& passiveWhister = playerByWhistingChoice(ctx().players, WhistingChoice::Pass);
-    co_await sendOpenWhistPlay(activeWhister.id, passiveWhister.id);
-    co_await sendDealCardsExcept(activeWhister.id, activeWhister.hand);
-    co_await sendDealCardsExcept(passiveWhister.id, passiveWhister.hand);
+    const auto& activeWhister = playerByWhistingChoice(ctx.players, WhistingChoice::Whist);
+    const auto& passiveWhister = playerByWhistingChoice(ctx.players, WhistingChoice::Pass);
+    co_await sendOpenWhistPlay(ctx, activeWhister.id, passiveWhister.id);
+    co_await sendDealCardsExcept(ctx, activeWhister.id, activeWhister.hand);
+    co_await sendDealCardsExcept(ctx, passiveWhister.id, passiveWhister.hand);
 }
 
-auto reconnectPlayer(const ChannelPtr& ch, const Player::IdView playerId, PlayerSession& session) -> task<>
+// The table as all its players see it: the hands of an open whist play included, the other hands left out
+[[nodiscard]] auto makeSnapshotMessages(Context& ctx, const WireFormat format) -> std::vector<std::string>
 {
-    co_await prepareNewSession(playerId, session);
-    auto& player = ctx().player(playerId);
-    player.conn.replaceChannel(ch);
-    PREF_DI(session.playerName, session.playerId, session.id);
-    const auto players = pref::players();
-    if (ctx().stage == GameStage::UNKNOWN) {
+    const auto players = pref::players(ctx);
+    auto result = std::vector<std::string>{};
+    result.push_back(makeForehand(ctx.forehandId));
+    const auto [turnId, stage, minBid, canHalfWhist, passRound, talon] = makePlayerTurnData(ctx);
+    result.push_back(makePlayerTurn(turnId, stage, minBid, canHalfWhist, passRound, talon, format));
+    for (const auto& [id, card] : ctx.trick) { result.push_back(makePlayCard(id, card, format)); }
+    for (const auto& player : players | rv::filter(rng::not_fn(&Bid::empty), &Player::bid)) {
+        result.push_back(makeBidding(player.id, player.bid, format));
+    }
+    for (const auto& player : players | rv::filter(rng::not_fn(rng::empty), &Player::whistingChoice)) {
+        result.push_back(makeWhisting(player.id, player.whistingChoice));
+    }
+    for (const auto& player : players | rv::filter(rng::not_fn(rng::empty), &Player::howToPlayChoice)) {
+        result.push_back(makeHowToPlay(player.id, player.howToPlayChoice));
+    }
+    if (rng::any_of(players, equalTo(PREF_OPENLY), &Player::howToPlayChoice)) {
+        const auto& activeWhister = playerByWhistingChoice(ctx.players, WhistingChoice::Whist);
+        const auto& passiveWhister = playerByWhistingChoice(ctx.players, WhistingChoice::Pass);
+        result.push_back(makeOpenWhistPlay(activeWhister.id, passiveWhister.id));
+        result.push_back(makeDealCards(passiveWhister.id, passiveWhister.hand, format));
+        result.push_back(makeDealCards(activeWhister.id, activeWhister.hand, format));
+    }
+    if (ctx.passGame.now and ctx.talon.current and (ctx.talon.open < std::size(ctx.talon.cards))) {
+        result.push_back(makeOpenTalon(*ctx.talon.current, format));
+    }
+    if (ctx.stage == GameStage::PLAYING) {
+        if (const auto declarerId = findDeclarerId(ctx);
+            declarerId and ctx.player((*declarerId).get()).bid.isMiser()) {
+            const auto [remaining, played] = makeDeclarerMiserCards(ctx);
+            result.push_back(makeMiserCards(remaining, played, format));
+        }
+    }
+    result.push_back(makeTableGameState(ctx, format));
+    return result;
+}
+
+} // namespace
+
+auto cachedSnapshot(Context& ctx, const WireFormat format) -> const std::string&
+{
+    auto& cache = ctx.snapshot;
+    auto& body = cache.bodies.at(static_cast<std::size_t>(format));
+    if (body.version == cache.version) { return body.bytes; }
+    auto head = GameSnapshot{};
+    head.set_version(cache.version);
+    body.bytes = head.SerializeAsString();
+    for (const auto& msg : makeSnapshotMessages(ctx, format)) {
+        appendField(body.bytes, GameSnapshot::kMessagesFieldNumber, msg);
+    }
+    body.version = cache.version;
+    return body.bytes;
+}
+
+namespace {
+
+// One frame of the player's own hand followed by the cached table, a copy of it for every reconnect in a version
+[[nodiscard]] auto makeGameSnapshot(Context& ctx, const Player& to) -> std::string
+{
+    const auto& table = cachedSnapshot(ctx, to.wireFormat);
+    auto snapshot = std::string{};
+    appendField(snapshot, GameSnapshot::kMessagesFieldNumber, makeDealCards(to.id, to.hand, to.wireFormat));
+    snapshot.append(table); // serialized messages concatenated parse as their merge
+    auto result = std::string{};
+    result.reserve(std::size(snapshot) + 16);
+    appendField(result, Message::kGameSnapshotFieldNumber, snapshot);
+    return result;
+}
+
+// The players and the table as they all see it, for a spectator who joins or lags
+[[nodiscard]] auto makeSpectatorSnapshot(Context& ctx) -> std::string
+{
+    auto snapshot = std::string{};
+    for (const auto& player : players(ctx)) {
+        appendField(snapshot, GameSnapshot::kMessagesFieldNumber, makePlayerJoined(player.name, player.id));
+    }
+    if (ctx.stage == GameStage::UNKNOWN) {
+        auto head = GameSnapshot{};
+        head.set_version(ctx.snapshot.version);
+        snapshot.append(head.SerializeAsString());
+    } else {
+        snapshot.append(cachedSnapshot(ctx, WireFormat::WIRE_COMPACT));
+    }
+    auto result = std::string{};
+    appendField(result, Message::kGameSnapshotFieldNumber, snapshot);
+    return result;
+}
+
+// From the lane's fan-out: the snapshot is serialized on the table's thread, in order with the frames it publishes
+auto requestSpectatorSnapshot(Context& ctx) -> void
+{
+    stdx::start_detached(stdx::starts_on(
+        ctx.sch,
+        stdx::just() | stdx::then([&ctx] {
+            ctx.spectators.publish(ctx.snapshot.version, makeFrame(makeSpectatorSnapshot(ctx)), true);
+        }) | stdx::upon_error(Detached("requestSpectatorSnapshot"))));
+}
+
+// What a reconnected player is sent to see the table again
+auto sendTableToOne(Context& ctx, const ChannelPtr& ch, const Player& player) -> task<>
+{
+    const auto players = pref::players(ctx);
+    if (ctx.stage == GameStage::UNKNOWN) {
         const auto readyChecks = players
             | rv::filter(notEqualTo(ReadyCheckState::NOT_REQUESTED), &Player::readyCheckState)
             | rv::transform([](const Player& p) { return std::pair{p.id, p.readyCheckState}; })
@@ -304,252 +344,258 @@ auto reconnectPlayer(const ChannelPtr& ch, const Player::IdView playerId, Player
         for (auto&& [id, check] : readyChecks) { co_await sendReadyCheckToOne(ch, id, check); }
         co_return;
     }
-    // TODO: combine all the messages in a batch
     // TODO: send SpeechBubble after reconnection
     // TODO: send Offer after reconnection
-    co_await sendUserGames(player);
-    co_await sendDealCardsFor(ch, playerId, player.hand | rng::to<Hand>);
-    co_await sendForehand();
-    co_await sendPlayerTurn(makePlayerTurnData());
-    co_await sendPlayedCards(ch);
-    const auto bids = players
-        | rv::filter(rng::not_fn(rng::empty), &Player::bid)
-        | rv::transform([](const Player& p) { return std::pair{p.id, p.bid}; })
-        | rng::to_vector;
-    const auto choices = players
-        | rv::filter(rng::not_fn(rng::empty), &Player::whistingChoice)
-        | rv::transform([](const Player& p) { return std::pair{p.id, p.whistingChoice}; })
-        | rng::to_vector;
+    co_await sendToOne(ch, makeGameSnapshot(ctx, player));
+}
 
-    const auto howToPlay = players
-        | rv::filter(rng::not_fn(rng::empty), &Player::howToPlayChoice)
-        | rv::transform([](const Player& p) { return std::pair{p.id, p.howToPlayChoice}; })
-        | rng::to_vector;
-    for (auto&& [id, bid] : bids) { co_await sendBiddingToOne(ch, id, bid); }
-    for (auto&& [id, whist] : choices) { co_await sendWhistingToOne(ch, id, whist); }
-    for (auto&& [id, play] : howToPlay) { co_await sendHowToPlayToOne(ch, id, play); }
-    if (rng::any_of(players, equalTo(PREF_OPENLY), &Player::howToPlayChoice)) {
-        const auto& activeWhister = playerByWhistingChoice(ctx().players, WhistingChoice::Whist);
-        const auto& passiveWhister = playerByWhistingChoice(ctx().players, WhistingChoice::Pass);
-        co_await sendOpenWhistPlayToOne(ch, activeWhister.id, passiveWhister.id);
-        if (playerId == activeWhister.id) {
-            co_await sendDealCardsFor(ch, passiveWhister.id, passiveWhister.hand);
-        } else if (playerId == passiveWhister.id) {
-            co_await sendDealCardsFor(ch, activeWhister.id, activeWhister.hand);
-        } else {
-            co_await sendDealCardsFor(ch, passiveWhister.id, passiveWhister.hand);
-            co_await sendDealCardsFor(ch, activeWhister.id, activeWhister.hand);
-        }
-    }
-    if (ctx().passGame.now and (ctx().talon.open < std::size(ctx().talon.cards))) { co_await sendOpenTalonToOne(ch); }
-    if (ctx().stage == GameStage::PLAYING) {
-        if (const auto declarerId = findDeclarerId(); declarerId) {
-            const auto isMiser = ctx().player((*declarerId).get()).bid.contains(PREF_MIS);
-            if (isMiser) { co_await sendMiserCards(); }
-        }
-    }
-    co_await sendGameState(ch);
+auto reconnectPlayer(Context& ctx, const ChannelPtr& ch, const Player::IdView playerId, PlayerSession& session)
+    -> task<>
+{
+    co_await prepareNewSession(ctx, playerId, session);
+    auto& player = ctx.player(playerId);
+    player.conn.replaceChannel(ch);
+    ctx.recorder.seated(playerId, session.playerName, false);
+    PREF_DI(session.playerName, session.playerId, session.id);
+    co_await sendTableToOne(ctx, ch, player);
 }
 
-auto maybeAddTalonToHand() -> void
+auto maybeAddTalonToHand(Context& ctx) -> void
 {
-    if (ctx().stage != GameStage::TALON_PICKING) { return; }
-    assert((std::size(ctx().talon.cards) == 2) and "talon is two cards");
-    for (const auto& card : ctx().talon.cards) { addCardToHand(ctx().whoseTurnId(), card); }
+    if (ctx.stage != GameStage::TALON_PICKING) { return; }
+    assert((std::size(ctx.talon.cards) == 2) and "talon is two cards");
+    for (const auto card : ctx.talon.cards) { addCardToHand(ctx, ctx.whoseTurnId(), card); }
 }
 
-[[nodiscard]] auto decidePlayerTurn() -> PlayerTurnData
+[[nodiscard]] auto decidePlayerTurn(Context& ctx) -> PlayerTurnData
 {
-    maybeAddTalonToHand();
-    return makePlayerTurnData();
+    maybeAddTalonToHand(ctx);
+    return makePlayerTurnData(ctx);
 }
 
-auto removeCardFromHand(const Player::IdView playerId, CardName card) -> void
+auto removeCardFromHand(Context& ctx, const Player::IdView playerId, const CardId card) -> void
 {
-    assert(ctx().player(playerId).hand.contains(card) and "card exists");
-    ctx().player(playerId).hand.erase(card);
-    ctx().player(playerId).playedCards.push_back(std::move(card));
+    assert(ctx.player(playerId).hand.contains(card) and "card exists");
+    ctx.player(playerId).hand.erase(card);
+    ctx.player(playerId).playedCards.push_back(card);
 }
 
-auto dealCards() -> task<>
+auto dealCards(Context& ctx) -> task<>
 {
-    const auto suits = std::array{PREF_SPADES, PREF_DIAMONDS, PREF_CLUBS, PREF_HEARTS};
-    const auto ranks
-        = std::array{PREF_SEVEN, PREF_EIGHT, PREF_NINE, PREF_TEN, PREF_JACK, PREF_QUEEN, PREF_KING, PREF_ACE};
-    const auto toCard = [](const auto& card) {
-        const auto& [rank, suit] = card;
-        return fmt::format("{}" PREF_OF_ "{}", rank, suit);
-    };
-    const auto deck = rv::cartesian_product(ranks, suits)
-        | rv::transform(toCard)
+    const auto deck = rv::iota(0uz, DeckSize)
+        | rv::transform([](const std::size_t index) { return static_cast<CardId>(index); })
         | rng::to_vector
-        | rng::actions::shuffle(std::mt19937{std::invoke(std::random_device{})});
+        | rng::actions::shuffle(ctx.random);
     const auto chunks = deck | rv::chunk(10);
-    const auto hands = chunks | rv::take(NumberOfPlayers) | rng::to_vector;
-    ctx().talon.cards = chunks | rv::drop(NumberOfPlayers) | rv::join | rng::to_vector;
-    assert((std::size(ctx().talon.cards) == 2) and "talon is two cards");
-    assert((std::size(ctx().players) == NumberOfPlayers) and (std::size(hands) == NumberOfPlayers));
-    for (auto&& [playerId, hand] : rv::zip(ctx().players | rv::keys, hands)) {
-        ctx().player(playerId).hand = hand | rng::to<Hand>;
-    }
-    PREF_I("talon: {}", ctx().talon.cards);
-    const auto channels = players()
-        | rv::transform([](const Player& player) { return std::pair{player.conn.ch, player.id}; })
+    const auto hands = chunks
+        | rv::take(NumberOfPlayers)
+        | rv::transform([](auto&& hand) { return toCardMask(hand); })
         | rng::to_vector;
-    assert((std::size(channels) == NumberOfPlayers) and (std::size(hands) == NumberOfPlayers));
-    for (auto&& [ch_id, hand] : rv::zip(channels, hands)) {
-        const auto& [ch, id] = ch_id;
-        co_await sendDealCardsFor(ch, id, hand | rng::to<Hand>);
+    ctx.talon.cards = chunks | rv::drop(NumberOfPlayers) | rv::join | rng::to_vector;
+    assert((std::size(ctx.talon.cards) == 2) and "talon is two cards");
+    assert((std::size(ctx.players) == NumberOfPlayers) and (std::size(hands) == NumberOfPlayers));
+    for (auto&& [playerId, hand] : rv::zip(ctx.players | rv::keys, hands)) { ctx.player(playerId).hand = hand; }
+    PREF_I("talon: {}", ctx.talon.cards);
+    for (const auto& player : players(ctx)) { co_await sendDealCardsFor(player, player.id, player.hand); }
+}
+
+auto resetGame(Context& ctx) -> void
+{
+    ctx.clear();
+    ctx.stage = GameStage::UNKNOWN;
+    ctx.forehandId = {};
+    ctx.scoreSheet = {};
+    ctx.gameStarted = {};
+    ctx.gameDuration = {};
+}
+
+// The bots leave with the last human, and the game is over
+auto removeBots(Context& ctx) -> void
+{
+    if (std::empty(ctx.players)) {
+        resetGame(ctx); // for the players the table is reused for
+        return;
+    }
+    if (not rng::all_of(players(ctx), &Player::isBot)) { return; }
+    for (const auto& bot : players(ctx)) {
+        PREF_I("botId: {}", bot.id);
+        bot.conn.ch->close(); // stops its runBot
+        ctx.registry.leave(ctx, bot.id);
     }
+    ctx.players.clear();
+    resetGame(ctx);
 }
 
-auto removePlayer(Player::Id playerId) -> task<>
+auto removePlayer(Context& ctx, Player::Id playerId) -> task<>
 {
-    assert(ctx().players.contains(playerId) and "player exists");
+    assert(ctx.players.contains(playerId) and "player exists");
     PREF_DI(playerId);
-    ctx().players.erase(playerId);
-    co_await sendPlayerLeft(std::move(playerId));
+    ctx.recorder.left(playerId);
+    ctx.players.erase(playerId);
+    ctx.registry.leave(ctx, playerId);
+    co_await sendPlayerLeft(ctx, std::move(playerId));
+    removeBots(ctx);
 }
 
-auto disconnected(Player::Id playerId) -> task<>
+auto removeIfSeated(Context& ctx, Player::Id playerId) -> task<>
 {
-    PREF_DI(playerId);
-    auto& player = ctx().player(playerId);
-    if (not player.conn.reconnectTimer) { player.conn.reconnectTimer.emplace(player.conn.ch->get_executor()); }
+    if (ctx.players.contains(playerId)) { co_await removePlayer(ctx, std::move(playerId)); }
+}
+
+auto disconnected(Context& ctx, Player::Id playerId, const PlayerSession::Id sessionId) -> task<>
+{
+    PREF_DI(playerId, sessionId);
+    if (not ctx.players.contains(playerId) or sessionId != ctx.player(playerId).sessionId) { co_return; }
+    auto& player = ctx.player(playerId);
+    if (not player.conn.reconnectTimer) { player.conn.reconnectTimer.emplace(ctx.ex); }
     player.conn.reconnectTimer->expires_after(10s);
     if (const auto [error] = co_await player.conn.reconnectTimer->async_wait(); error) {
         if (error != net::error::operation_aborted) { PREF_DW(error); }
         co_return;
     }
-    co_await removePlayer(std::move(playerId));
-}
-
-using TrickComparator = std::function<bool(int, int)>;
-[[nodiscard]] constexpr auto compareTricks(const ContractLevel level) -> TrickComparator
-{
-    return level == ContractLevel::Miser ? TrickComparator{std::less_equal{}} : TrickComparator{std::greater_equal{}};
+    co_await removePlayer(ctx, std::move(playerId));
 }
 
-[[maybe_unused]] auto hasDeclarerFulfilledContract() -> bool
+[[maybe_unused]] auto hasDeclarerFulfilledContract(Context& ctx) -> bool
 {
-    return findDeclarerId()
+    return findDeclarerId(ctx)
         .transform([&](const Player::Id& declarerId) {
-            const auto& declarer = ctx().players.at(declarerId);
+            const auto& declarer = ctx.players.at(declarerId);
             const auto contractLevel = makeContractLevel(declarer.bid);
-            return compareTricks(contractLevel)(declarer.tricksTaken, declarerReqTricks(contractLevel));
+            return hasFulfilledContract(contractLevel, declarer.tricksTaken);
         })
         .value_or(false);
 }
 
-auto updateScoreSheetForDeal() -> void
+auto updateScoreSheetForDeal(Context& ctx) -> void
 {
-    findDeclarerId() | OnValue([&](const Player::Id& declarerId) {
-        const auto& declarerPlayer = ctx().players.at(declarerId);
+    findDeclarerId(ctx) | OnValue([&](const Player::Id& declarerId) {
+        const auto& declarerPlayer = ctx.players.at(declarerId);
         const auto declarer = Declarer{
             .id = declarerId,
             .contractLevel = makeContractLevel(declarerPlayer.bid),
             .tricksTaken = declarerPlayer.tricksTaken};
         auto whisters = std::vector<Whister>{};
-        for (const auto& passerPlayer : getTwoPassers()) {
+        for (const auto& passerPlayer : getTwoPassers(ctx)) {
             whisters.emplace_back(
                 passerPlayer.get().id,
                 makeWhistingChoice(passerPlayer.get().whistingChoice),
                 passerPlayer.get().tricksTaken);
         }
         for (const auto& [id, entry] : calculateDealScore(declarer, whisters)) {
-            ctx().scoreSheet[id].dump.push_back(entry.dump);
-            ctx().scoreSheet[id].pool.push_back(entry.pool);
-            if (id != declarerId) { ctx().scoreSheet[id].whists[declarerId].push_back(entry.whist); }
+            ctx.scoreSheet[id].dump.push_back(entry.dump);
+            ctx.scoreSheet[id].pool.push_back(entry.pool);
+            if (id != declarerId) { ctx.scoreSheet[id].whists[declarerId].push_back(entry.whist); }
         }
-    }) | OnNone([] { // PassGame
-        const auto players = pref::players();
+    }) | OnNone([&] { // PassGame
+        const auto players = pref::players(ctx);
         const auto minTricksTaken = rng::min(players | rv::transform(&Player::tricksTaken));
         for (const auto& player : players) {
-            assert(ctx().passGame.now);
-            assert(ctx().passGame.round != 0);
-            if (const auto price = progressionTerm(ctx().passGame.round, PassGame::s_progression);
+            assert(ctx.passGame.now);
+            assert(ctx.passGame.round != 0);
+            if (const auto price = progressionTerm(ctx.passGame.round, PassGame::s_progression);
                 player.tricksTaken == 0) {
-                ctx().scoreSheet[player.id].pool.push_back(price);
+                ctx.scoreSheet[player.id].pool.push_back(price);
             } else {
-                ctx().scoreSheet[player.id].dump.push_back((player.tricksTaken - minTricksTaken) * price);
+                ctx.scoreSheet[player.id].dump.push_back((player.tricksTaken - minTricksTaken) * price);
             }
         }
     });
 }
 
-auto dealFinished() -> task<bool>
-{
-    ctx().gameDuration = pref::durationInSec(ctx().gameStarted);
-    PREF_I("gameId: {} duration: {}", ctx().gameId, formatDuration(ctx().gameDuration));
-    updateScoreSheetForDeal();
-    const auto finalResult = calculateFinalResult(makeFinalScore(ctx().scoreSheet));
-    for (const auto& [playerId, score] : ctx().scoreSheet) {
-        PREF_DI(playerId, score.dump, score.pool);
-        auto totalWhists = 0;
-        for (const auto& [id, whists] : score.whists) {
-            PREF_I("whists: {} -> {}", whists, id);
-            totalWhists += rng::accumulate(whists, 0);
+auto dealFinished(Context& ctx) -> task<bool>
+{
+    ++ctx.dealsPlayed;
+    ctx.gameDuration = pref::durationInSec(ctx.gameStarted);
+    PREF_I("gameId: {} duration: {}", ctx.gameId, formatDuration(ctx.gameDuration));
+    updateScoreSheetForDeal(ctx);
+    const auto finalResult = calculateFinalResult(makeFinalScore(ctx.scoreSheet));
+    {
+        const auto lock = std::scoped_lock{ctx.storage.mutex};
+        for (const auto& [playerId, score] : ctx.scoreSheet) {
+            PREF_DI(playerId, score.dump, score.pool);
+            auto totalWhists = 0;
+            for (const auto& [id, whists] : score.whists) {
+                PREF_I("whists: {} -> {}", whists, id);
+                totalWhists += rng::accumulate(whists, 0);
+            }
+            if (ctx.player(playerId).isBot) { continue; } // bots keep no games
+            recordChange(
+                ctx.storage.gameData,
+                ctx.storage.index,
+                ctx.storage.journal,
+                makeUserGameUpserted(
+                    playerId,
+                    makeUserGame(
+                        ctx.gameId,
+                        ctx.gameDuration,
+                        rng::accumulate(score.pool, 0),
+                        rng::accumulate(score.dump, 0),
+                        totalWhists,
+                        finalResult.at(playerId))));
         }
-        addOrUpdateUserGame(
-            ctx().gameData,
-            playerId,
-            makeUserGame(
-                ctx().gameId,
-                ctx().gameDuration,
-                rng::accumulate(score.pool, 0),
-                rng::accumulate(score.dump, 0),
-                totalWhists,
-                finalResult.at(playerId)));
+        ctx.storage.journal.commit();
     }
     PREF_DI(finalResult);
-    storeGameData(ctx().gameDataPath, ctx().gameData);
-    co_await sendUserGames();
-    const auto pools = ctx().scoreSheet
+    co_await sendUserGameUpdates(ctx);
+    const auto pools = ctx.scoreSheet
         | rv::values
         | rv::transform(&Score::pool)
         | rv::transform([](const auto& pool) { return rng::accumulate(pool, 0); });
     const auto isGameOver = rng::all_of(pools, [](const std::int32_t pool) { return pool >= ScoreTarget; });
     PREF_DI(isGameOver, pools);
-    co_await sendDealFinished(isGameOver);
-    ctx().clear();
+    co_await sendDealFinished(ctx, isGameOver);
+    ctx.clear();
     co_return isGameOver;
 }
 
-auto updateStageGame() -> void
+auto updateStageGame(Context& ctx) -> void
 {
-    const auto bids = players() | rv::transform(&Player::bid);
-    const auto passCount = rng::count(bids, std::string_view{PREF_PASS});
-    const auto activeCount = rng::count_if(bids, [](auto&& bid) { return not std::empty(bid) and bid != PREF_PASS; });
+    const auto bids = players(ctx) | rv::transform(&Player::bid);
+    const auto passCount = rng::count_if(bids, &Bid::isPass);
+    const auto activeCount = rng::count_if(bids, [](const Bid bid) { return not bid.empty() and not bid.isPass(); });
     if (std::cmp_equal(passCount, WhistersCount) and std::cmp_equal(activeCount, DeclarerCount)) {
-        const auto& contract = *rng::find_if(bids, notEqualTo(PREF_PASS));
-        ctx().stage = contract.contains(PREF_WT) ? GameStage::WITHOUT_TALON : GameStage::TALON_PICKING;
+        const auto contract = *rng::find_if(bids, rng::not_fn(&Bid::isPass));
+        ctx.stage = contract.isWithoutTalon() ? GameStage::WITHOUT_TALON : GameStage::TALON_PICKING;
         return;
     }
     if (std::cmp_equal(passCount, NumberOfPlayers)) {
-        ctx().passGame.update();
-        ctx().stage = GameStage::PLAYING;
+        ctx.passGame.update();
+        ctx.stage = GameStage::PLAYING;
         return;
     }
-    ctx().stage = GameStage::BIDDING;
+    ctx.stage = GameStage::BIDDING;
 }
 
-auto startGame() -> task<>
+auto startGame(Context& ctx) -> task<>
 {
-    assert(std::size(ctx().players) == NumberOfPlayers);
+    assert(std::size(ctx.players) == NumberOfPlayers);
     // TODO: use UTC on the server and local time zone on the client
-    ctx().gameStarted = localTimeSinceEpochInSec();
-    ++ctx().gameId;
-    PREF_I("gameId: {} started: {} {}", ctx().gameId, formatDate(ctx().gameStarted), formatTime(ctx().gameStarted));
-    for (const auto& id : ctx().players | rv::keys) {
-        addOrUpdateUserGame(ctx().gameData, id, makeUserGame(ctx().gameId, GameType::RANKED, ctx().gameStarted));
+    ctx.gameStarted = localTimeSinceEpochInSec();
+    {
+        const auto lock = std::scoped_lock{ctx.storage.mutex};
+        ctx.gameId = ++ctx.storage.gameId; // game IDs are unique across all the tables
+        for (const auto& player : players(ctx) | rv::filter(std::logical_not{}, &Player::isBot)) {
+            recordChange(
+                ctx.storage.gameData,
+                ctx.storage.index,
+                ctx.storage.journal,
+                makeUserGameUpserted(player.id, makeUserGame(ctx.gameId, GameType::RANKED, ctx.gameStarted)));
+        }
+        ctx.storage.journal.commit();
     }
-    storeGameData(ctx().gameDataPath, ctx().gameData);
-    co_await dealCards();
-    resetWhoseTurn();
-    setForehandId();
-    co_await sendForehand();
-    ctx().stage = GameStage::BIDDING;
-    co_await sendPlayerTurn(decidePlayerTurn());
+    PREF_I(
+        "tableId: {} gameId: {} started: {} {}",
+        ctx.id,
+        ctx.gameId,
+        formatDate(ctx.gameStarted),
+        formatTime(ctx.gameStarted));
+    co_await dealCards(ctx);
+    resetWhoseTurn(ctx);
+    setForehandId(ctx);
+    co_await sendForehand(ctx);
+    ctx.stage = GameStage::BIDDING;
+    co_await sendPlayerTurn(ctx, decidePlayerTurn(ctx));
 }
 
 [[nodiscard]] auto toServerAuthToken(const std::string_view authToken) -> std::string
@@ -562,82 +608,149 @@ auto startGame() -> task<>
     return bytes2hex(generateToken());
 }
 
-auto handleLoginRequest(const Message& msg, const ChannelPtr& ch) -> task<PlayerSession>
+// Runs the handler on the table's executor, the caller is resumed on its own scheduler afterwards
+template<typename T>
+auto onTable(Context& ctx, task<T> handler) -> task<T>
+{
+    co_return co_await stdx::starts_on(ctx.sch, std::move(handler));
+}
+
+auto seatBotsLater(Context& ctx) -> task<>;
+
+// Humans waiting at a table that isn't full get bots in the empty seats if nobody else joins for a while
+auto scheduleBots(Context& ctx) -> void
+{
+    if (std::size(ctx.players) == NumberOfPlayers) { return; }
+    stdx::start_detached(stdx::starts_on(ctx.sch, seatBotsLater(ctx) | stdx::upon_error(Detached("seatBotsLater"))));
+}
+
+auto loginPlayer(
+    Context& ctx, const ChannelPtr& ch, const Player::IdView playerId, std::string authToken, PlayerSession& session)
+    -> task<>
+{
+    if (isNewPlayer(ctx, playerId)) {
+        joinPlayer(ctx, ch, playerId, session);
+        co_await sendLoginResponse(ctx, ch, playerId, std::move(authToken), session.wireFormat);
+    } else {
+        co_await sendLoginResponse(ctx, ch, playerId, std::move(authToken), session.wireFormat);
+        co_await reconnectPlayer(ctx, ch, playerId, session);
+        co_return;
+    }
+    co_await sendPlayerJoined(ctx, session);
+    scheduleBots(ctx);
+}
+
+auto authPlayer(Context& ctx, const ChannelPtr& ch, const Player::IdView playerId, PlayerSession& session) -> task<>
+{
+    if (isNewPlayer(ctx, playerId)) {
+        joinPlayer(ctx, ch, playerId, session);
+        co_await sendAuthResponse(ctx, ch, session.playerName, session.wireFormat);
+    } else {
+        co_await sendAuthResponse(ctx, ch, session.playerName, session.wireFormat);
+        co_await reconnectPlayer(ctx, ch, playerId, session);
+        co_return;
+    }
+    co_await sendPlayerJoined(ctx, session);
+    scheduleBots(ctx);
+}
+
+auto handleLoginRequest(
+    TableRegistry& registry, const Message& msg, const ChannelPtr& ch, const net::ip::address& address)
+    -> task<PlayerSession>
 {
     auto loginRequest = makeMethod<LoginRequest>(msg);
     if (not loginRequest) { co_return PlayerSession{}; }
-    auto session = PlayerSession{};
-    auto& playerName = *loginRequest->mutable_player_name();
-    const auto password = loginRequest->password();
-    if (not verifyPlayerNameAndPassword(ctx().gameData, playerName, password)) {
-        auto error = fmt::format("unknown {} or wrong password", PREF_V(playerName));
+    auto session = PlayerSession{.wireFormat = negotiateWireFormat(loginRequest->wire_format()), .address = address};
+    ch->setBatches(loginRequest->batches());
+    auto playerName = loginRequest->player_name();
+    auto& storage = registry.storage();
+    auto lock = std::unique_lock{storage.mutex};
+    auto passwordHash = playerPasswordHash(storage.gameData, storage.index, playerName).transform([](const auto hash) {
+        return std::string{hash};
+    });
+    lock.unlock();
+    // Argon2 takes tens of milliseconds, so it runs on the password pool without holding the storage
+    auto password = std::string{loginRequest->password()};
+    const auto isVerified = passwordHash
+        ? co_await registry.passwords().verify(address, std::move(password), *std::move(passwordHash))
+        : std::optional{false};
+    if (not isVerified or not *isVerified) {
+        auto error = isVerified ? fmt::format("unknown {} or wrong password", PREF_V(playerName))
+                                : std::string{"too many login attempts, try again later"};
         PREF_DW(error);
         co_await sendLoginResponse(ch, std::move(error));
         co_return session;
     }
-    assert(userPlayerId(ctx().gameData, playerName));
+    lock.lock();
+    assert(userPlayerId(storage.gameData, storage.index, playerName));
     // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
-    const auto playerId = *userPlayerId(ctx().gameData, playerName);
+    const auto playerId = *userPlayerId(storage.gameData, storage.index, playerName);
     auto authToken = generateClientAuthToken();
-    addAuthToken(ctx().gameData, playerId, toServerAuthToken(authToken));
-    storeGameData(ctx().gameDataPath, ctx().gameData);
+    recordChange(
+        storage.gameData,
+        storage.index,
+        storage.journal,
+        makeAuthTokenAdded(playerId, toServerAuthToken(authToken), utcTimeSinceEpochInSec()));
+    storage.journal.commit();
+    lock.unlock();
     PREF_DI(playerName, playerId);
     session.playerName = std::move(playerName);
-    if (isNewPlayer(playerId)) {
-        joinPlayer(ch, playerId, session);
-        co_await sendLoginResponse(ch, {}, playerId, std::move(authToken));
-    } else {
-        co_await sendLoginResponse(ch, {}, playerId, std::move(authToken));
-        co_await reconnectPlayer(ch, playerId, session);
-        co_return session;
-    }
-    co_await sendPlayerJoined(session);
-    co_await sendUserGames();
+    auto& table = registry.seat(playerId);
+    co_await onTable(table, loginPlayer(table, ch, playerId, std::move(authToken), session));
     co_return session;
 }
 
-auto handleAuthRequest(const Message& msg, const ChannelPtr& ch) -> task<PlayerSession>
+auto handleAuthRequest(
+    TableRegistry& registry, const Message& msg, const ChannelPtr& ch, const net::ip::address& address)
+    -> task<PlayerSession>
 {
     const auto authRequest = makeMethod<AuthRequest>(msg);
     if (not authRequest) { co_return PlayerSession{}; }
-    auto session = PlayerSession{};
+    auto session = PlayerSession{.wireFormat = negotiateWireFormat(authRequest->wire_format()), .address = address};
+    ch->setBatches(authRequest->batches());
     const auto playerId = authRequest->player_id();
-    if (not verifyPlayerIdAndAuthToken(ctx().gameData, playerId, toServerAuthToken(authRequest->auth_token()))) {
+    const auto serverAuthToken = toServerAuthToken(authRequest->auth_token());
+    const auto now = utcTimeSinceEpochInSec();
+    auto& storage = registry.storage();
+    auto lock = std::unique_lock{storage.mutex};
+    if (not verifyPlayerIdAndAuthToken(storage.gameData, storage.index, playerId, serverAuthToken, now)) {
+        lock.unlock();
         auto error = fmt::format("unknown {} or wrong auth token", PREF_V(playerId));
         PREF_DW(error);
         co_await sendAuthResponse(ch, std::move(error));
         co_return session;
     }
-    assert(userByPlayerId(ctx().gameData, playerId));
+    assert(userByPlayerId(storage.gameData, storage.index, playerId));
     // NOLINTNEXTLINE(bugprone-unchecked-optional-access)
-    const auto playerName = userByPlayerId(ctx().gameData, playerId)->get().player_name();
-    PREF_DI(playerName, playerId);
-    session.playerName = playerName;
-    if (isNewPlayer(playerId)) {
-        joinPlayer(ch, playerId, session);
-        co_await sendAuthResponse(ch, {}, playerName);
-    } else {
-        co_await sendAuthResponse(ch, {}, playerName);
-        co_await reconnectPlayer(ch, playerId, session);
-        co_return session;
-    }
-    co_await sendPlayerJoined(session);
-    co_await sendUserGames();
+    session.playerName = userByPlayerId(storage.gameData, storage.index, playerId)->get().player_name();
+    recordChange(storage.gameData, storage.index, storage.journal, makeAuthTokenUsed(playerId, serverAuthToken, now));
+    storage.journal.commit();
+    lock.unlock();
+    PREF_DI(session.playerName, playerId);
+    auto& table = registry.seat(playerId);
+    co_await onTable(table, authPlayer(table, ch, playerId, session));
     co_return session;
 }
 
-auto handleLogout(const Message& msg) -> task<>
+auto handleLogout(Context& ctx, const Message& msg) -> task<>
 {
     auto logout = makeMethod<Logout>(msg);
     if (not logout) { co_return; }
-    auto& playerId = *logout->mutable_player_id();
+    auto playerId = logout->player_id();
     PREF_DI(playerId);
-    revokeAuthToken(ctx().gameData, playerId, toServerAuthToken(logout->auth_token()));
-    storeGameData(ctx().gameDataPath, ctx().gameData);
-    co_await removePlayer(std::move(playerId));
+    {
+        const auto lock = std::scoped_lock{ctx.storage.mutex};
+        recordChange(
+            ctx.storage.gameData,
+            ctx.storage.index,
+            ctx.storage.journal,
+            makeAuthTokenRevoked(playerId, toServerAuthToken(logout->auth_token())));
+        ctx.storage.journal.commit();
+    }
+    co_await onTable(ctx, removeIfSeated(ctx, std::move(playerId)));
 }
 
-auto handleReadyCheck(const Message& msg) -> task<>
+auto handleReadyCheck(Context& ctx, const Message& msg) -> task<>
 {
     const auto readyCheck = makeMethod<ReadyCheck>(msg);
     if (not readyCheck) { co_return; }
@@ -645,60 +758,70 @@ auto handleReadyCheck(const Message& msg) -> task<>
     const auto state = readyCheck->state();
     PREF_I("{}, state: {}", PREF_V(playerId), ReadyCheckState_Name(state));
     if (state == ReadyCheckState::REQUESTED) {
-        for (auto& readyCheckState : players() | rv::transform(&Player::readyCheckState)) {
+        for (auto& readyCheckState : players(ctx) | rv::transform(&Player::readyCheckState)) {
             readyCheckState = ReadyCheckState::NOT_REQUESTED;
         }
     }
-    ctx().player(playerId).readyCheckState = (state == ReadyCheckState::REQUESTED) ? ReadyCheckState::ACCEPTED : state;
-    co_await forwardToAllExcept(msg, playerId);
-    if (rng::all_of(players(), equalTo(ReadyCheckState::ACCEPTED), &Player::readyCheckState)) { co_await startGame(); }
+    ctx.player(playerId).readyCheckState = (state == ReadyCheckState::REQUESTED) ? ReadyCheckState::ACCEPTED : state;
+    co_await forwardToAllExcept(ctx, msg, playerId);
+    if (rng::all_of(players(ctx), equalTo(ReadyCheckState::ACCEPTED), &Player::readyCheckState)) {
+        co_await startGame(ctx);
+    }
 }
 
-auto handleBidding(const Message& msg) -> task<>
+auto handleBidding(Context& ctx, const Message& msg) -> task<>
 {
     auto bidding = makeMethod<Bidding>(msg);
     if (not bidding) { co_return; }
     const auto playerId = bidding->player_id();
-    auto& bid = *bidding->mutable_bid();
-    const auto playerName = ctx().playerName(playerId);
+    const auto bid = parseBid(bidding->bid(), bidding->bid_code());
+    if (bid.empty()) {
+        PREF_W("error: unknown bid: {}, code: {}", bidding->bid(), BidCode_Name(bidding->bid_code()));
+        co_return;
+    }
+    const auto playerName = ctx.playerName(playerId);
     PREF_DI(playerName, playerId, bid);
-    ctx().player(playerId).bid = std::move(bid);
-    co_await forwardToAllExcept(msg, playerId);
-    updateStageGame();
-    if (ctx().passGame.now) { co_await sendOpenTalon(); }
-    advanceWhoseTurn(ctx().stage);
-    co_await sendPlayerTurn(decidePlayerTurn());
+    ctx.player(playerId).bid = bid;
+    co_await sendBidding(ctx, playerId, bid);
+    updateStageGame(ctx);
+    if (ctx.passGame.now) { co_await sendOpenTalon(ctx); }
+    advanceWhoseTurn(ctx, ctx.stage);
+    co_await sendPlayerTurn(ctx, decidePlayerTurn(ctx));
 }
 
-auto startPlayingFromForehand() -> task<>;
+auto startPlayingFromForehand(Context& ctx) -> task<>;
 
-auto handleDiscardTalon(const Message& msg) -> task<>
+auto handleDiscardTalon(Context& ctx, const Message& msg) -> task<>
 {
     auto discardTalon = makeMethod<DiscardTalon>(msg);
     if (not discardTalon) { co_return; }
     const auto playerId = discardTalon->player_id();
-    ctx().player(playerId).bid = std::move(*discardTalon->mutable_bid());
-    const auto& bid = ctx().player(playerId).bid;
-    for (auto& card : *discardTalon->mutable_cards()) {
-        ctx().talon.discardedCards.push_back(card);
-        removeCardFromHand(playerId, std::move(card));
-    }
-    auto& discardedCards = ctx().talon.discardedCards;
-    const auto playerName = ctx().playerName(playerId);
+    const auto bid = parseBid(discardTalon->bid(), discardTalon->bid_code());
+    if (bid.empty()) {
+        PREF_W("error: unknown bid: {}, code: {}", discardTalon->bid(), BidCode_Name(discardTalon->bid_code()));
+        co_return;
+    }
+    ctx.player(playerId).bid = bid;
+    for (const auto card : parseHand(discardTalon->cards(), discardTalon->cards_mask())) {
+        ctx.talon.discardedCards.push_back(card);
+        removeCardFromHand(ctx, playerId, card);
+    }
+    auto& discardedCards = ctx.talon.discardedCards;
+    const auto playerName = ctx.playerName(playerId);
     PREF_DI(playerName, playerId, discardedCards, bid);
-    ctx().trump = getTrump(bid);
-    co_await sendBidding(playerId, bid); // final bid
-    ctx().stage = bid.contains(PREF_SIX) and bid.contains(PREF_SPADE) ? GameStage::PLAYING : GameStage::WHISTING;
-    if (ctx().stage == GameStage::PLAYING) { // Stalingrad
-        for (auto& p : getTwoPassers()) {
+    ctx.trump = bid.trump();
+    co_await sendBidding(ctx, playerId, bid); // final bid
+    ctx.stage = bid == PREF_SIX PREF_SPADE ? GameStage::PLAYING : GameStage::WHISTING;
+    if (ctx.stage == GameStage::PLAYING) { // Stalingrad
+        for (auto& p : getTwoPassers(ctx)) {
             p.get().whistingChoice = PREF_WHIST;
-            co_await sendWhisting(p.get().id, p.get().whistingChoice);
+            co_await sendWhisting(ctx, p.get().id, p.get().whistingChoice);
         }
-        co_await startPlayingFromForehand();
+        co_await startPlayingFromForehand(ctx);
         co_return;
     }
-    advanceWhoseTurn();
-    co_await sendPlayerTurn(decidePlayerTurn());
+    advanceWhoseTurn(ctx);
+    co_await sendPlayerTurn(ctx, decidePlayerTurn(ctx));
 }
 
 auto handlePingPong(const Message& msg, const ChannelPtr& ch) -> task<>
@@ -708,48 +831,101 @@ auto handlePingPong(const Message& msg, const ChannelPtr& ch) -> task<>
     co_await sendPingPong(msg, ch);
 }
 
-auto finishDeal() -> task<>
+auto handleUserGamesRequest(
+    TableRegistry& registry, const Message& msg, const ChannelPtr& ch, const PlayerSession& session) -> task<>
+{
+    const auto request = makeMethod<UserGamesRequest>(msg);
+    if (not request) { co_return; }
+    auto& storage = registry.storage();
+    auto userGames = std::invoke([&] {
+        const auto lock = std::scoped_lock{storage.mutex};
+        return makeUserGames(
+            storage.gameData, storage.index, session.playerId, request->before_id(), request->limit());
+    });
+    co_await sendToOne(ch, std::move(userGames));
+}
+
+// The snapshot goes straight into the new channel, so that no frame of the lane can overtake it
+auto watchTable(Context& ctx, const ChannelPtr& ch) -> task<>
+{
+    ch->queue();
+    if (not ch->try_send(sys::error_code{}, makeFrame(makeSpectatorSnapshot(ctx)))) {
+        ch->unqueue();
+        co_return;
+    }
+    ctx.spectators.add(ch, ctx.snapshot.version, [&ctx] { requestSpectatorSnapshot(ctx); });
+}
+
+auto handleSpectateRequest(TableRegistry& registry, const Message& msg, const ChannelPtr& ch, PlayerSession& session)
+    -> task<>
+{
+    const auto request = makeMethod<SpectateRequest>(msg);
+    if (not request or session.id != 0) { co_return; }
+    auto& storage = registry.storage();
+    const auto& playerName = request->player_name();
+    const auto playerId = std::invoke([&] {
+        const auto lock = std::scoped_lock{storage.mutex};
+        return userPlayerId(storage.gameData, storage.index, playerName).transform([](const PlayerIdView id) {
+            return Player::Id{id};
+        });
+    });
+    auto* const table = playerId ? registry.findTable(*playerId) : nullptr;
+    if (not table) {
+        PREF_W("error: no table to watch, {}", PREF_V(playerName));
+        co_return; // the session ends with no player to watch
+    }
+    const auto tableId = table->id;
+    PREF_DI(playerName, tableId);
+    ch->setBatches(request->batches());
+    session.spectated = table;
+    co_await onTable(*table, watchTable(*table, ch));
+}
+
+// Recorded, because the table handles the other messages while it waits for the next deal
+auto dealNextDeal(Context& ctx) -> task<>
 {
-    const auto isGameOver = co_await dealFinished();
+    ctx.recorder.nextDeal();
+    co_await dealCards(ctx);
+    setNextDealTurn(ctx);
+    co_await sendForehand(ctx);
+    ctx.stage = GameStage::BIDDING;
+    co_await sendPlayerTurn(ctx, decidePlayerTurn(ctx));
+}
+
+auto finishDeal(Context& ctx) -> task<>
+{
+    const auto isGameOver = co_await dealFinished(ctx);
     PREF_DI(isGameOver);
     if (isGameOver) {
-        ctx().clear();
-        ctx().stage = GameStage::UNKNOWN;
-        ctx().forehandId = {};
-        ctx().scoreSheet = {};
-        ctx().gameStarted = {};
-        ctx().gameDuration = {};
+        resetGame(ctx);
         co_return;
     }
-    co_await sleepFor(3s, ctx().ex);
-    co_await dealCards();
-    setNextDealTurn();
-    co_await sendForehand();
-    ctx().stage = GameStage::BIDDING;
-    co_await sendPlayerTurn(decidePlayerTurn());
+    if (ctx.isNextDealRecorded) { co_return; } // the replay deals it on its record
+    co_await sleepFor(ctx.nextDealDelay, ctx.ex);
+    co_await dealNextDeal(ctx);
 }
 
-auto updateDeclarerTakenTricks() -> void
+auto updateDeclarerTakenTricks(Context& ctx) -> void
 {
-    auto& declarer = getDeclarer();
+    auto& declarer = getDeclarer(ctx);
     declarer.tricksTaken = declarerReqTricks(makeContractLevel(declarer.bid));
 }
 
-auto openCards() -> task<>
+auto openCards(Context& ctx) -> task<>
 {
-    const auto& [p0, p1] = getTwoPassers();
-    co_await sendDealCardsExcept(p0.get().id, p0.get().hand);
-    co_await sendDealCardsExcept(p1.get().id, p1.get().hand);
+    const auto& [p0, p1] = getTwoPassers(ctx);
+    co_await sendDealCardsExcept(ctx, p0.get().id, p0.get().hand);
+    co_await sendDealCardsExcept(ctx, p1.get().id, p1.get().hand);
 }
 
-auto startPlayingFromForehand() -> task<>
+auto startPlayingFromForehand(Context& ctx) -> task<>
 {
-    forehandsTurn();
-    ctx().stage = GameStage::PLAYING;
-    co_await sendPlayerTurn(decidePlayerTurn());
+    forehandsTurn(ctx);
+    ctx.stage = GameStage::PLAYING;
+    co_await sendPlayerTurn(ctx, decidePlayerTurn(ctx));
 }
 
-auto handleWhisting(const Message& msg) -> task<>
+auto handleWhisting(Context& ctx, const Message& msg) -> task<>
 {
     using enum WhistingChoice;
     using enum GameStage;
@@ -757,171 +933,192 @@ auto handleWhisting(const Message& msg) -> task<>
     if (not whisting) { co_return; }
     const auto playerId = whisting->player_id();
     const auto choice = whisting->choice();
-    const auto playerName = ctx().playerName(playerId);
+    const auto playerName = ctx.playerName(playerId);
     PREF_DI(playerName, playerId, choice);
-    ctx().player(playerId).whistingChoice += choice; // Pass + Whist, Pass + Pass, etc.
-    co_await forwardToAllExcept(msg, playerId);
-    if (Context::isHalfWhistAfterPass()) {
-        advanceWhoseTurn(); // skip declarer
-        advanceWhoseTurn();
-        ctx().stage = WHISTING;
-        co_return co_await sendPlayerTurn(decidePlayerTurn());
-    }
-    if (Context::isWhistAfterHalfWhist()) {
+    ctx.player(playerId).whistingChoice += choice; // Pass + Whist, Pass + Pass, etc.
+    co_await forwardToAllExcept(ctx, msg, playerId);
+    if (ctx.isHalfWhistAfterPass()) {
+        advanceWhoseTurn(ctx); // skip declarer
+        advanceWhoseTurn(ctx);
+        ctx.stage = WHISTING;
+        co_return co_await sendPlayerTurn(ctx, decidePlayerTurn(ctx));
+    }
+    if (ctx.isWhistAfterHalfWhist()) {
         {
-            auto& whister = playerByWhistingChoice(ctx().players, HalfWhist);
+            auto& whister = playerByWhistingChoice(ctx.players, HalfWhist);
             whister.whistingChoice = PREF_PASS;
-            co_await sendWhisting(whister.id, whister.whistingChoice);
+            co_await sendWhisting(ctx, whister.id, whister.whistingChoice);
         }
         {
-            auto& whister = playerByWhistingChoice(ctx().players, PassWhist);
+            auto& whister = playerByWhistingChoice(ctx.players, PassWhist);
             whister.whistingChoice = PREF_WHIST;
         }
-        ctx().stage = HOW_TO_PLAY;
-        co_return co_await sendPlayerTurn(decidePlayerTurn());
-    }
-    if (Context::isPassAfterHalfWhist()) {
-        playerByWhistingChoice(ctx().players, PassPass).whistingChoice = PREF_PASS;
-        updateDeclarerTakenTricks();
-        co_return co_await finishDeal();
-    }
-    if (Context::areWhistersPass()) {
-        updateDeclarerTakenTricks();
-        co_return co_await finishDeal();
-    }
-    const auto& declarer = getDeclarer();
-    const auto isMiser = declarer.bid.contains(PREF_MIS);
-    const auto oneWhist = Context::areWhistersPassAndWhist();
-    const auto bothWhist = Context::areWhistersWhist();
+        ctx.stage = HOW_TO_PLAY;
+        co_return co_await sendPlayerTurn(ctx, decidePlayerTurn(ctx));
+    }
+    if (ctx.isPassAfterHalfWhist()) {
+        playerByWhistingChoice(ctx.players, PassPass).whistingChoice = PREF_PASS;
+        updateDeclarerTakenTricks(ctx);
+        co_return co_await finishDeal(ctx);
+    }
+    if (ctx.areWhistersPass()) {
+        updateDeclarerTakenTricks(ctx);
+        co_return co_await finishDeal(ctx);
+    }
+    const auto& declarer = getDeclarer(ctx);
+    const auto isMiser = declarer.bid.isMiser();
+    const auto oneWhist = ctx.areWhistersPassAndWhist();
+    const auto bothWhist = ctx.areWhistersWhist();
     const auto oneOrBothWhist = oneWhist or bothWhist;
     if (isMiser and oneOrBothWhist) [[unlikely]] {
-        if (ctx().forehandId == declarer.id) {
-            ctx().isDeclarerFirstMiserTurn = true;
-        } else if (Context::areWhistersWhist()) {
-            co_await openCards();
-            co_await sendMiserCards();
+        if (ctx.forehandId == declarer.id) {
+            ctx.isDeclarerFirstMiserTurn = true;
+        } else if (ctx.areWhistersWhist()) {
+            co_await openCards(ctx);
+            co_await sendMiserCards(ctx);
         } else {
-            assert(ctx().areWhistersPassAndWhist());
-            co_await openCardsAndLetAnotherWhisterPlay();
-            co_await sendMiserCards();
+            assert(ctx.areWhistersPassAndWhist());
+            co_await openCardsAndLetAnotherWhisterPlay(ctx);
+            co_await sendMiserCards(ctx);
         }
-        co_return co_await startPlayingFromForehand();
+        co_return co_await startPlayingFromForehand(ctx);
     }
-    if (bothWhist) { co_return co_await startPlayingFromForehand(); }
+    if (bothWhist) { co_return co_await startPlayingFromForehand(ctx); }
     if (oneWhist) {
-        if (choice != PREF_WHIST) { setWhoseTurn(playerItByWhistingChoice(ctx().players, Whist)); }
-        ctx().stage = HOW_TO_PLAY;
-        co_return co_await sendPlayerTurn(decidePlayerTurn());
+        if (choice != PREF_WHIST) { setWhoseTurn(ctx, playerItByWhistingChoice(ctx.players, Whist)); }
+        ctx.stage = HOW_TO_PLAY;
+        co_return co_await sendPlayerTurn(ctx, decidePlayerTurn(ctx));
     }
-    advanceWhoseTurn();
-    ctx().stage = WHISTING;
-    co_return co_await sendPlayerTurn(decidePlayerTurn());
+    advanceWhoseTurn(ctx);
+    ctx.stage = WHISTING;
+    co_return co_await sendPlayerTurn(ctx, decidePlayerTurn(ctx));
 }
 
-auto handleHowToPlay(const Message& msg) -> task<>
+auto handleHowToPlay(Context& ctx, const Message& msg) -> task<>
 {
     auto howToPlay = makeMethod<HowToPlay>(msg);
     if (not howToPlay) { co_return; }
     const auto playerId = howToPlay->player_id();
-    auto& choice = *howToPlay->mutable_choice();
-    const auto playerName = ctx().playerName(playerId);
+    auto choice = howToPlay->choice();
+    const auto playerName = ctx.playerName(playerId);
     PREF_DI(playerName, playerId, choice);
-    auto& player = ctx().player(playerId);
+    auto& player = ctx.player(playerId);
     player.howToPlayChoice = std::move(choice);
-    co_await forwardToAllExcept(msg, playerId);
-    if (player.howToPlayChoice == PREF_OPENLY) { co_await openCardsAndLetAnotherWhisterPlay(); }
-    co_await startPlayingFromForehand();
+    co_await forwardToAllExcept(ctx, msg, playerId);
+    if (player.howToPlayChoice == PREF_OPENLY) { co_await openCardsAndLetAnotherWhisterPlay(ctx); }
+    co_await startPlayingFromForehand(ctx);
 }
 
-auto resetPassGameIfNeeded() -> void
+auto resetPassGameIfNeeded(Context& ctx) -> void
 {
-    if (ctx().passGame.round != 0 and hasDeclarerFulfilledContract()) { ctx().passGame.resetRound(); }
+    if (ctx.passGame.round != 0 and hasDeclarerFulfilledContract(ctx)) { ctx.passGame.resetRound(); }
 }
 
-auto handleMakeOffer(const Message& msg) -> task<>
+auto handleMakeOffer(Context& ctx, const Message& msg) -> task<>
 {
     const auto makeOffer = makeMethod<MakeOffer>(msg);
     if (not makeOffer) { co_return; }
     const auto playerId = makeOffer->player_id();
     const auto offerRequest = makeOffer->offer();
-    auto& player = ctx().player(playerId);
-    auto& declarer = getDeclarer();
-    const auto isMiser = declarer.bid.contains(PREF_MIS);
+    auto& player = ctx.player(playerId);
+    auto& declarer = getDeclarer(ctx);
+    const auto isMiser = declarer.bid.isMiser();
     if (offerRequest == Offer::OFFER_REQUESTED) {
         if (player.offer != Offer::OFFER_REQUESTED) {
-            co_await sendDealCardsExcept(player.id, player.hand);
-            if (isMiser) { co_await sendMiserCards(); }
+            co_await sendDealCardsExcept(ctx, player.id, player.hand);
+            if (isMiser) { co_await sendMiserCards(ctx); }
         }
-        for (auto& offer : players() | rv::filter(notEqualTo(playerId), &Player::id) | rv::transform(&Player::offer)) {
+        for (auto& offer :
+             players(ctx) | rv::filter(notEqualTo(playerId), &Player::id) | rv::transform(&Player::offer)) {
             offer = Offer::NO_OFFER;
         }
     }
-    co_await forwardToAllExcept(msg, playerId);
+    co_await forwardToAllExcept(ctx, msg, playerId);
     player.offer = offerRequest;
-    if (rng::count_if(players(), equalTo(Offer::OFFER_ACCEPTED), &Player::offer) == std::ssize(getOneOrTwoWhisters())) {
+    if (rng::count_if(players(ctx), equalTo(Offer::OFFER_ACCEPTED), &Player::offer)
+        == std::ssize(getOneOrTwoWhisters(ctx))) {
         auto& whomAddTricks = std::invoke([&] -> Player& {
-            if (isMiser) { return playerByWhistingChoice(ctx().players, WhistingChoice::Whist); }
+            if (isMiser) { return playerByWhistingChoice(ctx.players, WhistingChoice::Whist); }
             return declarer;
         });
         whomAddTricks.tricksTaken += static_cast<int>(std::size(declarer.hand));
-        resetPassGameIfNeeded();
-        // TODO: create GameState once
+        resetPassGameIfNeeded(ctx);
         // TODO: send only taken tricks
-        for (const auto& p : players()) { co_await sendGameState(p.conn.ch); }
-        co_await finishDeal();
+        co_await sendToAll(ctx, [&](const WireFormat format) { return makeTableGameState(ctx, format); });
+        co_await finishDeal(ctx);
     }
 }
 
+// A player who doesn't follow the lead suit has none of it left, nor trumps unless it trumps
+auto updateVoidSuits(const Context& ctx, Player& player, const CardId card) -> void
+{
+    const auto leadCard = ctx.talon.current.or_else([&] {
+        return std::empty(ctx.trick) ? std::nullopt : std::optional{ctx.trick.front().card};
+    });
+    const auto suit = suitOf(card);
+    if (not leadCard or suitOf(*leadCard) == suit) { return; }
+    const auto setVoid = [&](const Suit s) {
+        player.voidSuits |= static_cast<std::uint8_t>(1U << std::to_underlying(s));
+    };
+    setVoid(suitOf(*leadCard));
+    if (ctx.trump and *ctx.trump != suit) { setVoid(*ctx.trump); }
+}
+
 // NOLINTNEXTLINE(readability-function-cognitive-complexity)
-auto handlePlayCard(const Message& msg) -> task<>
+auto handlePlayCard(Context& ctx, const Message& msg) -> task<>
 {
     auto playCard = makeMethod<PlayCard>(msg);
     if (not playCard) { co_return; }
     const auto playerId = playCard->player_id();
-    auto& card = *playCard->mutable_card();
-    const auto playerName = ctx().playerName(playerId);
+    const auto playerName = ctx.playerName(playerId);
+    const auto card = parseCard(playCard->card(), playCard->card_id());
+    if (not card) {
+        PREF_W("error: unknown card: {}, id: {}", playCard->card(), Card_Name(playCard->card_id()));
+        co_return;
+    }
     PREF_DI(playerName, playerId, card);
-    ctx().trick.emplace_back(std::string{playerId}, card);
-    removeCardFromHand(playerId, std::move(card));
-    co_await forwardToAll(msg);
-    if (ctx().isDeclarerFirstMiserTurn) {
-        ctx().isDeclarerFirstMiserTurn = false;
-        if (Context::areWhistersWhist()) {
-            co_await openCards();
+    updateVoidSuits(ctx, ctx.player(playerId), *card);
+    ctx.trick.emplace_back(std::string{playerId}, *card);
+    removeCardFromHand(ctx, playerId, *card);
+    co_await sendPlayCard(ctx, playerId, *card);
+    if (ctx.isDeclarerFirstMiserTurn) {
+        ctx.isDeclarerFirstMiserTurn = false;
+        if (ctx.areWhistersWhist()) {
+            co_await openCards(ctx);
         } else {
-            assert(Context::areWhistersPassAndWhist());
-            co_await openCardsAndLetAnotherWhisterPlay();
+            assert(ctx.areWhistersPassAndWhist());
+            co_await openCardsAndLetAnotherWhisterPlay(ctx);
         }
     }
-    if (const auto isNotTrickFinished = (std::size(ctx().trick) != 3); isNotTrickFinished) {
-        advanceWhoseTurn();
+    if (const auto isNotTrickFinished = (std::size(ctx.trick) != 3); isNotTrickFinished) {
+        advanceWhoseTurn(ctx);
     } else {
-        const auto winnerId = decideTrickWinner();
-        co_await sendTrickFinished();
-        if (const auto isDealFinished = rng::all_of(players(), &Hand::empty, &Player::hand); isDealFinished) {
-            resetPassGameIfNeeded();
-            co_return co_await finishDeal();
+        const auto winnerId = decideTrickWinner(ctx);
+        co_await sendTrickFinished(ctx);
+        if (const auto isDealFinished = rng::all_of(players(ctx), &Hand::empty, &Player::hand); isDealFinished) {
+            resetPassGameIfNeeded(ctx);
+            co_return co_await finishDeal(ctx);
         }
-        if (not ctx().passGame.now) {
-            setWhoseTurn(ctx().players.find(winnerId));
+        if (not ctx.passGame.now) {
+            setWhoseTurn(ctx, ctx.players.find(winnerId));
         } else {
-            ++ctx().talon.open;
-            if (ctx().talon.open == 1) {
-                co_await sendOpenTalon();
-                forehandsTurn();
-            } else if (ctx().talon.open == 2) {
-                forehandsTurn();
+            ++ctx.talon.open;
+            if (ctx.talon.open == 1) {
+                co_await sendOpenTalon(ctx);
+                forehandsTurn(ctx);
+            } else if (ctx.talon.open == 2) {
+                forehandsTurn(ctx);
             } else {
-                setWhoseTurn(ctx().players.find(winnerId));
+                setWhoseTurn(ctx, ctx.players.find(winnerId));
             }
         }
     }
-    if (const auto declarerId = findDeclarerId(); declarerId) {
-        const auto isMiser = ctx().player((*declarerId).get()).bid.contains(PREF_MIS);
-        if (isMiser and (*declarerId).get() == playerId) { co_await sendMiserCards(); }
+    if (const auto declarerId = findDeclarerId(ctx); declarerId) {
+        const auto isMiser = ctx.player((*declarerId).get()).bid.isMiser();
+        if (isMiser and (*declarerId).get() == playerId) { co_await sendMiserCards(ctx); }
     }
-    ctx().stage = GameStage::PLAYING;
-    co_await sendPlayerTurn(decidePlayerTurn());
+    ctx.stage = GameStage::PLAYING;
+    co_await sendPlayerTurn(ctx, decidePlayerTurn(ctx));
 }
 
 auto handleLog(const Message& msg) -> void
@@ -931,69 +1128,696 @@ auto handleLog(const Message& msg) -> void
     PREF_I("[client] {}, playerId: {}", log->text(), log->player_id());
 }
 
-auto handleSpeechBubble(const Message& msg) -> task<>
+auto handleSpeechBubble(Context& ctx, const Message& msg) -> task<>
 {
     const auto speechBubble = makeMethod<SpeechBubble>(msg);
     if (not speechBubble) { co_return; }
     const auto playerId = speechBubble->player_id();
     PREF_DI(playerId);
-    co_await forwardToAllExcept(msg, playerId);
+    relayToAllExcept(ctx, msg, playerId);
 }
 
-auto handleAudioSignal(const Message& msg) -> task<>
+auto handleAudioSignal(Context& ctx, const Message& msg) -> task<>
 {
     const auto audioSignal = makeMethod<AudioSignal>(msg);
     if (not audioSignal) { co_return; }
     const auto fromPlayerId = audioSignal->from_player_id();
     const auto toPlayerId = audioSignal->to_player_id();
     PREF_DI(fromPlayerId, toPlayerId);
-    co_await forwardToOne(toPlayerId, msg);
+    relayToOne(ctx, toPlayerId, msg);
 }
 
-auto dispatchMessage(const ChannelPtr& ch, PlayerSession& session, std::optional<Message> msg) -> task<>
-{ // clang-format off
+inline constexpr auto BotSeatingDelay = 20s;
+
+[[nodiscard]] auto seatOf(const Context& ctx, const Player::IdView playerId) -> BotView::Seat
+{
+    assert(ctx.players.contains(playerId) and "player exists");
+    return static_cast<BotView::Seat>(std::distance(std::cbegin(ctx.players), ctx.players.find(playerId)));
+}
+
+// Who decides on the turn: its player, or the active whister for the passive one when the whist is open
+[[nodiscard]] auto turnDeciderId(Context& ctx) -> Player::IdView
+{
+    const auto turnId = ctx.whoseTurnId();
+    const auto& player = ctx.player(turnId);
+    if (ctx.stage != GameStage::PLAYING or not player.bid.isPass() or player.whistingChoice != PREF_PASS
+        or not ctx.areWhistersPassAndWhist()) {
+        return turnId;
+    }
+    const auto isMiser = getDeclarer(ctx).bid.isMiser();
+    if (not isMiser and not rng::any_of(players(ctx), equalTo(PREF_OPENLY), &Player::howToPlayChoice)) {
+        return turnId;
+    }
+    return playerByWhistingChoice(ctx.players, WhistingChoice::Whist).id;
+}
+
+// The deal as the bot sees it: the talon is only known after it's shown, the discarded cards only to the declarer,
+// the whisters' hands on an open whist or a miser, and the declarer's hand on a miser after its first card
+[[nodiscard]] auto makeBotView(Context& ctx, const Player::IdView botId) -> BotView
+{
+    using enum GameStage;
+    auto result = BotView{.self = seatOf(ctx, botId)};
+    auto& position = result.position;
+    const auto declarerId = findDeclarerId(ctx);
+    const auto hasContract
+        = declarerId and rng::contains(std::array{TALON_PICKING, WHISTING, HOW_TO_PLAY, PLAYING}, ctx.stage);
+    const auto declarerSeat = hasContract ? seatOf(ctx, declarerId->get()) : result.self;
+    const auto isMiser = hasContract and ctx.player(declarerId->get()).bid.isMiser();
+    const auto isMiserOpen = isMiser and ctx.stage == PLAYING and not ctx.isDeclarerFirstMiserTurn;
+    const auto areWhistersOpen = isMiserOpen
+        or (hasContract and rng::any_of(players(ctx), equalTo(PREF_OPENLY), &Player::howToPlayChoice));
+    auto seen = CardMask{};
+    auto seat = BotView::Seat{};
+    for (const auto& player : players(ctx)) {
+        result.isKnown[seat] = seat == result.self or (seat == declarerSeat ? isMiserOpen : areWhistersOpen);
+        if (result.isKnown[seat]) { position.hands[seat] = player.hand; }
+        result.handSizes[seat] = player.hand.size();
+        result.voids[seat] = player.voidSuits;
+        seen = seen | position.hands[seat] | toCardMask(player.playedCards);
+        ++seat;
+    }
+    if (const auto discarded = toCardMask(ctx.talon.discardedCards); result.self != declarerSeat and not isMiserOpen) {
+        seen = seen - discarded; // the declarer played them face down
+    }
+    result.hidden = CardMask{~std::uint32_t{}} - seen;
+    if (hasContract and result.self != declarerSeat and not std::empty(ctx.talon.discardedCards)) {
+        result.declarerCards = toCardMask(ctx.talon.cards) & result.hidden;
+    }
+    const auto leaderId = ctx.stage != PLAYING ? Player::IdView{ctx.forehandId}
+        : std::empty(ctx.trick)                ? ctx.whoseTurnId()
+                                               : Player::IdView{ctx.trick.front().playerId};
+    position.trump = ctx.trump;
+    position.contractLevel = hasContract ? makeContractLevel(ctx.player(declarerId->get()).bid) : ContractLevel::Six;
+    position.declarer = declarerSeat;
+    position.leader = seatOf(ctx, leaderId);
+    position.trick = ctx.trick | rv::transform(&PlayedCard::card) | rng::to_vector;
+    position.declarerTricks = hasContract ? ctx.player(declarerId->get()).tricksTaken : 0;
+    return result;
+}
+
+[[nodiscard]] auto makeBotDeal(Context& ctx, const BotView& view) -> BotDeal
+{
+    auto result = BotDeal{.declarer = view.position.declarer, .contractLevel = view.position.contractLevel};
+    auto seat = BotView::Seat{};
+    for (const auto& player : players(ctx)) {
+        result.ids[seat] = player.id;
+        result.choices[seat] = std::empty(player.whistingChoice) ? WhistingChoice::Whist
+                                                                 : makeWhistingChoice(player.whistingChoice);
+        result.tricksTaken[seat] = player.tricksTaken;
+        ++seat;
+    }
+    return result;
+}
+
+// The highest bid so far, the way the bot's client would rank it
+[[nodiscard]] auto makeBidTurn(Context& ctx, const Player& bot) -> BidTurn
+{
+    auto result = BidTurn{.myBid = bot.bid};
+    const auto raise = [&](const std::size_t rank) {
+        result.currentRank = (result.currentRank == BidTurn::NoRank) ? rank : std::max(result.currentRank, rank);
+    };
+    for (const auto& player : players(ctx) | rv::filter(rng::not_fn(&Bid::isPass), &Player::bid)) {
+        if (player.bid.empty()) { continue; }
+        auto rank = player.bid.rank();
+        if (player.id != bot.id and bot.id == ctx.forehandId and rank != 0) { --rank; } // the forehand may hold
+        raise(rank);
+    }
+    if (ctx.passGame.minBid() == PREF_SEVEN) { raise(Bid{PREF_SIX}.rank()); }
+    return result;
+}
+
+[[nodiscard]] auto isBotsTurn(Context& ctx, const Player::IdView botId) -> bool
+{
+    using enum GameStage;
+    return std::size(ctx.players) == NumberOfPlayers
+        and rng::contains(std::array{BIDDING, TALON_PICKING, WHISTING, HOW_TO_PLAY, PLAYING}, ctx.stage)
+        and turnDeciderId(ctx) == botId
+        and not ctx.player(botId).isThinking;
+}
+
+// A move made for a player, handled as if the player's client had sent the message
+struct Move {
+    using Handle = auto (*)(Context&, const Message&) -> task<>;
+
+    Handle handle{};
+    Message msg;
+};
+
+[[nodiscard]] auto biddingMove(const Player::IdView playerId, const Bid bid) -> Move
+{
+    auto bidding = Bidding{};
+    bidding.set_player_id(playerId);
+    bidding.set_bid(bid.text());
+    bidding.set_bid_code(bid.code());
+    return {.handle = &handleBidding, .msg = makeMessage(std::move(bidding))};
+}
+
+[[nodiscard]] auto discardTalonMove(const Player::IdView playerId, const Bid bid, const CardMask discarded) -> Move
+{
+    auto discardTalon = DiscardTalon{};
+    discardTalon.set_player_id(playerId);
+    discardTalon.set_bid(bid.text());
+    discardTalon.set_bid_code(bid.code());
+    discardTalon.set_cards_mask(toWireHand(discarded));
+    return {.handle = &handleDiscardTalon, .msg = makeMessage(std::move(discardTalon))};
+}
+
+[[nodiscard]] auto whistingMove(const Player::IdView playerId, const std::string_view choice) -> Move
+{
+    auto whisting = Whisting{};
+    whisting.set_player_id(playerId);
+    whisting.set_choice(choice);
+    return {.handle = &handleWhisting, .msg = makeMessage(std::move(whisting))};
+}
+
+[[nodiscard]] auto howToPlayMove(const Player::IdView playerId, const std::string_view choice) -> Move
+{
+    auto howToPlay = HowToPlay{};
+    howToPlay.set_player_id(playerId);
+    howToPlay.set_choice(choice);
+    return {.handle = &handleHowToPlay, .msg = makeMessage(std::move(howToPlay))};
+}
+
+[[nodiscard]] auto playCardMove(const Player::IdView playerId, const CardId card) -> Move
+{
+    auto playCard = PlayCard{};
+    playCard.set_player_id(playerId);
+    playCard.set_card_id(toWireCard(card));
+    return {.handle = &handlePlayCard, .msg = makeMessage(std::move(playCard))};
+}
+
+[[nodiscard]] auto readyCheckMove(const Player::IdView playerId) -> Move
+{
+    auto readyCheck = ReadyCheck{};
+    readyCheck.set_player_id(playerId);
+    readyCheck.set_state(ReadyCheckState::ACCEPTED);
+    return {.handle = &handleReadyCheck, .msg = makeMessage(std::move(readyCheck))};
+}
+
+// A bot's move is recorded like its client's message would be
+auto makeMove(Context& ctx, const Move& move) -> task<>
+{
+    ctx.recorder.message(move.msg);
+    co_await move.handle(ctx, move.msg);
+}
+
+// The bot's decision is sampled on the bot pool and then handled as if the bot's client had sent it, unless the
+// turn has moved on in the meantime
+auto botTurn(Context& ctx, const Player::Id botId) -> task<>
+{
+    using enum GameStage;
+    const auto turn = [&] {
+        return std::tuple{ctx.stage, Player::Id{ctx.whoseTurnId()}, std::size(ctx.trick), ctx.talon.open};
+    };
+    const auto before = turn();
+    const auto& playerId = std::get<Player::Id>(before);
+    ctx.player(botId).isThinking = true;
+    auto _ = ex::scope_guard{[&] noexcept {
+        if (ctx.players.contains(botId)) { ctx.player(botId).isThinking = false; }
+    }};
+    const auto view = makeBotView(ctx, botId);
+    const auto deal = makeBotDeal(ctx, view);
+    auto& pool = ctx.registry.bots();
+    auto move = Move{};
+    switch (ctx.stage) {
+    case BIDDING:
+        move = biddingMove(playerId, co_await chooseBid(pool, view, deal, makeBidTurn(ctx, ctx.player(botId))));
+        break;
+    case TALON_PICKING: {
+        const auto [bid, discarded] = co_await chooseTalon(pool, view, deal, ctx.player(botId).bid);
+        move = discardTalonMove(playerId, bid, discarded);
+        break;
+    }
+    case WHISTING: move = whistingMove(playerId, co_await chooseWhisting(pool, view, deal)); break;
+    case HOW_TO_PLAY: move = howToPlayMove(playerId, PREF_CLOSED); break; // an open whist shows nothing of the bot
+    case PLAYING: {
+        const auto card = ctx.passGame.now ? passGameCard(view, ctx.talon.current.transform(suitOf))
+                                           : co_await chooseCard(pool, view, deal);
+        move = playCardMove(playerId, card);
+        break;
+    }
+    default: co_return;
+    }
+    if (not ctx.players.contains(botId) or std::size(ctx.players) != NumberOfPlayers or turn() != before) {
+        PREF_I("botId: {}, the turn is over", botId);
+        co_return;
+    }
+    ctx.player(botId).isThinking = false;
+    co_await makeMove(ctx, move);
+}
+
+auto acceptReadyCheck(Context& ctx, const Player::Id botId) -> task<>
+{
+    if (ctx.stage != GameStage::UNKNOWN
+        or std::size(ctx.players) != NumberOfPlayers
+        or not ctx.players.contains(botId)
+        or ctx.player(botId).readyCheckState == ReadyCheckState::ACCEPTED) {
+        co_return;
+    }
+    co_await makeMove(ctx, readyCheckMove(botId));
+}
+
+// A bot gets what the table sends like a client does, but it answers only the ready checks and its turns: the rest
+// it reads from the table, as it runs on the table's thread. Its decisions run apart, so that its channel is drained
+// while it thinks
+auto runBot(Context& ctx, const Player::Id botId, const ChannelPtr ch) -> task<>
+{
+    static constexpr auto arenaBlockSize = 1024uz;
+    auto arenaBlock = std::make_unique_for_overwrite<char[]>(arenaBlockSize);
+    auto arena = google::protobuf::Arena{arenaBlock.get(), arenaBlockSize};
+    while (true) {
+        const auto [error, frame] = co_await ch->async_receive(net::as_tuple);
+        if (error) { co_return; } // closed when the bot leaves
+        ch->unqueue();
+        if (not frame or std::empty(*frame) or frame->front() == '\0' or not ctx.players.contains(botId)) { continue; }
+        arena.Reset();
+        const auto* const msg = makeMessage(arena, frame->data(), std::size(*frame));
+        if (not msg) { continue; }
+        if (msg->body_case() == Message::kReadyCheck and msg->ready_check().state() == ReadyCheckState::REQUESTED) {
+            stdx::start_detached(stdx::starts_on(
+                ctx.sch, acceptReadyCheck(ctx, botId) | stdx::upon_error(Detached("acceptReadyCheck"))));
+        } else if (msg->body_case() == Message::kPlayerTurn and isBotsTurn(ctx, botId)) {
+            stdx::start_detached(stdx::starts_on(ctx.sch, botTurn(ctx, botId) | stdx::upon_error(Detached("botTurn"))));
+        }
+    }
+}
+
+// A headless bot reads nothing, its moves are made for it
+auto drainChannel(const ChannelPtr ch) -> task<>
+{
+    while (true) {
+        const auto [error, _] = co_await ch->async_receive(net::as_tuple);
+        if (error) { co_return; }
+        ch->unqueue();
+    }
+}
+
+auto seatBot(Context& ctx, Player::Id botId, const bool isHeadless = false) -> task<>
+{
+    static constexpr auto channelSize = 128;
+    auto ch = std::make_shared<Channel>(ctx.ex, channelSize);
+    const auto session = PlayerSession{
+        .id = 1,
+        .playerId = botId,
+        .playerName = fmt::format("Bot {}", ctx.botsSeated),
+        .table = &ctx,
+        .wireFormat = WireFormat::WIRE_COMPACT,
+    };
+    PREF_DI(session.playerId, session.playerName);
+    auto& bot = ctx.players.emplace(botId, Player{botId, session.playerName, session.id, ch}).first->second;
+    bot.isBot = true;
+    bot.wireFormat = session.wireFormat;
+    ctx.recorder.seated(bot.id, bot.name, true);
+    auto run = isHeadless ? drainChannel(std::move(ch)) : runBot(ctx, std::move(botId), std::move(ch));
+    stdx::start_detached(stdx::starts_on(ctx.sch, std::move(run) | stdx::upon_error(Detached("runBot"))));
+    co_await sendPlayerJoined(ctx, session);
+}
+
+auto seatBotsLater(Context& ctx) -> task<>
+{
+    co_await sleepFor(BotSeatingDelay, ctx.ex);
+    if (ctx.stage != GameStage::UNKNOWN or rng::all_of(players(ctx), &Player::isBot)) { co_return; }
+    while (std::size(ctx.players) < NumberOfPlayers) {
+        auto botId = fmt::format("bot:{}:{}", ctx.id, ++ctx.botsSeated);
+        if (not ctx.registry.seatBot(ctx, botId)) { co_return; } // a human has taken the seat meanwhile
+        co_await seatBot(ctx, std::move(botId));
+    }
+}
+
+// A random legal move for the turn, as a bot would make it without thinking
+[[nodiscard]] auto randomMove(Context& ctx, std::mt19937_64& random) -> Move
+{
+    using enum GameStage;
+    const auto playerId = ctx.whoseTurnId();
+    const auto& decider = ctx.player(turnDeciderId(ctx));
+    const auto view = [&] { return makeBotView(ctx, decider.id); };
+    switch (ctx.stage) {
+    case BIDDING: return biddingMove(playerId, randomBid(makeBidTurn(ctx, decider), random));
+    case TALON_PICKING: return discardTalonMove(playerId, decider.bid, randomDiscard(view(), random));
+    case WHISTING: return whistingMove(playerId, randomWhisting(view(), random));
+    case HOW_TO_PLAY: return howToPlayMove(playerId, PREF_CLOSED);
+    case PLAYING: {
+        const auto talonSuit = ctx.passGame.now ? ctx.talon.current.transform(suitOf) : std::nullopt;
+        return playCardMove(playerId, randomCard(view(), talonSuit, random));
+    }
+    default: return {};
+    }
+}
+
+// Makes the moves of the headless bots one after another and times each in its handler, including the messages
+// sent and the next deal dealt. A new game starts once every bot has accepted the ready check
+auto playHeadlessDeals(Context& ctx, const std::size_t deals, const std::uint64_t seed) -> task<HeadlessStats>
+{
+    using enum GameStage;
+    ctx.nextDealDelay = {};
+    ctx.reseed(seed); // the same deals for the same seed
+    while (std::size(ctx.players) < NumberOfPlayers) {
+        auto botId = fmt::format("headless:{}:{}", ctx.id, ++ctx.botsSeated);
+        if (not ctx.registry.seatBot(ctx, botId)) { break; }
+        co_await seatBot(ctx, std::move(botId), true);
+    }
+    auto random = std::mt19937_64{seed};
+    auto result = HeadlessStats{};
+    const auto dealsBefore = ctx.dealsPlayed;
+    while (result.deals < deals and std::size(ctx.players) == NumberOfPlayers) {
+        const auto stage = ctx.stage;
+        const auto move = std::invoke([&] {
+            if (stage != UNKNOWN) { return randomMove(ctx, random); }
+            const auto& notReady = *rng::find_if(
+                players(ctx), notEqualTo(ReadyCheckState::ACCEPTED), &Player::readyCheckState);
+            return readyCheckMove(notReady.id);
+        });
+        if (not move.handle) {
+            PREF_W("error: no move, stage: {}", GameStage_Name(stage));
+            break;
+        }
+        const auto started = std::chrono::steady_clock::now();
+        co_await makeMove(ctx, move);
+        const auto elapsed = std::chrono::nanoseconds{std::chrono::steady_clock::now() - started};
+        auto& moves = result.stages[static_cast<std::size_t>(stage)];
+        ++moves.moves;
+        moves.total += elapsed;
+        moves.max = std::max(moves.max, elapsed);
+        if (stage == UNKNOWN and ctx.stage != UNKNOWN) { ++result.games; }
+        result.deals = ctx.dealsPlayed - dealsBefore;
+    }
+    removeBots(ctx);
+    co_return result;
+}
+
+// The handlers of the messages a table records, see MethodHandlers
+[[nodiscard]] auto tableHandler(const Message::BodyCase tag) -> Move::Handle
+{
+    switch (tag) {
+    case Message::kReadyCheck: return &handleReadyCheck;
+    case Message::kBidding: return &handleBidding;
+    case Message::kDiscardTalon: return &handleDiscardTalon;
+    case Message::kWhisting: return &handleWhisting;
+    case Message::kHowToPlay: return &handleHowToPlay;
+    case Message::kMakeOffer: return &handleMakeOffer;
+    case Message::kPlayCard: return &handlePlayCard;
+    default: return nullptr;
+    }
+}
+
+// A replayed player is seated like a bot, whose moves come from the recording, or gets the seat back like on
+// reconnecting
+auto seatReplayed(Context& ctx, const TableSeated& seated, const ChannelPtr& ch) -> task<>
+{
+    const auto& playerId = seated.player_id();
+    if (ctx.players.contains(playerId)) {
+        co_await sendTableToOne(ctx, ch, ctx.player(playerId));
+        co_return;
+    }
+    if (not ctx.registry.seatBot(ctx, playerId)) {
+        PREF_W("error: the table is full, {}", PREF_V(playerId));
+        co_return;
+    }
+    const auto session = PlayerSession{
+        .id = 1,
+        .playerId = playerId,
+        .playerName = seated.player_name(),
+        .table = &ctx,
+        .wireFormat = WireFormat::WIRE_COMPACT,
+    };
+    PREF_DI(session.playerId, session.playerName);
+    auto& player = ctx.players.emplace(playerId, Player{playerId, session.playerName, session.id, ch}).first->second;
+    player.isBot = seated.is_bot();
+    player.wireFormat = session.wireFormat;
+    co_await sendPlayerJoined(ctx, session);
+}
+
+auto replayTable(Context& ctx, const std::vector<TableRecord>& records) -> task<ReplayStats>
+{
+    // nothing reads the channels while a record is handled, so they have room for all it sends
+    static constexpr auto channelSize = 1024;
+    ctx.nextDealDelay = {};
+    ctx.isNextDealRecorded = true;
+    auto channels = std::map<Player::Id, ChannelPtr, std::less<>>{};
+    auto result = ReplayStats{};
+    const auto dealsBefore = ctx.dealsPlayed;
+    const auto digest = [&] {
+        for (const auto& [playerId, ch] : channels) {
+            auto& seat = result.seats[playerId];
+            auto received = 0uz;
+            while (ch->try_receive([&](const sys::error_code&, const Frame& frame) {
+                ++received;
+                if (not frame) { return; }
+                ++seat.frames;
+                seat.crc.process_bytes(std::data(*frame), std::size(*frame));
+            })) { }
+            ch->unqueue(received);
+        }
+    };
+    for (const auto& record : records) {
+        switch (record.entry_case()) {
+        case TableRecord::kSeed: ctx.reseed(record.seed()); break;
+        case TableRecord::kSeated: {
+            auto& ch = channels[record.seated().player_id()];
+            if (not ch) { ch = std::make_shared<Channel>(ctx.ex, channelSize); }
+            co_await seatReplayed(ctx, record.seated(), ch);
+            break;
+        }
+        case TableRecord::kLeft:
+            if (ctx.players.contains(record.left())) { co_await removePlayer(ctx, record.left()); }
+            break;
+        case TableRecord::kMessage:
+            if (const auto handle = tableHandler(record.message().body_case())) {
+                co_await handle(ctx, record.message());
+                ++result.messages;
+            }
+            break;
+        case TableRecord::kNextDeal: co_await dealNextDeal(ctx); break;
+        case TableRecord::ENTRY_NOT_SET: PREF_W("error: empty table record"); break;
+        }
+        digest();
+    }
+    result.deals = ctx.dealsPlayed - dealsBefore;
+    ctx.isNextDealRecorded = false; // the table is reused once it's empty
+    for (auto playerId : ctx.players | rv::keys | rng::to_vector) {
+        if (ctx.players.contains(playerId)) { co_await removePlayer(ctx, std::move(playerId)); }
+    }
+    co_return result;
+}
+
+struct MethodHandler {
+    using Handle = auto (*)(TableRegistry&, const ChannelPtr&, PlayerSession&, const Message&) -> task<>;
+
+    Handle handle{};
+    bool needsSession = true;
+    bool forSpectators{}; // the rest is ignored from a spectator
+};
+
+// Recorded on the table's thread, so that the recording has the messages in the order the table handles them
+template<auto Handler>
+auto handleRecorded(Context& ctx, const Message& msg) -> task<>
+{
+    ctx.recorder.message(msg);
+    co_await Handler(ctx, msg);
+}
+
+// A session may outlive its seat, e.g. when its player was removed after a disconnect
+template<auto Handler>
+auto handleSeated(Context& ctx, const Player::Id playerId, const Message& msg) -> task<>
+{
+    if (not ctx.players.contains(playerId)) {
+        PREF_W("error: not seated, {}, {}", PREF_V(playerId), methodName(msg.body_case()));
+        co_return;
+    }
+    co_await Handler(ctx, msg);
+}
+
+template<auto Handler>
+auto onSessionTable(TableRegistry&, const ChannelPtr&, PlayerSession& session, const Message& msg) -> task<>
+{
+    assert(session.table and "session is seated at a table");
+    auto& ctx = *session.table;
+    return onTable(ctx, handleSeated<&handleRecorded<Handler>>(ctx, session.playerId, msg));
+}
+
+// The relayed messages are checked before they reach the table, so that a flood of them costs it nothing
+[[nodiscard]] auto isRelayAllowed(PlayerSession& session, const Message& msg) -> bool
+{
+    const auto isAudio = msg.has_audio_signal();
+    const auto size = isAudio ? std::size(msg.audio_signal().data()) : std::size(msg.speech_bubble().text());
+    const auto maxSize = isAudio ? MaxAudioSignalSize : MaxSpeechBubbleSize;
+    if (size <= maxSize and session.relayLimiter.tryTake(RateLimiter::Clock::now())) { return true; }
+    localMetrics().relayLimited.add(1);
+    const auto& playerId = session.playerId;
+    PREF_DW(playerId, size);
+    return false;
+}
+
+template<auto Handler>
+auto onSessionRelay(TableRegistry&, const ChannelPtr&, PlayerSession& session, const Message& msg) -> task<>
+{
+    if (not isRelayAllowed(session, msg)) { co_return; }
+    assert(session.table and "session is seated at a table");
+    auto& ctx = *session.table;
+    co_await onTable(ctx, handleSeated<Handler>(ctx, session.playerId, msg)); // the chats and voices aren't recorded
+}
+
+// indexed by Message::BodyCase, so dispatching is a single lookup instead of comparing the method names
+const auto MethodHandlers = std::invoke([] {
+    auto result = std::array<MethodHandler, MessageTagsCount>{};
+    const auto set = [&](const Message::BodyCase tag, const MethodHandler handler) {
+        result[static_cast<std::size_t>(tag)] = handler;
+    };
+    // clang-format off
+    set(Message::kLoginRequest, {.handle = [](TableRegistry& registry, const ChannelPtr& ch, PlayerSession& session, const Message& msg) -> task<> {
+        session = co_await handleLoginRequest(registry, msg, ch, session.address);
+    }, .needsSession = false});
+    set(Message::kAuthRequest, {.handle = [](TableRegistry& registry, const ChannelPtr& ch, PlayerSession& session, const Message& msg) -> task<> {
+        session = co_await handleAuthRequest(registry, msg, ch, session.address);
+    }, .needsSession = false});
+    set(Message::kLogout, {.handle = [](TableRegistry&, const ChannelPtr&, PlayerSession& session, const Message& msg) {
+        assert(session.table and "session is seated at a table");
+        return handleLogout(*session.table, msg);
+    }});
+    set(Message::kPingPong, {.handle = [](TableRegistry&, const ChannelPtr& ch, PlayerSession&, const Message& msg) {
+        return handlePingPong(msg, ch);
+    }, .forSpectators = true});
+    set(Message::kUserGamesRequest, {.handle = [](TableRegistry& registry, const ChannelPtr& ch, PlayerSession& session, const Message& msg) {
+        return handleUserGamesRequest(registry, msg, ch, session);
+    }});
+    set(Message::kSpectateRequest, {.handle = [](TableRegistry& registry, const ChannelPtr& ch, PlayerSession& session, const Message& msg) {
+        return handleSpectateRequest(registry, msg, ch, session);
+    }, .needsSession = false});
+    set(Message::kLog, {.handle = [](TableRegistry&, const ChannelPtr&, PlayerSession&, const Message& msg) -> task<> {
+        handleLog(msg);
+        co_return;
+    }, .forSpectators = true});
+    set(Message::kReadyCheck, {.handle = &onSessionTable<&handleReadyCheck>});
+    set(Message::kBidding, {.handle = &onSessionTable<&handleBidding>});
+    set(Message::kDiscardTalon, {.handle = &onSessionTable<&handleDiscardTalon>});
+    set(Message::kWhisting, {.handle = &onSessionTable<&handleWhisting>});
+    set(Message::kHowToPlay, {.handle = &onSessionTable<&handleHowToPlay>});
+    set(Message::kMakeOffer, {.handle = &onSessionTable<&handleMakeOffer>});
+    set(Message::kPlayCard, {.handle = &onSessionTable<&handlePlayCard>});
+    set(Message::kSpeechBubble, {.handle = &onSessionRelay<&handleSpeechBubble>});
+    set(Message::kAudioSignal, {.handle = &onSessionRelay<&handleAudioSignal>});
+    // clang-format on
+    return result;
+});
+
+// The player a message of a seated session says it's from, which is the session's one unless the client is broken
+[[nodiscard]] auto claimedPlayerId(const Message& msg) -> std::optional<std::string_view>
+{
+    switch (msg.body_case()) {
+    case Message::kLogout: return msg.logout().player_id();
+    case Message::kReadyCheck: return msg.ready_check().player_id();
+    case Message::kBidding: return msg.bidding().player_id();
+    case Message::kDiscardTalon: return msg.discard_talon().player_id();
+    case Message::kWhisting: return msg.whisting().player_id();
+    case Message::kHowToPlay: return msg.how_to_play().player_id();
+    case Message::kMakeOffer: return msg.make_offer().player_id();
+    case Message::kPlayCard: return msg.play_card().player_id();
+    case Message::kSpeechBubble: return msg.speech_bubble().player_id();
+    case Message::kAudioSignal: return msg.audio_signal().from_player_id();
+    default: return std::nullopt;
+    }
+}
+
+auto dispatchMessage(TableRegistry& registry, const ChannelPtr& ch, PlayerSession& session, const Message* const msg)
+    -> task<>
+{
     if (not msg) { co_return; }
-    const auto method = msg->method();
-    if (method == "LoginRequest") { session = co_await handleLoginRequest(*msg, ch); co_return; }
-    if (method == "AuthRequest") { session = co_await handleAuthRequest(*msg, ch); co_return; }
-    if (session.id == 0) { co_return; }
-    if (method == "Logout") { co_await handleLogout(*msg); co_return; }
-    if (method == "ReadyCheck") { co_await handleReadyCheck(*msg); co_return; }
-    if (method == "Bidding") { co_await handleBidding(*msg); co_return; }
-    if (method == "DiscardTalon") { co_await handleDiscardTalon(*msg); co_return; }
-    if (method == "Whisting") { co_await handleWhisting(*msg); co_return; }
-    if (method == "HowToPlay") { co_await handleHowToPlay(*msg); co_return; }
-    if (method == "MakeOffer") { co_await handleMakeOffer(*msg); co_return; }
-    if (method == "PlayCard") { co_await handlePlayCard(*msg); co_return; }
-    if (method == "SpeechBubble") { co_await handleSpeechBubble(*msg); co_return; }
-    if (method == "PingPong") { co_await handlePingPong(*msg, ch); co_return; }
-    if (method == "Log") { handleLog(*msg); co_return; }
-    if (method == "AudioSignal") { co_await handleAudioSignal(*msg); co_return; }
-    PREF_W("error: unknown {}", PREF_V(method));
-} // clang-format on
+    const auto tag = static_cast<std::size_t>(msg->body_case());
+    const auto& handler = MethodHandlers[tag]; // NOLINT(cppcoreguidelines-pk-array-index)
+    if (not handler.handle) {
+        PREF_W("error: unexpected {}", methodName(msg->body_case()));
+        co_return;
+    }
+    const auto isAllowed = session.spectated ? handler.forSpectators : (not handler.needsSession or session.id != 0);
+    if (not isAllowed) { co_return; }
+    if (const auto claimed = claimedPlayerId(*msg); claimed and *claimed != session.playerId) {
+        const auto& playerId = session.playerId;
+        const auto method = methodName(msg->body_case());
+        PREF_W("error: from another player, {}, claimed: {}, {}", PREF_V(playerId), *claimed, PREF_V(method));
+        co_return; // one client mustn't move for another one, nor take down the tables with an unseated one
+    }
+    const auto started = MetricsClock::now();
+    co_await handler.handle(registry, ch, session, *msg);
+    observeSince(localMetrics().methods[tag], started); // NOLINT(cppcoreguidelines-pk-array-index)
+}
+
+[[nodiscard]] auto remoteAddress(Stream& ws) -> net::ip::address
+{
+    auto error = sys::error_code{};
+    return beast::get_lowest_layer(ws).socket().remote_endpoint(error).address();
+}
+
+inline constexpr auto HttpRequestTimeout = 30s;
+
+// The listener serves the plain HTTP requests too: GET /metrics for the Prometheus scrapes. True when the request
+// was a WebSocket upgrade, and it's accepted. The steps of the handshakes run on `handshakeEx`, the acceptor's thread,
+// while the coroutine resumes on the session's shard
+auto acceptOrServe(TableRegistry& registry, Stream& ws, const net::any_io_executor& handshakeEx) -> task<bool>
+{
+    namespace http = beast::http;
+    const auto onAcceptor = net::bind_executor(handshakeEx, netx::use_sender);
+#ifdef PREF_SSL
+    co_await ws.next_layer().async_handshake(net::ssl::stream_base::server, onAcceptor);
+#endif // PREF_SSL
+    auto buf = beast::flat_buffer{};
+    auto req = http::request<http::string_body>{};
+    beast::get_lowest_layer(ws).expires_after(HttpRequestTimeout);
+    co_await http::async_read(ws.next_layer(), buf, req, onAcceptor);
+    beast::get_lowest_layer(ws).expires_never(); // the WebSocket has timeouts of its own
+    if (web::is_upgrade(req)) {
+        co_await ws.async_accept(req, onAcceptor);
+        co_return true;
+    }
+    auto res = http::response<http::string_body>{http::status::not_found, req.version()};
+    res.set(http::field::server, std::string{BOOST_BEAST_VERSION_STRING} + " preferans-server");
+    if (req.method() == http::verb::get and req.target() == "/metrics") {
+        res.result(http::status::ok);
+        res.set(http::field::content_type, "text/plain; version=0.0.4");
+        res.body() = metrics().render(registry.tablesCount());
+    }
+    res.keep_alive(false);
+    res.prepare_payload();
+    co_await http::async_write(ws.next_layer(), res, onAcceptor);
+    auto error = sys::error_code{};
+    beast::get_lowest_layer(ws).socket().shutdown(tcp::socket::shutdown_send, error);
+    co_return false;
+}
 
-auto launchSession(Stream ws) -> task<>
+auto launchSession(TableRegistry& registry, Stream ws, const net::any_io_executor handshakeEx) -> task<>
 {
     ws.binary(true);
     ws.set_option(web::stream_base::timeout::suggested(beast::role_type::server));
     ws.set_option(web::stream_base::decorator([](web::response_type& res) {
         res.set(beast::http::field::server, std::string{BOOST_BEAST_VERSION_STRING} + " preferans-server");
     }));
+    ws.set_option(makeDeflateOption(registry.sessionOptions().deflate));
     auto scp = ex::async_scope{};
     auto buf = beast::flat_buffer{};
+    // a message at a time is parsed into the arena, with a first block big enough for the usual ones
+    static constexpr auto arenaBlockSize = 4uz * 1024;
+    auto arenaBlock = std::make_unique_for_overwrite<char[]>(arenaBlockSize);
+    auto arena = google::protobuf::Arena{arenaBlock.get(), arenaBlockSize};
     auto chn = std::shared_ptr<Channel>{};
     auto sch = co_await stdx::get_scheduler();
-    auto ssn = PlayerSession{};
+    auto ssn = PlayerSession{.address = remoteAddress(ws)};
+    const auto isSession = co_await (
+        acceptOrServe(registry, ws, handshakeEx) | stdx::upon_error([](const std::exception_ptr& error) {
+            PrintError("launchSession", error);
+            return false;
+        }));
+    if (not isSession) { co_return; }
+    ++metrics().sessions;
+    registry.countSession(1);
+    auto _ = ex::scope_guard{[&registry] noexcept {
+        --metrics().sessions;
+        registry.countSession(-1);
+    }};
     co_await (
-#ifdef PREF_SSL
-        ws.next_layer().async_handshake(net::ssl::stream_base::server, netx::use_sender)
-        | stdx::let_value([&] { return ws.async_accept(netx::use_sender); })
-#else // PREF_SSL
-        ws.async_accept(netx::use_sender)
-#endif // PREF_SSL
+        stdx::just()
         | stdx::then([&] {
               static constexpr auto channelSize = 128;
               chn = std::make_shared<Channel>(ws.get_executor(), channelSize);
+              chn->setSlowConsumer(registry.sessionOptions().slowConsumer);
               scp.spawn(stdx::starts_on(sch, payloadSender(ws, *chn)));
           })
         | stdx::let_value([&] {
@@ -1002,9 +1826,10 @@ auto launchSession(Stream ws) -> task<>
                   | stdx::let_value([&](const std::uint64_t bytes) {
                         assert(bytes == buf.size());
                         auto _ = ex::scope_guard{[&] noexcept { buf.consume(buf.size()); }};
-                        return dispatchMessage(chn, ssn, makeMessage(buf.data().data(), buf.size()));
+                        arena.Reset(); // the previous message is handled, this one lives until the next read
+                        return dispatchMessage(registry, chn, ssn, makeMessage(arena, buf.data().data(), buf.size()));
                     })
-                  | stdx::then([&] { return ssn.id == 0; })
+                  | stdx::then([&] { return ssn.id == 0 and not ssn.spectated; })
                   | stdx::upon_stopped([] {
                         PREF_I("[launchSession] Stream canceled");
                         return true;
@@ -1018,16 +1843,13 @@ auto launchSession(Stream ws) -> task<>
               if (chn) {
                   assert(chn->is_open());
                   scp.request_stop();
+                  if (ssn.spectated) { chn->close(); } // the lane's fan-out drops the spectator
               }
-              const auto& playerId = ssn.playerId;
-              if (std::empty(playerId)
-                  or not ctx().players.contains(playerId)
-                  or ssn.id == 0
-                  or ssn.id != ctx().player(playerId).sessionId) {
-                  return;
-              }
-              stdx::start_detached(
-                  stdx::starts_on(sch, disconnected(playerId) | stdx::upon_error(Detached("disconnected"))));
+              if (std::empty(ssn.playerId) or ssn.id == 0 or not ssn.table) { return; }
+              auto& table = *ssn.table;
+              stdx::start_detached(stdx::starts_on(
+                  table.sch,
+                  disconnected(table, ssn.playerId, ssn.id) | stdx::upon_error(Detached("disconnected"))));
           })
         | stdx::upon_error([](const std::exception_ptr& error) { PrintError("launchSession", error); }));
     co_await scp.on_empty();
@@ -1059,41 +1881,41 @@ auto Context::playerName(const Player::IdView playerId) const -> Player::NameVie
     return player(playerId).name;
 }
 
-auto Context::areWhistersPass() -> bool
+auto Context::areWhistersPass() const -> bool
 {
     return 2 == countWhistingChoice(WhistingChoice::Pass);
 }
 
-auto Context::areWhistersWhist() -> bool
+auto Context::areWhistersWhist() const -> bool
 {
     return 2 == countWhistingChoice(WhistingChoice::Whist);
 }
 
-auto Context::areWhistersPassAndWhist() -> bool
+auto Context::areWhistersPassAndWhist() const -> bool
 {
     return 1 == countWhistingChoice(WhistingChoice::Pass) //
         and 1 == countWhistingChoice(WhistingChoice::Whist);
 }
 
-auto Context::isHalfWhistAfterPass() -> bool
+auto Context::isHalfWhistAfterPass() const -> bool
 {
     return 1 == countWhistingChoice(WhistingChoice::Pass) //
         and 1 == countWhistingChoice(WhistingChoice::HalfWhist);
 }
 
-auto Context::isPassAfterHalfWhist() -> bool
+auto Context::isPassAfterHalfWhist() const -> bool
 {
     return 1 == countWhistingChoice(WhistingChoice::PassPass);
 }
 
-auto Context::isWhistAfterHalfWhist() -> bool
+auto Context::isWhistAfterHalfWhist() const -> bool
 {
     return 1 == countWhistingChoice(WhistingChoice::PassWhist);
 }
 
-auto Context::countWhistingChoice(const WhistingChoice choice) -> std::ptrdiff_t
+auto Context::countWhistingChoice(const WhistingChoice choice) const -> std::ptrdiff_t
 {
-    const auto values = pref::players();
+    const auto values = pref::players(*this);
     return rng::count_if(
         values
             | rv::transform(&Player::whistingChoice)
@@ -1102,27 +1924,330 @@ auto Context::countWhistingChoice(const WhistingChoice choice) -> std::ptrdiff_t
         equalTo(choice));
 }
 
-[[nodiscard]] auto beats(const Beat beat) -> bool
+PasswordPool::PasswordPool(const Limits limits)
+    : m_limits{limits}
+    , m_pool(limits.threads)
 {
-    const auto [candidate, best, leadSuit, trump] = beat;
-    const auto candidateSuit = cardSuit(candidate);
-    const auto bestSuit = cardSuit(best);
-    if (candidateSuit == bestSuit) { return rankValue(cardRank(candidate)) > rankValue(cardRank(best)); }
-    if (not std::empty(trump) and (candidateSuit == trump) and (bestSuit != trump)) { return true; }
-    if (not std::empty(trump) and (candidateSuit != trump) and (bestSuit == trump)) { return false; }
-    return candidateSuit == leadSuit;
+    assert(limits.threads > 0);
 }
 
-[[nodiscard]] auto decideTrickWinner(const std::vector<PlayedCard>& trick, const std::string_view trump) -> Player::Id
-{ // clang-format off
+auto PasswordPool::verify(const net::ip::address from, std::string password, std::string hash)
+    -> task<std::optional<bool>>
+{
+    if (not admit(from)) {
+        const auto address = from.to_string();
+        PREF_DW(address);
+        co_return std::nullopt;
+    }
+    auto _ = ex::scope_guard{[&] noexcept { release(from); }};
+    co_return co_await stdx::starts_on(m_pool.get_scheduler(), stdx::just() | stdx::then([&] {
+        const auto started = MetricsClock::now();
+        const auto result = verifyPassword(password, hash);
+        observeSince(localMetrics().passwordChecks, started);
+        return result;
+    }));
+}
+
+auto PasswordPool::admit(const net::ip::address& from) -> bool
+{
+    const auto lock = std::scoped_lock{m_mutex};
+    const auto fromAddress = m_inFlightByAddress.contains(from) ? m_inFlightByAddress.at(from) : 0uz;
+    if (m_inFlight >= m_limits.maxInFlight or fromAddress >= m_limits.maxInFlightPerAddress) { return false; }
+    ++m_inFlight;
+    ++m_inFlightByAddress[from];
+    return true;
+}
+
+auto PasswordPool::release(const net::ip::address& from) -> void
+{
+    const auto lock = std::scoped_lock{m_mutex};
+    --m_inFlight;
+    if (const auto it = m_inFlightByAddress.find(from); it != std::end(m_inFlightByAddress) and --it->second == 0) {
+        m_inFlightByAddress.erase(it);
+    }
+}
+
+auto fanOut(std::vector<Spectator>& spectators, const SpectatorFrame& frame) -> bool
+{
+    auto needsSnapshot = false;
+    for (auto& spectator : spectators) {
+        if (frame.version <= spectator.seen or (frame.isSnapshot and not spectator.isLagging)) { continue; }
+        if (spectator.isLagging and not frame.isSnapshot) {
+            needsSnapshot = true;
+            continue;
+        }
+        spectator.ch->queue();
+        if (spectator.ch->try_send(sys::error_code{}, frame.frame)) {
+            spectator.seen = frame.version;
+            spectator.isLagging = false;
+            continue;
+        }
+        spectator.ch->unqueue();
+        if (not spectator.isLagging) { localMetrics().spectatorLags.add(1); }
+        spectator.isLagging = true;
+        needsSnapshot = true;
+    }
+    return needsSnapshot;
+}
+
+SpectatorLane::SpectatorLane(Shard& shard)
+    : m_sch{shard.get_scheduler()}
+    , m_queue{shard.get_executor(), QueueSize}
+{
+}
+
+auto SpectatorLane::isWatched() const noexcept -> bool
+{
+    return m_watchers.load(std::memory_order_relaxed) > 0;
+}
+
+auto SpectatorLane::publish(const std::uint64_t version, Frame frame, const bool isSnapshot) -> void
+{
+    if (m_queue.try_send(sys::error_code{}, SpectatorFrame{version, std::move(frame), isSnapshot})) { return; }
+    if (isSnapshot) { m_isSnapshotPending.store(false); } // so that the fan-out asks again
+    m_isOverflowed.store(true);
+}
+
+auto SpectatorLane::add(ChannelPtr ch, const std::uint64_t seen, RequestSnapshot requestSnapshot) -> void
+{
+    {
+        const auto lock = std::scoped_lock{m_mutex};
+        m_joining.push_back({.ch = std::move(ch), .seen = seen});
+    }
+    ++m_watchers;
+    if (std::exchange(m_isStarted, true)) { return; }
+    m_requestSnapshot = std::move(requestSnapshot);
+    stdx::start_detached(stdx::starts_on(m_sch, run() | stdx::upon_error(Detached("SpectatorLane"))));
+}
+
+auto SpectatorLane::close() -> void
+{
+    m_queue.close();
+}
+
+auto SpectatorLane::run() -> task<>
+{
+    auto spectators = std::vector<Spectator>{};
+    while (true) {
+        auto [error, frame] = co_await m_queue.async_receive(net::as_tuple);
+        if (error) { co_return; } // closed by the table's shutdown
+        {
+            const auto lock = std::scoped_lock{m_mutex};
+            rng::move(m_joining, std::back_inserter(spectators));
+            m_joining.clear();
+        }
+        m_watchers -= std::erase_if(spectators, [](const Spectator& s) { return not s.ch->is_open(); });
+        if (frame.isSnapshot) { m_isSnapshotPending.store(false); }
+        auto needsSnapshot = fanOut(spectators, frame);
+        if (m_isOverflowed.exchange(false)) {
+            for (auto& spectator : spectators | rv::filter(rng::not_fn(&Spectator::isLagging))) {
+                localMetrics().spectatorLags.add(1);
+                spectator.isLagging = true;
+                needsSnapshot = true;
+            }
+        }
+        if (needsSnapshot and not m_isSnapshotPending.exchange(true)) { m_requestSnapshot(); }
+    }
+}
+
+TableRegistry::TableRegistry(const std::size_t threads, const BotPool::Limits bots, const SessionOptions sessions)
+    : m_bots{bots}
+    , m_sessions{sessions}
+{
+    assert(threads > 0);
+    PREF_DI(threads);
+    for (auto i = 0uz; i < threads; ++i) { m_shards.push_back(std::make_unique<Shard>(1)); }
+    const auto acceptors = std::max(1uz, sessions.acceptors);
+    for (auto i = 0uz; i < acceptors; ++i) { m_acceptors.push_back(std::make_unique<Shard>(1)); }
+    m_accepted.resize(acceptors);
+    m_sessions.resize(threads);
+}
+
+auto TableRegistry::storage() noexcept -> Storage&
+{
+    return m_storage;
+}
+
+auto TableRegistry::passwords() noexcept -> PasswordPool&
+{
+    return m_passwords;
+}
+
+auto TableRegistry::bots() noexcept -> BotPool&
+{
+    return m_bots;
+}
+
+auto TableRegistry::sessionOptions() const noexcept -> const SessionOptions&
+{
+    return m_sessions;
+}
+
+auto TableRegistry::executor() -> net::any_io_executor
+{
+    return m_shards.front()->get_executor();
+}
+
+auto TableRegistry::scheduler() -> Scheduler
+{
+    return m_shards.front()->get_scheduler();
+}
+
+auto TableRegistry::nextShard() -> Shard&
+{
+    const auto lock = std::scoped_lock{m_mutex};
+    return *m_shards[m_nextShard++ % std::size(m_shards)];
+}
+
+auto TableRegistry::acceptorShard(const std::size_t acceptor) -> Shard&
+{
+    return *m_acceptors.at(acceptor % std::size(m_acceptors));
+}
+
+auto TableRegistry::countAccepted(const Shard& acceptor) -> void
+{
+    const auto lock = std::scoped_lock{m_mutex};
+    const auto it = rng::find(m_acceptors, &acceptor, &std::unique_ptr<Shard>::get);
+    assert(it != rng::end(m_acceptors) and "an acceptor's shard");
+    ++m_accepted[static_cast<std::size_t>(rng::distance(rng::begin(m_acceptors), it))];
+}
+
+auto TableRegistry::countSession(const std::int64_t delta) -> void
+{
+    const auto lock = std::scoped_lock{m_mutex};
+    const auto it = rng::find_if(m_shards, [](const auto& shard) {
+        return shard->get_executor().running_in_this_thread();
+    });
+    if (it == rng::end(m_shards)) { return; }
+    m_sessions[static_cast<std::size_t>(rng::distance(rng::begin(m_shards), it))] += delta;
+}
+
+auto TableRegistry::acceptedPerAcceptor() -> std::vector<std::size_t>
+{
+    const auto lock = std::scoped_lock{m_mutex};
+    return m_accepted;
+}
+
+auto TableRegistry::sessionsPerShard() -> std::vector<std::int64_t>
+{
+    const auto lock = std::scoped_lock{m_mutex};
+    return m_sessions;
+}
+
+auto TableRegistry::tablesCount() -> std::size_t
+{
+    const auto lock = std::scoped_lock{m_mutex};
+    return std::size(m_tables);
+}
+
+auto TableRegistry::addTable() -> Table&
+{
+    const auto tableId = ++m_lastTableId;
+    auto& shard = *m_shards[m_nextShard++ % std::size(m_shards)];
+    auto ctx = std::make_unique<Context>(tableId, shard, m_audience, *this, m_storage);
+    if (m_recordings.isOpen()) {
+        ctx->recorder = TableRecorder{m_recordings, tableId};
+        ctx->recorder.seeded(ctx->seed);
+    }
+    return m_tables.emplace(tableId, Table{.ctx = std::move(ctx)}).first->second;
+}
+
+// The tables are never destroyed before the shutdown, the sessions and the spectators keep pointing to them, so the
+// count of them is the most there have been at once
+auto TableRegistry::idleTable() -> Table&
+{
+    const auto isIdle = [](const Table& t) { return t.seats == 0 and not t.isOpened; };
+    auto idle = m_tables | rv::values | rv::filter(isIdle);
+    return rng::begin(idle) != rng::end(idle) ? *rng::begin(idle) : addTable();
+}
+
+auto TableRegistry::seat(const Player::IdView playerId) -> Context&
+{
+    const auto lock = std::scoped_lock{m_mutex};
+    if (const auto it = m_seats.find(playerId); it != std::end(m_seats)) { return *m_tables.at(it->second).ctx; }
+    auto free = m_tables | rv::values | rv::filter([](const Table& t) {
+        return t.seats < NumberOfPlayers and not t.isOpened;
+    });
+    auto it = rng::max_element(free, std::less{}, &Table::seats);
+    auto& table = it != rng::end(free) ? *it : addTable();
+    ++table.seats;
+    m_seats.emplace(playerId, table.ctx->id);
+    const auto tableId = table.ctx->id;
+    const auto seats = table.seats;
+    PREF_DI(playerId, tableId, seats);
+    return *table.ctx;
+}
+
+auto TableRegistry::findTable(const Player::IdView playerId) -> Context*
+{
+    const auto lock = std::scoped_lock{m_mutex};
+    const auto it = m_seats.find(playerId);
+    return it == std::end(m_seats) ? nullptr : m_tables.at(it->second).ctx.get();
+}
+
+auto TableRegistry::openTable() -> Context&
+{
+    const auto lock = std::scoped_lock{m_mutex};
+    auto& table = idleTable();
+    table.isOpened = true;
+    const auto tableId = table.ctx->id;
+    PREF_DI(tableId);
+    return *table.ctx;
+}
+
+auto TableRegistry::record(fs::path dir) -> bool
+{
+    const auto lock = std::scoped_lock{m_mutex};
+    assert(std::empty(m_tables) and "recording starts before the first table opens");
+    return m_recordings.open(std::move(dir));
+}
+
+auto TableRegistry::seatBot(const Context& table, const Player::IdView botId) -> bool
+{
+    const auto lock = std::scoped_lock{m_mutex};
+    auto& seats = m_tables.at(table.id).seats;
+    if (seats >= NumberOfPlayers) { return false; }
+    ++seats;
+    m_seats.emplace(botId, table.id);
+    const auto tableId = table.id;
+    PREF_DI(botId, tableId, seats);
+    return true;
+}
+
+auto TableRegistry::leave(const Context& table, const Player::IdView playerId) -> void
+{
+    const auto lock = std::scoped_lock{m_mutex};
+    const auto it = m_seats.find(playerId);
+    if (it == std::end(m_seats) or it->second != table.id) { return; }
+    m_seats.erase(it);
+    auto& left = m_tables.at(table.id);
+    const auto seats = --left.seats;
+    if (seats == 0) { left.isOpened = false; }
+    const auto tableId = table.id;
+    PREF_DI(playerId, tableId, seats);
+}
+
+auto TableRegistry::shutdown() -> void
+{
+    const auto lock = std::scoped_lock{m_mutex};
+    for (auto& table : m_tables | rv::values) { table.ctx->shutdown(); }
+    m_seats.clear();
+}
+
+[[nodiscard]] auto decideTrickWinner(
+    const std::vector<PlayedCard>& trick, const std::optional<Suit> trump, const std::optional<CardId> openTalon)
+    -> Player::Id
+{
     assert(std::size(trick) == NumberOfPlayers and "all players played cards");
-    const auto& firstCard = trick.front();
-    const auto& leadSuit = cardSuit(not std::empty(ctx().talon.current) ? ctx().talon.current : firstCard.name);
-    ctx().talon.current.clear();
-    return rng::accumulate(trick, firstCard, [&](const PlayedCard& best, const PlayedCard& candidate) {
-        return beats({candidate.name, best.name, leadSuit, trump}) ? candidate : best; // NOLINT(modernize-use-designated-initializers)
-    }).playerId;
-} // clang-format on
+    const auto leadSuit = suitOf(openTalon.value_or(trick.front().card));
+    const auto* best = &trick.front();
+    for (const auto& candidate : trick | rv::drop(1)) {
+        if (beats({.candidate = candidate.card, .best = best->card, .leadSuit = leadSuit, .trump = trump})) {
+            best = &candidate;
+        }
+    }
+    return best->playerId;
+}
 
 // NOLINTNEXTLINE(readability-function-cognitive-complexity)
 [[nodiscard]] auto calculateDealScore(const Declarer& declarer, const std::vector<Whister>& whisters) -> DealScore
@@ -1153,7 +2278,7 @@ auto Context::countWhistingChoice(const WhistingChoice choice) -> std::ptrdiff_t
 
     const auto makeDeclarerScore = [&] {
         auto result = DealScoreEntry{};
-        if (compareTricks(declarer.contractLevel)(declarer.tricksTaken, declarerReqTricks)) {
+        if (hasFulfilledContract(declarer.contractLevel, declarer.tricksTaken)) {
             result.pool = contractPrice;
         } else {
             result.dump = declarerFailedTricks * contractPrice;
@@ -1187,25 +2312,80 @@ auto Context::countWhistingChoice(const WhistingChoice choice) -> std::ptrdiff_t
     };
 }
 
-auto createAcceptor(
+auto playHeadless(TableRegistry& registry, const std::size_t deals, const std::uint64_t seed) -> task<HeadlessStats>
+{
+    auto& ctx = registry.openTable();
+    co_return co_await onTable(ctx, playHeadlessDeals(ctx, deals, seed));
+}
+
+auto replayRecording(TableRegistry& registry, const std::vector<TableRecord>& records) -> task<ReplayStats>
+{
+    auto& ctx = registry.openTable();
+    co_return co_await onTable(ctx, replayTable(ctx, records));
+}
+
+// The tokens revoked under one hold of the storage's mutex, so that the logins never wait long behind a sweep
+inline constexpr auto AuthTokenSweepBatch = 256;
+
+auto sweepAuthTokens(TableRegistry& registry) -> task<>
+{
+    auto& storage = registry.storage();
+    while (true) {
+        const auto now = utcTimeSinceEpochInSec();
+        auto expired = std::invoke([&] {
+            const auto lock = std::scoped_lock{storage.mutex};
+            return expiredAuthTokens(storage.gameData, storage.index, now);
+        });
+        auto expiredTokens = 0uz;
+        for (auto batch : expired | rv::chunk(AuthTokenSweepBatch)) {
+            {
+                const auto lock = std::scoped_lock{storage.mutex};
+                for (auto& entry : batch) {
+                    // used between the batches, or revoked by a logout
+                    if (not isAuthTokenExpired(storage.gameData, storage.index, entry, now)) { continue; }
+                    recordChange(storage.gameData,
+                        storage.index,
+                        storage.journal,
+                        makeAuthTokenRevoked(entry.playerId, entry.authToken));
+                    ++expiredTokens;
+                }
+            }
+            storage.journal.commit(); // never waits on the disk, but needs no lock either
+        }
+        if (expiredTokens != 0) { PREF_DI(expiredTokens); }
+        co_await sleepFor(AuthTokenSweepInterval, registry.executor());
+    }
+}
+
+namespace {
+
+// The acceptor's thread accepts the connections and runs their handshakes. Each session then runs on the next shard,
+// so that the sessions' reads, TLS and deflate are spread over all the shards like the tables are
+auto acceptOn(
 #ifdef PREF_SSL
-    net::ssl::context ssl,
+    net::ssl::context& ssl,
 #endif // PREF_SSL
-    tcp::endpoint endpoint,
-    net::any_io_executor ex) -> task<>
+    const tcp::endpoint& endpoint,
+    TableRegistry& registry,
+    Shard& shard) -> task<>
 {
-    PREF_I();
-    auto acceptor = Acceptor{ex, endpoint};
-    auto sch = co_await stdx::get_scheduler();
+    auto acceptor = makeAcceptor(shard.get_executor(), endpoint);
+    auto* sessionShard = static_cast<Shard*>(nullptr);
     co_await ex::repeat_effect_until(
-        acceptor.async_accept()
+        stdx::just()
+        | stdx::let_value([&] {
+              sessionShard = &registry.nextShard(); // the socket's I/O belongs to the session's shard
+              return acceptor.async_accept(net::any_io_executor{sessionShard->get_executor()});
+          })
         | stdx::then([&](auto socket) {
+              registry.countAccepted(shard);
 #ifdef PREF_SSL
               auto ws = Stream{std::move(socket), ssl};
 #else // PREF_SSL
               auto ws = Stream{std::move(socket)};
 #endif // PREF_SSL
-              stdx::start_detached(stdx::starts_on(sch, launchSession(std::move(ws))));
+              stdx::start_detached(stdx::starts_on(
+                  sessionShard->get_scheduler(), launchSession(registry, std::move(ws), shard.get_executor())));
               return false;
           })
         | stdx::upon_error([](const std::exception_ptr& error) {
@@ -1214,4 +2394,35 @@ auto createAcceptor(
           }));
 }
 
+} // namespace
+
+auto createAcceptor(
+#ifdef PREF_SSL
+    net::ssl::context ssl,
+#endif // PREF_SSL
+    tcp::endpoint endpoint,
+    TableRegistry& registry) -> task<>
+{
+    const auto acceptors = registry.sessionOptions().acceptors;
+    PREF_DI(acceptors);
+    const auto acceptOnShard = [&](const std::size_t i) {
+        auto& shard = registry.acceptorShard(i);
+        return stdx::starts_on(
+            shard.get_scheduler(),
+            acceptOn(
+#ifdef PREF_SSL
+                ssl,
+#endif // PREF_SSL
+                endpoint,
+                registry,
+                shard));
+    };
+    // the first acceptor is stopped with this task, and it stops the others
+    auto scope = ex::async_scope{};
+    for (auto i = 1uz; i < acceptors; ++i) { scope.spawn(acceptOnShard(i) | stdx::upon_error(Detached("acceptOn"))); }
+    co_await (acceptOnShard(0) | stdx::upon_stopped([] {}));
+    scope.request_stop();
+    co_await scope.on_empty();
+}
+
 } // namespace pref
@@ -3,28 +3,80 @@
 
 #pragma once
 
+#include "bot.hpp"
 #include "common/common.hpp"
 #include "common/logger.hpp"
+#include "journal.hpp"
 #include "proto/pref.pb.h"
+#include "recording.hpp"
+#include "rules.hpp"
 #include "transport.hpp"
 
 #include <boost/asio.hpp>
 #include <boost/system.hpp>
+#include <execpools/asio/asio_thread_pool.hpp>
 #include <range/v3/all.hpp>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <exception>
 #include <filesystem>
+#include <functional>
 #include <map>
-#include <set>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 namespace pref {
 
-using Hand = std::set<CardName>;
+using Hand = CardMask;
+
+struct Context;
+class TableRegistry;
+
+// Lets `rate` messages a second through on average, in bursts of up to `burst` of them
+class RateLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    RateLimiter(const double rate, const double burst) noexcept
+        : m_rate{rate}
+        , m_burst{burst}
+        , m_tokens{burst}
+    {
+    }
+
+    [[nodiscard]] auto tryTake(const Clock::time_point now) noexcept -> bool
+    {
+        const auto elapsed = std::chrono::duration<double>{now - m_last};
+        m_tokens = m_last == Clock::time_point{} ? m_tokens : std::min(m_burst, m_tokens + m_rate * elapsed.count());
+        m_last = now;
+        if (m_tokens < 1.0) { return false; }
+        m_tokens -= 1.0;
+        return true;
+    }
+
+private:
+    double m_rate{};
+    double m_burst{};
+    double m_tokens{};
+    Clock::time_point m_last;
+};
+
+// An ICE restart sends a few dozen candidates at once, an SDP offer takes a few KiB
+inline constexpr auto RelayRate = 20.0;
+inline constexpr auto RelayBurst = 50.0;
+inline constexpr auto MaxAudioSignalSize = 16uz * 1024;
+inline constexpr auto MaxSpeechBubbleSize = 1024uz;
 
 struct PlayerSession {
     using Id = std::uint64_t;
@@ -32,6 +84,11 @@ struct PlayerSession {
     Id id{};
     std::string playerId;
     std::string playerName;
+    Context* table{};
+    Context* spectated{}; // the table a spectator watches, it has no seat
+    WireFormat wireFormat = WireFormat::WIRE_TEXT;
+    net::ip::address address; // of the client, limits its concurrent password checks
+    RateLimiter relayLimiter{RelayRate, RelayBurst}; // of its AudioSignal and SpeechBubble messages
 };
 
 struct Player {
@@ -49,78 +106,53 @@ struct Player {
     PlayerSession::Id sessionId{};
     Connection conn;
     Hand hand;
-    std::vector<CardName> playedCards;
-    std::string bid;
+    std::vector<CardId> playedCards;
+    Bid bid; // none before the player's first one
     std::string whistingChoice;
     std::string howToPlayChoice;
     int tricksTaken{};
     ReadyCheckState readyCheckState = ReadyCheckState::NOT_REQUESTED;
     Offer offer = Offer::NO_OFFER;
+    WireFormat wireFormat = WireFormat::WIRE_TEXT;
+    std::uint8_t voidSuits{}; // a bit per Suit the player has shown out of in the deal
+    bool isBot{};
+    bool isThinking{}; // a bot's decision is on the way
 
     auto clear() -> void
     {
         hand.clear();
         playedCards.clear();
-        bid.clear();
+        bid = {};
         whistingChoice.clear();
         howToPlayChoice.clear();
         tricksTaken = 0;
         readyCheckState = ReadyCheckState::NOT_REQUESTED;
         offer = Offer::NO_OFFER;
+        voidSuits = 0;
     }
 };
 
 struct PlayedCard {
     Player::Id playerId;
-    CardName name;
-};
-
-enum class WhistingChoice {
-    Pass,
-    Whist,
-    HalfWhist,
-    PassWhist,
-    PassPass,
-};
-
-struct Whister {
-    Player::Id id;
-    WhistingChoice choice = WhistingChoice::Pass;
-    int tricksTaken{};
-};
-
-enum class ContractLevel {
-    Six,
-    Seven,
-    Eight,
-    Nine,
-    Ten,
-    Miser,
-};
-
-struct Declarer {
-    Player::Id id;
-    ContractLevel contractLevel = ContractLevel::Six;
-    int tricksTaken{};
+    CardId card{};
 };
 
 struct Talon {
     std::size_t open{};
-    CardName current;
-    std::vector<CardName> cards;
-    std::vector<CardName> discardedCards;
+    std::optional<CardId> current;
+    std::vector<CardId> cards;
+    std::vector<CardId> discardedCards;
 
     auto clear() -> void
     {
-        current.clear();
+        current.reset();
         cards.clear();
         discardedCards.clear();
         open = 0;
     }
 };
 
-[[nodiscard]] constexpr auto pickMinBid(int round, std::span<const std::string_view> values) noexcept
-    -> std::string_view
+[[nodiscard]] constexpr auto pickMinBid(int round, std::span<const Bid> values) noexcept -> Bid
 {
     assert(not std::empty(values));
     return values[static_cast<std::size_t>(std::clamp(round, 0, static_cast<int>(std::size(values) - 1)))];
@@ -129,11 +161,11 @@ struct Talon {
 struct PassGame {
     static constexpr auto s_rounds = 3; // 1, 2, 3
     static constexpr auto s_progression = ProgressionArgs{.prog = Progression::Arithmetic, .first = 1, .step = 1};
-    static constexpr auto s_minBids = std::array<std::string_view, 2>{PREF_SIX, PREF_SEVEN};
+    static constexpr auto s_minBids = std::array<Bid, 2>{PREF_SIX, PREF_SEVEN};
     int round{};
     bool now{};
 
-    [[nodiscard]] constexpr auto minBid() const noexcept -> std::string_view
+    [[nodiscard]] constexpr auto minBid() const noexcept -> Bid
     {
         return pickMinBid(round, s_minBids);
     }
@@ -161,31 +193,114 @@ struct PassGame {
     }
 };
 
+using Shard = execpools::asio_thread_pool;
+using Scheduler = decltype(std::declval<Shard&>().get_scheduler());
+
+// Users data shared by all the tables, guarded by the mutex
+struct Storage {
+    std::mutex mutex;
+    fs::path gameDataPath;
+    GameData gameData;
+    GameDataIndex index; // over `gameData`
+    JournalWriter journal; // persists the changes of `gameData` in the background
+    std::int32_t gameId{};
+};
+
+// The public part of a GameSnapshot, serialized at most once per version of what the players see
+struct SnapshotCache {
+    struct Body {
+        std::uint64_t version{};
+        std::string bytes; // of a GameSnapshot
+    };
+
+    std::uint64_t version = 1; // bumped by every message sent to the whole table
+    std::array<Body, 2> bodies; // by WireFormat
+};
+
+// What the audience's fan-out knows of a spectator
+struct Spectator {
+    ChannelPtr ch;
+    std::uint64_t seen{}; // the table's version its frames got it to
+    bool isLagging{}; // it missed a frame and waits for the next snapshot
+};
+
+// A frame of the table for its audience, serialized in WIRE_COMPACT
+struct SpectatorFrame {
+    std::uint64_t version{}; // of the table once the frame is sent
+    Frame frame;
+    bool isSnapshot{}; // a GameSnapshot of the table at the version
+};
+
+// Hands the frame to the spectators who have room for it, true when one of them lags and waits for a snapshot
+[[nodiscard]] auto fanOut(std::vector<Spectator>& spectators, const SpectatorFrame& frame) -> bool;
+
+// Streams a table to its spectators without the players waiting for them. The table pushes the frames it sends to
+// all its players, hands left out, into a bounded queue and never blocks; the fan-out on a shard of its own copies
+// the shared frames to the spectators. A spectator who misses a frame, for its own channel or the queue being full,
+// skips the table's frames up to its next GameSnapshot
+class SpectatorLane {
+public:
+    using RequestSnapshot = std::function<void()>; // has the table publish a snapshot soon
+    static constexpr auto QueueSize = 1024;
+
+    explicit SpectatorLane(Shard& shard);
+
+    [[nodiscard]] auto isWatched() const noexcept -> bool;
+    // from the table's thread
+    auto publish(std::uint64_t version, Frame frame, bool isSnapshot = false) -> void;
+    // from the table's thread, once the spectator got the table's snapshot at `seen`; the first one starts the fan-out
+    auto add(ChannelPtr ch, std::uint64_t seen, RequestSnapshot requestSnapshot) -> void;
+    auto close() -> void;
+
+private:
+    using Queue = netx::use_sender_t::as_default_on_t<
+        net::experimental::concurrent_channel<void(sys::error_code, SpectatorFrame)>>;
+
+    auto run() -> task<>;
+
+    Scheduler m_sch;
+    Queue m_queue;
+    RequestSnapshot m_requestSnapshot;
+    std::mutex m_mutex;
+    std::vector<Spectator> m_joining; // under the mutex, taken over by the fan-out
+    std::atomic<std::size_t> m_watchers;
+    std::atomic<bool> m_isOverflowed; // the queue was full, every spectator missed a frame
+    std::atomic<bool> m_isSnapshotPending;
+    bool m_isStarted{}; // the table's thread only
+};
+
+// A single table. All its state is only touched from its shard's thread
 struct Context {
+    using Id = std::uint64_t;
     using Players = std::map<Player::Id, Player, std::less<>>;
 
-    explicit Context(net::any_io_executor executor)
-        : ex{std::move(executor)}
+    Context(Id aId, Shard& shard, Shard& audience, TableRegistry& aRegistry, Storage& aStorage)
+        : id{aId}
+        , ex{shard.get_executor()}
+        , sch{shard.get_scheduler()}
+        , registry{aRegistry}
+        , storage{aStorage}
+        , spectators{audience}
     {
     }
 
     [[nodiscard]] auto whoseTurnId() const -> Player::IdView;
     [[nodiscard]] auto player(Player::IdView playerId) const -> Player&;
     [[nodiscard]] auto playerName(Player::IdView playerId) const -> Player::NameView;
-    [[nodiscard]] static auto areWhistersPass() -> bool;
-    [[nodiscard]] static auto areWhistersWhist() -> bool;
-    [[nodiscard]] static auto areWhistersPassAndWhist() -> bool;
-    [[nodiscard]] static auto isHalfWhistAfterPass() -> bool;
-    [[nodiscard]] static auto isPassAfterHalfWhist() -> bool;
-    [[nodiscard]] static auto isWhistAfterHalfWhist() -> bool;
-    [[nodiscard]] static auto countWhistingChoice(WhistingChoice choice) -> std::ptrdiff_t;
+    [[nodiscard]] auto areWhistersPass() const -> bool;
+    [[nodiscard]] auto areWhistersWhist() const -> bool;
+    [[nodiscard]] auto areWhistersPassAndWhist() const -> bool;
+    [[nodiscard]] auto isHalfWhistAfterPass() const -> bool;
+    [[nodiscard]] auto isPassAfterHalfWhist() const -> bool;
+    [[nodiscard]] auto isWhistAfterHalfWhist() const -> bool;
+    [[nodiscard]] auto countWhistingChoice(WhistingChoice choice) const -> std::ptrdiff_t;
 
     auto clear() -> void
     {
         talon.clear();
         trick.clear();
         lastTrick.clear();
-        trump.clear();
+        trump.reset();
         passGame.clear();
         isDeclarerFirstMiserTurn = false;
         for (auto&& [_, p] : players) { p.clear(); }
@@ -194,54 +309,200 @@ struct Context {
     auto shutdown() -> void
     {
         players.clear();
+        spectators.close();
+    }
+
+    // e.g. a replay deals the cards of its recording
+    auto reseed(const std::uint64_t aSeed) -> void
+    {
+        seed = aSeed;
+        random.seed(seed);
+        recorder.seeded(seed);
     }
 
+    Id id{};
     net::any_io_executor ex;
+    Scheduler sch;
+    TableRegistry& registry;
+    Storage& storage;
     GameStage stage = GameStage::UNKNOWN;
     mutable Players players;
     Players::const_iterator whoseTurnIt;
     Talon talon;
-    std::vector<CardName> lastTrick;
+    std::vector<CardId> lastTrick;
     std::vector<PlayedCard> trick;
-    std::string trump;
+    std::optional<Suit> trump;
     PassGame passGame;
     Player::Id forehandId;
     ScoreSheet scoreSheet;
-    fs::path gameDataPath;
-    GameData gameData;
     bool isDeclarerFirstMiserTurn{};
+    std::size_t botsSeated{}; // numbers the table's bots
+    std::size_t dealsPlayed{};
+    std::chrono::milliseconds nextDealDelay = 3s; // to look at the deal's result
+    bool isNextDealRecorded{}; // a replay deals the next deal on its record, not after the delay
+    std::uint64_t seed = std::random_device{}();
+    std::mt19937_64 random{seed}; // shuffles the deck
+    TableRecorder recorder;
+    mutable SnapshotCache snapshot; // the sends to a const table bump its version
+    mutable SpectatorLane spectators; // the sends to a const table publish to it
 
     std::int32_t gameId{};
     std::int64_t gameStarted{};
     std::int32_t gameDuration{};
 };
 
-[[nodiscard]] inline auto ctx(net::any_io_executor ex = {}) -> Context&
-{
-    static auto ctx = Context{std::move(ex)};
-    return ctx;
-}
+// Runs the Argon2 password checks on threads of their own, so that logins never stall the tables. Admission is
+// bounded: a check is rejected at once when the pool or the client's address already has too many checks in flight
+class PasswordPool {
+public:
+    struct Limits {
+        std::size_t threads = 2;
+        std::size_t maxInFlight = 32; // running and queued
+        std::size_t maxInFlightPerAddress = 2;
+    };
+
+    explicit PasswordPool(Limits limits = {});
+
+    // std::nullopt when rejected, otherwise whether the password matches the hash
+    [[nodiscard]] auto verify(net::ip::address from, std::string password, std::string hash)
+        -> task<std::optional<bool>>;
+
+private:
+    [[nodiscard]] auto admit(const net::ip::address& from) -> bool;
+    auto release(const net::ip::address& from) -> void;
+
+    Limits m_limits;
+    std::mutex m_mutex;
+    std::size_t m_inFlight{};
+    std::map<net::ip::address, std::size_t> m_inFlightByAddress;
+    Shard m_pool; // declared last to join the threads before the counters are gone
+};
+
+// How the WebSocket sessions are served
+struct SessionOptions {
+    SlowConsumer slowConsumer = SlowConsumer::Wait;
+    Deflate deflate;
+    std::size_t acceptors = 1; // each on a thread of its own, running the handshakes of the sessions it accepts
+};
+
+// Owns the tables and the shards they run on. Each shard is a single-threaded pool, so it serializes the work of
+// its tables like a strand would, while the tables are spread over all the shards
+class TableRegistry {
+public:
+    explicit TableRegistry(std::size_t threads, BotPool::Limits bots = {}, SessionOptions sessions = {});
+
+    [[nodiscard]] auto storage() noexcept -> Storage&;
+    [[nodiscard]] auto passwords() noexcept -> PasswordPool&;
+    [[nodiscard]] auto bots() noexcept -> BotPool&;
+    [[nodiscard]] auto sessionOptions() const noexcept -> const SessionOptions&;
+    [[nodiscard]] auto executor() -> net::any_io_executor;
+    [[nodiscard]] auto scheduler() -> Scheduler;
+    [[nodiscard]] auto nextShard() -> Shard&;
+    [[nodiscard]] auto acceptorShard(std::size_t acceptor) -> Shard&;
+    // counts a connection in, accepted by the acceptor running on `acceptor`
+    auto countAccepted(const Shard& acceptor) -> void;
+    // counts the session running on the calling thread in, +1, or out, -1
+    auto countSession(std::int64_t delta) -> void;
+    // by acceptor, e.g. to check that SO_REUSEPORT spreads the connections
+    [[nodiscard]] auto acceptedPerAcceptor() -> std::vector<std::size_t>;
+    // by shard, the sessions running on it
+    [[nodiscard]] auto sessionsPerShard() -> std::vector<std::int64_t>;
+    [[nodiscard]] auto tablesCount() -> std::size_t;
+    // the table the player is seated at, or the fullest table with a free seat, or a new one
+    [[nodiscard]] auto seat(Player::IdView playerId) -> Context&;
+    // the table the player is seated at
+    [[nodiscard]] auto findTable(Player::IdView playerId) -> Context*;
+    // a table of its own, e.g. for the bots of a headless game, never seated by `seat` until its last seat is left
+    [[nodiscard]] auto openTable() -> Context&;
+    // records the tables opened from now on under the directory, see RecordingWriter
+    auto record(fs::path dir) -> bool;
+    // takes a free seat at the table for the bot, false when the table is full
+    [[nodiscard]] auto seatBot(const Context& table, Player::IdView botId) -> bool;
+    // the table is reused once its last seat is left
+    auto leave(const Context& table, Player::IdView playerId) -> void;
+    auto shutdown() -> void;
+
+private:
+    struct Table {
+        std::unique_ptr<Context> ctx;
+        std::size_t seats{};
+        bool isOpened{}; // by openTable
+    };
+
+    [[nodiscard]] auto addTable() -> Table&; // under the mutex
+    [[nodiscard]] auto idleTable() -> Table&; // under the mutex, an empty one or a new one
+
+    std::mutex m_mutex;
+    Storage m_storage;
+    PasswordPool m_passwords;
+    BotPool m_bots;
+    SessionOptions m_sessions;
+    std::map<Context::Id, Table> m_tables;
+    std::map<Player::Id, Context::Id, std::less<>> m_seats;
+    Context::Id m_lastTableId{};
+    std::size_t m_nextShard{};
+    std::vector<std::size_t> m_accepted; // by acceptor
+    std::vector<std::int64_t> m_sessions; // by shard
+    RecordingWriter m_recordings; // joined after the shards that record to it
+    Shard m_audience{1}; // the spectator lanes' fan-outs, joined after the shards that publish to them
+    std::vector<std::unique_ptr<Shard>> m_shards; // the tables and the sessions, joined before the tables are gone
+    std::vector<std::unique_ptr<Shard>> m_acceptors; // the accepts and the handshakes, declared last to be joined first
+};
 
 inline constexpr auto ToPlayerId = &Context::Players::value_type::first;
 inline constexpr auto ToPlayer = &Context::Players::value_type::second;
 
-struct Beat {
-    std::string_view candidate;
-    std::string_view best;
-    std::string_view leadSuit;
-    std::string_view trump;
+[[nodiscard]] auto decideTrickWinner(
+    const std::vector<PlayedCard>& trick, std::optional<Suit> trump, std::optional<CardId> openTalon = {})
+    -> Player::Id;
+
+// What a headless table has played, with the time the handlers took on the moves of each stage
+struct HeadlessStats {
+    struct Stage {
+        std::size_t moves{};
+        std::chrono::nanoseconds total{};
+        std::chrono::nanoseconds max{};
+    };
+
+    std::size_t games{};
+    std::size_t deals{};
+    std::array<Stage, GameStage_ARRAYSIZE> stages{};
 };
 
-[[nodiscard]] auto beats(Beat beat) -> bool;
+// Plays the deals at a new table of three bots making random legal moves. It's the table of a real game, with the
+// same handlers and messages, only nobody reads them and the next deal starts at once: it measures the game alone
+[[nodiscard]] auto playHeadless(TableRegistry& registry, std::size_t deals, std::uint64_t seed) -> task<HeadlessStats>;
+
+// What a replayed recording made its table do. The seats are the same for two builds that play the recording the
+// same way: each has the count and the CRC-32 of the frames the table sent the player
+struct ReplayStats {
+    struct Seat {
+        std::size_t frames{};
+        boost::crc_32_type crc;
+    };
+
+    std::size_t messages{};
+    std::size_t deals{};
+    std::map<Player::Id, Seat, std::less<>> seats;
+};
+
+// Plays the recording again at a new table, as fast as it goes: the cards are dealt with the recorded seed, the
+// players take the seats they took, and their messages are handled one after another, the timestamps ignored. Each
+// next deal is dealt where it's recorded, so the messages handled during the delay before it are replayed before it
+[[nodiscard]] auto replayRecording(TableRegistry& registry, const std::vector<TableRecord>& records)
+    -> task<ReplayStats>;
+
+// The table as all the players see it, serialized once per version of the table and wire format
+[[nodiscard]] auto cachedSnapshot(Context& ctx, WireFormat format) -> const std::string&;
 
-[[nodiscard]] auto decideTrickWinner(const std::vector<PlayedCard>& trick, std::string_view trump) -> Player::Id;
-[[nodiscard]] auto calculateDealScore(const Declarer& declarer, const std::vector<Whister>& whisters) -> DealScore;
+// Expires the stale auth tokens every AuthTokenSweepInterval, starting with the ones gone stale during a downtime
+auto sweepAuthTokens(TableRegistry& registry) -> task<>;
 
 auto createAcceptor(
 #ifdef PREF_SSL
     net::ssl::context ssl,
 #endif // PREF_SSL
     net::ip::tcp::endpoint endpoint,
-    net::any_io_executor ex) -> task<>;
+    TableRegistry& registry) -> task<>;
 
 }; // namespace pref
@@ -0,0 +1,464 @@
+// SPDX-License-Identifier: AGPL-3.0-only
+// Copyright (c) 2025 Oleksandr Kozlov
+
+#pragma once
+
+#include "common/common.hpp"
+#include "rules.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace pref {
+
+// Trick play with every hand open: the declarer against the two whisters, with the talon already discarded
+struct DealPosition {
+    using Seat = std::size_t; // an index in `hands`, the play goes in the ascending order of the seats
+
+    std::array<CardMask, NumberOfPlayers> hands;
+    std::optional<Suit> trump;
+    ContractLevel contractLevel = ContractLevel::Six;
+    Seat declarer{};
+    Seat leader{}; // of the current trick
+    std::vector<CardId> trick{}; // played to the current trick so far, the leader's card first
+    int declarerTricks{}; // taken before the current trick
+};
+
+struct ScoredCard {
+    CardId card{};
+    int tricks{}; // the declarer takes from the current trick on after the card
+};
+
+// An exact double-dummy solver: null-window alpha-beta over bitmask hands with the cards of a sequence searched
+// once, the likely best cards tried first, and the positions at trick boundaries cached under a Zobrist hash. The
+// declarer takes as many tricks as possible, or as few as possible on a miser, and the whisters play together.
+// Keep one solver per thread: the cache is reused across calls for as long as the trump and the declarer stay put.
+class DoubleDummySolver {
+public:
+    static constexpr auto DefaultTableSize = std::size_t{1} << 16; // entries, a power of two
+
+    explicit DoubleDummySolver(const std::size_t tableSize = DefaultTableSize)
+        : m_table(std::bit_ceil(tableSize))
+        , m_tableMask{std::size(m_table) - 1}
+    {
+    }
+
+    // The tricks the declarer takes from the current trick on with the best play of every side
+    [[nodiscard]] auto solve(const DealPosition& position) -> int
+    {
+        setUp(position);
+        return exactTricks(tricksLeft(), [this](const int target) { return reaches(target); });
+    }
+
+    // The same for each card the player to move can play, in the CardId order
+    [[nodiscard]] auto evaluate(const DealPosition& position) -> std::vector<ScoredCard>
+    {
+        setUp(position);
+        const auto seat = seatToMove();
+        const auto tricks = tricksLeft();
+        auto byRunTop = std::array<std::optional<int>, DeckSize>{};
+        auto result = std::vector<ScoredCard>{};
+        for (const auto card : playableCards(m_hands[seat], leadSuit(), m_trump)) {
+            auto& value = byRunTop[std::to_underlying(topOfRun(card, m_hands[seat].bits(), m_inPlay))];
+            if (not value) {
+                value = exactTricks(tricks, [&](const int target) { return play(card, target); });
+            }
+            result.push_back({card, *value});
+        }
+        return result;
+    }
+
+    // Whether the declarer fulfills the contract with the best play, a single search instead of the exact count
+    [[nodiscard]] auto isContractMade(const DealPosition& position) -> bool
+    {
+        setUp(position);
+        const auto reachesGuess = reaches(m_guess);
+        return m_isMiser ? not reachesGuess : reachesGuess;
+    }
+
+private:
+    using Seat = DealPosition::Seat;
+    using Hash = std::uint64_t;
+    using Hands = std::array<std::uint32_t, NumberOfPlayers>;
+
+    static constexpr auto SuitBits = (std::uint32_t{1} << RanksCount) - 1;
+
+    static constexpr auto NoMove = static_cast<std::uint8_t>(DeckSize);
+
+    // Bounds of the declarer's tricks from a trick boundary on, and the card that settled the last search of it;
+    // packed into 16 bytes to keep more of the table in the cache
+    struct Entry {
+        Hands hands{}; // normalized
+        std::uint16_t generation{};
+        std::uint8_t lower : 4 {};
+        std::uint8_t upper : 4 {};
+        std::uint8_t leader : 2 {};
+        std::uint8_t move : 6 {NoMove};
+    };
+    static_assert(sizeof(Entry) == 16);
+
+    // Tabulation over the suits of each hand: a key per seat, suit and the cards of the suit, and one per leader
+    static constexpr auto LeaderKeys = (NumberOfPlayers * SuitsCount) << RanksCount;
+    static constexpr auto Zobrist = [] {
+        auto result = std::array<Hash, LeaderKeys + NumberOfPlayers>{};
+        auto state = Hash{};
+        for (auto& key : result) { // splitmix64
+            state += 0x9E3779B97F4A7C15;
+            auto z = state;
+            z = (z ^ (z >> 30U)) * 0xBF58476D1CE4E5B9;
+            z = (z ^ (z >> 27U)) * 0x94D049BB133111EB;
+            key = z ^ (z >> 31U);
+        }
+        return result;
+    }();
+
+    // [cards of a suit in play][cards of it held]: the held ones renumbered among the ones in play
+    using CompressTable = std::array<std::array<std::uint8_t, SuitBits + 1>, SuitBits + 1>;
+
+    [[nodiscard]] static auto compressTable() -> const CompressTable&
+    {
+        static const auto result = [] {
+            auto table = CompressTable{};
+            for (auto inPlay = 0U; inPlay <= SuitBits; ++inPlay) {
+                for (auto held = 0U; held <= SuitBits; ++held) {
+                    auto compressed = 0U;
+                    auto rank = 0U;
+                    for (auto bit = 0U; bit < RanksCount; ++bit) {
+                        if (((inPlay >> bit) & 1U) == 0) { continue; }
+                        compressed |= ((held >> bit) & 1U) << rank++;
+                    }
+                    table[inPlay][held] = static_cast<std::uint8_t>(compressed);
+                }
+            }
+            return table;
+        }();
+        return result;
+    }
+
+    auto setUp(const DealPosition& position) -> void
+    {
+        assert(position.declarer < NumberOfPlayers and position.leader < NumberOfPlayers);
+        assert(std::size(position.trick) < NumberOfPlayers);
+        const auto isMiser = position.contractLevel == ContractLevel::Miser;
+        if (position.trump != m_trump or position.declarer != m_declarer or isMiser != m_isMiser) {
+            m_trump = position.trump;
+            m_declarer = position.declarer;
+            m_isMiser = isMiser;
+            if (++m_generation == 0) { // the cached bounds are for other rules, and the oldest ones may look current
+                std::ranges::fill(m_table, Entry{});
+                m_generation = 1;
+            }
+        }
+        m_hands = position.hands;
+        m_leader = position.leader;
+        m_played = std::size(position.trick);
+        std::ranges::copy(position.trick, std::begin(m_trick));
+        m_inPlay = toCardMask(position.trick).bits();
+        for (const auto hand : m_hands) { m_inPlay |= hand.bits(); }
+        // the tricks that decide the contract: at least the required ones, or one over them on a miser
+        const auto required = declarerReqTricks(position.contractLevel) - position.declarerTricks;
+        m_guess = isMiser ? required + 1 : required;
+    }
+
+    [[nodiscard]] auto seatToMove() const noexcept -> Seat
+    {
+        return (m_leader + m_played) % NumberOfPlayers;
+    }
+
+    [[nodiscard]] auto tricksLeft() const noexcept -> int
+    {
+        return static_cast<int>(m_hands[seatToMove()].size()); // the current trick included
+    }
+
+    [[nodiscard]] auto leadSuit() const noexcept -> std::optional<Suit>
+    {
+        if (m_played == 0) { return std::nullopt; }
+        return suitOf(m_trick.front());
+    }
+
+    [[nodiscard]] auto isDeclarer(const Seat seat) const noexcept -> bool
+    {
+        return seat == m_declarer;
+    }
+
+    // The index of the best card of a trick among the first `count`, as decideTrickWinner picks it
+    [[nodiscard]] auto bestOf(const std::array<CardId, NumberOfPlayers>& trick, const std::size_t count) const noexcept
+        -> std::size_t
+    {
+        const auto lead = suitOf(trick.front());
+        auto best = std::size_t{};
+        for (auto i = std::size_t{1}; i < count; ++i) {
+            if (beats({.candidate = trick[i], .best = trick[best], .leadSuit = lead, .trump = m_trump})) { best = i; }
+        }
+        return best;
+    }
+
+    // The cards of the suit above the card
+    [[nodiscard]] static constexpr auto higherThan(const CardId card) noexcept -> std::uint32_t
+    {
+        const auto index = std::to_underlying(card);
+        return (SuitBits << (index / RanksCount * RanksCount)) & ~((std::uint32_t{2} << index) - 1);
+    }
+
+    // The highest card of the run the card belongs to in the hand: no card still in play ranks between them, so the
+    // two take the same tricks
+    [[nodiscard]] static auto topOfRun(CardId card, const std::uint32_t hand, const std::uint32_t inPlay) noexcept
+        -> CardId
+    {
+        for (auto above = inPlay & higherThan(card); (hand & above & (0U - above)) != 0;
+             above = inPlay & higherThan(card)) {
+            card = static_cast<CardId>(std::countr_zero(above));
+        }
+        return card;
+    }
+
+    // The cards that beat the best one on the current trick
+    [[nodiscard]] auto winners(const CardId best) const noexcept -> std::uint32_t
+    {
+        if (not m_trump or suitOf(best) == *m_trump) { return higherThan(best); }
+        return higherThan(best) | CardMask::of(*m_trump).bits();
+    }
+
+    // One card per run, the likely best first: the cached move, then for the leader the high cards, for a follower
+    // the cheapest card that wins the trick for its side, otherwise the cheapest card, and for the miser declarer the
+    // highest card under the best one
+    [[nodiscard]] auto orderedMoves(const Seat seat, const std::uint8_t hint, std::array<CardId, DeckSize>& moves)
+        const noexcept -> std::size_t
+    {
+        const auto hand = m_hands[seat].bits();
+        const auto best = m_played == 0 ? std::size_t{} : bestOf(m_trick, m_played);
+        const auto wins = m_played == 0 ? 0U : winners(m_trick[best]);
+        const auto isPartnerBest =
+            m_played != 0 and isDeclarer((m_leader + best) % NumberOfPlayers) == isDeclarer(seat);
+        const auto isDucking = m_isMiser and isDeclarer(seat);
+        const auto sequence = static_cast<int>(RanksCount);
+        auto keys = std::array<int, DeckSize>{};
+        auto count = std::size_t{};
+        for (const auto card : playableCards(m_hands[seat], leadSuit(), m_trump)) {
+            const auto above = m_inPlay & higherThan(card);
+            if ((hand & above & (0U - above)) != 0) { continue; } // the next card in play above is ours as well
+            const auto index = std::to_underlying(card);
+            const auto rank = static_cast<int>(index % RanksCount);
+            const auto isWinner = ((wins >> index) & 1U) != 0;
+            auto key = -rank;
+            if (index == hint) {
+                key = -sequence;
+            } else if (m_played != 0 and isDucking) {
+                key = isWinner ? sequence + rank : -rank;
+            } else if (m_played != 0) {
+                key = (isPartnerBest or not isWinner) ? sequence + rank : rank;
+            }
+            auto i = count++;
+            for (; i > 0 and keys[i - 1] > key; --i) {
+                keys[i] = keys[i - 1];
+                moves[i] = moves[i - 1];
+            }
+            keys[i] = key;
+            moves[i] = card;
+        }
+        return count;
+    }
+
+    // The declarer's tricks from the last trick, the cards left are the only ones to play
+    [[nodiscard]] auto lastTrick() const noexcept -> int
+    {
+        auto trick = std::array<CardId, NumberOfPlayers>{};
+        for (auto i = std::size_t{}; i < NumberOfPlayers; ++i) {
+            trick[i] = *std::begin(m_hands[(m_leader + i) % NumberOfPlayers]);
+        }
+        return isDeclarer((m_leader + bestOf(trick, NumberOfPlayers)) % NumberOfPlayers) ? 1 : 0;
+    }
+
+    // The tricks the leader's side can take for sure, if it wants them, by cashing the top cards of the leader's
+    // suits one by one: each other player follows the suit for as many rounds as they have cards of it, and ruffs
+    // after that, which takes the lead away even from the partner
+    [[nodiscard]] auto quickTricks() const noexcept -> int
+    {
+        const auto inPlay = m_inPlay;
+        const auto hand = m_hands[m_leader].bits();
+        auto result = 0;
+        for (auto suit = 0U; suit < SuitsCount; ++suit) {
+            const auto shift = suit * RanksCount;
+            const auto ours = (hand >> shift) & SuitBits;
+            const auto theirs = (inPlay >> shift) & ~ours & SuitBits;
+            auto tricks = std::popcount(ours >> std::bit_width(theirs));
+            if (m_trump and std::to_underlying(*m_trump) != suit) {
+                const auto trumps = CardMask::of(*m_trump).bits();
+                for (auto seat = Seat{}; seat < NumberOfPlayers; ++seat) {
+                    if (seat != m_leader and (m_hands[seat].bits() & trumps) != 0) {
+                        tricks = std::min(tricks, std::popcount((m_hands[seat].bits() >> shift) & SuitBits));
+                    }
+                }
+            }
+            result += tricks;
+        }
+        return result;
+    }
+
+    // The trumps above every trump of the other side win a trick each whenever they are played: a player with trumps
+    // plays them only on a trump lead or on a ruff. The whisters' ones may fall on the same trick, so only the top
+    // trumps of one whister count for them
+    [[nodiscard]] auto topTrumpTricks() const noexcept -> std::pair<int, int>
+    {
+        if (not m_trump) { return {}; }
+        const auto above = [](const std::uint32_t cards, const std::uint32_t others) {
+            return std::popcount(others == 0 ? cards : cards & ~((std::bit_floor(others) << 1U) - 1));
+        };
+        const auto trumps = CardMask::of(*m_trump).bits();
+        const auto declarer = m_hands[m_declarer].bits() & trumps;
+        auto whistersTricks = 0;
+        for (auto seat = Seat{}; seat < NumberOfPlayers; ++seat) {
+            if (not isDeclarer(seat)) {
+                whistersTricks = std::max(whistersTricks, above(m_hands[seat].bits() & trumps, declarer));
+            }
+        }
+        return {above(declarer, m_inPlay & trumps & ~declarer), whistersTricks};
+    }
+
+    // The hands with the cards renumbered within each suit as if the played ones never existed, and their hash: the
+    // ranks only compare within a suit, so the positions of the same shape take the same tricks
+    [[nodiscard]] auto normalized() const noexcept -> std::pair<Hands, Hash>
+    {
+        const auto& compress = compressTable();
+        const auto inPlay = m_inPlay;
+        auto hands = Hands{};
+        auto hash = Zobrist[LeaderKeys + m_leader];
+        for (auto suit = 0U; suit < SuitsCount; ++suit) {
+            const auto shift = suit * RanksCount;
+            const auto& row = compress[(inPlay >> shift) & SuitBits];
+            for (auto seat = Seat{}; seat < NumberOfPlayers; ++seat) {
+                const auto held = row[(m_hands[seat].bits() >> shift) & SuitBits];
+                hands[seat] |= std::uint32_t{held} << shift;
+                hash ^= Zobrist[(((seat * SuitsCount) + suit) << RanksCount) + held];
+            }
+        }
+        return {hands, hash};
+    }
+
+    [[nodiscard]] auto probe(const Hands& hands, const Hash hash) noexcept -> Entry&
+    {
+        auto& entry = m_table[hash & m_tableMask];
+        if (entry.generation != m_generation or entry.hands != hands or entry.leader != m_leader) {
+            entry = {
+                .hands = hands,
+                .generation = m_generation,
+                .lower = 0,
+                .upper = static_cast<std::uint8_t>(tricksLeft() & 0xF),
+                .leader = static_cast<std::uint8_t>(m_leader & 0x3U),
+                .move = NoMove,
+            };
+        }
+        return entry;
+    }
+
+    // Whether the declarer takes at least `target` tricks from the position on after the card
+    [[nodiscard]] auto play(const CardId card, const int target) -> bool
+    {
+        const auto seat = seatToMove();
+        m_hands[seat].erase(card);
+        m_trick[m_played++] = card;
+        auto result = false;
+        if (m_played < NumberOfPlayers) {
+            result = reaches(target);
+        } else {
+            const auto leader = m_leader;
+            const auto trick = m_trick; // the next tricks overwrite it
+            const auto inPlay = m_inPlay;
+            m_leader = (m_leader + bestOf(m_trick, NumberOfPlayers)) % NumberOfPlayers;
+            m_played = 0;
+            m_inPlay = m_hands[0].bits() | m_hands[1].bits() | m_hands[2].bits();
+            result = reaches(isDeclarer(m_leader) ? target - 1 : target);
+            m_inPlay = inPlay;
+            m_played = NumberOfPlayers;
+            m_leader = leader;
+            m_trick = trick;
+        }
+        m_hands[seat].insert(card);
+        --m_played;
+        return result;
+    }
+
+    // A null-window search: whether the declarer takes at least `target` tricks from the position on
+    [[nodiscard]] auto reaches(const int target) -> bool
+    {
+        if (target <= 0) { return true; }
+        if (target > tricksLeft()) { return false; }
+        auto key = std::optional<std::pair<Hands, Hash>>{};
+        auto hint = NoMove;
+        if (m_played == 0) {
+            if (tricksLeft() == 1) { return lastTrick() >= target; }
+            if (not m_isMiser) {
+                auto [lower, whistersTricks] = topTrumpTricks();
+                auto upper = tricksLeft() - whistersTricks;
+                if (isDeclarer(m_leader)) {
+                    lower = std::max(lower, quickTricks());
+                } else {
+                    upper = std::min(upper, tricksLeft() - quickTricks());
+                }
+                if (lower >= target) { return true; }
+                if (upper < target) { return false; }
+            }
+            key = normalized();
+            const auto& entry = probe(key->first, key->second);
+            if (entry.lower >= target) { return true; }
+            if (entry.upper < target) { return false; }
+            hint = entry.move;
+        }
+        const auto seat = seatToMove();
+        const auto isMaximizing = isDeclarer(seat) != m_isMiser;
+        auto moves = std::array<CardId, DeckSize>{};
+        const auto count = orderedMoves(seat, hint, moves);
+        auto result = not isMaximizing;
+        auto move = std::optional<CardId>{};
+        for (auto i = std::size_t{}; i < count and result != isMaximizing; ++i) {
+            result = play(moves[i], target);
+            move = moves[i];
+        }
+        if (key) {
+            auto& entry = probe(key->first, key->second); // the search above may have taken the slot
+            if (result) {
+                entry.lower = static_cast<std::uint8_t>(std::max(static_cast<int>(entry.lower), target)) & 0xFU;
+            } else {
+                entry.upper = static_cast<std::uint8_t>(std::min(static_cast<int>(entry.upper), target - 1)) & 0xFU;
+            }
+            if (result == isMaximizing) { entry.move = std::to_underlying(*move) & 0x3FU; }
+        }
+        return result;
+    }
+
+    // The exact number of tricks, from 0 to `tricks`, by the null-window searches stepping from the guess: the
+    // declarers usually take about what they bid, and each step reuses the bounds cached by the one before
+    [[nodiscard]] auto exactTricks(const int tricks, const std::invocable<int> auto& reaches) const -> int
+    {
+        auto result = std::clamp(m_guess, 1, std::max(tricks, 1));
+        if (reaches(result)) {
+            while (result < tricks and reaches(result + 1)) { ++result; }
+            return result;
+        }
+        while (--result > 0 and not reaches(result)) {}
+        return result;
+    }
+
+    std::vector<Entry> m_table;
+    std::size_t m_tableMask{};
+    std::uint16_t m_generation = 1; // of the entries in use, the empty ones have none
+    std::optional<Suit> m_trump;
+    Seat m_declarer{};
+    bool m_isMiser{};
+    std::array<CardMask, NumberOfPlayers> m_hands;
+    std::array<CardId, NumberOfPlayers> m_trick{};
+    std::size_t m_played{};
+    std::uint32_t m_inPlay{}; // the cards in the hands and on the current trick
+    Seat m_leader{};
+    int m_guess{}; // of the declarer's tricks from the current trick on
+};
+
+} // namespace pref
@@ -5,29 +5,42 @@
 
 #include "common/common.hpp"
 #include "common/logger.hpp"
+#include "metrics.hpp"
 
 #include <asioexec/use_sender.hpp>
 #include <boost/asio.hpp>
-#include <boost/asio/experimental/channel.hpp> // IWYU pragma: keep
+#include <boost/asio/experimental/concurrent_channel.hpp> // IWYU pragma: keep
 #include <boost/beast.hpp>
+#include <boost/container/small_vector.hpp>
 #include <boost/system.hpp>
+#include <exec/async_scope.hpp>
 #include <exec/repeat_effect_until.hpp>
 #include <exec/task.hpp>
 #include <exec/variant_sender.hpp>
+#include <google/protobuf/io/coded_stream.h>
 #include <stdexec/execution.hpp>
 
 #ifdef PREF_SSL
 #include <boost/asio/ssl.hpp>
 #include <boost/asio/ssl/context.hpp>
 #include <boost/beast/websocket/ssl.hpp>
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <openssl/params.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
 #endif // PREF_SSL
 
 #include <cassert>
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <coroutine>
+#include <cstdint>
+#include <deque>
 #include <iterator>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <span>
 #include <stdexcept>
@@ -35,6 +48,7 @@
 #include <string_view>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 namespace net = boost::asio;
 namespace beast = boost::beast;
@@ -61,8 +75,196 @@ using Stream = web::stream<net::ssl::stream<beast::tcp_stream>>;
 using Stream = netx::use_sender_t::as_default_on_t<web::stream<beast::tcp_stream>>;
 #endif // PREF_SSL
 
-using Channel = netx::use_sender_t::as_default_on_t<net::experimental::channel<void(sys::error_code, std::string)>>;
+// a serialized message, shared by all its recipients down to the socket write
+using Frame = std::shared_ptr<const std::string>;
+
+// tables and sessions run on different shards, so the channel between them must be thread-safe
+using BasicChannel
+    = netx::use_sender_t::as_default_on_t<net::experimental::concurrent_channel<void(sys::error_code, Frame)>>;
+
+// What a table does with a frame for a client whose channel is full, i.e. a client that doesn't read fast enough
+enum class SlowConsumer {
+    Wait, // for room in the channel, which holds up the table
+    Drop, // the frame, the client is out of sync until it reconnects
+    Disconnect, // the client, it gets the whole state when it reconnects
+    Collapse, // never waits: the frames are set aside, a state message replacing the one of its method before it
+};
+
+[[nodiscard]] inline auto parseSlowConsumer(const std::string_view policy) noexcept -> std::optional<SlowConsumer>
+{
+    using enum SlowConsumer;
+    static constexpr auto policies = std::to_array<std::pair<std::string_view, SlowConsumer>>(
+        {{"wait", Wait}, {"drop", Drop}, {"disconnect", Disconnect}, {"collapse", Collapse}});
+    const auto it = rng::find(policies, policy, &std::pair<std::string_view, SlowConsumer>::first);
+    return it == rng::end(policies) ? std::nullopt : std::optional{it->second};
+}
+
+// permessage-deflate of the frames from `threshold` bytes on: the smaller ones gain less than the deflate block costs,
+// and the ones that don't compress go out in stored blocks, a few bytes over their size. Each connection keeps a
+// window of 2^windowBits bytes and a deflate state of about 2^(memLevel + 9) bytes
+struct Deflate {
+    std::size_t threshold{}; // 0 means no compression
+    int windowBits = 15; // 9 to 15
+    int memLevel = 8; // 1 to 9
+};
+
+[[nodiscard]] inline auto makeDeflateOption(const Deflate& deflate) -> web::permessage_deflate
+{
+    auto result = web::permessage_deflate{};
+    result.server_enable = deflate.threshold > 0;
+    result.server_max_window_bits = deflate.windowBits;
+    result.client_max_window_bits = deflate.windowBits; // the window we keep to inflate the client's frames
+    result.memLevel = deflate.memLevel;
+    result.msg_size_threshold = deflate.threshold;
+    return result;
+}
+
+// The relayed frames a client may have waiting, and how many bytes of them go out in a row between the game frames
+inline constexpr auto RelayQueueSize = 64uz;
+inline constexpr auto RelayWriteSize = 16uz * 1024;
+// The frames set aside for a full channel under SlowConsumer::Collapse before its client is disconnected
+inline constexpr auto SetAsideSize = 64uz;
+
+// The body is the only field of a Message, so the first tag of a serialized one is the body's
+[[nodiscard]] inline auto bodyCaseOf(const std::string_view payload) noexcept -> Message::BodyCase
+{
+    auto key = std::uint64_t{};
+    for (auto i = 0uz; i < std::min(std::size(payload), 5uz); ++i) {
+        const auto byte = static_cast<std::uint8_t>(payload[i]);
+        key |= static_cast<std::uint64_t>(byte & 0x7Fu) << (7 * i);
+        if ((byte & 0x80u) == 0) { break; }
+    }
+    return static_cast<Message::BodyCase>(key >> 3);
+}
+
+// The state messages that a later one of the same method replaces as a whole
+inline constexpr auto SupersededMethods = std::array{Message::kGameState};
+
+// Counts the frames it holds for the metrics, asio's channels don't tell, and knows how its client is sent to. The
+// relayed frames, the players' voice signaling and chat, wait in a queue of their own that the sender only drains
+// when no game frame is waiting, so that they never delay a move
+class Channel : public BasicChannel {
+public:
+    using BasicChannel::BasicChannel;
+
+    // Never waits: false when the relay queue is full and the frame is dropped
+    auto relay(Frame frame) -> bool
+    {
+        auto isFirst = false;
+        {
+            const auto lock = std::scoped_lock{m_relayMutex};
+            if (not is_open() or std::size(m_relayed) >= RelayQueueSize) { return false; }
+            isFirst = std::empty(m_relayed);
+            m_relayed.push_back(std::move(frame));
+        }
+        if (isFirst) {
+            // an empty frame wakes the sender, a full channel doesn't need it: the sender looks past its game frames
+            queue();
+            if (not try_send(sys::error_code{}, Frame{})) { unqueue(); }
+        }
+        return true;
+    }
+
+    // SlowConsumer::Collapse, never waits: once the channel is full the frames are set aside in order until the sender
+    // takes them, so that the later ones never overtake them. False when too many are set aside already
+    auto sendOrSetAside(Frame frame) -> bool
+    {
+        const auto lock = std::scoped_lock{m_setAsideMutex};
+        if (std::empty(m_setAside)) {
+            queue();
+            if (try_send(sys::error_code{}, frame)) { return true; }
+            unqueue();
+            localMetrics().channelFull.add(1);
+        }
+        const auto tag = bodyCaseOf(*frame);
+        if (rng::contains(SupersededMethods, tag)) {
+            if (const auto it = rng::find(m_setAside, tag, [](const Frame& f) { return bodyCaseOf(*f); });
+                it != std::end(m_setAside)) {
+                m_setAside.erase(it);
+                localMetrics().framesCollapsed.add(1);
+            }
+        } else if (std::size(m_setAside) >= SetAsideSize) {
+            return false;
+        }
+        m_setAside.push_back(std::move(frame));
+        return true;
+    }
+
+    [[nodiscard]] auto hasSetAside() -> bool
+    {
+        const auto lock = std::scoped_lock{m_setAsideMutex};
+        return not std::empty(m_setAside);
+    }
+
+    auto takeSetAside(std::vector<Frame>& frames) -> void
+    {
+        const auto lock = std::scoped_lock{m_setAsideMutex};
+        rng::move(m_setAside, std::back_inserter(frames));
+        m_setAside.clear();
+    }
+
+    [[nodiscard]] auto hasRelayed() -> bool
+    {
+        const auto lock = std::scoped_lock{m_relayMutex};
+        return not std::empty(m_relayed);
+    }
+
+    // the oldest relayed frames, up to `bytes` of them unless the first one is bigger
+    auto takeRelayed(std::vector<Frame>& frames, const std::size_t bytes) -> void
+    {
+        const auto lock = std::scoped_lock{m_relayMutex};
+        for (auto size = 0uz; not std::empty(m_relayed) and (std::empty(frames) or size < bytes);) {
+            size += std::size(*m_relayed.front());
+            frames.push_back(std::move(m_relayed.front()));
+            m_relayed.pop_front();
+        }
+    }
+
+    // before the frame is sent, so that its receiver never takes the count below zero
+    auto queue() noexcept -> void
+    {
+        localMetrics().channelDepth.observe(m_queued.fetch_add(1, std::memory_order_relaxed));
+    }
+
+    auto unqueue(const std::uint64_t frames = 1) noexcept -> void
+    {
+        m_queued.fetch_sub(frames, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] auto slowConsumer() const noexcept -> SlowConsumer
+    {
+        return m_slowConsumer;
+    }
+
+    // before the channel is shared with the tables
+    auto setSlowConsumer(const SlowConsumer policy) noexcept -> void
+    {
+        m_slowConsumer = policy;
+    }
+
+    // whether the client reads Batch frames, negotiated at login
+    [[nodiscard]] auto batches() const noexcept -> bool
+    {
+        return m_batches.load(std::memory_order_relaxed);
+    }
+
+    auto setBatches(const bool batches) noexcept -> void
+    {
+        m_batches.store(batches, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<std::uint64_t> m_queued;
+    std::atomic<bool> m_batches;
+    SlowConsumer m_slowConsumer = SlowConsumer::Wait;
+    std::mutex m_relayMutex;
+    std::deque<Frame> m_relayed; // under the mutex
+    std::mutex m_setAsideMutex;
+    std::deque<Frame> m_setAside; // under the mutex
+};
+
 using ChannelPtr = std::shared_ptr<Channel>;
+using Channels = boost::container::small_vector<ChannelPtr, NumberOfPlayers>;
 using SteadyTimer = net::as_tuple_t<netx::use_sender_t>::as_default_on_t<net::steady_timer>;
 using Acceptor = netx::use_sender_t::as_default_on_t<tcp::acceptor>;
 using SignalSet = net::as_tuple_t<netx::use_sender_t>::as_default_on_t<net::signal_set>;
@@ -121,34 +323,221 @@ inline constexpr auto Detached = [](const std::string_view func) {
 };
 
 #ifdef PREF_SSL
+// The keys of the session tickets, so that a client reconnecting after a deploy or a network change resumes its
+// session instead of a full handshake. A new key encrypts the tickets every TicketKeyLifetime, and the previous one
+// still decrypts those issued before, which then are renewed
+class TicketKeys {
+public:
+    static constexpr auto TicketKeyLifetime = std::chrono::hours{12};
+
+    // SSL_CTX_set_tlsext_ticket_key_evp_cb's callback, 1 for an encrypted ticket or a current key, 2 for a key to
+    // replace, 0 for an unknown key and a full handshake
+    static auto callback(SSL*, unsigned char* name, unsigned char* iv, EVP_CIPHER_CTX* cipher, EVP_MAC_CTX* mac,
+        const int isEncrypting) -> int
+    {
+        auto& keys = instance();
+        const auto lock = std::scoped_lock{keys.m_mutex};
+        keys.rotate(std::chrono::steady_clock::now());
+        const auto* const key = isEncrypting ? &keys.m_current : keys.find(name);
+        if (not key) { return 0; }
+        if (isEncrypting) {
+            if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1) { return -1; }
+            rng::copy(key->name, name);
+        }
+        auto params = std::array{
+            OSSL_PARAM_construct_octet_string(
+                OSSL_MAC_PARAM_KEY, const_cast<unsigned char*>(std::data(key->hmac)), std::size(key->hmac)),
+            OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0),
+            OSSL_PARAM_construct_end()};
+        const auto isInitialized = isEncrypting
+            ? EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, std::data(key->aes), iv)
+            : EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, std::data(key->aes), iv);
+        if (isInitialized != 1 or EVP_MAC_CTX_set_params(mac, std::data(params)) != 1) { return -1; }
+        return (isEncrypting or key == &keys.m_current) ? 1 : 2;
+    }
+
+private:
+    static constexpr auto KeyNameSize = 16uz;
+
+    struct Key {
+        std::array<unsigned char, KeyNameSize> name{};
+        std::array<unsigned char, 32> aes{};
+        std::array<unsigned char, 32> hmac{};
+        std::chrono::steady_clock::time_point created;
+    };
+
+    [[nodiscard]] static auto instance() -> TicketKeys&
+    {
+        static auto keys = TicketKeys{};
+        return keys;
+    }
+
+    [[nodiscard]] static auto makeKey(const std::chrono::steady_clock::time_point now) -> Key
+    {
+        auto result = Key{.created = now};
+        if (RAND_bytes(std::data(result.name), std::size(result.name)) != 1
+            or RAND_bytes(std::data(result.aes), std::size(result.aes)) != 1
+            or RAND_bytes(std::data(result.hmac), std::size(result.hmac)) != 1) {
+            throw std::runtime_error{"no random bytes for a session ticket key"};
+        }
+        return result;
+    }
+
+    TicketKeys()
+        : m_current{makeKey(std::chrono::steady_clock::now())}
+    {
+    }
+
+    [[nodiscard]] auto find(const unsigned char* const name) const -> const Key*
+    {
+        const auto isNamed = [name = std::span{name, KeyNameSize}](const Key& key) {
+            return rng::equal(key.name, name);
+        };
+        if (isNamed(m_current)) { return &m_current; }
+        if (m_previous and isNamed(*m_previous)) { return &*m_previous; }
+        return nullptr;
+    }
+
+    auto rotate(const std::chrono::steady_clock::time_point now) -> void
+    {
+        if (now - m_current.created < TicketKeyLifetime) { return; }
+        m_previous = std::exchange(m_current, makeKey(now));
+        PREF_I("session ticket key rotated");
+    }
+
+    std::mutex m_mutex;
+    Key m_current;
+    std::optional<Key> m_previous;
+};
+
+// TLS 1.2 and 1.3. The sessions resume from a ticket, or from the cache shared by all the acceptors for the clients
+// that don't take tickets
 [[nodiscard]] inline auto loadCertificate(const fs::path& cert, const fs::path& key, const fs::path& dh)
     -> net::ssl::context
 {
-    auto ssl = net::ssl::context{net::ssl::context::tlsv12};
+    static constexpr auto sessionCacheSize = 20'000;
+    static constexpr auto sessionLifetime = std::chrono::seconds{TicketKeys::TicketKeyLifetime};
+    static constexpr auto sessionIdContext = std::string_view{"preferans-server"};
+    auto ssl = net::ssl::context{net::ssl::context::tls_server};
     ssl.set_options(
-        net::ssl::context::default_workarounds | net::ssl::context::no_sslv2 | net::ssl::context::single_dh_use);
+        net::ssl::context::default_workarounds
+        | net::ssl::context::no_sslv2
+        | net::ssl::context::no_sslv3
+        | net::ssl::context::no_tlsv1
+        | net::ssl::context::no_tlsv1_1
+        | net::ssl::context::single_dh_use);
     ssl.use_certificate_chain_file(cert);
     ssl.use_private_key_file(key, net::ssl::context::file_format::pem);
-    ssl.use_tmp_dh_file(dh);
+    ssl.use_tmp_dh_file(dh); // for the TLS 1.2 DHE suites
+    auto* const handle = ssl.native_handle();
+    SSL_CTX_set_session_cache_mode(handle, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(handle, sessionCacheSize);
+    SSL_CTX_set_timeout(handle, static_cast<long>(sessionLifetime.count()));
+    SSL_CTX_set_session_id_context(
+        handle, reinterpret_cast<const unsigned char*>(std::data(sessionIdContext)), std::size(sessionIdContext));
+    SSL_CTX_set_num_tickets(handle, 1); // TLS 1.3 sends them after the handshake, one is enough to reconnect
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(handle, &TicketKeys::callback);
     return ssl;
 }
 #endif // PREF_SSL
 
+// Every acceptor listens on a socket of its own: with SO_REUSEPORT the kernel spreads the connections over them
+[[nodiscard]] inline auto makeAcceptor(net::any_io_executor ex, const tcp::endpoint& endpoint) -> Acceptor
+{
+    using ReusePort = net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+    auto result = Acceptor{std::move(ex)};
+    result.open(endpoint.protocol());
+    result.set_option(tcp::acceptor::reuse_address{true});
+    result.set_option(ReusePort{true});
+    result.bind(endpoint);
+    result.listen();
+    return result;
+}
+
 template<typename Rep, typename Period>
 auto sleepFor(const std::chrono::duration<Rep, Period> duration, net::any_io_executor ex) -> task<>
 {
     co_await SteadyTimer{ex, duration}.async_wait();
 }
 
-inline auto sendToOne(const ChannelPtr& ch, std::string payload) -> task<>
+[[nodiscard]] inline auto makeFrame(std::string payload) -> Frame
+{
+    return std::make_shared<const std::string>(std::move(payload));
+}
+
+inline auto disconnectSlowConsumer(Channel& ch) -> void
+{
+    localMetrics().slowConsumersDisconnected.add(1);
+    ch.close(); // the session's sender closes the WebSocket
+}
+
+// Applies the SlowConsumer policy of a full channel, true when the frame has to wait for room in it
+[[nodiscard]] inline auto waitsForRoom(Channel& ch) -> bool
+{
+    if (not ch.is_open()) { return false; } // disconnected already
+    localMetrics().channelFull.add(1);
+    switch (ch.slowConsumer()) {
+    case SlowConsumer::Wait: return true;
+    case SlowConsumer::Drop: localMetrics().framesDropped.add(1); return false;
+    case SlowConsumer::Disconnect: disconnectSlowConsumer(ch); return false;
+    case SlowConsumer::Collapse: return false; // set aside before the channel is found full, see trySend
+    }
+    return true;
+}
+
+// Hands the frame to the channel, or applies the SlowConsumer policy when it is full. True when the frame has to wait
+// for room in it, it is counted as queued then
+[[nodiscard]] inline auto trySend(Channel& ch, const Frame& frame) -> bool
+{
+    if (ch.slowConsumer() == SlowConsumer::Collapse) {
+        if (not ch.sendOrSetAside(frame) and ch.is_open()) { disconnectSlowConsumer(ch); }
+        return false;
+    }
+    ch.queue();
+    if (ch.try_send(sys::error_code{}, frame)) { return false; }
+    if (not waitsForRoom(ch)) {
+        ch.unqueue();
+        return false;
+    }
+    return true;
+}
+
+// The frame is queued already
+inline auto sendWhenRoom(const ChannelPtr& ch, Frame frame) -> task<>
+{
+    if (const auto [error] = co_await ch->async_send({}, std::move(frame), net::as_tuple); error) {
+        ch->unqueue();
+        PREF_DW(error);
+    };
+}
+
+inline auto sendFrame(const ChannelPtr& ch, Frame frame) -> task<>
 {
     assert(ch);
-    if (const auto [error] = co_await ch->async_send({}, std::move(payload), net::as_tuple); error) { PREF_DW(error); };
+    if (trySend(*ch, frame)) { co_await sendWhenRoom(ch, std::move(frame)); }
+}
+
+inline auto sendToOne(const ChannelPtr& ch, std::string payload) -> task<>
+{
+    return sendFrame(ch, makeFrame(std::move(payload)));
+}
+
+// One slow player with a full channel mustn't hold up the others: the frame is handed to every channel with room
+// right away and only the full ones are awaited, concurrently
+inline auto sendToMany(const Channels& channels, const Frame frame) -> task<>
+{
+    auto scope = ex::async_scope{};
+    const auto sch = co_await stdx::get_scheduler();
+    for (const auto& ch : channels) {
+        assert(ch);
+        if (trySend(*ch, frame)) { scope.spawn(stdx::starts_on(sch, sendWhenRoom(ch, frame))); }
+    }
+    co_await scope.on_empty();
 }
 
-inline auto sendToMany(const std::span<const ChannelPtr> channels, std::string payload) -> task<>
+inline auto sendToMany(const Channels& channels, std::string payload) -> task<>
 {
-    for (const auto& ch : channels) { co_await sendToOne(ch, payload); }
+    return sendToMany(channels, makeFrame(std::move(payload)));
 }
 
 struct Connection {
@@ -183,7 +572,8 @@ struct Connection {
     std::optional<SteadyTimer> reconnectTimer;
 };
 
-inline auto sendOrClose(Stream& ws, std::string payload) -> task<bool>
+// The caller keeps the payload alive until the write completes
+inline auto sendOrClose(Stream& ws, const std::string_view payload) -> task<bool>
 {
     assert(not std::empty(payload));
     if (payload.front() == '\0') {
@@ -193,20 +583,137 @@ inline auto sendOrClose(Stream& ws, std::string payload) -> task<bool>
         co_return true;
     }
     assert(ws.is_open());
+    const auto started = MetricsClock::now();
     co_await ws.async_write(net::buffer(payload), netx::use_sender);
+    observeSince(localMetrics().writes, started);
+    co_return false;
+}
+
+// The size of a length-delimited field's tag and size
+[[nodiscard]] inline auto fieldHeaderSize(const int field, const std::size_t size) noexcept -> std::size_t
+{
+    using Coded = google::protobuf::io::CodedOutputStream;
+    return Coded::VarintSize32(static_cast<std::uint32_t>(field) << 3) + Coded::VarintSize64(size);
+}
+
+// Appends the tag and the size of a length-delimited field, its bytes are to follow
+inline auto appendFieldHeader(std::string& out, const int field, const std::size_t size) -> void
+{
+    const auto appendVarint = [&out](std::uint64_t value) {
+        for (; value >= 0x80; value >>= 7) { out.push_back(static_cast<char>((value & 0x7F) | 0x80)); }
+        out.push_back(static_cast<char>(value));
+    };
+    static constexpr auto lengthDelimited = 2u;
+    appendVarint((static_cast<std::uint64_t>(field) << 3) | lengthDelimited);
+    appendVarint(size);
+}
+
+// Appends a length-delimited field: its tag, its size and its bytes
+inline auto appendField(std::string& out, const int field, const std::string_view bytes) -> void
+{
+    appendFieldHeader(out, field, std::size(bytes));
+    out.append(bytes);
+}
+
+// A serialized Message{batch: Batch{messages}} made of the serialized messages as they are, without parsing them.
+// It's written into `out`, the sender's buffer that keeps its capacity from a batch to the next one
+inline auto makeBatch(const std::span<const Frame> frames, std::string& out) -> std::string_view
+{
+    auto size = 0uz;
+    for (const auto& frame : frames) {
+        size += fieldHeaderSize(Batch::kMessagesFieldNumber, std::size(*frame)) + std::size(*frame);
+    }
+    out.clear();
+    out.reserve(fieldHeaderSize(Message::kBatchFieldNumber, size) + size);
+    appendFieldHeader(out, Message::kBatchFieldNumber, size);
+    for (const auto& frame : frames) { appendField(out, Batch::kMessagesFieldNumber, *frame); }
+    return out;
+}
+
+// Keeps the last of each of the SupersededMethods, the rest of the frames as they are
+inline auto collapseSuperseded(std::vector<Frame>& frames) -> void
+{
+    auto isReplaced = std::array<bool, MessageTagsCount>{};
+    auto kept = std::vector<Frame>{};
+    kept.reserve(std::size(frames));
+    for (auto& frame : frames | rv::reverse) {
+        const auto tag = bodyCaseOf(*frame);
+        if (rng::contains(SupersededMethods, tag) and std::exchange(isReplaced[static_cast<std::size_t>(tag)], true)) {
+            localMetrics().framesCollapsed.add(1);
+            continue;
+        }
+        kept.push_back(std::move(frame));
+    }
+    rng::reverse(kept);
+    frames = std::move(kept);
+}
+
+inline constexpr auto MaxBatchSize = 64uz * 1024;
+
+// The frames that were queued together go out together: in Batch frames to the clients reading them, frame by frame
+// to the others. True when the stream is closed
+inline auto sendFrames(Stream& ws, const Channel& ch, std::vector<Frame>& frames, std::string& batch) -> task<bool>
+{
+    if (ch.slowConsumer() == SlowConsumer::Collapse) { collapseSuperseded(frames); }
+    const auto isBatched = ch.batches();
+    for (auto first = std::begin(frames); first != std::end(frames);) {
+        // a batch ends before a close frame and once it's big enough
+        auto last = first;
+        for (auto size = 0uz; isBatched and last != std::end(frames) and not (*last)->starts_with('\0')
+             and size < MaxBatchSize;
+             ++last) {
+            size += std::size(**last);
+        }
+        if (last == first) { ++last; } // a close frame, or not batched
+        const auto payload = (std::next(first) == last) ? std::string_view{**first} : makeBatch({first, last}, batch);
+        if (co_await sendOrClose(ws, payload)) { co_return true; }
+        first = last;
+    }
     co_return false;
 }
 
+inline auto sendQueued(Stream& ws, Channel& ch) -> task<>
+{
+    auto frames = std::vector<Frame>{};
+    auto batch = std::string{};
+    while (true) {
+        if (not ch.ready() and ch.hasSetAside()) { // after the frames queued before them
+            ch.takeSetAside(frames);
+            if (co_await sendFrames(ws, ch, frames, batch)) { co_return; }
+            frames.clear();
+            continue;
+        }
+        if (not ch.ready() and ch.hasRelayed()) { // the game frames go first
+            ch.takeRelayed(frames, RelayWriteSize);
+            if (co_await sendFrames(ws, ch, frames, batch)) { co_return; }
+            frames.clear();
+            continue;
+        }
+        auto [error, frame] = co_await ch.async_receive(net::as_tuple);
+        if (error) {
+            // closed by a table for SlowConsumer::Disconnect, cancelled when the session ends
+            if (error == net::experimental::error::channel_closed and ws.is_open()) {
+                co_await ws.async_close({web::close_code::policy_error, "Too slow"}, netx::use_sender);
+            }
+            co_return;
+        }
+        auto received = 1uz;
+        if (frame) { frames.push_back(std::move(frame)); } // an empty one rings for the relayed frames
+        while (ch.try_receive([&frames, &received](const sys::error_code&, Frame queued) {
+            ++received;
+            if (queued) { frames.push_back(std::move(queued)); }
+        })) { }
+        ch.unqueue(received);
+        if (co_await sendFrames(ws, ch, frames, batch)) { co_return; }
+        frames.clear();
+    }
+}
+
 inline auto payloadSender(Stream& ws, Channel& ch) -> stdx::sender auto
 {
     PREF_I();
-    return ex::repeat_effect_until(
-        ch.async_receive()
-        | stdx::let_value([&ws](std::string payload) { return sendOrClose(ws, std::move(payload)); })
-        | stdx::upon_error([](const std::exception_ptr& error) {
-              PrintError("payloadSender", error);
-              return true;
-          }));
+    return sendQueued(ws, ch)
+        | stdx::upon_error([](const std::exception_ptr& error) { PrintError("payloadSender", error); });
 }
 
 } // namespace pref
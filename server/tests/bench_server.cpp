@@ -0,0 +1,239 @@
+// SPDX-License-Identifier: AGPL-3.0-only
+// Copyright (c) 2025 Oleksandr Kozlov
+
+#include "common/common.hpp"
+#include "rules.hpp"
+#include "serialization.hpp"
+#include "server.hpp"
+#include "solver.hpp"
+
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_all.hpp>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace pref {
+namespace {
+
+// the builders log what they make, which would be measured instead of them
+class QuietLog : public Catch::EventListenerBase {
+public:
+    using EventListenerBase::EventListenerBase;
+
+    auto testRunStarting(const Catch::TestRunInfo&) -> void override
+    {
+        spdlog::set_level(spdlog::level::warn);
+    }
+};
+
+CATCH_REGISTER_LISTENER(QuietLog)
+
+const auto PlayerIds = std::array<PlayerId, NumberOfPlayers>{"p0", "p1", "p2"};
+
+// A score sheet after the deals, the values in the range they have in a game
+[[nodiscard]] auto makeScoreSheet(const int deals) -> ScoreSheet
+{
+    auto random = std::mt19937{42};
+    auto value = std::uniform_int_distribution{0, 20};
+    auto result = ScoreSheet{};
+    for (const auto& playerId : PlayerIds) {
+        auto& score = result[playerId];
+        for (auto deal = 0; deal < deals; ++deal) {
+            score.dump.push_back(value(random));
+            score.pool.push_back(value(random));
+            for (const auto& otherId : PlayerIds) {
+                if (otherId != playerId) { score.whists[otherId].push_back(value(random)); }
+            }
+        }
+    }
+    return result;
+}
+
+// Tricks of random cards from the shuffled deck, so that their suits vary like in a game
+[[nodiscard]] auto makeTricks(const std::size_t count) -> std::vector<std::vector<PlayedCard>>
+{
+    auto random = std::mt19937{42};
+    auto deck = std::vector<CardId>(DeckSize);
+    for (auto i = 0uz; i < DeckSize; ++i) { deck[i] = static_cast<CardId>(i); }
+    auto result = std::vector<std::vector<PlayedCard>>{};
+    while (std::size(result) < count) {
+        std::ranges::shuffle(deck, random);
+        for (auto i = 0uz; i + NumberOfPlayers <= DeckSize and std::size(result) < count; i += NumberOfPlayers) {
+            auto& trick = result.emplace_back();
+            for (auto seat = 0uz; seat < NumberOfPlayers; ++seat) {
+                trick.push_back({.playerId = PlayerIds[seat], .card = deck[i + seat]});
+            }
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+TEST_CASE("scoring")
+{
+    const auto deals = GENERATE(1, 10, 50);
+    const auto sheet = makeScoreSheet(deals);
+    const auto finalScore = makeFinalScore(sheet);
+    const auto suffix = " of " + std::to_string(deals) + " deals";
+
+    BENCHMARK("makeFinalScore" + suffix)
+    {
+        return makeFinalScore(sheet);
+    };
+    BENCHMARK("calculateFinalResult" + suffix)
+    {
+        return calculateFinalResult(finalScore);
+    };
+    BENCHMARK("makeDealFinished" + suffix)
+    {
+        return makeDealFinished(sheet, false);
+    };
+}
+
+TEST_CASE("deal")
+{
+    using enum WhistingChoice;
+    const auto takenTricks = std::array<std::pair<PlayerId, int>, NumberOfPlayers>{
+        std::pair{PlayerIds[0], 5}, std::pair{PlayerIds[1], 3}, std::pair{PlayerIds[2], 2}};
+
+    BENCHMARK("six, two whisters")
+    {
+        return calculateDealScore(
+            {.id = "p0", .contractLevel = ContractLevel::Six, .tricksTaken = 5},
+            {{.id = "p1", .choice = Whist, .tricksTaken = 3}, {.id = "p2", .choice = Whist, .tricksTaken = 2}});
+    };
+    BENCHMARK("miser")
+    {
+        return calculateDealScore(
+            {.id = "p0", .contractLevel = ContractLevel::Miser, .tricksTaken = 1},
+            {{.id = "p1", .choice = Whist, .tricksTaken = 4}, {.id = "p2", .choice = Whist, .tricksTaken = 5}});
+    };
+    BENCHMARK("makeTrickFinished")
+    {
+        return makeTrickFinished(takenTricks);
+    };
+}
+
+TEST_CASE("rules")
+{
+    const auto tricks = makeTricks(1024);
+    const auto trumps = std::array<std::optional<Suit>, 2>{std::nullopt, Suit::Hearts};
+
+    BENCHMARK("beats, 1024 tricks")
+    {
+        auto wins = 0;
+        for (const auto& trick : tricks) {
+            for (const auto trump : trumps) {
+                wins += beats({.candidate = trick[1].card,
+                               .best = trick[0].card,
+                               .leadSuit = suitOf(trick[0].card),
+                               .trump = trump});
+            }
+        }
+        return wins;
+    };
+    BENCHMARK("decideTrickWinner, 1024 tricks")
+    {
+        auto winners = std::size_t{};
+        for (const auto& trick : tricks) { winners += std::size(decideTrickWinner(trick, Suit::Hearts)); }
+        return winners;
+    };
+    BENCHMARK("getTrump, all bids")
+    {
+        auto trumps = std::size_t{};
+        for (const std::string_view bid : BidsRank) { trumps += std::size(getTrump(bid)); }
+        return trumps;
+    };
+    BENCHMARK("progressionTerm, 20 terms")
+    {
+        auto sum = 0;
+        for (auto n = 1; n <= 20; ++n) {
+            sum += progressionTerm(n, {.prog = Progression::Arithmetic, .first = 1, .step = 1});
+        }
+        return sum;
+    };
+}
+
+TEST_CASE("solver")
+{
+    auto random = std::mt19937{42};
+    auto deck = std::vector<CardId>(DeckSize);
+    for (auto i = 0uz; i < DeckSize; ++i) { deck[i] = static_cast<CardId>(i); }
+    std::ranges::shuffle(deck, random);
+    auto position = DealPosition{};
+    for (auto i = 0uz; i < NumberOfPlayers * 10; ++i) { position.hands[i % NumberOfPlayers].insert(deck[i]); }
+
+    // a new solver each time, so that nothing is left cached by the run before
+    const auto solve = [&](const std::optional<Suit> trump, const ContractLevel level) {
+        position.trump = trump;
+        position.contractLevel = level;
+        auto solver = DoubleDummySolver{};
+        return solver.solve(position);
+    };
+    BENCHMARK("solve, 10 tricks, trump")
+    {
+        return solve(Suit::Spades, ContractLevel::Six);
+    };
+    BENCHMARK("solve, 10 tricks, no trump")
+    {
+        return solve(std::nullopt, ContractLevel::Six);
+    };
+    BENCHMARK("solve, 10 tricks, miser")
+    {
+        return solve(std::nullopt, ContractLevel::Miser);
+    };
+}
+
+TEST_CASE("serialization")
+{
+    const auto format = GENERATE(WireFormat::WIRE_TEXT, WireFormat::WIRE_COMPACT);
+    const auto suffix = std::string{format == WireFormat::WIRE_COMPACT ? ", compact" : ", text"};
+    const auto hand = CardMask{
+        makeCard(Rank::Seven, Suit::Spades),
+        makeCard(Rank::Ace, Suit::Spades),
+        makeCard(Rank::Nine, Suit::Clubs),
+        makeCard(Rank::Ten, Suit::Clubs),
+        makeCard(Rank::Jack, Suit::Diamonds),
+        makeCard(Rank::Queen, Suit::Diamonds),
+        makeCard(Rank::King, Suit::Diamonds),
+        makeCard(Rank::Eight, Suit::Hearts),
+        makeCard(Rank::Nine, Suit::Hearts),
+        makeCard(Rank::Ace, Suit::Hearts)};
+    const auto talon = std::array{makeCard(Rank::Seven, Suit::Hearts), makeCard(Rank::King, Suit::Clubs)};
+    const auto takenTricks = std::array<std::pair<PlayerId, int>, NumberOfPlayers>{
+        std::pair{PlayerIds[0], 4}, std::pair{PlayerIds[1], 3}, std::pair{PlayerIds[2], 1}};
+
+    BENCHMARK("makeDealCards" + suffix)
+    {
+        return makeDealCards(PlayerIds[0], hand, format);
+    };
+    BENCHMARK("makePlayerTurn" + suffix)
+    {
+        return makePlayerTurn(PlayerIds[1], GameStage::BIDDING, PREF_SIX PREF_SPADE, false, 0, talon, format);
+    };
+    BENCHMARK("makeBidding" + suffix)
+    {
+        return makeBidding(PlayerIds[2], PREF_SEVEN PREF_HEART, format);
+    };
+    BENCHMARK("makePlayCard" + suffix)
+    {
+        return makePlayCard(PlayerIds[0], makeCard(Rank::Queen, Suit::Diamonds), format);
+    };
+    BENCHMARK("makeGameState" + suffix)
+    {
+        return makeGameState(talon, takenTricks, takenTricks, format);
+    };
+}
+
+} // namespace pref
@@ -2,17 +2,30 @@
 // Copyright (c) 2025 Oleksandr Kozlov
 
 #include "auth.hpp"
+#include "bot.hpp"
 #include "common/common.hpp"
+#include "common/wire.hpp"
+#include "metrics.hpp"
+#include "serialization.hpp"
 #include "server.hpp"
+#include "solver.hpp"
+#include "transport.hpp"
 
 #include <catch2/catch_all.hpp>
+#include <spdlog/spdlog.h>
 
+#include <chrono>
 #include <cstdint>
+#include <filesystem>
 #include <iterator>
 #include <map>
+#include <optional>
+#include <random>
 #include <span>
+#include <stdexcept>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <tuple>
 #include <utility>
 #include <vector>
@@ -32,6 +45,20 @@ struct Catch::StringMaker<std::map<pref::Player::Id, pref::DealScoreEntry>> {
     }
 };
 
+// counts how many times it's formatted
+struct Formatted {
+    int* count{};
+};
+
+template<>
+struct fmt::formatter<Formatted> : fmt::formatter<std::string_view> {
+    auto format(const Formatted& formatted, fmt::format_context& ctx) const
+    {
+        ++*formatted.count;
+        return fmt::formatter<std::string_view>::format("formatted", ctx);
+    }
+};
+
 namespace pref {
 
 // clang-format off
@@ -39,53 +66,116 @@ TEST_CASE("server")
 {
     SECTION("beats")
     {
-        REQUIRE_FALSE(beats({.candidate = PREF_SEVEN PREF_OF_ PREF_HEARTS, .best = PREF_EIGHT PREF_OF_ PREF_HEARTS, .leadSuit = PREF_HEARTS, .trump = PREF_SPADES}));
-        REQUIRE_FALSE(beats({.candidate = PREF_SEVEN PREF_OF_ PREF_HEARTS, .best = PREF_SEVEN PREF_OF_ PREF_HEARTS, .leadSuit = PREF_HEARTS, .trump = PREF_SPADES}));
-        REQUIRE_FALSE(beats({.candidate = PREF_SEVEN PREF_OF_ PREF_HEARTS, .best = PREF_SEVEN PREF_OF_ PREF_SPADES, .leadSuit = PREF_HEARTS, .trump = PREF_SPADES}));
+        REQUIRE_FALSE(beats({.candidate = makeCard(Rank::Seven, Suit::Hearts), .best = makeCard(Rank::Eight, Suit::Hearts), .leadSuit = Suit::Hearts, .trump = Suit::Spades}));
+        REQUIRE_FALSE(beats({.candidate = makeCard(Rank::Seven, Suit::Hearts), .best = makeCard(Rank::Seven, Suit::Hearts), .leadSuit = Suit::Hearts, .trump = Suit::Spades}));
+        REQUIRE_FALSE(beats({.candidate = makeCard(Rank::Seven, Suit::Hearts), .best = makeCard(Rank::Seven, Suit::Spades), .leadSuit = Suit::Hearts, .trump = Suit::Spades}));
 
-        REQUIRE(beats({.candidate = PREF_EIGHT PREF_OF_ PREF_HEARTS, .best = PREF_SEVEN PREF_OF_ PREF_HEARTS, .leadSuit = PREF_HEARTS, .trump = PREF_SPADES}));
-        REQUIRE(beats({.candidate = PREF_SEVEN PREF_OF_ PREF_HEARTS, .best = PREF_SEVEN PREF_OF_ PREF_SPADES, .leadSuit = PREF_HEARTS, .trump = ""}));
-        REQUIRE(beats({.candidate = PREF_SEVEN PREF_OF_ PREF_SPADES, .best = PREF_EIGHT PREF_OF_ PREF_HEARTS, .leadSuit = PREF_HEARTS, .trump = PREF_SPADES}));
-        REQUIRE(beats({.candidate = PREF_SEVEN PREF_OF_ PREF_SPADES, .best = PREF_SEVEN PREF_OF_ PREF_HEARTS, .leadSuit = PREF_HEARTS, .trump = PREF_SPADES}));
+        REQUIRE(beats({.candidate = makeCard(Rank::Eight, Suit::Hearts), .best = makeCard(Rank::Seven, Suit::Hearts), .leadSuit = Suit::Hearts, .trump = Suit::Spades}));
+        REQUIRE(beats({.candidate = makeCard(Rank::Seven, Suit::Hearts), .best = makeCard(Rank::Seven, Suit::Spades), .leadSuit = Suit::Hearts, .trump = std::nullopt}));
+        REQUIRE(beats({.candidate = makeCard(Rank::Seven, Suit::Spades), .best = makeCard(Rank::Eight, Suit::Hearts), .leadSuit = Suit::Hearts, .trump = Suit::Spades}));
+        REQUIRE(beats({.candidate = makeCard(Rank::Seven, Suit::Spades), .best = makeCard(Rank::Seven, Suit::Hearts), .leadSuit = Suit::Hearts, .trump = Suit::Spades}));
     }
 
     SECTION("decideTrickWinner")
     {
         SECTION("higher rank wins last")
         {
-            REQUIRE(decideTrickWinner({{.playerId = "1", .name = PREF_SEVEN PREF_OF_ PREF_HEARTS},
-                                       {.playerId = "2", .name = PREF_EIGHT PREF_OF_ PREF_HEARTS},
-                                       {.playerId = "3", .name = PREF_NINE  PREF_OF_ PREF_HEARTS}}, PREF_SPADES) == "3");
+            REQUIRE(decideTrickWinner({{.playerId = "1", .card = makeCard(Rank::Seven, Suit::Hearts)},
+                                       {.playerId = "2", .card = makeCard(Rank::Eight, Suit::Hearts)},
+                                       {.playerId = "3", .card = makeCard(Rank::Nine,  Suit::Hearts)}}, Suit::Spades) == "3");
         }
 
         SECTION("higer rank wins first")
         {
-            REQUIRE(decideTrickWinner({{.playerId = "1", .name = PREF_NINE  PREF_OF_ PREF_HEARTS},
-                                       {.playerId = "2", .name = PREF_EIGHT PREF_OF_ PREF_HEARTS},
-                                       {.playerId = "3", .name = PREF_SEVEN PREF_OF_ PREF_HEARTS}}, PREF_SPADES) == "1");
+            REQUIRE(decideTrickWinner({{.playerId = "1", .card = makeCard(Rank::Nine,  Suit::Hearts)},
+                                       {.playerId = "2", .card = makeCard(Rank::Eight, Suit::Hearts)},
+                                       {.playerId = "3", .card = makeCard(Rank::Seven, Suit::Hearts)}}, Suit::Spades) == "1");
         }
 
         SECTION("trump wins")
         {
-            REQUIRE(decideTrickWinner({{.playerId = "1", .name = PREF_NINE  PREF_OF_ PREF_HEARTS},
-                                       {.playerId = "2", .name = PREF_SEVEN PREF_OF_ PREF_SPADES},
-                                       {.playerId = "3", .name = PREF_SEVEN PREF_OF_ PREF_HEARTS}}, PREF_SPADES) == "2");
+            REQUIRE(decideTrickWinner({{.playerId = "1", .card = makeCard(Rank::Nine,  Suit::Hearts)},
+                                       {.playerId = "2", .card = makeCard(Rank::Seven, Suit::Spades)},
+                                       {.playerId = "3", .card = makeCard(Rank::Seven, Suit::Hearts)}}, Suit::Spades) == "2");
         }
 
         SECTION ("first lead wins")
         {
-            REQUIRE(decideTrickWinner({{.playerId = "1", .name = PREF_SEVEN PREF_OF_ PREF_HEARTS},
-                                       {.playerId = "2", .name = PREF_SEVEN PREF_OF_ PREF_DIAMONDS},
-                                       {.playerId = "3", .name = PREF_SEVEN PREF_OF_ PREF_CLUBS}}, PREF_SPADES) == "1");
+            REQUIRE(decideTrickWinner({{.playerId = "1", .card = makeCard(Rank::Seven, Suit::Hearts)},
+                                       {.playerId = "2", .card = makeCard(Rank::Seven, Suit::Diamonds)},
+                                       {.playerId = "3", .card = makeCard(Rank::Seven, Suit::Clubs)}}, Suit::Spades) == "1");
         }
 
         SECTION("higher rank wins second without trump")
         {
-            REQUIRE(decideTrickWinner({{.playerId = "1", .name = PREF_SEVEN PREF_OF_ PREF_HEARTS},
-                                       {.playerId = "2", .name = PREF_EIGHT PREF_OF_ PREF_HEARTS},
-                                       {.playerId = "3", .name = PREF_EIGHT PREF_OF_ PREF_CLUBS}}, "") == "2");
+            REQUIRE(decideTrickWinner({{.playerId = "1", .card = makeCard(Rank::Seven, Suit::Hearts)},
+                                       {.playerId = "2", .card = makeCard(Rank::Eight, Suit::Hearts)},
+                                       {.playerId = "3", .card = makeCard(Rank::Eight, Suit::Clubs)}}, std::nullopt) == "2");
         }
     }
+
+    SECTION("CardMask")
+    {
+        const auto hand = CardMask{makeCard(Rank::Ace, Suit::Hearts), makeCard(Rank::Seven, Suit::Spades)};
+        REQUIRE(hand.size() == 2);
+        REQUIRE(hand.contains(makeCard(Rank::Ace, Suit::Hearts)));
+        REQUIRE_FALSE(hand.contains(makeCard(Rank::Ace, Suit::Spades)));
+        REQUIRE((hand & CardMask::of(Suit::Hearts)) == CardMask{makeCard(Rank::Ace, Suit::Hearts)});
+        REQUIRE((hand - CardMask::of(Suit::Hearts)) == CardMask{makeCard(Rank::Seven, Suit::Spades)});
+        REQUIRE(toCardsNames(hand) == CardsNames{PREF_SEVEN PREF_OF_ PREF_SPADES, PREF_ACE PREF_OF_ PREF_HEARTS});
+        REQUIRE(toCardId(PREF_QUEEN PREF_OF_ PREF_DIAMONDS) == makeCard(Rank::Queen, Suit::Diamonds));
+        REQUIRE_FALSE(toCardId("joker").has_value());
+    }
+
+    SECTION("wire encoding")
+    {
+        REQUIRE(toWireCard(makeCard(Rank::Queen, Suit::Hearts)) == Card::QUEEN_OF_HEARTS);
+        REQUIRE(fromWireCard(Card::SEVEN_OF_SPADES) == makeCard(Rank::Seven, Suit::Spades));
+        REQUIRE_FALSE(fromWireCard(Card::NO_CARD).has_value());
+        REQUIRE(toBidCode(PREF_EIGHT PREF_HEART) == BidCode::BID_EIGHT_HEARTS);
+        REQUIRE(toBidCode(PREF_MISER_WT) == BidCode::BID_MISER_WT);
+        REQUIRE(toBidCode("") == BidCode::NO_BID);
+        REQUIRE(fromBidCode(BidCode::BID_PASS) == PREF_PASS);
+        REQUIRE(parseCard(PREF_ACE PREF_OF_ PREF_CLUBS, Card::NO_CARD) == makeCard(Rank::Ace, Suit::Clubs));
+        REQUIRE(parseBid(PREF_PASS, BidCode::BID_TEN_NO_TRUMP) == Bid{PREF_TEN});
+        REQUIRE(parseBid("joker", BidCode::NO_BID).empty());
+        const auto hand = CardMask{makeCard(Rank::Ten, Suit::Diamonds), makeCard(Rank::King, Suit::Clubs)};
+        REQUIRE(parseHand(CardsNames{}, toWireHand(hand)) == hand);
+        REQUIRE(parseHand(toCardsNames(hand), 0) == hand);
+    }
+
+    SECTION("Bid")
+    {
+        STATIC_REQUIRE(Bid{PREF_SIX PREF_SPADE} < Bid{PREF_SIX PREF_CLUB});
+        STATIC_REQUIRE(Bid{PREF_EIGHT} < Bid{PREF_MISER});
+        STATIC_REQUIRE(Bid{PREF_MISER} < Bid{PREF_NINE PREF_SPADE});
+        STATIC_REQUIRE(Bid{PREF_TEN} < Bid{PREF_PASS});
+        STATIC_REQUIRE(Bid{PREF_NINE_WT}.code() == BidCode::BID_NINE_WT);
+        STATIC_REQUIRE(Bid{PREF_TEN PREF_DIAMOND}.level() == 10);
+        STATIC_REQUIRE(Bid{PREF_TEN PREF_DIAMOND}.trump() == Suit::Diamonds);
+        STATIC_REQUIRE_FALSE(Bid{PREF_SEVEN}.trump().has_value());
+        STATIC_REQUIRE(Bid{PREF_MISER_WT}.isMiser());
+        STATIC_REQUIRE(Bid{PREF_MISER_WT}.isWithoutTalon());
+        STATIC_REQUIRE_FALSE(Bid{PREF_NINE_WT}.trump().has_value());
+        STATIC_REQUIRE(Bid{PREF_PASS}.isPass());
+        STATIC_REQUIRE(Bid{}.empty());
+        STATIC_REQUIRE(Bid{}.rank() == std::size(BidsRank));
+        STATIC_REQUIRE(Bid::parse(PREF_SEVEN PREF_HEART).text() == PREF_SEVEN PREF_HEART);
+        STATIC_REQUIRE(Bid::parse("joker").empty());
+        STATIC_REQUIRE(Bid::fromCode(BidCode::BID_PASS) == PREF_PASS);
+        for (const auto bid : AllBids) { REQUIRE(Bid::parse(bid.text()) == bid); }
+    }
+
+    SECTION("message envelope")
+    {
+        auto pingPong = PingPong{};
+        pingPong.set_id(42);
+        const auto msg = makeMessage(pingPong);
+        REQUIRE(msg.body_case() == Message::kPingPong);
+        REQUIRE(methodName(msg.body_case()) == "PingPong");
+        REQUIRE(makeMethod<PingPong>(msg)->id() == 42);
+        REQUIRE(makeMethod<Log>(msg) == nullptr);
+    }
 }
 
 TEST_CASE("calculateDealScore")
@@ -395,6 +485,22 @@ TEST_CASE("auth")
         REQUIRE(verifyPassword(password, hashPassword(password)));
     }
 
+    SECTION("PasswordPool")
+    {
+        const auto address = net::ip::make_address("127.0.0.1");
+        const auto hash = hashPassword("aboba");
+        const auto verify = [&](PasswordPool& pool, std::string password) {
+            return std::get<0>(stdx::sync_wait(pool.verify(address, std::move(password), hash)).value());
+        };
+        auto pool = PasswordPool{{.threads = 1, .maxInFlight = 1, .maxInFlightPerAddress = 1}};
+        REQUIRE(verify(pool, "aboba") == true);
+        REQUIRE(verify(pool, "amogus") == false);
+        REQUIRE(verify(pool, "aboba") == true); // the slot is released after every check
+
+        auto saturated = PasswordPool{{.threads = 1, .maxInFlight = 0}};
+        REQUIRE_FALSE(verify(saturated, "aboba").has_value());
+    }
+
     SECTION("toBytes")
     {
         const auto str = "aboba"s;
@@ -415,6 +521,916 @@ TEST_CASE("auth")
     }
 }
 
+TEST_CASE("journal")
+{
+    auto user = User{};
+    user.set_player_id("id");
+    user.set_player_name("name");
+    const auto records = std::vector{
+        makeUserAdded(user),
+        makeAuthTokenAdded("id", "token0", 100),
+        makeAuthTokenAdded("id", "token1", 100),
+        makeAuthTokenUsed("id", "token1", 200),
+        makeUserGameUpserted("id", makeUserGame(1, GameType::RANKED, 100)),
+        makeUserGameUpserted("id", makeUserGame(1, 60, 10, 2, 4, 20)),
+        makeAuthTokenRevoked("id", "token0"),
+    };
+    auto journal = std::string{};
+    for (const auto& record : records) { journal += frameRecord(record); }
+
+    const auto requireReplayed = [](const GameData& data) {
+        REQUIRE(data.users_size() == 1);
+        const auto& replayed = data.users(0);
+        REQUIRE(replayed.player_name() == "name");
+        REQUIRE(replayed.tokens_size() == 1);
+        REQUIRE(replayed.tokens(0).hash() == "token1");
+        REQUIRE(replayed.tokens(0).issued_at() == 100);
+        REQUIRE(replayed.tokens(0).last_used_at() == 200);
+        REQUIRE(replayed.games_size() == 1);
+        REQUIRE(replayed.games(0).timestamp() == 100);
+        REQUIRE(replayed.games(0).mmr() == 20);
+    };
+
+    SECTION("replay")
+    {
+        auto data = GameData{};
+        auto index = GameDataIndex{};
+        REQUIRE(replayJournal(data, index, journal) == std::size(journal));
+        requireReplayed(data);
+    }
+
+    SECTION("replay is idempotent")
+    {
+        auto data = GameData{};
+        auto index = GameDataIndex{};
+        REQUIRE(replayJournal(data, index, journal) == std::size(journal));
+        REQUIRE(replayJournal(data, index, journal) == std::size(journal));
+        requireReplayed(data);
+    }
+
+    SECTION("torn and corrupted tails are dropped")
+    {
+        const auto lastRecord = frameRecord(makeAuthTokenAdded("id", "token2", 300));
+        auto data = GameData{};
+        auto index = GameDataIndex{};
+        REQUIRE(replayJournal(data, index, journal + lastRecord.substr(0, std::size(lastRecord) - 1)) == std::size(journal));
+        requireReplayed(data);
+
+        auto corrupted = lastRecord;
+        corrupted.back() ^= 1;
+        REQUIRE(replayJournal(data, index, journal + corrupted) == std::size(journal));
+        requireReplayed(data);
+    }
+
+    SECTION("snapshot and journal files")
+    {
+        const auto dir = fs::temp_directory_path() / fmt::format("pref-journal-{}", generateUuid());
+        fs::create_directories(dir);
+        const auto path = dir / "game.dat";
+        {
+            auto data = GameData{};
+            auto index = GameDataIndex{};
+            auto fileJournal = Journal{};
+            REQUIRE(fileJournal.open(path));
+            for (const auto& record : records) { recordChange(data, index, fileJournal, record); }
+            REQUIRE(fileJournal.commit([&] { return data; }));
+        }
+        REQUIRE(fs::file_size(journalPath(path)) == std::size(journal));
+        auto loaded = loadGameData(path);
+        requireReplayed(loaded);
+
+        REQUIRE(compactGameData(path, loaded));
+        REQUIRE(fs::file_size(journalPath(path)) == 0);
+        requireReplayed(loadGameData(path));
+        fs::remove_all(dir);
+    }
+
+    SECTION("background writer")
+    {
+        const auto dir = fs::temp_directory_path() / fmt::format("pref-journal-{}", generateUuid());
+        fs::create_directories(dir);
+        const auto path = dir / "game.dat";
+        auto data = GameData{};
+        auto index = GameDataIndex{};
+        auto durableCount = 0;
+        {
+            auto writer = JournalWriter{};
+            REQUIRE(writer.open(path, [&] { return data; }));
+            for (const auto& record : records) {
+                recordChange(data, index, writer, record);
+                writer.commit([&](const bool isDurable) { durableCount += isDurable; });
+            }
+            writer.stop();
+            REQUIRE(writer.durable() == std::size(records));
+        }
+        REQUIRE(durableCount == std::ssize(records));
+        requireReplayed(loadGameData(path));
+        fs::remove_all(dir);
+    }
+}
+
+TEST_CASE("GameDataIndex")
+{
+    auto data = GameData{};
+    auto user = User{};
+    user.set_player_id("id0");
+    user.set_player_name("name0");
+    user.add_auth_tokens("token0");
+    *user.add_games() = makeUserGame(7, GameType::RANKED, 100);
+    *data.add_users() = user;
+    const auto now = std::int64_t{1'000'000'000};
+    migrateLegacyAuthTokens(data, now);
+    REQUIRE(data.users(0).auth_tokens_size() == 0);
+    REQUIRE(data.users(0).tokens(0).last_used_at() == now);
+    auto index = makeGameDataIndex(data);
+    REQUIRE(index.lastGameId == 7);
+
+    user.set_player_id("id1");
+    user.set_player_name("name1");
+    user.clear_auth_tokens();
+    user.clear_games();
+    addUser(data, index, user);
+    addUser(data, index, user);
+    REQUIRE(data.users_size() == 2);
+
+    REQUIRE(userPlayerId(data, index, "name1") == "id1");
+    REQUIRE_FALSE(userPlayerId(data, index, "name2").has_value());
+    REQUIRE(userByPlayerId(data, index, "id0")->get().player_name() == "name0");
+    REQUIRE(verifyPlayerIdAndAuthToken(data, index, "id0", "token0", now));
+    REQUIRE_FALSE(verifyPlayerIdAndAuthToken(data, index, "id1", "token0", now));
+
+    addAuthToken(data, index, "id1", "token1", now);
+    REQUIRE(verifyPlayerIdAndAuthToken(data, index, "id1", "token1", now));
+    revokeAuthToken(data, index, "id1", "token1");
+    REQUIRE_FALSE(verifyPlayerIdAndAuthToken(data, index, "id1", "token1", now));
+    REQUIRE(data.users(1).tokens_size() == 0);
+
+    addOrUpdateUserGame(data, index, "id1", makeUserGame(8, GameType::RANKED, 200));
+    addOrUpdateUserGame(data, index, "id1", makeUserGame(8, 60, 10, 2, 4, 20));
+    REQUIRE(index.lastGameId == 8);
+    REQUIRE(data.users(1).games_size() == 1);
+    REQUIRE(data.users(1).games(0).timestamp() == 200);
+    REQUIRE(data.users(1).games(0).mmr() == 20);
+}
+
+TEST_CASE("UserGames pages")
+{
+    auto data = GameData{};
+    auto user = User{};
+    user.set_player_id("id0");
+    for (auto id = 1; id <= 75; ++id) { *user.add_games() = makeUserGame(id, 60, 1, 2, 3, id % 3 - 1); }
+    *data.add_users() = user;
+    const auto index = makeGameDataIndex(data);
+    const auto parse = [](const std::string& payload) {
+        auto msg = Message{};
+        REQUIRE(msg.ParseFromString(payload));
+        return msg.user_games();
+    };
+
+    const auto newest = parse(makeUserGames(data, index, "id0", 0, 0));
+    REQUIRE(newest.games_size() == UserGamesPageSize);
+    REQUIRE(newest.games(0).id() == 46);
+    REQUIRE(newest.games(UserGamesPageSize - 1).id() == 75);
+    REQUIRE(newest.has_more());
+    REQUIRE(newest.totals().games() == 75);
+    REQUIRE(newest.totals().wins() == 25);
+    REQUIRE(newest.totals().losses() == 25);
+    REQUIRE(newest.totals().duration() == 75 * 60);
+
+    const auto oldest = parse(makeUserGames(data, index, "id0", 21, 1'000));
+    REQUIRE(oldest.games_size() == 20);
+    REQUIRE(oldest.games(0).id() == 1);
+    REQUIRE_FALSE(oldest.has_more());
+    REQUIRE_FALSE(oldest.has_totals());
+    REQUIRE(parse(makeUserGames(data, index, "id1", 0, 0)).games_size() == 0);
+
+    const auto update = makeUserGameUpdate(data, index, "id0", 74);
+    REQUIRE(update);
+    REQUIRE(parse(*update).is_update());
+    REQUIRE(parse(*update).games(0).mmr() == 1);
+    REQUIRE_FALSE(makeUserGameUpdate(data, index, "id0", 76));
+}
+
+TEST_CASE("auth token expiry")
+{
+    auto data = GameData{};
+    auto index = GameDataIndex{};
+    auto user = User{};
+    user.set_player_id("id");
+    addUser(data, index, user);
+    const auto ttl = std::chrono::seconds{AuthTokenTtl}.count();
+    const auto now = std::int64_t{1'000'000'000};
+
+    SECTION("the least recently used token is evicted past the cap")
+    {
+        for (auto i = 0; i <= MaxAuthTokensPerUser; ++i) {
+            addAuthToken(data, index, "id", fmt::format("token{}", i), now + i);
+            if (i == 0) { touchAuthToken(data, index, "id", "token0", now + MaxAuthTokensPerUser); }
+        }
+        REQUIRE(data.users(0).tokens_size() == MaxAuthTokensPerUser);
+        REQUIRE(verifyPlayerIdAndAuthToken(data, index, "id", "token0", now));
+        REQUIRE_FALSE(verifyPlayerIdAndAuthToken(data, index, "id", "token1", now));
+    }
+
+    SECTION("stale tokens are rejected and swept, the used ones are kept")
+    {
+        addAuthToken(data, index, "id", "stale", now);
+        addAuthToken(data, index, "id", "used", now);
+        touchAuthToken(data, index, "id", "used", now + ttl / 2);
+        REQUIRE_FALSE(verifyPlayerIdAndAuthToken(data, index, "id", "stale", now + ttl));
+        REQUIRE(verifyPlayerIdAndAuthToken(data, index, "id", "used", now + ttl));
+
+        const auto expired = expiredAuthTokens(data, index, now + ttl + AuthTokenWheel::Interval);
+        REQUIRE(std::size(expired) == 1);
+        REQUIRE(expired.front().authToken == "stale");
+        REQUIRE(std::empty(expiredAuthTokens(data, index, now + ttl + 2 * AuthTokenWheel::Interval)));
+
+        const auto later = now + ttl / 2 + ttl + AuthTokenWheel::Interval;
+        const auto expiredLater = expiredAuthTokens(data, index, later);
+        REQUIRE(std::size(expiredLater) == 1);
+        REQUIRE(expiredLater.front().authToken == "used");
+    }
+}
+
+TEST_CASE("DoubleDummySolver")
+{
+    using enum Rank;
+    using enum Suit;
+    auto solver = DoubleDummySolver{1U << 10U};
+
+    SECTION("the top cards take every trick")
+    {
+        const auto position = DealPosition{
+            .hands = {CardMask{makeCard(Ace, Spades), makeCard(Ace, Clubs)},
+                      CardMask{makeCard(Seven, Spades), makeCard(Seven, Clubs)},
+                      CardMask{makeCard(Eight, Spades), makeCard(Eight, Clubs)}},
+            .trump = std::nullopt,
+        };
+        REQUIRE(solver.solve(position) == 2);
+    }
+
+    SECTION("a void declarer ruffs only with a trump")
+    {
+        auto position = DealPosition{
+            .hands = {CardMask{makeCard(Seven, Hearts), makeCard(Eight, Clubs)},
+                      CardMask{makeCard(Ace, Spades), makeCard(King, Spades)},
+                      CardMask{makeCard(Queen, Spades), makeCard(Jack, Spades)}},
+            .trump = Hearts,
+            .leader = 1,
+            .declarerTricks = 4,
+        };
+        REQUIRE(solver.solve(position) == 2);
+        REQUIRE(solver.isContractMade(position));
+        position.trump = std::nullopt;
+        REQUIRE(solver.solve(position) == 0);
+        REQUIRE_FALSE(solver.isContractMade(position));
+    }
+
+    SECTION("each card is scored by the tricks it leads to")
+    {
+        const auto position = DealPosition{
+            .hands = {CardMask{makeCard(Ace, Spades), makeCard(Seven, Hearts)},
+                      CardMask{makeCard(King, Spades)},
+                      CardMask{makeCard(Queen, Spades)}},
+            .trump = std::nullopt,
+            .leader = 1,
+            .trick = {makeCard(Ace, Diamonds), makeCard(Seven, Diamonds)},
+        };
+        const auto scores = solver.evaluate(position);
+        REQUIRE(std::size(scores) == 2);
+        REQUIRE(scores[0].card == makeCard(Ace, Spades));
+        REQUIRE(scores[0].tricks == 0);
+        REQUIRE(scores[1].card == makeCard(Seven, Hearts));
+        REQUIRE(scores[1].tricks == 1);
+        REQUIRE(solver.solve(position) == 1);
+    }
+
+    SECTION("the miser declarer ducks")
+    {
+        auto position = DealPosition{
+            .hands = {CardMask{makeCard(Eight, Spades), makeCard(Seven, Clubs)},
+                      CardMask{makeCard(Nine, Spades), makeCard(Eight, Clubs)},
+                      CardMask{makeCard(Seven, Spades), makeCard(Nine, Clubs)}},
+            .trump = std::nullopt,
+            .contractLevel = ContractLevel::Miser,
+        };
+        REQUIRE(solver.solve(position) == 0);
+        REQUIRE(solver.isContractMade(position));
+        position.hands[0] = CardMask{makeCard(Ace, Spades), makeCard(Seven, Clubs)};
+        REQUIRE(solver.solve(position) == 1);
+        REQUIRE_FALSE(solver.isContractMade(position));
+        REQUIRE_FALSE(hasFulfilledContract(ContractLevel::Miser, 1));
+    }
+
+    SECTION("agrees with a plain minimax over the rules")
+    {
+        using Seat = DealPosition::Seat;
+        const auto seatIds = std::array<Player::Id, NumberOfPlayers>{"0", "1", "2"};
+        // every playable card tried, the tricks decided by decideTrickWinner, and nothing cached or pruned
+        const auto minimax = [&](this const auto& self, DealPosition& p, std::vector<PlayedCard>& trick) -> int {
+            const auto isMiser = p.contractLevel == ContractLevel::Miser;
+            if (std::size(trick) == NumberOfPlayers) {
+                const auto winner = static_cast<Seat>(rng::distance(
+                    rng::begin(seatIds), rng::find(seatIds, decideTrickWinner(trick, p.trump))));
+                const auto taken = winner == p.declarer ? 1 : 0;
+                if (p.hands[winner].empty()) { return taken; }
+                auto next = std::vector<PlayedCard>{};
+                const auto leader = std::exchange(p.leader, winner);
+                const auto result = taken + self(p, next);
+                p.leader = leader;
+                return result;
+            }
+            const auto seat = (p.leader + std::size(trick)) % NumberOfPlayers;
+            const auto leadSuit = std::empty(trick) ? std::nullopt : std::optional{suitOf(trick.front().card)};
+            const auto isMaximizing = (seat == p.declarer) != isMiser;
+            auto best = isMaximizing ? -1 : static_cast<int>(DeckSize);
+            for (const auto card : playableCards(p.hands[seat], leadSuit, p.trump)) {
+                p.hands[seat].erase(card);
+                trick.push_back({.playerId = seatIds[seat], .card = card});
+                const auto tricks = self(p, trick);
+                trick.pop_back();
+                p.hands[seat].insert(card);
+                best = isMaximizing ? std::max(best, tricks) : std::min(best, tricks);
+            }
+            return best;
+        };
+        auto random = std::mt19937{42};
+        const auto pick = [&](const int from, const int to) { return std::uniform_int_distribution{from, to}(random); };
+        const auto levels = std::array{ContractLevel::Six, ContractLevel::Seven, ContractLevel::Eight,
+                                       ContractLevel::Nine, ContractLevel::Ten};
+        const auto trumps = std::array<std::optional<Suit>, 5>{std::nullopt, Spades, Clubs, Diamonds, Hearts};
+        auto deck = std::vector<CardId>(DeckSize);
+        for (auto i = 0uz; i < DeckSize; ++i) { deck[i] = static_cast<CardId>(i); }
+        for (const auto kind : {"trump"sv, "no trump"sv, "miser"sv}) {
+            for (auto deal = 0; deal < 50; ++deal) {
+                std::ranges::shuffle(deck, random);
+                const auto tricks = static_cast<std::size_t>(pick(3, 5));
+                auto position = DealPosition{
+                    .declarer = static_cast<Seat>(pick(0, 2)),
+                    .leader = static_cast<Seat>(pick(0, 2)),
+                };
+                for (auto i = 0uz; i < NumberOfPlayers * tricks; ++i) {
+                    position.hands[i % NumberOfPlayers].insert(deck[i]);
+                }
+                if (kind == "miser") {
+                    position.contractLevel = ContractLevel::Miser;
+                } else {
+                    position.contractLevel = levels[static_cast<std::size_t>(pick(0, 4))];
+                    position.declarerTricks = pick(0, static_cast<int>(DeckSize / NumberOfPlayers - tricks));
+                    if (kind == "trump") { position.trump = trumps[static_cast<std::size_t>(pick(1, 4))]; }
+                }
+                // the play sometimes starts inside a trick, with legal cards played to it
+                auto trick = std::vector<PlayedCard>{};
+                for (auto played = pick(0, 2); played > 0; --played) {
+                    const auto seat = (position.leader + std::size(trick)) % NumberOfPlayers;
+                    const auto leadSuit =
+                        std::empty(trick) ? std::nullopt : std::optional{suitOf(trick.front().card)};
+                    const auto card = *std::begin(playableCards(position.hands[seat], leadSuit, position.trump));
+                    position.hands[seat].erase(card);
+                    trick.push_back({.playerId = seatIds[seat], .card = card});
+                    position.trick.push_back(card);
+                }
+                CAPTURE(kind, deal, tricks, std::size(trick));
+                auto reference = position;
+                const auto expected = minimax(reference, trick);
+                REQUIRE(solver.solve(position) == expected);
+                REQUIRE(solver.isContractMade(position)
+                        == hasFulfilledContract(position.contractLevel, position.declarerTricks + expected));
+                const auto seat = (position.leader + std::size(trick)) % NumberOfPlayers;
+                for (const auto& [card, cardTricks] : solver.evaluate(position)) {
+                    reference.hands[seat].erase(card);
+                    trick.push_back({.playerId = seatIds[seat], .card = card});
+                    REQUIRE(cardTricks == minimax(reference, trick));
+                    trick.pop_back();
+                    reference.hands[seat].insert(card);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("bot")
+{
+    using enum Rank;
+    using enum Suit;
+
+    SECTION("the sampled hands fit the sizes and the voids")
+    {
+        auto view = BotView{.self = 0};
+        view.position.hands[0] = CardMask{makeCard(Ace, Spades), makeCard(King, Spades)};
+        view.isKnown = {true, false, false};
+        view.handSizes = {2, 2, 2};
+        view.voids[1] = 1U << std::to_underlying(Hearts);
+        view.hidden = CardMask{
+            makeCard(Seven, Hearts),
+            makeCard(Eight, Hearts),
+            makeCard(Seven, Clubs),
+            makeCard(Eight, Clubs),
+            makeCard(Nine, Clubs)};
+        auto random = std::mt19937_64{1};
+        for (auto i = 0; i < 32; ++i) {
+            const auto hands = sampleHands(view, random);
+            REQUIRE(hands[0] == view.position.hands[0]);
+            REQUIRE(std::size(hands[1]) == 2);
+            REQUIRE(std::size(hands[2]) == 2);
+            REQUIRE((hands[1] & hands[2]).empty());
+            REQUIRE((hands[1] & CardMask::of(Hearts)).empty());
+            REQUIRE((hands[1] | hands[2]) - view.hidden == CardMask{});
+        }
+    }
+
+    SECTION("the talon goes to the declarer")
+    {
+        auto view = BotView{.self = 0};
+        view.position.hands[0] = CardMask{makeCard(Ace, Spades)};
+        view.position.declarer = 2;
+        view.isKnown = {true, false, false};
+        view.handSizes = {1, 1, 1};
+        view.hidden = CardMask{makeCard(Seven, Hearts), makeCard(Eight, Hearts), makeCard(Nine, Hearts)};
+        view.declarerCards = CardMask{makeCard(Nine, Hearts)};
+        auto random = std::mt19937_64{2};
+        REQUIRE(sampleHands(view, random)[2] == view.declarerCards);
+    }
+
+    SECTION("bids")
+    {
+        STATIC_REQUIRE(makeBid(ContractLevel::Eight, Hearts) == PREF_EIGHT PREF_HEART);
+        STATIC_REQUIRE(makeBid(ContractLevel::Ten, std::nullopt) == PREF_TEN);
+        STATIC_REQUIRE(makeBid(ContractLevel::Miser, std::nullopt) == PREF_MISER);
+        STATIC_REQUIRE(Bid{PREF_SIX PREF_SPADE}.rank() == 0);
+        STATIC_REQUIRE(Bid{PREF_PASS}.rank() == std::size(BidsRank) - 1);
+
+        STATIC_REQUIRE(isBidAllowed(PREF_SIX PREF_SPADE, {}));
+        STATIC_REQUIRE(isBidAllowed(PREF_MISER, {}));
+        STATIC_REQUIRE_FALSE(isBidAllowed(PREF_NINE_WT, {}));
+        STATIC_REQUIRE_FALSE(isBidAllowed(PREF_MISER, {.myBid = PREF_SIX PREF_SPADE}));
+        STATIC_REQUIRE_FALSE(isBidAllowed(PREF_SIX PREF_SPADE, {.currentRank = 0}));
+        STATIC_REQUIRE(isBidAllowed(PREF_SIX PREF_CLUB, {.currentRank = 0}));
+        STATIC_REQUIRE_FALSE(isBidAllowed(PREF_SEVEN, {.myBid = PREF_MISER}));
+        STATIC_REQUIRE(isBidAllowed(PREF_PASS, {.myBid = PREF_MISER}));
+    }
+
+    SECTION("a deal is worth more to the declarer who makes it")
+    {
+        auto deal = BotDeal{
+            .ids = {"a", "b", "c"},
+            .declarer = 0,
+            .contractLevel = ContractLevel::Six,
+            .choices = {WhistingChoice::Whist, WhistingChoice::Whist, WhistingChoice::Whist}};
+        const auto declarer = dealValues(deal, 0);
+        const auto whister = dealValues(deal, 1);
+        REQUIRE(declarer[6] > 0.0);
+        REQUIRE(declarer[5] < 0.0);
+        REQUIRE(declarer[7] > declarer[6]);
+        REQUIRE(whister[6] < whister[5]);
+        deal.choices[1] = deal.choices[2] = WhistingChoice::Pass;
+        REQUIRE(dealValues(deal, 1)[6] < 0.0);
+    }
+
+    SECTION("the declarer drops the low cards of its short suits")
+    {
+        const auto hand = CardMask{
+            makeCard(Ace, Spades),
+            makeCard(King, Spades),
+            makeCard(Queen, Spades),
+            makeCard(Jack, Spades),
+            makeCard(Nine, Clubs),
+            makeCard(Ace, Diamonds),
+            makeCard(Eight, Diamonds),
+            makeCard(Seven, Hearts),
+            makeCard(Eight, Hearts),
+            makeCard(King, Hearts),
+            makeCard(Ten, Hearts),
+            makeCard(Nine, Hearts)};
+        REQUIRE(discardFor(hand, Spades, false) == CardMask{makeCard(Nine, Clubs), makeCard(Eight, Diamonds)});
+        REQUIRE(discardFor(hand, std::nullopt, true) == CardMask{makeCard(Ace, Spades), makeCard(Ace, Diamonds)});
+    }
+
+    SECTION("a pass game is played to lose the tricks")
+    {
+        auto view = BotView{.self = 2};
+        view.position.hands[2] = CardMask{makeCard(Seven, Spades), makeCard(Jack, Spades), makeCard(Ace, Spades)};
+        view.position.trick = {makeCard(Queen, Spades), makeCard(Eight, Clubs)};
+        REQUIRE(passGameCard(view, std::nullopt) == makeCard(Jack, Spades));
+        view.position.trick = {makeCard(Eight, Clubs), makeCard(Nine, Clubs)};
+        REQUIRE(passGameCard(view, std::nullopt) == makeCard(Ace, Spades));
+        view.position.trick.clear();
+        view.position.leader = 2;
+        REQUIRE(passGameCard(view, std::nullopt) == makeCard(Seven, Spades));
+    }
+
+    SECTION("the random moves are legal")
+    {
+        auto random = std::mt19937_64{3};
+        auto view = BotView{.self = 1};
+        view.position.hands[1] = CardMask{makeCard(Seven, Spades), makeCard(Ace, Clubs), makeCard(Nine, Hearts)};
+        view.position.leader = 0;
+        view.position.trick = {makeCard(King, Clubs)};
+        for (auto i = 0; i < 16; ++i) {
+            REQUIRE(randomCard(view, std::nullopt, random) == makeCard(Ace, Clubs));
+            REQUIRE(randomCard(view, Spades, random) == makeCard(Seven, Spades));
+            const auto discarded = randomDiscard(view, random);
+            REQUIRE(std::size(discarded) == 2);
+            REQUIRE(discarded - view.position.hands[1] == CardMask{});
+            const auto bid = randomBid({.currentRank = Bid{PREF_SEVEN}.rank()}, random);
+            REQUIRE((bid == PREF_PASS or bid == PREF_EIGHT PREF_SPADE));
+        }
+        view.position.contractLevel = ContractLevel::Miser;
+        REQUIRE(randomWhisting(view, random) == PREF_WHIST);
+    }
+
+    SECTION("a worker's error is the estimate's one")
+    {
+        auto view = BotView{.self = 0};
+        view.position.hands[0] = CardMask{makeCard(Ace, Spades)};
+        view.isKnown = {true, false, false};
+        view.handSizes = {1, 1, 1};
+        view.hidden = CardMask{makeCard(Seven, Hearts), makeCard(Eight, Hearts)};
+        auto pool = BotPool{{.threads = 2}};
+        const auto failing = [](DoubleDummySolver&, const BotPool::Hands&, std::span<double>) {
+            throw std::runtime_error{"no solution"};
+        };
+        REQUIRE_THROWS_AS(stdx::sync_wait(pool.estimate(view, 1, failing)), std::runtime_error);
+    }
+}
+
+TEST_CASE("TableRegistry")
+{
+    auto registry = TableRegistry{1, {.threads = 1}};
+    auto& first = registry.seat("p1");
+    REQUIRE(&registry.seat("p1") == &first); // the seat of a player seated already
+    REQUIRE(&registry.seat("p2") == &first);
+    REQUIRE(&registry.seat("p3") == &first);
+    REQUIRE_FALSE(registry.seatBot(first, "bot1")); // the table is full
+    auto& second = registry.seat("p4");
+    REQUIRE(&second != &first);
+    REQUIRE(registry.findTable("p4") == &second);
+
+    registry.leave(second, "p1"); // not seated at that table
+    REQUIRE(registry.findTable("p1") == &first);
+    registry.leave(first, "p1");
+    REQUIRE_FALSE(registry.findTable("p1"));
+    REQUIRE(&registry.seat("p5") == &first); // the fullest table with a free seat
+    registry.leave(first, "p5");
+    REQUIRE(registry.seatBot(first, "bot1")); // the seat left
+    REQUIRE_FALSE(registry.seatBot(first, "bot2"));
+
+    auto& opened = registry.openTable();
+    REQUIRE(&opened != &first);
+    REQUIRE(&opened != &second);
+    REQUIRE(&registry.seat("p6") == &second); // never an opened table
+    registry.leave(second, "p4");
+    registry.leave(second, "p6");
+    REQUIRE(registry.tablesCount() == 3);
+    REQUIRE(&registry.seat("p7") == &second); // the empty table is reused
+    REQUIRE(registry.seatBot(opened, "bot3"));
+    registry.leave(opened, "bot3");
+    REQUIRE(&registry.openTable() == &opened);
+    REQUIRE(registry.tablesCount() == 3);
+    registry.shutdown();
+}
+
+TEST_CASE("snapshot cache")
+{
+    auto registry = TableRegistry{1, {.threads = 1}};
+    auto& ctx = registry.openTable();
+    for (const auto* const id : {"p1", "p2", "p3"}) { ctx.players.emplace(id, Player{id, id, 0, nullptr}); }
+    ctx.whoseTurnIt = std::cbegin(ctx.players);
+    ctx.stage = GameStage::BIDDING;
+    ctx.forehandId = "p1";
+    const auto& cached = cachedSnapshot(ctx, WireFormat::WIRE_COMPACT);
+    const auto bytes = cached;
+
+    ctx.forehandId = "p2"; // no message is sent to the table yet, so its version is the same
+    const auto& reused = cachedSnapshot(ctx, WireFormat::WIRE_COMPACT);
+    REQUIRE(&reused == &cached);
+    REQUIRE(reused == bytes); // not serialized again
+
+    ++ctx.snapshot.version; // as on sending the change to the table
+    const auto changed = cachedSnapshot(ctx, WireFormat::WIRE_COMPACT);
+    REQUIRE(changed != bytes);
+    auto snapshot = GameSnapshot{};
+    REQUIRE(snapshot.ParseFromString(changed));
+    REQUIRE(snapshot.version() == ctx.snapshot.version);
+    REQUIRE(snapshot.messages(0).forehand().player_id() == "p2");
+    REQUIRE(&cachedSnapshot(ctx, WireFormat::WIRE_COMPACT) == &cached); // the same buffer, serialized again
+    registry.shutdown();
+}
+
+TEST_CASE("headless")
+{
+    auto registry = TableRegistry{1, {.threads = 1}};
+    const auto stats = std::get<0>(stdx::sync_wait(playHeadless(registry, 10, 1)).value());
+    REQUIRE(stats.deals == 10);
+    REQUIRE(stats.games >= 1);
+    REQUIRE(stats.stages[static_cast<std::size_t>(GameStage::PLAYING)].moves >= 10 * 30);
+    registry.shutdown();
+}
+
+TEST_CASE("recording")
+{
+    const auto dir = fs::temp_directory_path() / fmt::format("pref-recording-{}", generateUuid());
+    auto played = HeadlessStats{};
+    {
+        auto registry = TableRegistry{1, {.threads = 1}};
+        REQUIRE(registry.record(dir));
+        played = std::get<0>(stdx::sync_wait(playHeadless(registry, 3, 1)).value());
+        registry.shutdown();
+    } // the writer is joined with the registry
+    const auto files = std::vector(fs::directory_iterator{dir}, fs::directory_iterator{});
+    REQUIRE(std::size(files) == 1);
+    const auto bytes = readFile(files.front().path()).value();
+    const auto records = parseRecording(bytes);
+    REQUIRE(rng::count_if(records, &TableRecord::has_seated) == NumberOfPlayers);
+    REQUIRE(rng::count_if(records, &TableRecord::has_seed) == 2); // the table's own, then the headless one
+
+    SECTION("replays the same deals")
+    {
+        auto registry = TableRegistry{1, {.threads = 1}};
+        const auto first = std::get<0>(stdx::sync_wait(replayRecording(registry, records)).value());
+        const auto second = std::get<0>(stdx::sync_wait(replayRecording(registry, records)).value());
+        const auto moves = rng::accumulate(played.stages | rv::transform(&HeadlessStats::Stage::moves), 0uz);
+        REQUIRE(first.deals == 3);
+        REQUIRE(first.messages == moves);
+        REQUIRE(std::size(first.seats) == NumberOfPlayers);
+        REQUIRE(second.deals == first.deals);
+        for (const auto& [playerId, seat] : first.seats) {
+            REQUIRE(seat.frames > 0);
+            REQUIRE(second.seats.at(playerId).frames == seat.frames);
+            REQUIRE(second.seats.at(playerId).crc.checksum() == seat.crc.checksum());
+        }
+        registry.shutdown();
+    }
+
+    SECTION("deals the next deal on its record")
+    {
+        // the messages between a deal's last move and the next deal were handled during the delay before it
+        const auto nextDeal = rng::find_if(records, &TableRecord::has_next_deal);
+        REQUIRE(nextDeal != rng::end(records));
+        auto registry = TableRegistry{1, {.threads = 1}};
+        const auto before = std::vector(rng::begin(records), nextDeal);
+        const auto after = std::vector(rng::begin(records), rng::next(nextDeal));
+        const auto waiting = std::get<0>(stdx::sync_wait(replayRecording(registry, before)).value());
+        const auto dealt = std::get<0>(stdx::sync_wait(replayRecording(registry, after)).value());
+        REQUIRE(waiting.deals == 1);
+        REQUIRE(dealt.deals == 1);
+        for (const auto& [playerId, seat] : waiting.seats) {
+            REQUIRE(dealt.seats.at(playerId).frames > seat.frames); // the cards of the next deal
+        }
+        registry.shutdown();
+    }
+
+    SECTION("a torn tail is dropped")
+    {
+        REQUIRE(std::size(parseRecording(bytes.substr(0, std::size(bytes) - 1))) == std::size(records) - 1);
+    }
+    fs::remove_all(dir);
+}
+
+TEST_CASE("metrics")
+{
+    // the counters are the process's, so only their growth is checked
+    const auto valueOf = [](const std::string_view series) {
+        const auto text = metrics().render(3);
+        const auto line = text.find(fmt::format("\n{} ", series));
+        REQUIRE(line != std::string::npos);
+        return std::stoull(text.substr(line + std::size(series) + 2));
+    };
+    const auto count = valueOf("pref_password_check_duration_seconds_count");
+    const auto fast = valueOf(R"(pref_password_check_duration_seconds_bucket{le="0.001"})");
+    const auto slow = valueOf(R"(pref_password_check_duration_seconds_bucket{le="+Inf"})");
+    std::jthread{[] {
+        localMetrics().passwordChecks.observe(700);
+        localMetrics().passwordChecks.observe(3'000'000);
+    }}.join();
+    REQUIRE(valueOf("pref_password_check_duration_seconds_count") == count + 2);
+    REQUIRE(valueOf(R"(pref_password_check_duration_seconds_bucket{le="0.001"})") == fast + 1);
+    REQUIRE(valueOf(R"(pref_password_check_duration_seconds_bucket{le="+Inf"})") == slow + 2);
+    REQUIRE(valueOf("pref_tables") == 3);
+}
+
+TEST_CASE("serializeMessage")
+{
+    auto playCard = PlayCard{};
+    playCard.set_player_id("p1");
+    playCard.set_card(std::string(200, 'x')); // a size of two varint bytes
+    REQUIRE(serializeMessage(playCard) == makeMessage(playCard).SerializeAsString());
+    REQUIRE(serializeMessage(Logout{}) == makeMessage(Logout{}).SerializeAsString());
+
+    auto arena = google::protobuf::Arena{};
+    const auto bytes = makeMessage(playCard).SerializeAsString();
+    const auto* const msg = makeMessage(arena, std::data(bytes), std::size(bytes));
+    REQUIRE(msg);
+    REQUIRE(msg->GetArena() == &arena);
+    REQUIRE(msg->play_card().card() == playCard.card());
+}
+
+TEST_CASE("batch")
+{
+    const auto frameOf = [](const Message::BodyCase method, const std::string_view text) {
+        auto msg = Message{};
+        if (method == Message::kGameState) { msg.mutable_game_state()->add_last_trick(std::string{text}); }
+        if (method == Message::kUserGames) { msg.mutable_user_games(); }
+        if (method == Message::kPlayCard) { msg.mutable_play_card()->set_card(std::string{text}); }
+        return makeFrame(msg.SerializeAsString());
+    };
+    auto frames = std::vector{
+        frameOf(Message::kGameState, "first"),
+        frameOf(Message::kPlayCard, "ace_of_hearts"),
+        frameOf(Message::kUserGames, ""),
+        frameOf(Message::kGameState, "second"),
+        frameOf(Message::kUserGames, "")};
+    REQUIRE(bodyCaseOf(*frames[1]) == Message::kPlayCard);
+
+    auto buffer = std::string{"the previous batch"};
+    auto batch = Message{};
+    REQUIRE(batch.ParseFromString(makeBatch(frames, buffer)));
+    REQUIRE(batch.body_case() == Message::kBatch);
+    REQUIRE(batch.batch().messages_size() == 5);
+    REQUIRE(batch.batch().messages(1).play_card().card() == "ace_of_hearts");
+    REQUIRE(batch.batch().messages(3).game_state().last_trick(0) == "second");
+
+    collapseSuperseded(frames); // the UserGames are pages and updates, each of them is kept
+    REQUIRE(std::size(frames) == 4);
+    REQUIRE(bodyCaseOf(*frames[0]) == Message::kPlayCard);
+    REQUIRE(bodyCaseOf(*frames[1]) == Message::kUserGames);
+    REQUIRE(bodyCaseOf(*frames[2]) == Message::kGameState);
+    REQUIRE(bodyCaseOf(*frames[3]) == Message::kUserGames);
+    REQUIRE(parseSlowConsumer("collapse") == SlowConsumer::Collapse);
+    REQUIRE_FALSE(parseSlowConsumer("never"));
+}
+
+TEST_CASE("slow consumer")
+{
+    auto io = net::io_context{};
+    const auto stateOf = [](const std::string_view text) {
+        auto msg = Message{};
+        msg.mutable_game_state()->add_last_trick(std::string{text});
+        return makeFrame(msg.SerializeAsString());
+    };
+    const auto cardOf = [](const std::string_view card) {
+        auto msg = Message{};
+        msg.mutable_play_card()->set_card(std::string{card});
+        return makeFrame(msg.SerializeAsString());
+    };
+    const auto never = std::make_shared<Channel>(io.get_executor(), 1); // a player who never reads
+    const auto reader = std::make_shared<Channel>(io.get_executor(), 1);
+    never->setSlowConsumer(SlowConsumer::Collapse);
+    reader->setSlowConsumer(SlowConsumer::Collapse);
+    const auto send = [&](const Frame& frame) {
+        stdx::sync_wait(sendToMany(Channels{never, reader}, frame)); // returns at once, the table never waits
+        REQUIRE(reader->try_receive([](sys::error_code, const Frame&) { }));
+        reader->unqueue();
+    };
+
+    send(stateOf("first"));
+    send(cardOf("ace_of_hearts"));
+    send(stateOf("second"));
+    send(stateOf("third"));
+    REQUIRE(never->hasSetAside());
+    auto frames = std::vector<Frame>{};
+    REQUIRE(never->try_receive([&](sys::error_code, Frame frame) { frames.push_back(std::move(frame)); }));
+    never->unqueue();
+    never->takeSetAside(frames); // the last game state replaces the one set aside before it
+    REQUIRE(std::size(frames) == 3);
+    REQUIRE(bodyCaseOf(*frames[0]) == Message::kGameState);
+    REQUIRE(bodyCaseOf(*frames[1]) == Message::kPlayCard);
+    REQUIRE(bodyCaseOf(*frames[2]) == Message::kGameState);
+    auto state = Message{};
+    REQUIRE(state.ParseFromString(*frames[2]));
+    REQUIRE(state.game_state().last_trick(0) == "third");
+
+    for (auto i = 0uz; i <= SetAsideSize; ++i) { send(cardOf("king_of_spades")); }
+    REQUIRE(never->is_open());
+    send(cardOf("queen_of_spades")); // too many set aside
+    REQUIRE_FALSE(never->is_open());
+    REQUIRE(reader->is_open());
+}
+
+TEST_CASE("spectators")
+{
+    auto io = net::io_context{};
+    const auto ch = std::make_shared<Channel>(io.get_executor(), 1);
+    const auto frame = [](const std::uint64_t version, const bool isSnapshot = false) {
+        return SpectatorFrame{
+            .version = version, .frame = makeFrame(std::to_string(version)), .isSnapshot = isSnapshot};
+    };
+    const auto received = [&] {
+        auto result = std::string{};
+        REQUIRE(ch->try_receive([&](sys::error_code, const Frame& f) { result = *f; }));
+        ch->unqueue();
+        return result;
+    };
+    auto spectators = std::vector<Spectator>{{.ch = ch, .seen = 2}};
+
+    REQUIRE_FALSE(fanOut(spectators, frame(2))); // the snapshot it joined with has it already
+    REQUIRE_FALSE(fanOut(spectators, frame(3)));
+    REQUIRE(fanOut(spectators, frame(4))); // the channel is full
+    REQUIRE(spectators[0].isLagging);
+    REQUIRE(received() == "3");
+    REQUIRE(fanOut(spectators, frame(5))); // no frame after a missed one but a snapshot
+    REQUIRE_FALSE(ch->ready());
+    REQUIRE_FALSE(fanOut(spectators, frame(5, true)));
+    REQUIRE_FALSE(spectators[0].isLagging);
+    REQUIRE(spectators[0].seen == 5);
+    REQUIRE(received() == "5");
+    REQUIRE_FALSE(fanOut(spectators, frame(6)));
+    REQUIRE(received() == "6");
+    REQUIRE_FALSE(fanOut(spectators, frame(6, true))); // a spectator in sync skips the snapshots
+    REQUIRE_FALSE(ch->ready());
+}
+
+TEST_CASE("relay")
+{
+    auto io = net::io_context{};
+    auto ch = Channel{io.get_executor(), 1};
+    REQUIRE(ch.relay(makeFrame(std::string(RelayWriteSize, 'a'))));
+    auto isRung = false;
+    REQUIRE(ch.try_receive([&](sys::error_code, const Frame& frame) { isRung = not frame; }));
+    REQUIRE(isRung);
+    for (auto i = 1uz; i < RelayQueueSize; ++i) { REQUIRE(ch.relay(makeFrame("b"))); }
+    REQUIRE_FALSE(ch.relay(makeFrame("c"))); // the queue is full
+    REQUIRE_FALSE(ch.ready()); // rung once, while the queue was empty
+
+    auto frames = std::vector<Frame>{};
+    ch.takeRelayed(frames, RelayWriteSize); // a big frame goes alone
+    REQUIRE(std::size(frames) == 1);
+    frames.clear();
+    ch.takeRelayed(frames, 10);
+    REQUIRE(std::size(frames) == 10);
+    REQUIRE(ch.hasRelayed());
+
+    auto limiter = RateLimiter{2.0, 3.0};
+    const auto now = RateLimiter::Clock::now();
+    for (auto i = 0; i < 3; ++i) { REQUIRE(limiter.tryTake(now)); }
+    REQUIRE_FALSE(limiter.tryTake(now));
+    REQUIRE(limiter.tryTake(now + 500ms)); // a token a half of a second
+    REQUIRE_FALSE(limiter.tryTake(now + 500ms));
+}
+
+#ifndef PREF_SSL
+TEST_CASE("acceptors")
+{
+    auto registry = TableRegistry{2, {.threads = 1}, {.acceptors = 2}};
+    auto io = net::io_context{};
+    const auto endpoint = [&] { // a free port
+        auto probe = tcp::acceptor{io, {net::ip::address_v4::loopback(), 0}};
+        return probe.local_endpoint();
+    }();
+    auto scope = ex::async_scope{};
+    scope.spawn(
+        stdx::starts_on(registry.scheduler(), createAcceptor(endpoint, registry))
+        | stdx::upon_error(Detached("createAcceptor")));
+
+    // the kernel spreads the connections over the acceptors' sockets, once they all listen
+    const auto throughEach = [&] {
+        return rng::all_of(registry.acceptedPerAcceptor(), [](const auto count) { return count > 0; });
+    };
+    auto clients = std::vector<web::stream<tcp::socket>>{};
+    while (std::size(clients) < 16 or (not throughEach() and std::size(clients) < 256)) {
+        auto& ws = clients.emplace_back(io);
+        auto error = sys::error_code{};
+        for (auto attempt = 0; attempt < 100; ++attempt) { // until the acceptors listen
+            if (not ws.next_layer().connect(endpoint, error)) { break; }
+            ws.next_layer().close();
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        }
+        REQUIRE_FALSE(error);
+        ws.handshake("localhost", "/");
+    }
+    const auto sessions = [&] { return rng::accumulate(registry.sessionsPerShard(), std::int64_t{}); };
+    for (auto attempt = 0; attempt < 100 and sessions() != std::ssize(clients); ++attempt) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+    REQUIRE(sessions() == std::ssize(clients));
+    REQUIRE(rng::accumulate(registry.acceptedPerAcceptor(), 0uz) == std::size(clients));
+    REQUIRE(throughEach());
+    REQUIRE(rng::all_of(registry.sessionsPerShard(), [](const auto count) { return count > 0; })); // on each shard
+
+    for (auto& ws : clients) { ws.next_layer().close(); }
+    scope.request_stop();
+    stdx::sync_wait(scope.on_empty());
+    registry.shutdown();
+}
+#endif // PREF_SSL
+
+TEST_CASE("logger")
+{
+    auto count = 0;
+    const auto formatted = Formatted{&count};
+    const auto level = spdlog::get_level();
+    spdlog::set_level(spdlog::level::warn);
+    PREF_I("{}", PREF_V(formatted));
+    PREF_DI(formatted);
+    REQUIRE(count == 0);
+    spdlog::set_level(level);
+
+    const auto empty = std::string{};
+    const auto shown = true;
+    REQUIRE(fmt::format("{}", PREF_V(formatted)) == "formatted: formatted");
+    REQUIRE(fmt::format("{}{}{}", PREF_V(count), PREF_M(empty), PREF_B(shown)) == "count: 1, shown: true");
+}
+
 TEST_CASE("progression")
 {
     SECTION("arithmetic")
@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+
+# SPDX-License-Identifier: AGPL-3.0-only
+# Copyright (c) 2025 Oleksandr Kozlov
+
+"""Compares two runs of bench_server saved with `--reporter XML::out=<path>`.
+
+Usage: bench-compare.py <baseline.xml> <current.xml> [--threshold=<ratio>]
+
+Prints the mean time of every benchmark in both runs, and exits with 1 when
+one of them got slower than the baseline by more than the threshold
+(0.10 by default, i.e. 10%).
+"""
+
+import sys
+import xml.etree.ElementTree as ET
+
+
+def load_means(path):
+    means = {}
+    for result in ET.parse(path).getroot().iter('BenchmarkResults'):
+        mean = result.find('mean')
+        if mean is not None:
+            means[result.get('name')] = float(mean.get('value'))
+    return means
+
+
+def main(argv):
+    args = [arg for arg in argv if not arg.startswith('--threshold=')]
+    thresholds = [arg.split('=', 1)[1] for arg in argv if arg.startswith('--threshold=')]
+    if len(args) != 2:
+        print(__doc__, file=sys.stderr)
+        return 2
+    threshold = float(thresholds[-1]) if thresholds else 0.10
+    baseline, current = load_means(args[0]), load_means(args[1])
+    width = max((len(name) for name in current), default=0)
+    regressions = 0
+    for name, mean in current.items():
+        if name not in baseline:
+            print(f'{name:<{width}} | {mean:>12.1f} ns | new')
+            continue
+        ratio = mean / baseline[name] - 1.0
+        slower = ratio > threshold
+        regressions += slower
+        mark = ' REGRESSION' if slower else ''
+        print(f'{name:<{width}} | {baseline[name]:>12.1f} -> {mean:>12.1f} ns | {ratio:+7.1%}{mark}')
+    for name in baseline.keys() - current.keys():
+        print(f'{name:<{width}} | gone')
+    return 1 if regressions else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
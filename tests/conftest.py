@@ -51,8 +51,7 @@ async def send_join(websocket, name):
     jr = pref_pb2.LoginRequest()
     jr.player_name = name
     msg = pref_pb2.Message()
-    msg.method = 'LoginRequest'
-    msg.payload = jr.SerializeToString()
+    msg.login_request.CopyFrom(jr)
     await websocket.send(msg.SerializeToString())
 
 
@@ -63,6 +62,10 @@ async def recv_message(websocket, timeout=5.0):
     return msg
 
 
+def method_of(msg):
+    return msg.WhichOneof('body')
+
+
 async def recv_until(websocket, predicate, timeout=5.0):
     deadline = asyncio.get_event_loop().time() + timeout
     while True:
@@ -3,7 +3,7 @@
 
 import asyncio
 import pytest
-from conftest import open_client, recv_until
+from conftest import method_of, open_client, recv_until
 
 
 @pytest.mark.skip(reason="FIXME")
@@ -19,33 +19,33 @@ async def test_server(server_proc):
 
     try:
         # Each player should receive its LoginResponse
-        jr0 = await recv_until(ws0, lambda m: m.method == 'LoginResponse', timeout=5)
-        jr1 = await recv_until(ws1, lambda m: m.method == 'LoginResponse', timeout=5)
-        jr2 = await recv_until(ws2, lambda m: m.method == 'LoginResponse', timeout=5)
+        jr0 = await recv_until(ws0, lambda m: method_of(m) == 'login_response', timeout=5)
+        jr1 = await recv_until(ws1, lambda m: method_of(m) == 'login_response', timeout=5)
+        jr2 = await recv_until(ws2, lambda m: method_of(m) == 'login_response', timeout=5)
 
-        assert jr0.method == 'LoginResponse'
-        assert jr1.method == 'LoginResponse'
-        assert jr2.method == 'LoginResponse'
+        assert method_of(jr0) == 'login_response'
+        assert method_of(jr1) == 'login_response'
+        assert method_of(jr2) == 'login_response'
 
         # Earlier players should see PlayerJoined for later joiners
-        pj01 = await recv_until(ws0, lambda m: m.method == 'PlayerJoined', timeout=5)
-        pj02 = await recv_until(ws0, lambda m: m.method == 'PlayerJoined', timeout=5)
-        pj03 = await recv_until(ws1, lambda m: m.method == 'PlayerJoined', timeout=5)
-        assert pj01.method == 'PlayerJoined'
-        assert pj02.method == 'PlayerJoined'
-        assert pj03.method == 'PlayerJoined'
+        pj01 = await recv_until(ws0, lambda m: method_of(m) == 'player_joined', timeout=5)
+        pj02 = await recv_until(ws0, lambda m: method_of(m) == 'player_joined', timeout=5)
+        pj03 = await recv_until(ws1, lambda m: method_of(m) == 'player_joined', timeout=5)
+        assert method_of(pj01) == 'player_joined'
+        assert method_of(pj02) == 'player_joined'
+        assert method_of(pj03) == 'player_joined'
 
         # Everyone should eventually get DealCards
-        dc0 = await recv_until(ws0, lambda m: m.method == 'DealCards', timeout=5)
-        dc1 = await recv_until(ws1, lambda m: m.method == 'DealCards', timeout=5)
-        dc2 = await recv_until(ws2, lambda m: m.method == 'DealCards', timeout=5)
-        assert dc0.method == dc1.method == dc2.method == 'DealCards'
+        dc0 = await recv_until(ws0, lambda m: method_of(m) == 'deal_cards', timeout=5)
+        dc1 = await recv_until(ws1, lambda m: method_of(m) == 'deal_cards', timeout=5)
+        dc2 = await recv_until(ws2, lambda m: method_of(m) == 'deal_cards', timeout=5)
+        assert method_of(dc0) == method_of(dc1) == method_of(dc2) == 'deal_cards'
 
         # And PlayerTurn announcing the first bidder
-        pt0 = await recv_until(ws0, lambda m: m.method == 'PlayerTurn', timeout=5)
-        pt1 = await recv_until(ws1, lambda m: m.method == 'PlayerTurn', timeout=5)
-        pt2 = await recv_until(ws2, lambda m: m.method == 'PlayerTurn', timeout=5)
-        assert pt0.method == pt1.method == pt2.method == 'PlayerTurn'
+        pt0 = await recv_until(ws0, lambda m: method_of(m) == 'player_turn', timeout=5)
+        pt1 = await recv_until(ws1, lambda m: method_of(m) == 'player_turn', timeout=5)
+        pt2 = await recv_until(ws2, lambda m: method_of(m) == 'player_turn', timeout=5)
+        assert method_of(pt0) == method_of(pt1) == method_of(pt2) == 'player_turn'
 
     finally:
         await asyncio.gather(